@@ -0,0 +1,223 @@
+// Throughput and latency of tiny messages, sent one by one and in batches
+//
+// One thread sends count messages of size bytes through PUSH/PULL, either
+// directly, or through a zq::BatchingSender with each of the given
+// max_delay values. The receiver splits batches with a zq::BatchReceiver
+// and records the one way latency of every message.
+// Reports messages per second and the latency distribution as JSON.
+//
+//  zq-batching-bench [--count 1000000] [--size 16] [--rate 0]
+//                    [--delays 50,200,1000] [--max-count 256]
+//                    [--fixed] [--endpoint ipc://zq-batching-bench]
+//                    [--out results.json]
+//
+// --rate limits the messages per second, 0 sends as fast as possible.
+// --delays are in microseconds, --fixed turns off the adaptive count limit.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zq/batching.hpp>
+#include <zq/zq.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+  using namespace std::chrono_literals;
+
+  struct Config {
+    size_t count;
+    size_t size;
+    double rate;
+    size_t max_count;
+    bool adaptive;
+    std::string endpoint;
+  };
+
+  struct Result {
+    zq::LatencyHistogram latency;
+    uint64_t received{0};
+    uint64_t batches{0};
+    double seconds{0};
+  };
+
+  void set_unlimited_hwm(zq::Socket& s) {
+    int hwm = 0;
+    zmq_setsockopt(s.socket_ptr.get(), ZMQ_SNDHWM, &hwm, sizeof(hwm));
+    zmq_setsockopt(s.socket_ptr.get(), ZMQ_RCVHWM, &hwm, sizeof(hwm));
+  }
+
+  std::optional<zq::Socket> mk_socket(zq::Context& ctx,
+                                      zq::SocketType type,
+                                      const std::string& endpoint,
+                                      bool bind) {
+    auto socket = ctx.socket(type);
+    if (!socket) {
+      return std::nullopt;
+    }
+    set_unlimited_hwm(*socket);
+    auto rc = bind ? socket->bind(endpoint) : socket->connect(endpoint);
+    if (!rc) {
+      std::fprintf(stderr, "%s: %s\n", endpoint.c_str(), rc.error().what());
+      return std::nullopt;
+    }
+    return std::move(*socket);
+  }
+
+  void receive(zq::Socket& socket, const Config& config, Result& result) {
+    zq::BatchReceiver receiver;
+    while (result.received < config.count) {
+      auto msg = receiver.await(socket, 2000ms);
+      if (!msg) {
+        return;
+      }
+      if (!*msg || (*msg)->payload.size() < bench::stamp_size) {
+        continue;
+      }
+      const auto* data = static_cast<const char*>((*msg)->payload.data());
+      result.latency.record(bench::now_stamp() - bench::read_stamp(data));
+      ++result.received;
+    }
+  }
+
+  // sends count messages at the configured rate, send_one takes a message,
+  // idle is called while waiting for the next one to be due
+  template <typename Send, typename Idle>
+  bool send_all(const Config& config, Send&& send_one, Idle&& idle) {
+    std::string payload(std::max(config.size, bench::stamp_size), 'z');
+    const auto period_ns =
+        config.rate > 0 ? static_cast<uint64_t>(1e9 / config.rate) : 0;
+    auto due = zq::monotonic_now_ns();
+    for (size_t i = 0; i < config.count; ++i) {
+      if (period_ns > 0) {
+        while (zq::monotonic_now_ns() < due) {
+          idle();
+        }
+        due += period_ns;
+      }
+      bench::write_stamp(payload.data(), bench::now_stamp());
+      if (!send_one(zq::typed_message(std::string_view{payload}))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::optional<Result> run(const Config& config,
+                            std::optional<std::chrono::microseconds> delay) {
+    auto ctx = zq::mk_context();
+    if (!ctx) {
+      return std::nullopt;
+    }
+    auto pull = mk_socket(*ctx, zq::SocketType::PULL, config.endpoint, true);
+    auto push = mk_socket(*ctx, zq::SocketType::PUSH, config.endpoint, false);
+    if (!pull || !push) {
+      return std::nullopt;
+    }
+
+    Result result;
+    std::thread receiving{[&] { receive(*pull, config, result); }};
+    const auto start = zq::monotonic_now_ns();
+    bool sent = false;
+    if (!delay) {
+      sent = send_all(
+          config, [&](const zq::TypedMessage& msg) {
+            return push->send(msg).has_value();
+          },
+          [] {});
+    } else {
+      zq::BatchingSender sender{std::move(*push),
+                                {.max_count = config.max_count,
+                                 .max_delay = *delay,
+                                 .adaptive = config.adaptive}};
+      sent = send_all(
+          config, [&](const zq::TypedMessage& msg) {
+            return sender.send(msg).has_value();
+          },
+          [&] { [[maybe_unused]] auto rc = sender.flush_if_due(); });
+      sent = sent && sender.flush().has_value();
+      result.batches = sender.batches_sent();
+    }
+    receiving.join();
+    result.seconds = static_cast<double>(zq::monotonic_now_ns() - start) / 1e9;
+    if (!sent) {
+      std::fprintf(stderr, "sending failed\n");
+    }
+    return result;
+  }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Args args{argc, argv};
+  if (args.flag("--help")) {
+    std::printf(
+        "zq-batching-bench [--count 1000000] [--size 16] [--rate 0]\n"
+        "                  [--delays 50,200,1000] [--max-count 256]\n"
+        "                  [--fixed] [--endpoint ipc://zq-batching-bench]\n"
+        "                  [--out results.json]\n");
+    return 0;
+  }
+  Config config{
+      .count = bench::parse_size(args.value("--count").value_or("1000000"))
+                   .value_or(1000000),
+      .size = bench::parse_size(args.value("--size").value_or("16"))
+                  .value_or(16),
+      .rate = static_cast<double>(
+          bench::parse_size(args.value("--rate").value_or("0")).value_or(0)),
+      .max_count = bench::parse_size(args.value("--max-count").value_or("256"))
+                       .value_or(256),
+      .adaptive = !args.flag("--fixed"),
+      .endpoint = std::string{
+          args.value("--endpoint").value_or("ipc://zq-batching-bench")},
+  };
+
+  std::vector<std::optional<std::chrono::microseconds>> modes{std::nullopt};
+  for (auto delay : bench::parse_sizes(args.list("--delays", "50,200,1000"))) {
+    modes.emplace_back(std::chrono::microseconds{delay});
+  }
+
+  std::vector<std::string> results;
+  for (const auto& delay : modes) {
+    auto result = run(config, delay);
+    if (!result) {
+      return 1;
+    }
+    const std::string mode =
+        delay ? "batched " + std::to_string(delay->count()) + "us" : "direct";
+    const auto per_second =
+        static_cast<double>(result->received) / result->seconds;
+    std::fprintf(stderr,
+                 "%-14s %10.0f msg/s, %8llu batches, "
+                 "p50 %9.1f us p99 %9.1f us\n",
+                 mode.c_str(), per_second,
+                 static_cast<unsigned long long>(result->batches),
+                 static_cast<double>(result->latency.p50()) / 1e3,
+                 static_cast<double>(result->latency.p99()) / 1e3);
+    results.push_back(
+        bench::JsonObject{}
+            .add("mode", mode)
+            .add("max_delay_us",
+                 static_cast<uint64_t>(delay ? delay->count() : 0))
+            .add("adaptive", config.adaptive)
+            .add("size", uint64_t{config.size})
+            .add("rate", config.rate)
+            .add("received", result->received)
+            .add("batches", result->batches)
+            .add("messages_per_second", per_second)
+            .add_json("latency_ns", bench::histogram_json(result->latency))
+            .str());
+  }
+  auto report = bench::JsonObject{}
+                    .add("benchmark", "zq-batching-bench")
+                    .add_json("results", bench::json_array(results))
+                    .str();
+  return bench::write_report(args, report) ? 0 : 1;
+}
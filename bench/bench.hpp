@@ -0,0 +1,339 @@
+#pragma once
+
+// Helpers shared by the benchmark programs,
+// command line handling, sizes and JSON output
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <zq/histogram.hpp>
+#include <zq/trace.hpp>
+
+namespace bench {
+
+  /**
+   * @brief Minimal command line access, options are --name value
+   */
+  class Args {
+    std::vector<std::string_view> args;
+
+   public:
+    Args(int argc, char** argv) : args(argv + 1, argv + argc) {}
+
+    /// @brief The value of --name, nullopt if not given
+    [[nodiscard]] std::optional<std::string_view> value(
+        std::string_view name) const noexcept {
+      auto it = std::find(args.begin(), args.end(), name);
+      if (it == args.end() || std::next(it) == args.end()) {
+        return std::nullopt;
+      }
+      return *std::next(it);
+    }
+
+    /// @brief true if --name is given
+    [[nodiscard]] bool flag(std::string_view name) const noexcept {
+      return std::find(args.begin(), args.end(), name) != args.end();
+    }
+
+    /// @brief The value of --name split at ',', or the default
+    [[nodiscard]] std::vector<std::string_view> list(
+        std::string_view name,
+        std::string_view default_value) const {
+      auto v = value(name).value_or(default_value);
+      std::vector<std::string_view> items;
+      while (!v.empty()) {
+        auto pos = v.find(',');
+        items.push_back(v.substr(0, pos));
+        v = pos == std::string_view::npos ? std::string_view{}
+                                          : v.substr(pos + 1);
+      }
+      return items;
+    }
+  };
+
+  /**
+   * @brief Parse a size like 64, 4K, 16M or 1G, binary units
+   *
+   * @param text
+   * @return std::optional<size_t>
+   */
+  inline std::optional<size_t> parse_size(std::string_view text) noexcept {
+    size_t value = 0;
+    auto [end, ec] =
+        std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc{}) {
+      return std::nullopt;
+    }
+    auto unit = text.substr(static_cast<size_t>(end - text.data()));
+    if (unit.empty() || unit == "B") {
+      return value;
+    }
+    if (unit == "K" || unit == "KiB") {
+      return value << 10;
+    }
+    if (unit == "M" || unit == "MiB") {
+      return value << 20;
+    }
+    if (unit == "G" || unit == "GiB") {
+      return value << 30;
+    }
+    return std::nullopt;
+  }
+
+  /// @brief Parse a list of sizes, invalid entries are reported and skipped
+  inline std::vector<size_t> parse_sizes(
+      const std::vector<std::string_view>& items) {
+    std::vector<size_t> sizes;
+    for (auto item : items) {
+      if (auto size = parse_size(item)) {
+        sizes.push_back(*size);
+      } else {
+        std::fprintf(stderr, "ignoring invalid size: %.*s\n",
+                     static_cast<int>(item.size()), item.data());
+      }
+    }
+    return sizes;
+  }
+
+  /**
+   * @brief Builds one JSON object, keys are added in order
+   */
+  class JsonObject {
+    std::string out{"{"};
+
+    void key(std::string_view name) {
+      if (out.size() > 1) {
+        out += ',';
+      }
+      out += '"';
+      out += name;
+      out += "\":";
+    }
+
+   public:
+    JsonObject& add(std::string_view name, std::string_view value) {
+      key(name);
+      out += '"';
+      for (char c : value) {
+        if (c == '"' || c == '\\') {
+          out += '\\';
+        }
+        out += c;
+      }
+      out += '"';
+      return *this;
+    }
+
+    JsonObject& add(std::string_view name, const char* value) {
+      return add(name, std::string_view{value});
+    }
+
+    JsonObject& add(std::string_view name, uint64_t value) {
+      key(name);
+      out += std::to_string(value);
+      return *this;
+    }
+
+    JsonObject& add(std::string_view name, double value) {
+      key(name);
+      char buf[32];
+      std::snprintf(buf, sizeof(buf), "%.3f", value);
+      out += buf;
+      return *this;
+    }
+
+    JsonObject& add(std::string_view name, bool value) {
+      key(name);
+      out += value ? "true" : "false";
+      return *this;
+    }
+
+    /// @brief Add an already formatted JSON value, object or array
+    JsonObject& add_json(std::string_view name, std::string_view json) {
+      key(name);
+      out += json;
+      return *this;
+    }
+
+    [[nodiscard]] std::string str() const { return out + "}"; }
+  };
+
+  /// @brief Join JSON values to an array
+  inline std::string json_array(const std::vector<std::string>& items) {
+    std::string out{"["};
+    for (const auto& item : items) {
+      if (out.size() > 1) {
+        out += ",\n ";
+      }
+      out += item;
+    }
+    return out + "]";
+  }
+
+  /// @brief The summary of a histogram as JSON object
+  inline std::string histogram_json(const zq::LatencyHistogram& h) {
+    return JsonObject{}
+        .add("count", h.count())
+        .add("min", h.min())
+        .add("mean", h.mean())
+        .add("p50", h.p50())
+        .add("p90", h.percentile(90.0))
+        .add("p99", h.p99())
+        .add("p999", h.p999())
+        .add("max", h.max())
+        .str();
+  }
+
+  // The first 8 bytes of a payload can carry the send time, 7 bits per
+  // byte, so the stamp is also valid content for a protobuf string.
+  // A stamp of 0 marks a warm up message.
+  inline constexpr size_t stamp_size = 8;
+
+  inline void write_stamp(char* data, uint64_t stamp) noexcept {
+    for (size_t i = 0; i < stamp_size; ++i) {
+      data[i] = static_cast<char>((stamp >> (7 * i)) & 0x7f);
+    }
+  }
+
+  inline uint64_t read_stamp(const char* data) noexcept {
+    uint64_t stamp = 0;
+    for (size_t i = 0; i < stamp_size; ++i) {
+      stamp |= static_cast<uint64_t>(data[i] & 0x7f) << (7 * i);
+    }
+    return stamp;
+  }
+
+  /// @brief A monotonic time in ns that fits into a stamp
+  inline uint64_t to_stamp(uint64_t ns) noexcept {
+    constexpr uint64_t mask = (uint64_t{1} << (7 * stamp_size)) - 1;
+    return ns & mask;
+  }
+
+  inline uint64_t now_stamp() noexcept {
+    return to_stamp(zq::monotonic_now_ns());
+  }
+
+  /**
+   * @brief Keep the compiler from optimizing away a result
+   */
+  template <typename T>
+  inline void do_not_optimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static const volatile void* sink = nullptr;
+    sink = std::addressof(value);
+#endif
+  }
+
+  /**
+   * @brief Write the report to the file given with --out, or stdout
+   *
+   * @return true on success
+   */
+  inline bool write_report(const Args& args, const std::string& json) {
+    auto path = args.value("--out");
+    if (!path) {
+      std::printf("%s\n", json.c_str());
+      return true;
+    }
+    std::FILE* f = std::fopen(std::string{*path}.c_str(), "w");
+    if (f == nullptr) {
+      std::fprintf(stderr, "can not write %.*s\n",
+                   static_cast<int>(path->size()), path->data());
+      return false;
+    }
+    std::fprintf(f, "%s\n", json.c_str());
+    std::fclose(f);
+    return true;
+  }
+
+  /**
+   * @brief Read the result objects of a report written by write_report
+   *
+   * This is not a JSON parser, it only understands the flat objects
+   * in the results array that the benchmarks write.
+   *
+   * @param path
+   * @return std::optional<std::vector<std::string>>
+   */
+  inline std::optional<std::vector<std::string>> read_results(
+      const std::string& path) {
+    std::FILE* f = std::fopen(path.c_str(), "r");
+    if (f == nullptr) {
+      return std::nullopt;
+    }
+    std::string content;
+    char buf[4096];
+    size_t n = 0;
+    while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) {
+      content.append(buf, n);
+    }
+    std::fclose(f);
+
+    std::vector<std::string> results;
+    auto pos = content.find("\"results\":[");
+    if (pos == std::string::npos) {
+      return std::nullopt;
+    }
+    // nested objects, like latency_ns, belong to their result
+    int depth = 0;
+    size_t start = 0;
+    for (; pos < content.size(); ++pos) {
+      if (content[pos] == '{') {
+        if (depth++ == 0) {
+          start = pos;
+        }
+      } else if (content[pos] == '}') {
+        if (--depth == 0) {
+          results.push_back(content.substr(start, pos - start + 1));
+        }
+      } else if (content[pos] == ']' && depth == 0) {
+        break;
+      }
+    }
+    return results;
+  }
+
+  /**
+   * @brief The raw value of a field in a result object, quotes removed
+   *
+   * @param object
+   * @param name
+   * @return std::optional<std::string_view>
+   */
+  inline std::optional<std::string_view> json_field(std::string_view object,
+                                                    std::string_view name) {
+    const std::string key = "\"" + std::string{name} + "\":";
+    auto pos = object.find(key);
+    if (pos == std::string_view::npos) {
+      return std::nullopt;
+    }
+    auto value = object.substr(pos + key.size());
+    if (!value.empty() && value.front() == '"') {
+      value.remove_prefix(1);
+      return value.substr(0, value.find('"'));
+    }
+    return value.substr(0, value.find_first_of(",}"));
+  }
+
+  /// @brief A numeric field of a result object, nullopt if missing
+  inline std::optional<double> json_number(std::string_view object,
+                                           std::string_view name) {
+    auto field = json_field(object, name);
+    if (!field) {
+      return std::nullopt;
+    }
+    return std::strtod(std::string{*field}.c_str(), nullptr);
+  }
+
+}  // namespace bench
@@ -0,0 +1,275 @@
+// Chunked transfer of a large payload between two processes
+//
+// For each mode and chunk size, a sender and a receiver process are forked
+// and connected with an ipc:// PAIR socket. In buffer mode, a buffer is
+// sent into a preallocated buffer, in file mode, a file into a file.
+// Reports the sustained MB/s, and the peak RSS of both processes. The
+// results are written as JSON.
+//
+//  zq-chunked-bench [--modes buffer,file] [--size 256M]
+//                   [--chunks 64K,256K,1M] [--window 16] [--dir /tmp]
+//                   [--out results.json]
+//
+// In file mode, the peak RSS should stay near window * chunk size, no
+// matter the size of the transfer. POSIX only.
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "bench.hpp"
+
+#ifndef _WIN32
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <zq/chunked.hpp>
+#include <zq/zq.hpp>
+
+namespace {
+
+  using namespace std::chrono_literals;
+
+  struct Config {
+    std::string_view mode;
+    uint64_t size;
+    zq::ChunkOptions options;
+    std::filesystem::path source;
+    std::filesystem::path target;
+    std::string address;
+  };
+
+  struct Report {
+    uint64_t bytes{0};
+    uint64_t nanoseconds{0};
+    uint64_t peak_rss_kb{0};
+  };
+
+  struct Result {
+    size_t chunk_size{0};
+    Report sender;
+    Report receiver;
+  };
+
+  // each side writes its report into a pipe
+  struct Pipe {
+    std::array<int, 2> fds{-1, -1};
+
+    Pipe() {
+      if (::pipe(fds.data()) != 0) {
+        std::perror("pipe");
+        std::exit(1);
+      }
+    }
+    ~Pipe() {
+      ::close(fds[0]);
+      ::close(fds[1]);
+    }
+    Pipe(const Pipe&) = delete;
+    Pipe& operator=(const Pipe&) = delete;
+
+    void write(const Report& report) const {
+      [[maybe_unused]] auto rc = ::write(fds[1], &report, sizeof(report));
+    }
+    bool read(Report& report) const {
+      return ::read(fds[0], &report, sizeof(report)) ==
+             static_cast<ssize_t>(sizeof(report));
+    }
+  };
+
+  uint64_t peak_rss_kb() {
+    rusage usage{};
+    ::getrusage(RUSAGE_SELF, &usage);
+    return static_cast<uint64_t>(usage.ru_maxrss);
+  }
+
+  // the receiver binds, the sender connects
+  template <typename Transfer>
+  [[noreturn]] void run_side(const Config& config,
+                             const Pipe& reports,
+                             Transfer&& transfer) {
+    auto context = zq::mk_context();
+    if (!context) {
+      ::_exit(1);
+    }
+    auto socket = std::remove_cvref_t<Transfer>::receiving
+                      ? context->bind(zq::SocketType::PAIR, config.address)
+                      : context->connect(zq::SocketType::PAIR, config.address);
+    if (!socket) {
+      ::_exit(1);
+    }
+    const auto start = std::chrono::steady_clock::now();
+    auto bytes = transfer.run(*socket);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    if (!bytes) {
+      std::fprintf(stderr, "%s\n", bytes.error().what());
+      ::_exit(1);
+    }
+    reports.write(Report{
+        *bytes,
+        static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                .count()),
+        peak_rss_kb()});
+    ::_exit(0);
+  }
+
+  struct Sending {
+    static constexpr bool receiving = false;
+    const Config& config;
+
+    auto run(zq::Socket& socket) -> std::expected<uint64_t, zq::Error> {
+      if (config.mode == "file") {
+        return zq::send_chunked(socket, config.source, config.options);
+      }
+      std::vector<std::byte> data(config.size, std::byte{'x'});
+      return zq::send_chunked(socket, std::span{data}, config.options);
+    }
+  };
+
+  struct Receiving {
+    static constexpr bool receiving = true;
+    const Config& config;
+
+    auto run(zq::Socket& socket) -> std::expected<uint64_t, zq::Error> {
+      auto options = config.options;
+      options.timeout = 30000ms;
+      if (config.mode == "file") {
+        return zq::recv_chunked(socket, config.target, options);
+      }
+      std::vector<std::byte> buffer(config.size);
+      return zq::recv_chunked(socket, std::span{buffer}, options);
+    }
+  };
+
+  std::optional<Result> run(const Config& config) {
+    Pipe sender_reports;
+    Pipe receiver_reports;
+    // contexts do not survive a fork, both sides are children
+    const auto receiver = ::fork();
+    if (receiver == 0) {
+      run_side(config, receiver_reports, Receiving{config});
+    }
+    const auto sender = ::fork();
+    if (sender == 0) {
+      run_side(config, sender_reports, Sending{config});
+    }
+    bool ok = true;
+    for (auto pid : {receiver, sender}) {
+      int status = 0;
+      ::waitpid(pid, &status, 0);
+      ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    Result result{config.options.chunk_size, {}, {}};
+    if (!ok || !sender_reports.read(result.sender) ||
+        !receiver_reports.read(result.receiver)) {
+      return std::nullopt;
+    }
+    return result;
+  }
+
+  bool create_source(const std::filesystem::path& path, uint64_t size) {
+    std::ofstream out{path, std::ios::binary | std::ios::trunc};
+    const std::vector<char> block(1 << 20, 'x');
+    for (uint64_t written = 0; written < size && out;) {
+      const auto n = std::min<uint64_t>(block.size(), size - written);
+      out.write(block.data(), static_cast<std::streamsize>(n));
+      written += n;
+    }
+    return out.good();
+  }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Args args{argc, argv};
+  if (args.flag("--help")) {
+    std::printf(
+        "zq-chunked-bench [--modes buffer,file] [--size 256M] "
+        "[--chunks 64K,256K,1M] [--window 16] [--dir /tmp] "
+        "[--out results.json]\n");
+    return 0;
+  }
+  const auto size = bench::parse_size(args.value("--size").value_or("256M"))
+                        .value_or(256u << 20);
+  const auto window =
+      bench::parse_size(args.value("--window").value_or("16")).value_or(16);
+  const auto chunk_sizes =
+      bench::parse_sizes(args.list("--chunks", "64K,256K,1M"));
+  const std::filesystem::path dir{args.value("--dir").value_or(
+      std::filesystem::temp_directory_path().native())};
+  const auto tag = std::to_string(::getpid());
+
+  Config config{"",
+                size,
+                {},
+                dir / ("zq_chunked_bench_in_" + tag),
+                dir / ("zq_chunked_bench_out_" + tag),
+                "ipc://" + (dir / ("zq_chunked_bench_" + tag)).string()};
+  std::vector<std::string> results;
+  for (auto mode : args.list("--modes", "buffer,file")) {
+    config.mode = mode;
+    if (mode == "file" && !create_source(config.source, size)) {
+      std::fprintf(stderr, "can not create %s\n", config.source.c_str());
+      return 1;
+    }
+    for (auto chunk_size : chunk_sizes) {
+      config.options.chunk_size = chunk_size;
+      config.options.window = window;
+      auto result = run(config);
+      if (!result) {
+        std::fprintf(stderr, "%.*s %zu chunks failed\n",
+                     static_cast<int>(mode.size()), mode.data(), chunk_size);
+        return 1;
+      }
+      const auto seconds =
+          static_cast<double>(result->sender.nanoseconds) / 1e9;
+      const auto mb_per_second =
+          static_cast<double>(result->sender.bytes) / 1e6 / seconds;
+      std::fprintf(stderr,
+                   "%-6.*s %8zu B chunks %10.1f MB/s, peak rss sender %8llu "
+                   "KB receiver %8llu KB\n",
+                   static_cast<int>(mode.size()), mode.data(), chunk_size,
+                   mb_per_second,
+                   static_cast<unsigned long long>(result->sender.peak_rss_kb),
+                   static_cast<unsigned long long>(
+                       result->receiver.peak_rss_kb));
+      results.push_back(
+          bench::JsonObject{}
+              .add("mode", mode)
+              .add("size", uint64_t{size})
+              .add("chunk_size", uint64_t{chunk_size})
+              .add("window", uint64_t{window})
+              .add("mb_per_second", mb_per_second)
+              .add("sender_peak_rss_kb", result->sender.peak_rss_kb)
+              .add("receiver_peak_rss_kb", result->receiver.peak_rss_kb)
+              .str());
+    }
+    std::filesystem::remove(config.target);
+  }
+  std::filesystem::remove(config.source);
+  auto report = bench::JsonObject{}
+                    .add("benchmark", "zq-chunked-bench")
+                    .add_json("results", bench::json_array(results))
+                    .str();
+  return bench::write_report(args, report) ? 0 : 1;
+}
+
+#else
+
+int main() {
+  std::fprintf(stderr, "zq-chunked-bench needs POSIX\n");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,69 @@
+# Compile time of the same translation unit, with #include <zq/zq.hpp> and
+# with import zq
+#
+#  cmake -DBUILD_DIR=build [-DRUNS=5] [-DOUT=results.json] \
+#        -P bench/compile_time.cmake
+#
+# BUILD_DIR must be configured with ZQ_WITH_MODULE=ON. The module itself is
+# built first and not measured, that happens once per build, not per TU.
+# Each run touches compile_tu.cpp and rebuilds one object library, the
+# reported times are the minimum and the mean in milliseconds.
+
+if (NOT BUILD_DIR)
+    message(FATAL_ERROR "usage: cmake -DBUILD_DIR=<dir> [-DRUNS=5] [-DOUT=<file>] -P compile_time.cmake")
+endif()
+if (NOT RUNS)
+    set(RUNS 5)
+endif()
+set(source "${CMAKE_CURRENT_LIST_DIR}/compile_tu.cpp")
+
+function(build target)
+    execute_process(
+        COMMAND ${CMAKE_COMMAND} --build ${BUILD_DIR} --target ${target}
+        RESULT_VARIABLE rc
+        OUTPUT_QUIET
+    )
+    if (NOT rc EQUAL 0)
+        message(FATAL_ERROR "building ${target} failed")
+    endif()
+endfunction()
+
+function(now_us out)
+    string(TIMESTAMP seconds "%s" UTC)
+    string(TIMESTAMP micros "%f" UTC)
+    # %f has leading zeros, that math(EXPR) would read as octal
+    string(REGEX REPLACE "^0+([0-9])" "\\1" micros "${micros}")
+    math(EXPR us "${seconds} * 1000000 + ${micros}")
+    set(${out} ${us} PARENT_SCOPE)
+endfunction()
+
+# everything the TUs depend on, the zq module included
+build(zq-compile-header)
+build(zq-compile-module)
+
+set(results "")
+foreach(mode header module)
+    set(total 0)
+    set(min -1)
+    foreach(run RANGE 1 ${RUNS})
+        file(TOUCH ${source})
+        now_us(start)
+        build(zq-compile-${mode})
+        now_us(end)
+        math(EXPR ms "(${end} - ${start}) / 1000")
+        math(EXPR total "${total} + ${ms}")
+        if (min LESS 0 OR ms LESS min)
+            set(min ${ms})
+        endif()
+    endforeach()
+    math(EXPR mean "${total} / ${RUNS}")
+    message(STATUS "${mode}: min ${min} ms, mean ${mean} ms, ${RUNS} runs")
+    list(APPEND results
+        "{\"mode\": \"${mode}\", \"runs\": ${RUNS}, \"min_ms\": ${min}, \"mean_ms\": ${mean}}")
+endforeach()
+
+if (OUT)
+    list(JOIN results ", " results)
+    file(WRITE ${OUT}
+        "{\"benchmark\": \"zq-compile-time\", \"results\": [${results}]}\n")
+endif()
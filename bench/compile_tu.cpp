@@ -0,0 +1,47 @@
+// A translation unit that uses zq like an application does, compiled once
+// with the headers and once with import zq, see compile_time.cmake.
+// It uses nothing from std, import zq does not export std.
+
+#ifdef ZQ_COMPILE_MODULE
+import zq;
+#else
+#include <zq/zq.hpp>
+#endif
+
+namespace {
+
+  struct Quote {
+    double bid;
+    double ask;
+    int volume;
+  };
+
+}  // namespace
+
+int zq_compile_tu() {
+  auto context = zq::mk_context();
+  if (!context) {
+    return 1;
+  }
+  auto pull = context->bind(zq::SocketType::PULL, "inproc://compile_tu");
+  auto push = context->connect(zq::SocketType::PUSH, "inproc://compile_tu");
+  if (!pull || !push) {
+    return 1;
+  }
+  if (!push->send(zq::typed_message(Quote{1.0, 1.1, 100})) ||
+      !push->send(zq::typed_message(42))) {
+    return 1;
+  }
+  int received = 0;
+  while (received < 2) {
+    auto msg = pull->recv();
+    if (!msg) {
+      continue;
+    }
+    if (!*msg || !zq::restore_any<Quote, int>(**msg)) {
+      return 1;
+    }
+    ++received;
+  }
+  return 0;
+}
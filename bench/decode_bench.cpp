@@ -0,0 +1,203 @@
+// How decoding scales with the workers of a zq::DecodePipeline
+//
+// A sender thread sends count messages through PUSH/PULL, as fast as the
+// receiver takes them. The receiver restores them on its own thread, the
+// inline run, or through a DecodePipeline with each of the given worker
+// counts. With --key, the pipeline keeps the order per key, 64 keys, else
+// the global order. Reports messages per second as JSON.
+//
+//  zq-decode-bench [--count 500000] [--size 256] [--workers 1,2,4,8,16]
+//                  [--key] [--endpoint inproc://zq-decode-bench]
+//                  [--out results.json]
+//
+// Messages are protobuf Pings with a string of size bytes, or strings if
+// zq is built without ZQ_WITH_PROTO.
+
+#include <algorithm>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zq/decode_pipeline.hpp>
+#include <zq/zq.hpp>
+#ifdef ZQ_PROTO
+#include "pingpong.pb.h"
+#endif
+
+#include "bench.hpp"
+
+namespace {
+
+  using namespace std::chrono_literals;
+
+#ifdef ZQ_PROTO
+  using Value = zq::proto::Ping;
+  constexpr const char* payload_name = "proto";
+
+  zq::TypedMessage mk_message(size_t i, size_t size) {
+    Value ping;
+    ping.set_id(static_cast<int32_t>(i % 64));
+    ping.set_msg(std::string(size, 'z'));
+    return zq::typed_message(ping);
+  }
+
+  uint64_t key_of(const zq::TypedMessage& msg) {
+    // the id field comes first, tag and varint, that is the key
+    const auto payload = zq::as_string_view(msg.payload);
+    return zq::detail::fnv1a(payload.substr(0, 2));
+  }
+#else
+  using Value = std::string;
+  constexpr const char* payload_name = "string";
+
+  zq::TypedMessage mk_message(size_t i, size_t size) {
+    auto value = std::string(std::max<size_t>(size, 1), 'z');
+    value[0] = static_cast<char>('0' + i % 64);
+    return zq::typed_message(value);
+  }
+
+  uint64_t key_of(const zq::TypedMessage& msg) {
+    return zq::detail::fnv1a(zq::as_string_view(msg.payload).substr(0, 1));
+  }
+#endif
+
+  struct Config {
+    size_t count;
+    size_t size;
+    bool key;
+    std::string endpoint;
+  };
+
+  struct Result {
+    uint64_t decoded{0};
+    uint64_t failed{0};
+    double seconds{0};
+  };
+
+  // workers 0 restores on the receiving thread
+  std::optional<Result> run(const Config& config, size_t workers) {
+    auto ctx = zq::mk_context();
+    if (!ctx) {
+      return std::nullopt;
+    }
+    auto pull = ctx->bind(zq::SocketType::PULL, config.endpoint);
+    auto push = ctx->connect(zq::SocketType::PUSH, config.endpoint);
+    if (!pull || !push) {
+      std::fprintf(stderr, "can not create sockets on %s\n",
+                   config.endpoint.c_str());
+      return std::nullopt;
+    }
+
+    // if the receiver gives up, the sender must not block forever
+    int send_timeout = 2000;
+    zmq_setsockopt(push->socket_ptr.get(), ZMQ_SNDTIMEO, &send_timeout,
+                   sizeof(send_timeout));
+    // the same few messages over and over, sending them is cheap
+    std::vector<zq::TypedMessage> messages;
+    for (size_t i = 0; i < 64; ++i) {
+      messages.push_back(mk_message(i, config.size));
+    }
+    std::thread sending{[&] {
+      for (size_t i = 0; i < config.count; ++i) {
+        if (!push->send(messages[i % messages.size()])) {
+          return;
+        }
+      }
+    }};
+
+    Result result;
+    const auto start = zq::monotonic_now_ns();
+    auto count = [&](const auto& value) {
+      if (value) {
+        ++result.decoded;
+        bench::do_not_optimize(*value);
+      } else {
+        ++result.failed;
+      }
+    };
+    if (workers == 0) {
+      for (size_t i = 0; i < config.count; ++i) {
+        auto msg = pull->await(2000ms);
+        if (!msg || !*msg) {
+          break;
+        }
+        count(zq::restore_as<Value>(**msg));
+      }
+    } else {
+      zq::DecodeOptions options{.workers = workers};
+      if (config.key) {
+        options.key = key_of;
+      }
+      zq::DecodePipeline<Value> pipeline{std::move(*pull), options};
+      for (size_t i = 0; i < config.count; ++i) {
+        auto value = pipeline.next(2000ms);
+        if (!value) {
+          break;
+        }
+        count(*value);
+      }
+    }
+    result.seconds = static_cast<double>(zq::monotonic_now_ns() - start) / 1e9;
+    sending.join();
+    return result;
+  }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Args args{argc, argv};
+  if (args.flag("--help")) {
+    std::printf(
+        "zq-decode-bench [--count 500000] [--size 256] "
+        "[--workers 1,2,4,8,16]\n"
+        "                [--key] [--endpoint inproc://zq-decode-bench]\n"
+        "                [--out results.json]\n");
+    return 0;
+  }
+  Config config{
+      .count = bench::parse_size(args.value("--count").value_or("500000"))
+                   .value_or(500000),
+      .size = bench::parse_size(args.value("--size").value_or("256"))
+                  .value_or(256),
+      .key = args.flag("--key"),
+      .endpoint = std::string{
+          args.value("--endpoint").value_or("inproc://zq-decode-bench")},
+  };
+
+  std::vector<size_t> worker_counts{0};
+  const auto workers_list = args.list("--workers", "1,2,4,8,16");
+  for (auto workers : bench::parse_sizes(workers_list)) {
+    worker_counts.push_back(std::max<size_t>(workers, 1));
+  }
+
+  std::vector<std::string> results;
+  for (auto workers : worker_counts) {
+    auto result = run(config, workers);
+    if (!result) {
+      return 1;
+    }
+    const auto per_second =
+        static_cast<double>(result->decoded) / result->seconds;
+    const std::string mode =
+        workers == 0 ? "inline" : std::to_string(workers) + " workers";
+    std::fprintf(stderr, "%-11s %10.0f msg/s, %llu failed\n", mode.c_str(),
+                 per_second, static_cast<unsigned long long>(result->failed));
+    results.push_back(bench::JsonObject{}
+                          .add("mode", mode)
+                          .add("workers", uint64_t{workers})
+                          .add("payload", payload_name)
+                          .add("size", uint64_t{config.size})
+                          .add("order", config.key ? "key" : "global")
+                          .add("decoded", result->decoded)
+                          .add("failed", result->failed)
+                          .add("messages_per_second", per_second)
+                          .str());
+  }
+  auto report = bench::JsonObject{}
+                    .add("benchmark", "zq-decode-bench")
+                    .add_json("results", bench::json_array(results))
+                    .str();
+  return bench::write_report(args, report) ? 0 : 1;
+}
@@ -0,0 +1,342 @@
+// One publisher, many subscriber processes, the shared memory broadcast
+// ring compared to ipc:// PUB/SUB
+//
+// For each transport and reader count, reader processes are forked, the
+// parent publishes and measures its own cost per message. Readers report
+// what they received and lost. The results are written as JSON.
+//
+//  zq-fanout-bench [--transports shm,ipc] [--readers 1,2,4,8,16,20]
+//                  [--size 64] [--messages 200000] [--busy-spin]
+//                  [--out results.json]
+//
+// The broadcast writer should cost the same for any number of readers,
+// compare writer_cpu_ns_per_message. With --busy-spin, shm readers never
+// sleep, so the writer never has to wake them, that needs a cpu per reader.
+// Linux only, like zq::ShmBroadcaster.
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "bench.hpp"
+
+#ifdef __linux__
+
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zq/shm_broadcast.hpp>
+#include <zq/zq.hpp>
+
+namespace {
+
+  using namespace std::chrono_literals;
+
+  struct Config {
+    size_t size;
+    size_t messages;
+    zq::WaitMode wait_mode;
+  };
+
+  struct ReaderReport {
+    uint64_t received{0};
+    uint64_t lost{0};
+  };
+
+  struct Result {
+    std::string_view transport;
+    size_t readers{0};
+    double writer_ns_per_message{0};
+    double writer_cpu_ns_per_message{0};
+    uint64_t received{0};
+    uint64_t lost{0};
+  };
+
+  // readers tell the parent they are ready, and at the end their counts
+  struct Pipe {
+    std::array<int, 2> fds{-1, -1};
+
+    Pipe() {
+      if (::pipe(fds.data()) != 0) {
+        std::perror("pipe");
+        std::exit(1);
+      }
+    }
+    ~Pipe() {
+      ::close(fds[0]);
+      ::close(fds[1]);
+    }
+    Pipe(const Pipe&) = delete;
+    Pipe& operator=(const Pipe&) = delete;
+
+    void write(const void* data, size_t size) const {
+      [[maybe_unused]] auto rc = ::write(fds[1], data, size);
+    }
+    bool read(void* data, size_t size) const {
+      return ::read(fds[0], data, size) == static_cast<ssize_t>(size);
+    }
+  };
+
+  void run_shm_reader(const std::string& name,
+                      const Config& config,
+                      const Pipe& ready,
+                      const Pipe& reports) {
+    auto reader =
+        zq::shm_broadcast_reader(name, {}, {.wait_mode = config.wait_mode});
+    if (!reader) {
+      ::_exit(1);
+    }
+    ready.write("r", 1);
+    ReaderReport report;
+    for (;;) {
+      const auto lost = reader->lost();
+      auto msg = reader->await(5000ms);
+      if (!msg) {
+        break;
+      }
+      if (!*msg) {
+        if (reader->lost() > lost) {
+          continue;
+        }
+        break;
+      }
+      ++report.received;
+    }
+    report.lost = reader->lost();
+    reports.write(&report, sizeof(report));
+    ::_exit(0);
+  }
+
+  void run_ipc_reader(const std::string& address,
+                      const Pipe& ready,
+                      const Pipe& reports) {
+    auto context = zq::mk_context();
+    if (!context) {
+      ::_exit(1);
+    }
+    // the high water mark must be set before connecting
+    auto socket = context->socket(zq::SocketType::SUB);
+    if (!socket) {
+      ::_exit(1);
+    }
+    int hwm = 0;
+    zmq_setsockopt(socket->socket_ptr.get(), ZMQ_RCVHWM, &hwm, sizeof(hwm));
+    if (!socket->connect(address) || !zq::subscribe(*socket, {})) {
+      ::_exit(1);
+    }
+    ready.write("r", 1);
+    ReaderReport report;
+    for (;;) {
+      auto msg = socket->await(5000ms);
+      // an empty payload is the end
+      if (!msg || !*msg || (**msg).payload.size() == 0) {
+        break;
+      }
+      ++report.received;
+    }
+    reports.write(&report, sizeof(report));
+    ::_exit(0);
+  }
+
+  uint64_t thread_cpu_ns() {
+    timespec ts{};
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000u +
+           static_cast<uint64_t>(ts.tv_nsec);
+  }
+
+  // wall time and cpu time of the writer, with few cpus the wall time
+  // includes the time the readers run
+  template <typename Writer>
+  void publish(Writer& writer, const Config& config, Result& result) {
+    const auto tm = zq::typed_message(std::string(config.size, 'x'));
+    const auto start = std::chrono::steady_clock::now();
+    const auto cpu_start = thread_cpu_ns();
+    for (size_t i = 0; i < config.messages; ++i) {
+      while (!writer.send(tm)) {
+        zq::cpu_relax();
+      }
+    }
+    const auto cpu = thread_cpu_ns() - cpu_start;
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    const auto count = static_cast<double>(config.messages);
+    result.writer_ns_per_message =
+        static_cast<double>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                .count()) /
+        count;
+    result.writer_cpu_ns_per_message = static_cast<double>(cpu) / count;
+  }
+
+  std::optional<Result> collect(Result result,
+                                const std::vector<pid_t>& pids,
+                                const Pipe& reports) {
+    bool ok = true;
+    for (size_t i = 0; i < pids.size(); ++i) {
+      ReaderReport report;
+      if (!reports.read(&report, sizeof(report))) {
+        ok = false;
+        break;
+      }
+      result.received += report.received;
+      result.lost += report.lost;
+    }
+    for (auto pid : pids) {
+      int status = 0;
+      ::waitpid(pid, &status, 0);
+      ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    return ok ? std::optional<Result>{result} : std::nullopt;
+  }
+
+  bool wait_ready(const Pipe& ready, size_t readers) {
+    for (size_t i = 0; i < readers; ++i) {
+      char c = 0;
+      if (!ready.read(&c, 1)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::optional<Result> run_shm(size_t readers, const Config& config) {
+    const auto name = "zq_fanout_bench_" + std::to_string(::getpid());
+    auto writer = zq::shm_broadcaster(
+        name, {.slots = 1 << 16, .slot_size = config.size + 64});
+    if (!writer) {
+      std::fprintf(stderr, "%s\n", writer.error().what());
+      return std::nullopt;
+    }
+    Pipe ready;
+    Pipe reports;
+    std::vector<pid_t> pids;
+    for (size_t i = 0; i < readers; ++i) {
+      const auto pid = ::fork();
+      if (pid == 0) {
+        run_shm_reader(name, config, ready, reports);
+      }
+      pids.push_back(pid);
+    }
+    Result result{"shm", readers, 0, 0, 0, 0};
+    if (wait_ready(ready, readers)) {
+      publish(*writer, config, result);
+    }
+    // destroying the writer ends the readers
+    { auto done = std::move(*writer); }
+    return collect(result, pids, reports);
+  }
+
+  std::optional<Result> run_ipc(size_t readers, const Config& config) {
+    const auto address =
+        "ipc://" + (std::filesystem::temp_directory_path() /
+                    ("zq_fanout_bench_" + std::to_string(::getpid())))
+                       .string();
+    Pipe ready;
+    Pipe reports;
+    // contexts do not survive a fork, so the readers start first
+    std::vector<pid_t> pids;
+    for (size_t i = 0; i < readers; ++i) {
+      const auto pid = ::fork();
+      if (pid == 0) {
+        run_ipc_reader(address, ready, reports);
+      }
+      pids.push_back(pid);
+    }
+    Result result{"ipc", readers, 0, 0, 0, 0};
+    auto context = zq::mk_context();
+    if (!context) {
+      return std::nullopt;
+    }
+    auto socket = context->socket(zq::SocketType::PUB);
+    int hwm = 0;
+    if (socket) {
+      zmq_setsockopt(socket->socket_ptr.get(), ZMQ_SNDHWM, &hwm, sizeof(hwm));
+    }
+    if (socket && socket->bind(address) && wait_ready(ready, readers)) {
+      // subscriptions need a moment to arrive at the publisher
+      std::this_thread::sleep_for(200ms);
+      publish(*socket, config, result);
+      [[maybe_unused]] auto end =
+          socket->send(zq::typed_message(std::string{}));
+    }
+    return collect(result, pids, reports);
+  }
+
+  std::string to_json(const Result& r, const Config& config) {
+    return bench::JsonObject{}
+        .add("transport", r.transport)
+        .add("readers", uint64_t{r.readers})
+        .add("size", uint64_t{config.size})
+        .add("messages", uint64_t{config.messages})
+        .add("writer_ns_per_message", r.writer_ns_per_message)
+        .add("writer_cpu_ns_per_message", r.writer_cpu_ns_per_message)
+        .add("received", r.received)
+        .add("lost", r.lost)
+        .str();
+  }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Args args{argc, argv};
+  if (args.flag("--help")) {
+    std::printf(
+        "zq-fanout-bench [--transports shm,ipc] [--readers 1,2,4,8,16,20] "
+        "[--size 64] [--messages 200000] [--busy-spin] "
+        "[--out results.json]\n");
+    return 0;
+  }
+  const Config config{
+      bench::parse_size(args.value("--size").value_or("64")).value_or(64),
+      bench::parse_size(args.value("--messages").value_or("200000"))
+          .value_or(200000),
+      args.flag("--busy-spin") ? zq::WaitMode::BUSY_SPIN
+                               : zq::WaitMode::FUTEX};
+  const auto reader_counts =
+      bench::parse_sizes(args.list("--readers", "1,2,4,8,16,20"));
+
+  std::vector<std::string> results;
+  for (auto transport : args.list("--transports", "shm,ipc")) {
+    for (auto readers : reader_counts) {
+      auto result = transport == "shm" ? run_shm(readers, config)
+                                       : run_ipc(readers, config);
+      if (!result) {
+        std::fprintf(stderr, "%.*s %zu readers failed\n",
+                     static_cast<int>(transport.size()), transport.data(),
+                     readers);
+        return 1;
+      }
+      std::fprintf(stderr,
+                   "%-4s %3zu readers, writer %10.1f ns/msg %10.1f cpu ns/msg, "
+                   "%10llu received %10llu lost\n",
+                   result->transport.data(), readers,
+                   result->writer_ns_per_message,
+                   result->writer_cpu_ns_per_message,
+                   static_cast<unsigned long long>(result->received),
+                   static_cast<unsigned long long>(result->lost));
+      results.push_back(to_json(*result, config));
+    }
+  }
+  auto report = bench::JsonObject{}
+                    .add("benchmark", "zq-fanout-bench")
+                    .add_json("results", bench::json_array(results))
+                    .str();
+  return bench::write_report(args, report) ? 0 : 1;
+}
+
+#else
+
+int main() {
+  std::fprintf(stderr, "zq-fanout-bench needs Linux\n");
+  return 0;
+}
+
+#endif
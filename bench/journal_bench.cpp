@@ -0,0 +1,129 @@
+// Cost of recording into a zq::Journal, and of reading it back
+//
+// For each payload size, messages are appended to a journal in a temporary
+// directory, then read back. Reports ns per append and ns per record read,
+// the results are written as JSON.
+//
+//  zq-journal-bench [--sizes 16,64,256,1K] [--messages 1000000]
+//                   [--dir /tmp] [--out results.json]
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "bench.hpp"
+
+#ifndef _WIN32
+
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+#include <zq/journal.hpp>
+#include <zq/zq.hpp>
+
+namespace {
+
+  struct Result {
+    size_t size{0};
+    size_t messages{0};
+    double append_ns{0};
+    double read_ns{0};
+  };
+
+  double ns_per(std::chrono::steady_clock::duration elapsed, size_t count) {
+    return static_cast<double>(
+               std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                   .count()) /
+           static_cast<double>(count);
+  }
+
+  std::optional<Result> run(const std::filesystem::path& dir,
+                            size_t size,
+                            size_t messages) {
+    std::filesystem::remove_all(dir);
+    Result result{size, messages, 0, 0};
+    const auto tm = zq::typed_message(std::string(size, 'x'));
+    {
+      auto journal = zq::open_journal(dir);
+      if (!journal) {
+        std::fprintf(stderr, "%s\n", journal.error().what());
+        return std::nullopt;
+      }
+      const auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < messages; ++i) {
+        if (!journal->append(tm)) {
+          return std::nullopt;
+        }
+      }
+      result.append_ns = ns_per(std::chrono::steady_clock::now() - start,
+                                messages);
+    }
+    auto reader = zq::open_journal_reader(dir);
+    if (!reader) {
+      return std::nullopt;
+    }
+    size_t bytes = 0;
+    const auto start = std::chrono::steady_clock::now();
+    while (auto record = reader->next()) {
+      bytes += record->payload.size();
+    }
+    result.read_ns = ns_per(std::chrono::steady_clock::now() - start,
+                            messages);
+    bench::do_not_optimize(bytes);
+    std::filesystem::remove_all(dir);
+    return result;
+  }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Args args{argc, argv};
+  if (args.flag("--help")) {
+    std::printf(
+        "zq-journal-bench [--sizes 16,64,256,1K] [--messages 1000000] "
+        "[--dir /tmp] [--out results.json]\n");
+    return 0;
+  }
+  const auto sizes = bench::parse_sizes(args.list("--sizes", "16,64,256,1K"));
+  const auto messages =
+      bench::parse_size(args.value("--messages").value_or("1000000"))
+          .value_or(1000000);
+  const std::filesystem::path base{
+      args.value("--dir").value_or(
+          std::filesystem::temp_directory_path().native())};
+  const auto dir =
+      base / ("zq_journal_bench_" + std::to_string(::getpid()));
+
+  std::vector<std::string> results;
+  for (auto size : sizes) {
+    auto result = run(dir, size, messages);
+    if (!result) {
+      std::fprintf(stderr, "%zu failed\n", size);
+      return 1;
+    }
+    std::fprintf(stderr, "%8zu B %10.1f ns/append %10.1f ns/read\n", size,
+                 result->append_ns, result->read_ns);
+    results.push_back(bench::JsonObject{}
+                          .add("size", uint64_t{size})
+                          .add("messages", uint64_t{result->messages})
+                          .add("append_ns", result->append_ns)
+                          .add("read_ns", result->read_ns)
+                          .str());
+  }
+  auto report = bench::JsonObject{}
+                    .add("benchmark", "zq-journal-bench")
+                    .add_json("results", bench::json_array(results))
+                    .str();
+  return bench::write_report(args, report) ? 0 : 1;
+}
+
+#else
+
+int main() {
+  std::fprintf(stderr, "zq-journal-bench needs POSIX\n");
+  return 0;
+}
+
+#endif
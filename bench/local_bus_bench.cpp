@@ -0,0 +1,156 @@
+// Thread to thread throughput of a zq::LocalBus, and of inproc sockets
+//
+// A publisher thread sends count messages to a receiving thread, through a
+// PUSH/PULL inproc pair, and through a LocalBus with one producer, with
+// each wait mode. Reports the time and the messages per second as JSON.
+//
+//  zq-local-bus-bench [--count 1000000] [--size 64] [--capacity 1024]
+//                     [--out results.json]
+
+#include <chrono>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zq/local_bus.hpp>
+#include <zq/zq.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+  using namespace std::chrono_literals;
+
+  struct Config {
+    size_t count;
+    size_t size;
+    size_t capacity;
+  };
+
+  struct Result {
+    uint64_t received{0};
+    std::chrono::nanoseconds elapsed{0};
+  };
+
+  std::optional<Result> run_inproc(const Config& config) {
+    auto ctx = zq::mk_context();
+    if (!ctx) {
+      return std::nullopt;
+    }
+    const std::string endpoint{"inproc://zq-local-bus-bench"};
+    auto pull = ctx->bind(zq::SocketType::PULL, endpoint);
+    auto push = ctx->connect(zq::SocketType::PUSH, endpoint);
+    if (!pull || !push) {
+      std::fprintf(stderr, "can not create sockets on %s\n", endpoint.c_str());
+      return std::nullopt;
+    }
+
+    Result result;
+    const auto msg = zq::typed_message(std::string(config.size, 'z'));
+    const auto start = std::chrono::steady_clock::now();
+    std::thread pusher{[&] {
+      for (size_t i = 0; i < config.count; ++i) {
+        while (!push->send(msg)) {
+          std::this_thread::yield();
+        }
+      }
+    }};
+    while (result.received < config.count) {
+      auto received = pull->await(2000ms);
+      if (!received || !*received) {
+        break;
+      }
+      ++result.received;
+    }
+    pusher.join();
+    result.elapsed = std::chrono::steady_clock::now() - start;
+    return result;
+  }
+
+  Result run_bus(const Config& config, zq::WaitMode wait_mode) {
+    zq::LocalBus bus{zq::LocalBusOptions{.capacity = config.capacity,
+                                         .producers = zq::Producers::SINGLE,
+                                         .wait_mode = wait_mode}};
+    auto sub = bus.subscribe<std::string>();
+    auto publisher = bus.publisher();
+
+    Result result;
+    const auto msg = zq::typed_message(std::string(config.size, 'z'));
+    const auto start = std::chrono::steady_clock::now();
+    std::thread pusher{[&] {
+      for (size_t i = 0; i < config.count; ++i) {
+        while (publisher->publish(zq::shared_copy(msg)) == 0) {
+          std::this_thread::yield();
+        }
+      }
+    }};
+    while (result.received < config.count) {
+      if (!sub.await(2000ms)) {
+        break;
+      }
+      ++result.received;
+    }
+    pusher.join();
+    result.elapsed = std::chrono::steady_clock::now() - start;
+    return result;
+  }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Args args{argc, argv};
+  if (args.flag("--help")) {
+    std::printf(
+        "zq-local-bus-bench [--count 1000000] [--size 64] [--capacity 1024]\n"
+        "                   [--out results.json]\n");
+    return 0;
+  }
+  const Config config{
+      .count = bench::parse_size(args.value("--count").value_or("1000000"))
+                   .value_or(1000000),
+      .size = bench::parse_size(args.value("--size").value_or("64"))
+                  .value_or(64),
+      .capacity = bench::parse_size(args.value("--capacity").value_or("1024"))
+                      .value_or(1024),
+  };
+
+  struct Mode {
+    std::string name;
+    std::optional<Result> result;
+  };
+  const std::vector<Mode> modes{
+      {"inproc", run_inproc(config)},
+      {"bus futex", run_bus(config, zq::WaitMode::FUTEX)},
+      {"bus spin", run_bus(config, zq::WaitMode::BUSY_SPIN)},
+  };
+
+  std::vector<std::string> results;
+  for (const auto& [name, result] : modes) {
+    if (!result) {
+      return 1;
+    }
+    const auto seconds =
+        std::chrono::duration<double>(result->elapsed).count();
+    const double rate =
+        seconds > 0 ? static_cast<double>(result->received) / seconds : 0.0;
+    std::fprintf(stderr, "%-10s %10.1f ms %12.0f msg/s, %llu of %zu received\n",
+                 name.c_str(), seconds * 1e3, rate,
+                 static_cast<unsigned long long>(result->received),
+                 config.count);
+    results.push_back(bench::JsonObject{}
+                          .add("mode", name)
+                          .add("size", uint64_t{config.size})
+                          .add("capacity", uint64_t{config.capacity})
+                          .add("received", result->received)
+                          .add("seconds", seconds)
+                          .add("msgs_per_sec", rate)
+                          .str());
+  }
+  auto report = bench::JsonObject{}
+                    .add("benchmark", "zq-local-bus-bench")
+                    .add_json("results", bench::json_array(results))
+                    .str();
+  return bench::write_report(args, report) ? 0 : 1;
+}
@@ -0,0 +1,257 @@
+// Latency of control messages under saturating bulk load
+//
+// One thread sends bulk data as fast as the receiver takes it, and small
+// control messages at a fixed rate in between. In shared mode both go
+// through one socket, in strict and weighted mode through a
+// zq::PriorityChannel, with control messages routed to lane 0.
+// Reports the one way latency of the control messages, and the bulk
+// throughput, as JSON.
+//
+//  zq-priority-bench [--modes shared,strict,weighted] [--bulk-size 64K]
+//                    [--control-rate 1000] [--duration 3] [--hwm 100]
+//                    [--weights 4,1] [--endpoint ipc://zq-priority-bench]
+//                    [--out results.json]
+//
+// The sender does not block on a full bulk lane, it waits until the lane
+// can take a message or the next control message is due.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zq/priority_channel.hpp>
+#include <zq/zq.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+  using namespace std::chrono_literals;
+
+  struct Control {
+    uint64_t sent_ns;
+  };
+
+  struct Config {
+    std::string_view mode;
+    size_t bulk_size;
+    double control_rate;
+    double duration;
+    int hwm;
+    std::vector<unsigned> weights;
+    std::string endpoint;
+  };
+
+  struct Result {
+    zq::LatencyHistogram control;
+    uint64_t bulk_messages{0};
+    uint64_t bulk_bytes{0};
+    double seconds{0};
+  };
+
+  std::optional<zq::PriorityChannel> mk_channel(zq::Context& ctx,
+                                                zq::SocketType type,
+                                                const Config& config,
+                                                size_t lanes,
+                                                bool bind,
+                                                zq::PriorityOptions options) {
+    auto endpoints = zq::lane_endpoints(config.endpoint, lanes);
+    if (!endpoints) {
+      std::fprintf(stderr, "%s\n", endpoints.error().what());
+      return std::nullopt;
+    }
+    std::vector<zq::Socket> sockets;
+    for (const auto& endpoint : *endpoints) {
+      auto socket = ctx.socket(type);
+      if (!socket) {
+        return std::nullopt;
+      }
+      // the queue limits have to be in place before bind or connect
+      auto* s = socket->socket_ptr.get();
+      zmq_setsockopt(s, ZMQ_SNDHWM, &config.hwm, sizeof(config.hwm));
+      zmq_setsockopt(s, ZMQ_RCVHWM, &config.hwm, sizeof(config.hwm));
+      auto rc = bind ? socket->bind(endpoint) : socket->connect(endpoint);
+      if (!rc) {
+        std::fprintf(stderr, "%s: %s\n", endpoint.c_str(), rc.error().what());
+        return std::nullopt;
+      }
+      sockets.push_back(std::move(*socket));
+    }
+    return zq::PriorityChannel{std::move(sockets), std::move(options)};
+  }
+
+  // zq sends the first frame blocking, wait until the lane takes a message
+  bool wait_writable(zq::Socket& socket, uint64_t until_ns) {
+    const auto now = zq::monotonic_now_ns();
+    const auto timeout_ms =
+        until_ns > now ? static_cast<long>((until_ns - now) / 1'000'000) : 0;
+    zmq_pollitem_t item{socket.socket_ptr.get(), 0, ZMQ_POLLOUT, 0};
+    return zmq_poll(&item, 1, timeout_ms) == 1;
+  }
+
+  void receive(zq::PriorityChannel& channel,
+               Result& result,
+               const std::atomic<bool>& sending) {
+    const auto control_type = zq::wire_type_name<Control>();
+    // after the sender stopped, read until the lanes are empty
+    for (;;) {
+      auto msg = channel.await(100ms);
+      if (!msg) {
+        if (!sending) {
+          return;
+        }
+        continue;
+      }
+      if (!*msg) {
+        continue;
+      }
+      if (zq::as_string_view((*msg)->type) == control_type) {
+        auto control = zq::restore_as<Control>(**msg);
+        if (control) {
+          result.control.record(zq::monotonic_now_ns() - control->sent_ns);
+        }
+      } else {
+        ++result.bulk_messages;
+        result.bulk_bytes += (*msg)->payload.size();
+      }
+    }
+  }
+
+  std::optional<Result> run(const Config& config,
+                            size_t lanes,
+                            zq::PriorityOptions options) {
+    auto ctx = zq::mk_context();
+    if (!ctx) {
+      return std::nullopt;
+    }
+    auto receiver = mk_channel(*ctx, zq::SocketType::PULL, config, lanes, true,
+                               std::move(options));
+    auto sender =
+        mk_channel(*ctx, zq::SocketType::PUSH, config, lanes, false, {});
+    if (!receiver || !sender) {
+      return std::nullopt;
+    }
+    sender->route<Control>(0);
+    auto& bulk_lane = sender->lane(lanes - 1);
+    auto& control_lane = sender->lane(0);
+
+    Result result;
+    std::atomic<bool> sending{true};
+    std::thread receiving{[&] { receive(*receiver, result, sending); }};
+
+    const auto bulk =
+        zq::typed_message(std::string(config.bulk_size, 'b'));
+    const auto period_ns =
+        static_cast<uint64_t>(1e9 / std::max(config.control_rate, 1.0));
+    const auto start = zq::monotonic_now_ns();
+    const auto end = start + static_cast<uint64_t>(config.duration * 1e9);
+    auto control_due = start;
+    for (auto now = start; now < end; now = zq::monotonic_now_ns()) {
+      if (now >= control_due) {
+        if (wait_writable(control_lane, end) &&
+            sender->send(Control{zq::monotonic_now_ns()})) {
+          control_due += period_ns;
+        }
+        continue;
+      }
+      if (wait_writable(bulk_lane, control_due)) {
+        [[maybe_unused]] auto rc = sender->send(bulk);
+      }
+    }
+    sending = false;
+    receiving.join();
+    result.seconds = static_cast<double>(zq::monotonic_now_ns() - start) / 1e9;
+    return result;
+  }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Args args{argc, argv};
+  if (args.flag("--help")) {
+    std::printf(
+        "zq-priority-bench [--modes shared,strict,weighted] "
+        "[--bulk-size 64K]\n"
+        "                  [--control-rate 1000] [--duration 3] "
+        "[--hwm 100]\n"
+        "                  [--weights 4,1] "
+        "[--endpoint ipc://zq-priority-bench]\n"
+        "                  [--out results.json]\n");
+    return 0;
+  }
+  Config config{
+      .mode = "",
+      .bulk_size =
+          bench::parse_size(args.value("--bulk-size").value_or("64K"))
+              .value_or(64 << 10),
+      .control_rate = static_cast<double>(
+          bench::parse_size(args.value("--control-rate").value_or("1000"))
+              .value_or(1000)),
+      .duration = static_cast<double>(
+          bench::parse_size(args.value("--duration").value_or("3"))
+              .value_or(3)),
+      .hwm = static_cast<int>(
+          bench::parse_size(args.value("--hwm").value_or("100")).value_or(100)),
+      .weights = {},
+      .endpoint = std::string{
+          args.value("--endpoint").value_or("ipc://zq-priority-bench")},
+  };
+  for (auto weight : bench::parse_sizes(args.list("--weights", "4,1"))) {
+    config.weights.push_back(static_cast<unsigned>(weight));
+  }
+
+  std::vector<std::string> results;
+  for (auto mode : args.list("--modes", "shared,strict,weighted")) {
+    config.mode = mode;
+    std::optional<Result> result;
+    if (mode == "shared") {
+      result = run(config, 1, {});
+    } else if (mode == "strict") {
+      result = run(config, 2, {.order = zq::PollOrder::STRICT});
+    } else if (mode == "weighted") {
+      result = run(config, 2,
+                   {.order = zq::PollOrder::WEIGHTED,
+                    .weights = config.weights});
+    } else {
+      std::fprintf(stderr, "unknown mode: %.*s\n",
+                   static_cast<int>(mode.size()), mode.data());
+      continue;
+    }
+    if (!result) {
+      std::fprintf(stderr, "%.*s failed\n", static_cast<int>(mode.size()),
+                   mode.data());
+      return 1;
+    }
+    const auto mb_per_second =
+        static_cast<double>(result->bulk_bytes) / 1e6 / result->seconds;
+    std::fprintf(stderr,
+                 "%-8.*s control p50 %9.1f us p99 %9.1f us p99.9 %9.1f us, "
+                 "bulk %8.1f MB/s\n",
+                 static_cast<int>(mode.size()), mode.data(),
+                 static_cast<double>(result->control.p50()) / 1e3,
+                 static_cast<double>(result->control.p99()) / 1e3,
+                 static_cast<double>(result->control.p999()) / 1e3,
+                 mb_per_second);
+    results.push_back(
+        bench::JsonObject{}
+            .add("mode", mode)
+            .add("bulk_size", uint64_t{config.bulk_size})
+            .add("control_rate", config.control_rate)
+            .add("hwm", static_cast<uint64_t>(config.hwm))
+            .add("bulk_messages", result->bulk_messages)
+            .add("bulk_mb_per_second", mb_per_second)
+            .add_json("control_latency_ns",
+                      bench::histogram_json(result->control))
+            .str());
+  }
+  auto report = bench::JsonObject{}
+                    .add("benchmark", "zq-priority-bench")
+                    .add_json("results", bench::json_array(results))
+                    .str();
+  return bench::write_report(args, report) ? 0 : 1;
+}
@@ -0,0 +1,370 @@
+// Cost of typed_message and restore_as, without any network, and of the
+// errors that happen routinely, a type mismatch or EAGAIN
+//
+//  zq-serialize-bench [--filter name] [--min-time-ms 20] [--out run.json]
+//  zq-serialize-bench --compare base.json new.json [--threshold 10]
+//
+// Per conversion it reports ns/op, allocations/op and bytes copied/op.
+//
+// Allocations are the operator new calls of the operation, plus the zmq
+// messages too large to be stored inline in zmq_msg_t, those are malloced
+// by libzmq.
+// Bytes copied are the bytes written into the message parts by
+// typed_message, and the payload bytes read out by restore_as.
+//
+// The compare mode prints the difference between two runs and fails if an
+// operation got slower by more than the threshold, in percent, or needs
+// more allocations.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <zq/zq.hpp>
+#ifdef ZQ_PROTO
+#include "pingpong.pb.h"
+#endif
+
+#include "bench.hpp"
+
+namespace {
+
+  std::atomic<uint64_t> allocations{0};
+
+  void* counted_alloc(std::size_t size, std::size_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) {
+      size = 1;
+    }
+    void* p = nullptr;
+    if (alignment <= alignof(std::max_align_t)) {
+      p = std::malloc(size);
+    } else {
+#ifdef _WIN32
+      p = _aligned_malloc(size, alignment);
+#else
+      p = std::aligned_alloc(alignment,
+                             (size + alignment - 1) / alignment * alignment);
+#endif
+    }
+    if (p == nullptr) {
+      throw std::bad_alloc{};
+    }
+    return p;
+  }
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+  return counted_alloc(size, alignof(std::max_align_t));
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  return counted_alloc(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  std::free(p);
+#endif
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t a) noexcept {
+  operator delete(p, a);
+}
+
+namespace bench {
+
+  struct SmallStruct {
+    int32_t id;
+    float x;
+    float y;
+    float z;
+  };
+
+  struct LargeStruct {
+    std::array<double, 512> values;
+  };
+
+}  // namespace bench
+
+namespace {
+
+  using steady = std::chrono::steady_clock;
+
+  // libzmq stores up to 33 bytes in the zmq_msg_t, larger parts are malloced
+  constexpr size_t zmq_inline_size = 33;
+
+  uint64_t zmq_allocs(const zq::TypedMessage& tm) {
+    uint64_t count = 0;
+    for (const auto* part : {&tm.type, &tm.payload, &tm.meta}) {
+      if (part->size() > zmq_inline_size) {
+        ++count;
+      }
+    }
+    return count;
+  }
+
+  struct Measurement {
+    std::string name;
+    uint64_t iterations{0};
+    double ns_per_op{0};
+    double allocs_per_op{0};
+    uint64_t bytes_copied_per_op{0};
+  };
+
+  struct Config {
+    std::string_view filter;
+    std::chrono::milliseconds min_time;
+  };
+
+  template <typename Op>
+  double run_batch(Op& op, uint64_t iterations) {
+    const auto start = steady::now();
+    for (uint64_t i = 0; i < iterations; ++i) {
+      auto result = op();
+      bench::do_not_optimize(result);
+    }
+    const std::chrono::duration<double, std::nano> elapsed =
+        steady::now() - start;
+    return elapsed.count();
+  }
+
+  /**
+   * Double the iterations until a batch takes 1/5 of the min time,
+   * then run 5 batches and take the median.
+   */
+  template <typename Op>
+  Measurement measure(const Config& config,
+                      std::string name,
+                      Op op,
+                      uint64_t extra_allocs,
+                      uint64_t bytes_copied) {
+    const double batch_ns =
+        std::chrono::duration<double, std::nano>(config.min_time).count() / 5;
+    uint64_t iterations = 1;
+    while (run_batch(op, iterations) < batch_ns && iterations < (1u << 30)) {
+      iterations *= 2;
+    }
+    std::array<double, 5> ns_per_op{};
+    for (auto& ns : ns_per_op) {
+      ns = run_batch(op, iterations) / static_cast<double>(iterations);
+    }
+    std::sort(ns_per_op.begin(), ns_per_op.end());
+
+    const auto before = allocations.load(std::memory_order_relaxed);
+    run_batch(op, iterations);
+    const auto counted = allocations.load(std::memory_order_relaxed) - before;
+
+    return Measurement{
+        std::move(name), iterations, ns_per_op[ns_per_op.size() / 2],
+        static_cast<double>(counted) / static_cast<double>(iterations) +
+            static_cast<double>(extra_allocs),
+        bytes_copied};
+  }
+
+  /**
+   * typed_message and restore_as for one value
+   */
+  template <typename T>
+  void measure_type(const Config& config,
+                    std::string_view label,
+                    const T& value,
+                    std::vector<Measurement>& results) {
+    const auto create_name = "typed_message/" + std::string{label};
+    const auto restore_name = "restore_as/" + std::string{label};
+    const auto sample = zq::typed_message(value);
+    const auto written = sample.type.size() + sample.payload.size();
+    if (create_name.find(config.filter) != std::string::npos) {
+      results.push_back(measure(
+          config, create_name, [&value] { return zq::typed_message(value); },
+          zmq_allocs(sample), written));
+    }
+    if (restore_name.find(config.filter) != std::string::npos) {
+      results.push_back(measure(
+          config, restore_name, [&sample] { return zq::restore_as<T>(sample); },
+          0, sample.payload.size()));
+    }
+  }
+
+  /**
+   * Failures that happen under load, they should not allocate
+   */
+  void measure_errors(const Config& config, std::vector<Measurement>& results) {
+    const auto str = zq::typed_message("not an int");
+    const zq::Message part{8};
+    auto add = [&](std::string name, auto op) {
+      if (name.find(config.filter) != std::string::npos) {
+        results.push_back(measure(config, std::move(name), op, 0, 0));
+      }
+    };
+    add("error/restore_as_mismatch",
+        [&str] { return zq::restore_as<int32_t>(str); });
+    add("error/restore_any_mismatch", [&str] {
+      return zq::restore_any<int32_t, double, bench::SmallStruct>(str);
+    });
+    add("error/current_zmq_error", [] {
+      return std::expected<int, zq::Error>{
+          std::unexpected(zq::currentZmqError())};
+    });
+    auto context = zq::mk_context();
+    if (!context) {
+      return;
+    }
+    // a PUSH socket without peers can not send, that is EAGAIN
+    if (auto push = context->socket(zq::SocketType::PUSH)) {
+      add("error/send_eagain", [&push, &part] { return push->send(part); });
+    }
+  }
+
+  std::vector<Measurement> run_all(const Config& config) {
+    std::vector<Measurement> results;
+    measure_type(config, "int32", int32_t{42}, results);
+    measure_type(config, "uint64", uint64_t{42}, results);
+    measure_type(config, "double", 42.2, results);
+    measure_type(config, "small_struct", bench::SmallStruct{1, 2, 3, 4},
+                 results);
+    bench::LargeStruct large{};
+    large.values.fill(1.5);
+    measure_type(config, "large_struct", large, results);
+    for (size_t size : {8u, 64u, 1024u, 65536u}) {
+      measure_type(config, "string_" + std::to_string(size),
+                   std::string(size, 'x'), results);
+    }
+#ifdef ZQ_PROTO
+    zq::proto::Ping ping;
+    ping.set_id(23);
+    ping.set_msg("ping from the serialization benchmark");
+    measure_type(config, "proto_ping", ping, results);
+    zq::proto::Pong pong;
+    pong.set_id(23);
+    pong.set_reply(std::string(1024, 'y'));
+    measure_type(config, "proto_pong_1K", pong, results);
+#endif
+    measure_errors(config, results);
+    return results;
+  }
+
+  std::string to_json(const std::vector<Measurement>& results) {
+    std::vector<std::string> items;
+    for (const auto& m : results) {
+      items.push_back(bench::JsonObject{}
+                          .add("name", m.name)
+                          .add("iterations", m.iterations)
+                          .add("ns_per_op", m.ns_per_op)
+                          .add("allocs_per_op", m.allocs_per_op)
+                          .add("bytes_copied_per_op", m.bytes_copied_per_op)
+                          .str());
+    }
+    return bench::JsonObject{}
+        .add("benchmark", "zq-serialize-bench")
+        .add_json("results", bench::json_array(items))
+        .str();
+  }
+
+  int compare(const std::string& base_path,
+              const std::string& new_path,
+              double threshold) {
+    auto base = bench::read_results(base_path);
+    auto current = bench::read_results(new_path);
+    if (!base || !current) {
+      std::fprintf(stderr, "can not read %s or %s\n", base_path.c_str(),
+                   new_path.c_str());
+      return 2;
+    }
+    int regressions = 0;
+    std::printf("%-28s %12s %12s %8s %8s %8s\n", "name", "base ns", "new ns",
+                "diff %", "allocs", "allocs");
+    for (const auto& result : *current) {
+      auto name = bench::json_field(result, "name").value_or("?");
+      auto it = std::find_if(base->begin(), base->end(), [&](const auto& b) {
+        return bench::json_field(b, "name") == name;
+      });
+      const auto new_ns = bench::json_number(result, "ns_per_op").value_or(0);
+      const auto new_allocs =
+          bench::json_number(result, "allocs_per_op").value_or(0);
+      if (it == base->end()) {
+        std::printf("%-28.*s %12s %12.1f %8s %8s %8.2f new\n",
+                    static_cast<int>(name.size()), name.data(), "-", new_ns,
+                    "-", "-", new_allocs);
+        continue;
+      }
+      const auto base_ns = bench::json_number(*it, "ns_per_op").value_or(0);
+      const auto base_allocs =
+          bench::json_number(*it, "allocs_per_op").value_or(0);
+      const auto diff =
+          base_ns > 0 ? (new_ns - base_ns) / base_ns * 100.0 : 0.0;
+      const bool regression =
+          diff > threshold || new_allocs > base_allocs + 0.01;
+      regressions += regression ? 1 : 0;
+      std::printf("%-28.*s %12.1f %12.1f %+8.1f %8.2f %8.2f%s\n",
+                  static_cast<int>(name.size()), name.data(), base_ns, new_ns,
+                  diff, base_allocs, new_allocs,
+                  regression ? " REGRESSION" : "");
+    }
+    std::printf("%d regression(s), threshold %.1f%%\n", regressions,
+                threshold);
+    return regressions == 0 ? 0 : 1;
+  }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Args args{argc, argv};
+  if (args.flag("--help")) {
+    std::printf(
+        "zq-serialize-bench [--filter name] [--min-time-ms 20] "
+        "[--out run.json]\n"
+        "zq-serialize-bench --compare base.json new.json "
+        "[--threshold 10]\n");
+    return 0;
+  }
+  if (args.flag("--compare")) {
+    auto files = args.value("--compare");
+    if (!files || argc < 4) {
+      std::fprintf(stderr, "--compare needs two files\n");
+      return 2;
+    }
+    // the second file is the argument after the first one
+    std::string base_path{*files};
+    std::string new_path;
+    for (int i = 1; i + 2 < argc; ++i) {
+      if (std::string_view{argv[i]} == "--compare") {
+        new_path = argv[i + 2];
+      }
+    }
+    const auto threshold = std::strtod(
+        std::string{args.value("--threshold").value_or("10")}.c_str(),
+        nullptr);
+    return compare(base_path, new_path, threshold);
+  }
+
+  Config config{
+      args.value("--filter").value_or(""),
+      std::chrono::milliseconds{std::atoi(
+          std::string{args.value("--min-time-ms").value_or("20")}.c_str())}};
+  auto results = run_all(config);
+  for (const auto& m : results) {
+    std::fprintf(stderr, "%-28s %10.1f ns/op %6.2f allocs/op %8llu bytes/op\n",
+                 m.name.c_str(), m.ns_per_op, m.allocs_per_op,
+                 static_cast<unsigned long long>(m.bytes_copied_per_op));
+  }
+  return bench::write_report(args, to_json(results)) ? 0 : 1;
+}
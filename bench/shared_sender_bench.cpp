@@ -0,0 +1,205 @@
+// Many threads sending through one socket, zq::SharedSender compared to a
+// mutex around Socket::send
+//
+// For each mode and producer count, the producers send their share of the
+// messages to an inproc PUSH socket, a receiver thread drains the PULL
+// side. Reports messages per second and the time producers spent per
+// send. The results are written as JSON.
+//
+//  zq-shared-sender-bench [--modes shared,mutex]
+//                         [--producers 1,2,4,8,16,32] [--size 64]
+//                         [--messages 1000000] [--out results.json]
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "bench.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zq/shared_sender.hpp>
+#include <zq/zq.hpp>
+
+namespace {
+
+  using namespace std::chrono_literals;
+
+  struct Result {
+    std::string_view mode;
+    size_t producers{0};
+    size_t messages{0};
+    double seconds{0};
+    double send_ns{0};
+  };
+
+  // a mutex around the socket, what SharedSender replaces
+  class LockedSender {
+    std::mutex mutex;
+    zq::Socket socket;
+
+   public:
+    explicit LockedSender(zq::Socket s) : socket{std::move(s)} {}
+
+    bool send(const zq::TypedMessage& tm) {
+      for (;;) {
+        {
+          std::lock_guard lock{mutex};
+          auto rc = socket.send(tm);
+          if (rc) {
+            return true;
+          }
+          if (rc.error().errNo != EAGAIN) {
+            return false;
+          }
+        }
+        std::this_thread::yield();
+      }
+    }
+  };
+
+  bool send_message(zq::SharedSender& sender, const zq::TypedMessage& tm) {
+    return sender.send(zq::shared_copy(tm)).has_value();
+  }
+
+  bool send_message(LockedSender& sender, const zq::TypedMessage& tm) {
+    return sender.send(tm);
+  }
+
+  template <typename Sender>
+  std::optional<Result> run(Sender& sender,
+                            zq::Socket& pull,
+                            Result result,
+                            size_t size) {
+    const auto per_producer = result.messages / result.producers;
+    const auto total = per_producer * result.producers;
+    const auto tm = zq::typed_message(std::string(size, 'x'));
+    std::atomic<size_t> received{0};
+    std::thread receiver{[&]() {
+      while (received.load(std::memory_order_relaxed) < total) {
+        auto msg = pull.await(5000ms);
+        if (!msg || !*msg) {
+          return;
+        }
+        received.fetch_add(1, std::memory_order_relaxed);
+      }
+    }};
+
+    std::atomic<bool> go{false};
+    std::atomic<uint64_t> send_ns{0};
+    std::atomic<bool> ok{true};
+    std::vector<std::thread> producers;
+    for (size_t p = 0; p < result.producers; ++p) {
+      producers.emplace_back([&]() {
+        while (!go.load(std::memory_order_acquire)) {
+          std::this_thread::yield();
+        }
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < per_producer; ++i) {
+          if (!send_message(sender, tm)) {
+            ok = false;
+            return;
+          }
+        }
+        send_ns.fetch_add(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start)
+                .count()));
+      });
+    }
+    const auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& t : producers) {
+      t.join();
+    }
+    receiver.join();
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    if (!ok || received.load() != total) {
+      return std::nullopt;
+    }
+    result.messages = total;
+    result.seconds = std::chrono::duration<double>(elapsed).count();
+    result.send_ns =
+        static_cast<double>(send_ns.load()) / static_cast<double>(total);
+    return result;
+  }
+
+  std::optional<Result> run_mode(std::string_view mode,
+                                 size_t producers,
+                                 size_t messages,
+                                 size_t size) {
+    auto context = zq::mk_context();
+    if (!context) {
+      return std::nullopt;
+    }
+    const auto address = "inproc://zq-shared-sender-bench";
+    auto pull = context->bind(zq::SocketType::PULL, address);
+    auto push = context->connect(zq::SocketType::PUSH, address);
+    if (!pull || !push) {
+      return std::nullopt;
+    }
+    const Result result{mode, producers, messages, 0, 0};
+    if (mode == "shared") {
+      zq::SharedSender sender{std::move(*push)};
+      return run(sender, *pull, result, size);
+    }
+    LockedSender sender{std::move(*push)};
+    return run(sender, *pull, result, size);
+  }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Args args{argc, argv};
+  if (args.flag("--help")) {
+    std::printf(
+        "zq-shared-sender-bench [--modes shared,mutex] "
+        "[--producers 1,2,4,8,16,32] [--size 64] [--messages 1000000] "
+        "[--out results.json]\n");
+    return 0;
+  }
+  const auto size =
+      bench::parse_size(args.value("--size").value_or("64")).value_or(64);
+  const auto messages =
+      bench::parse_size(args.value("--messages").value_or("1000000"))
+          .value_or(1000000);
+  const auto producer_counts =
+      bench::parse_sizes(args.list("--producers", "1,2,4,8,16,32"));
+
+  std::vector<std::string> results;
+  for (auto mode : args.list("--modes", "shared,mutex")) {
+    for (auto producers : producer_counts) {
+      auto result = run_mode(mode, std::max<size_t>(producers, 1), messages,
+                             size);
+      if (!result) {
+        std::fprintf(stderr, "%.*s %zu producers failed\n",
+                     static_cast<int>(mode.size()), mode.data(), producers);
+        return 1;
+      }
+      const auto rate =
+          static_cast<double>(result->messages) / result->seconds;
+      std::fprintf(stderr,
+                   "%-6.*s %3zu producers %12.0f msg/s %10.1f ns/send\n",
+                   static_cast<int>(mode.size()), mode.data(),
+                   result->producers, rate, result->send_ns);
+      results.push_back(bench::JsonObject{}
+                            .add("mode", result->mode)
+                            .add("producers", uint64_t{result->producers})
+                            .add("size", uint64_t{size})
+                            .add("messages", uint64_t{result->messages})
+                            .add("messages_per_second", rate)
+                            .add("ns_per_send", result->send_ns)
+                            .str());
+    }
+  }
+  auto report = bench::JsonObject{}
+                    .add("benchmark", "zq-shared-sender-bench")
+                    .add_json("results", bench::json_array(results))
+                    .str();
+  return bench::write_report(args, report) ? 0 : 1;
+}
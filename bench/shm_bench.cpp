@@ -0,0 +1,260 @@
+// Shared memory channels compared to ipc:// PAIR sockets
+//
+// For each transport and payload size, a child process is forked that
+// streams messages to the parent, for throughput, and then answers pings,
+// for round trip latency. The results are written as JSON.
+//
+//  zq-shm-bench [--transports shm,ipc] [--sizes 64,256,1K,4K,16K,64K]
+//               [--messages 100000] [--rounds 10000] [--out results.json]
+//
+// For large messages, the message count is limited to 256M per run.
+// Linux only, like zq::ShmChannel.
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "bench.hpp"
+
+#ifdef __linux__
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+#include <zq/shm.hpp>
+#include <zq/trace.hpp>
+#include <zq/zq.hpp>
+
+namespace {
+
+  using namespace std::chrono_literals;
+
+  struct Config {
+    size_t messages;
+    size_t rounds;
+  };
+
+  struct Result {
+    std::string_view transport;
+    size_t size{0};
+    size_t received{0};
+    double seconds{0};
+    zq::LatencyHistogram round_trip;
+  };
+
+  // ShmChannel and Socket have the same send and await, so one
+  // implementation for both
+
+  template <typename Channel>
+  bool send_retry(Channel& channel, const zq::TypedMessage& tm) {
+    for (;;) {
+      auto rc = channel.send(tm);
+      if (rc) {
+        return true;
+      }
+      if (rc.error().errNo != EAGAIN) {
+        return false;
+      }
+      zq::cpu_relax();
+    }
+  }
+
+  template <typename Channel>
+  std::optional<zq::TypedMessage> await_message(Channel& channel) {
+    auto msg = channel.await(5000ms);
+    if (!msg || !*msg) {
+      return std::nullopt;
+    }
+    return std::move(**msg);
+  }
+
+  size_t message_count(size_t size, const Config& config) {
+    return std::max<size_t>(
+        1, std::min(config.messages, (size_t{256} << 20) / size));
+  }
+
+  // stream, then echo pings until the parent says done
+  template <typename Channel>
+  int run_child(Channel& channel, size_t size, const Config& config) {
+    const auto tm = zq::typed_message(std::string(size, 'x'));
+    for (size_t i = 0; i < message_count(size, config); ++i) {
+      if (!send_retry(channel, tm)) {
+        return 1;
+      }
+    }
+    for (;;) {
+      auto ping = await_message(channel);
+      if (!ping) {
+        return 1;
+      }
+      if (ping->payload.size() == 0) {
+        return 0;
+      }
+      if (!send_retry(channel, *ping)) {
+        return 1;
+      }
+    }
+  }
+
+  template <typename Channel>
+  Result run_parent(Channel& channel,
+                    std::string_view transport,
+                    size_t size,
+                    const Config& config) {
+    Result result{transport, size, 0, 0, {}};
+    const auto count = message_count(size, config);
+    auto first = await_message(channel);
+    if (!first) {
+      return result;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    result.received = 1;
+    while (result.received < count && await_message(channel)) {
+      ++result.received;
+    }
+    result.seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    const auto ping = zq::typed_message(std::string(size, 'p'));
+    for (size_t i = 0; i < config.rounds; ++i) {
+      const auto sent = zq::monotonic_now_ns();
+      if (!send_retry(channel, ping) || !await_message(channel)) {
+        break;
+      }
+      result.round_trip.record(zq::monotonic_now_ns() - sent);
+    }
+    // an empty payload ends the child
+    [[maybe_unused]] auto done =
+        send_retry(channel, zq::typed_message(std::string{}));
+    return result;
+  }
+
+  std::filesystem::path temp_path(std::string_view name) {
+    return std::filesystem::temp_directory_path() /
+           (std::string{name} + std::to_string(::getpid()));
+  }
+
+  std::optional<Result> wait_child(pid_t pid, std::optional<Result> result) {
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      return std::nullopt;
+    }
+    return result;
+  }
+
+  std::optional<Result> run_shm(size_t size, const Config& config) {
+    const auto path = temp_path("zq_shm_bench_");
+    auto listener = zq::shm_listen(path);
+    if (!listener) {
+      std::fprintf(stderr, "%s\n", listener.error().what());
+      return std::nullopt;
+    }
+    const auto pid = ::fork();
+    if (pid == 0) {
+      auto channel = zq::shm_connect(path, 5000ms);
+      ::_exit(channel ? run_child(*channel, size, config) : 1);
+    }
+    std::optional<Result> result;
+    if (auto channel = listener->accept(5000ms)) {
+      result = run_parent(*channel, "shm", size, config);
+    }
+    return wait_child(pid, std::move(result));
+  }
+
+  std::optional<Result> run_ipc(size_t size, const Config& config) {
+    const auto address = "ipc://" + temp_path("zq_ipc_bench_").string();
+    // contexts do not survive a fork, so each process makes its own
+    const auto pid = ::fork();
+    if (pid == 0) {
+      int rc = 1;
+      if (auto context = zq::mk_context()) {
+        if (auto socket = context->connect(zq::SocketType::PAIR, address)) {
+          rc = run_child(*socket, size, config);
+        }
+      }
+      ::_exit(rc);
+    }
+    std::optional<Result> result;
+    auto context = zq::mk_context();
+    if (context) {
+      if (auto socket = context->bind(zq::SocketType::PAIR, address)) {
+        result = run_parent(*socket, "ipc", size, config);
+      }
+    }
+    return wait_child(pid, std::move(result));
+  }
+
+  std::string to_json(const Result& r) {
+    const auto mib = static_cast<double>(r.received * r.size) / (1 << 20);
+    return bench::JsonObject{}
+        .add("transport", r.transport)
+        .add("size", uint64_t{r.size})
+        .add("messages", uint64_t{r.received})
+        .add("msgs_per_sec", static_cast<double>(r.received) / r.seconds)
+        .add("mib_per_sec", mib / r.seconds)
+        .add_json("round_trip_ns", bench::histogram_json(r.round_trip))
+        .str();
+  }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Args args{argc, argv};
+  if (args.flag("--help")) {
+    std::printf(
+        "zq-shm-bench [--transports shm,ipc] [--sizes 64,256,1K,4K,16K,64K] "
+        "[--messages 100000] [--rounds 10000] [--out results.json]\n");
+    return 0;
+  }
+  const auto sizes =
+      bench::parse_sizes(args.list("--sizes", "64,256,1K,4K,16K,64K"));
+  const Config config{
+      bench::parse_size(args.value("--messages").value_or("100000"))
+          .value_or(100000),
+      bench::parse_size(args.value("--rounds").value_or("10000"))
+          .value_or(10000)};
+
+  std::vector<std::string> results;
+  for (auto transport : args.list("--transports", "shm,ipc")) {
+    for (auto size : sizes) {
+      auto result = transport == "shm" ? run_shm(size, config)
+                                       : run_ipc(size, config);
+      if (!result) {
+        std::fprintf(stderr, "%.*s %zu failed\n",
+                     static_cast<int>(transport.size()), transport.data(),
+                     size);
+        return 1;
+      }
+      std::fprintf(stderr,
+                   "%-4s %8zu B %12.0f msg/s %10.1f MiB/s rtt p50 %8llu ns "
+                   "p99 %8llu ns\n",
+                   result->transport.data(), size,
+                   static_cast<double>(result->received) / result->seconds,
+                   static_cast<double>(result->received * size) /
+                       (1 << 20) / result->seconds,
+                   static_cast<unsigned long long>(result->round_trip.p50()),
+                   static_cast<unsigned long long>(result->round_trip.p99()));
+      results.push_back(to_json(*result));
+    }
+  }
+  auto report = bench::JsonObject{}
+                    .add("benchmark", "zq-shm-bench")
+                    .add_json("results", bench::json_array(results))
+                    .str();
+  return bench::write_report(args, report) ? 0 : 1;
+}
+
+#else
+
+int main() {
+  std::fprintf(stderr, "zq-shm-bench needs Linux\n");
+  return 0;
+}
+
+#endif
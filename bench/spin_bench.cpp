@@ -0,0 +1,187 @@
+// Round trip latency with Socket::await, and with a zq::SpinReceiver
+//
+// A client sends a message to an echo thread through PAIR sockets, and
+// waits for the answer, count times. Both sides receive with
+// Socket::await, or with a SpinReceiver with each of the given spin
+// budgets. Reports the round trip latency, and how often the spin found
+// a message, as JSON.
+//
+//  zq-spin-bench [--count 100000] [--size 64] [--budgets 10,50,200]
+//                [--cpus 2,3] [--endpoint inproc://zq-spin-bench]
+//                [--out results.json]
+//
+// --budgets are in microseconds. --cpus pins the client and the echo
+// thread, spinning threads that share a cpu delay each other.
+
+#include <chrono>
+#include <cstdio>
+#include <expected>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zq/spin_recv.hpp>
+#include <zq/zq.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+  using namespace std::chrono_literals;
+
+  struct Config {
+    size_t count;
+    size_t size;
+    std::vector<int> cpus;
+    std::string endpoint;
+  };
+
+  struct Result {
+    zq::LatencyHistogram round_trip;
+    uint64_t received{0};
+    double hit_ratio{0};
+    double echo_hit_ratio{0};
+  };
+
+  // Socket::await, or a SpinReceiver
+  class Receiver {
+    std::optional<zq::SpinReceiver> spin;
+
+   public:
+    Receiver(std::optional<std::chrono::microseconds> budget,
+             std::optional<int> cpu) {
+      if (budget) {
+        spin.emplace(zq::SpinOptions{.spin_budget = *budget, .pin_cpu = cpu});
+      } else if (cpu) {
+        [[maybe_unused]] auto rc = zq::pin_current_thread(*cpu);
+      }
+    }
+
+    std::optional<std::expected<zq::TypedMessage, zq::Error>> await(
+        zq::Socket& socket) {
+      return spin ? spin->await(socket, 2000ms) : socket.await(2000ms);
+    }
+
+    [[nodiscard]] double hit_ratio() const noexcept {
+      return spin ? spin->hit_ratio() : 0.0;
+    }
+  };
+
+  std::optional<int> cpu_at(const Config& config, size_t i) {
+    if (i < config.cpus.size()) {
+      return config.cpus[i];
+    }
+    return std::nullopt;
+  }
+
+  std::optional<Result> run(const Config& config,
+                            std::optional<std::chrono::microseconds> budget) {
+    auto ctx = zq::mk_context();
+    if (!ctx) {
+      return std::nullopt;
+    }
+    auto server = ctx->bind(zq::SocketType::PAIR, config.endpoint);
+    auto client = ctx->connect(zq::SocketType::PAIR, config.endpoint);
+    if (!server || !client) {
+      std::fprintf(stderr, "can not create sockets on %s\n",
+                   config.endpoint.c_str());
+      return std::nullopt;
+    }
+
+    Result result;
+    std::thread echo{[&] {
+      Receiver receiver{budget, cpu_at(config, 1)};
+      for (size_t i = 0; i < config.count; ++i) {
+        auto msg = receiver.await(*server);
+        if (!msg || !*msg || !server->send(**msg)) {
+          return;
+        }
+      }
+      result.echo_hit_ratio = receiver.hit_ratio();
+    }};
+
+    Receiver receiver{budget, cpu_at(config, 0)};
+    const auto msg = zq::typed_message(std::string(config.size, 'z'));
+    for (size_t i = 0; i < config.count; ++i) {
+      const auto start = zq::monotonic_now_ns();
+      if (!client->send(msg)) {
+        break;
+      }
+      auto answer = receiver.await(*client);
+      if (!answer || !*answer) {
+        break;
+      }
+      result.round_trip.record(zq::monotonic_now_ns() - start);
+      ++result.received;
+    }
+    echo.join();
+    result.hit_ratio = receiver.hit_ratio();
+    return result;
+  }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Args args{argc, argv};
+  if (args.flag("--help")) {
+    std::printf(
+        "zq-spin-bench [--count 100000] [--size 64] [--budgets 10,50,200]\n"
+        "              [--cpus 2,3] [--endpoint inproc://zq-spin-bench]\n"
+        "              [--out results.json]\n");
+    return 0;
+  }
+  Config config{
+      .count = bench::parse_size(args.value("--count").value_or("100000"))
+                   .value_or(100000),
+      .size = bench::parse_size(args.value("--size").value_or("64"))
+                  .value_or(64),
+      .cpus = {},
+      .endpoint = std::string{
+          args.value("--endpoint").value_or("inproc://zq-spin-bench")},
+  };
+  for (auto cpu : bench::parse_sizes(args.list("--cpus", ""))) {
+    config.cpus.push_back(static_cast<int>(cpu));
+  }
+
+  std::vector<std::optional<std::chrono::microseconds>> modes{std::nullopt};
+  for (auto budget : bench::parse_sizes(args.list("--budgets", "10,50,200"))) {
+    modes.emplace_back(std::chrono::microseconds{budget});
+  }
+
+  std::vector<std::string> results;
+  for (const auto& budget : modes) {
+    auto result = run(config, budget);
+    if (!result) {
+      return 1;
+    }
+    const std::string mode =
+        budget ? "spin " + std::to_string(budget->count()) + "us" : "await";
+    std::fprintf(stderr,
+                 "%-10s round trip p50 %8.1f us p99 %8.1f us p99.9 %8.1f us, "
+                 "hit ratio %.3f\n",
+                 mode.c_str(),
+                 static_cast<double>(result->round_trip.p50()) / 1e3,
+                 static_cast<double>(result->round_trip.p99()) / 1e3,
+                 static_cast<double>(result->round_trip.p999()) / 1e3,
+                 result->hit_ratio);
+    results.push_back(
+        bench::JsonObject{}
+            .add("mode", mode)
+            .add("spin_budget_us",
+                 static_cast<uint64_t>(budget ? budget->count() : 0))
+            .add("size", uint64_t{config.size})
+            .add("pinned", !config.cpus.empty())
+            .add("round_trips", result->received)
+            .add("hit_ratio", result->hit_ratio)
+            .add("echo_hit_ratio", result->echo_hit_ratio)
+            .add_json("round_trip_ns",
+                      bench::histogram_json(result->round_trip))
+            .str());
+  }
+  auto report = bench::JsonObject{}
+                    .add("benchmark", "zq-spin-bench")
+                    .add_json("results", bench::json_array(results))
+                    .str();
+  return bench::write_report(args, report) ? 0 : 1;
+}
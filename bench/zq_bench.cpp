@@ -0,0 +1,574 @@
+// Throughput and latency of zq compared to plain libzmq
+//
+// Every combination of transport, pattern, api, payload size and number of
+// I/O threads given on the command line is run once, the results are
+// written as JSON.
+//
+//  zq-bench [--transports inproc,ipc,tcp] [--patterns reqrep,pushpull,pubsub]
+//           [--apis libzmq,message,typed,proto] [--sizes 8,64,1K,16M]
+//           [--io-threads 1,4] [--budget 256M] [--out results.json]
+//
+// The budget limits the bytes sent per run, the message count is derived
+// from it, between 10 and 100000 messages. ipc endpoints are files in the
+// temp directory, removed after each run.
+//
+// REQ/REP reports round trip latency, PUSH/PULL and PUB/SUB the one way
+// latency under full load, so that includes queueing.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include <zq/trace.hpp>
+#include <zq/zq.hpp>
+#ifdef ZQ_PROTO
+#include "pingpong.pb.h"
+#endif
+
+#include "bench.hpp"
+
+namespace {
+
+  using namespace std::chrono_literals;
+
+  enum class Pattern { REQREP, PUSHPULL, PUBSUB };
+
+  struct Run {
+    std::string_view transport;
+    Pattern pattern;
+    std::string_view api;
+    size_t size;
+    int io_threads;
+    size_t count;
+  };
+
+  struct Result {
+    size_t received{0};
+    double seconds{0};
+    zq::LatencyHistogram latency;
+  };
+
+  using bench::now_stamp;
+  using bench::read_stamp;
+  using bench::stamp_size;
+  using bench::write_stamp;
+
+  // wait for input, false on timeout
+  bool wait_for(zq::Socket& s, std::chrono::milliseconds timeout) {
+    auto ready = s.poll(timeout);
+    return ready && *ready;
+  }
+
+  // zq sends the last frame with ZMQ_DONTWAIT, retry if the queue is full
+  template <typename SendFunction>
+  bool send_retry(SendFunction&& send) {
+    for (;;) {
+      auto rc = send();
+      if (rc) {
+        return true;
+      }
+      if (rc.error().errNo != EAGAIN) {
+        std::fprintf(stderr, "send failed: %s\n", rc.error().what());
+        return false;
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  /**
+   * The apis below have the same interface
+   *
+   *  send(socket, payload) send the payload
+   *  recv(socket, timeout) receive, restore, and return the stamp
+   *  echo(socket, timeout) receive, restore and send back, for REP
+   *  subscribe(socket)     what a SUB socket subscribes to
+   */
+
+  // libzmq only, like src/example_c_client.cpp and example_c_server.cpp
+  struct LibzmqApi {
+    std::string buffer;
+
+    explicit LibzmqApi(size_t size) : buffer(size, '\0') {}
+
+    bool send(zq::Socket& s, const std::string& payload) {
+      return zmq_send(s.socket_ptr.get(), payload.data(), payload.size(), 0) >=
+             0;
+    }
+
+    std::optional<uint64_t> recv(zq::Socket& s,
+                                 std::chrono::milliseconds timeout) {
+      if (!wait_for(s, timeout)) {
+        return std::nullopt;
+      }
+      auto rc = zmq_recv(s.socket_ptr.get(), buffer.data(), buffer.size(), 0);
+      if (rc < static_cast<int>(stamp_size)) {
+        return std::nullopt;
+      }
+      return read_stamp(buffer.data());
+    }
+
+    bool echo(zq::Socket& s, std::chrono::milliseconds timeout) {
+      if (!wait_for(s, timeout)) {
+        return false;
+      }
+      auto rc = zmq_recv(s.socket_ptr.get(), buffer.data(), buffer.size(), 0);
+      return rc >= 0 && zmq_send(s.socket_ptr.get(), buffer.data(),
+                                 static_cast<size_t>(rc), 0) >= 0;
+    }
+
+    void subscribe(zq::Socket& s) {
+      zmq_setsockopt(s.socket_ptr.get(), ZMQ_SUBSCRIBE, "", 0);
+    }
+  };
+
+  // single frame zq::Message
+  struct MessageApi {
+    explicit MessageApi(size_t) {}
+
+    bool send(zq::Socket& s, const std::string& payload) {
+      zq::Message msg{payload.size()};
+      std::memcpy(msg.data(), payload.data(), payload.size());
+      return send_retry([&] { return s.send(msg); });
+    }
+
+    std::optional<uint64_t> recv(zq::Socket& s,
+                                 std::chrono::milliseconds timeout) {
+      if (!wait_for(s, timeout)) {
+        return std::nullopt;
+      }
+      auto msgs = s.recv_all();
+      if (!msgs || !*msgs || (*msgs)->front().size() < stamp_size) {
+        return std::nullopt;
+      }
+      return read_stamp(static_cast<const char*>((*msgs)->front().data()));
+    }
+
+    bool echo(zq::Socket& s, std::chrono::milliseconds timeout) {
+      if (!wait_for(s, timeout)) {
+        return false;
+      }
+      auto msgs = s.recv_all();
+      if (!msgs || !*msgs) {
+        return false;
+      }
+      return send_retry([&] { return s.send((*msgs)->front()); });
+    }
+
+    void subscribe(zq::Socket& s) {
+      [[maybe_unused]] auto rc = zq::subscribe(s, {});
+    }
+  };
+
+  // TypedMessage with a string payload
+  struct TypedApi {
+    explicit TypedApi(size_t) {}
+
+    bool send(zq::Socket& s, const std::string& payload) {
+      auto msg = zq::typed_message(std::string_view{payload});
+      return send_retry([&] { return s.send(msg); });
+    }
+
+    std::optional<std::string> recv_value(zq::Socket& s,
+                                          std::chrono::milliseconds timeout) {
+      auto msg = s.await(timeout);
+      if (!msg || !*msg) {
+        return std::nullopt;
+      }
+      auto value = zq::restore_as<std::string>(**msg);
+      if (!value || value->size() < stamp_size) {
+        return std::nullopt;
+      }
+      return std::move(*value);
+    }
+
+    std::optional<uint64_t> recv(zq::Socket& s,
+                                 std::chrono::milliseconds timeout) {
+      auto value = recv_value(s, timeout);
+      if (!value) {
+        return std::nullopt;
+      }
+      return read_stamp(value->data());
+    }
+
+    bool echo(zq::Socket& s, std::chrono::milliseconds timeout) {
+      auto value = recv_value(s, timeout);
+      return value && send(s, *value);
+    }
+
+    void subscribe(zq::Socket& s) {
+      [[maybe_unused]] auto rc =
+          zq::subscribe(s, {zq::wire_type_name<std::string>()});
+    }
+  };
+
+#ifdef ZQ_PROTO
+  // TypedMessage with a protobuf payload
+  struct ProtoApi {
+    explicit ProtoApi(size_t) {}
+
+    bool send(zq::Socket& s, const std::string& payload) {
+      zq::proto::Ping ping;
+      ping.set_msg(payload);
+      auto msg = zq::typed_message(ping);
+      return send_retry([&] { return s.send(msg); });
+    }
+
+    std::optional<zq::proto::Ping> recv_value(
+        zq::Socket& s,
+        std::chrono::milliseconds timeout) {
+      auto msg = s.await(timeout);
+      if (!msg || !*msg) {
+        return std::nullopt;
+      }
+      auto value = zq::restore_as<zq::proto::Ping>(**msg);
+      if (!value || value->msg().size() < stamp_size) {
+        return std::nullopt;
+      }
+      return std::move(*value);
+    }
+
+    std::optional<uint64_t> recv(zq::Socket& s,
+                                 std::chrono::milliseconds timeout) {
+      auto value = recv_value(s, timeout);
+      if (!value) {
+        return std::nullopt;
+      }
+      return read_stamp(value->msg().data());
+    }
+
+    bool echo(zq::Socket& s, std::chrono::milliseconds timeout) {
+      auto value = recv_value(s, timeout);
+      if (!value) {
+        return false;
+      }
+      auto msg = zq::typed_message(*value);
+      return send_retry([&] { return s.send(msg); });
+    }
+
+    void subscribe(zq::Socket& s) {
+      [[maybe_unused]] auto rc =
+          zq::subscribe(s, {zq::wire_type_name<zq::proto::Ping>()});
+    }
+  };
+#endif
+
+  // An ipc endpoint is a file, removed when the run is done
+  struct IpcFile {
+    std::filesystem::path path;
+
+    IpcFile() = default;
+    IpcFile(const IpcFile&) = delete;
+    IpcFile& operator=(const IpcFile&) = delete;
+    ~IpcFile() {
+      if (!path.empty()) {
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+      }
+    }
+  };
+
+  // ipc files go to the temp directory, not the working directory
+  std::string endpoint_for(std::string_view transport, IpcFile& ipc_file) {
+    static std::atomic<unsigned> counter{0};
+    const auto id = std::to_string(counter++);
+    if (transport == "inproc") {
+      return "inproc://zq-bench-" + id;
+    }
+    if (transport == "ipc") {
+      std::error_code ec;
+      auto dir = std::filesystem::temp_directory_path(ec);
+      if (ec) {
+        dir = ".";
+      }
+      ipc_file.path = dir / ("zq-bench-" + id);
+      return "ipc://" + ipc_file.path.string();
+    }
+    return "tcp://127.0.0.1:*";
+  }
+
+  std::optional<std::string> last_endpoint(zq::Socket& s) {
+    char buf[256];
+    size_t size = sizeof(buf);
+    if (zmq_getsockopt(s.socket_ptr.get(), ZMQ_LAST_ENDPOINT, buf,
+                       std::addressof(size)) != 0) {
+      return std::nullopt;
+    }
+    return std::string{buf};
+  }
+
+  void set_unlimited_hwm(zq::Socket& s) {
+    int hwm = 0;
+    zmq_setsockopt(s.socket_ptr.get(), ZMQ_SNDHWM, &hwm, sizeof(hwm));
+    zmq_setsockopt(s.socket_ptr.get(), ZMQ_RCVHWM, &hwm, sizeof(hwm));
+  }
+
+  struct Sockets {
+    zq::Socket server;  // bound
+    zq::Socket client;  // connected
+  };
+
+  std::optional<Sockets> mk_sockets(zq::Context& ctx,
+                                    const Run& run,
+                                    const std::string& bind_endpoint) {
+    using zq::SocketType;
+    auto [bind_type, connect_type] =
+        run.pattern == Pattern::REQREP     ? std::pair{SocketType::REP,
+                                                   SocketType::REQ}
+        : run.pattern == Pattern::PUSHPULL ? std::pair{SocketType::PULL,
+                                                       SocketType::PUSH}
+                                           : std::pair{SocketType::PUB,
+                                                       SocketType::SUB};
+    auto server = ctx.socket(bind_type);
+    auto client = ctx.socket(connect_type);
+    if (!server || !client) {
+      return std::nullopt;
+    }
+    if (run.pattern == Pattern::PUBSUB) {
+      // PUB drops what does not fit, measure the transport, not the drops
+      set_unlimited_hwm(*server);
+      set_unlimited_hwm(*client);
+    }
+    if (auto rc = server->bind(bind_endpoint); !rc) {
+      std::fprintf(stderr, "bind failed: %s\n", rc.error().what());
+      return std::nullopt;
+    }
+    auto endpoint = last_endpoint(*server);
+    if (!endpoint || !client->connect(*endpoint)) {
+      return std::nullopt;
+    }
+    return Sockets{std::move(*server), std::move(*client)};
+  }
+
+  template <typename Api>
+  Result run_reqrep(Sockets& sockets, const Run& run) {
+    Result result;
+    std::thread server{[&] {
+      Api api{run.size};
+      for (size_t i = 0; i < run.count; ++i) {
+        if (!api.echo(sockets.server, 2000ms)) {
+          return;
+        }
+      }
+    }};
+    Api api{run.size};
+    std::string payload(run.size, 'z');
+    const auto start = zq::monotonic_now_ns();
+    for (size_t i = 0; i < run.count; ++i) {
+      const auto sent = now_stamp();
+      write_stamp(payload.data(), sent);
+      if (!api.send(sockets.client, payload)) {
+        break;
+      }
+      if (!api.recv(sockets.client, 2000ms)) {
+        break;
+      }
+      result.latency.record(now_stamp() - sent);
+      ++result.received;
+    }
+    const auto end = zq::monotonic_now_ns();
+    server.join();
+    result.seconds = static_cast<double>(end - start) / 1e9;
+    return result;
+  }
+
+  template <typename Api>
+  Result run_one_way(zq::Socket& sender, zq::Socket& receiver, const Run& run) {
+    Result result;
+    std::atomic<bool> ready{false};
+    uint64_t last_received = 0;
+    std::thread receiving{[&] {
+      Api api{run.size};
+      while (result.received < run.count) {
+        auto stamp = api.recv(receiver, 2000ms);
+        if (!stamp) {
+          return;
+        }
+        if (*stamp == 0) {
+          ready = true;
+          continue;
+        }
+        last_received = zq::monotonic_now_ns();
+        result.latency.record(now_stamp() - *stamp);
+        ++result.received;
+      }
+    }};
+    Api api{run.size};
+    std::string payload(run.size, 'z');
+    // warm up until the connection and subscriptions are in place
+    write_stamp(payload.data(), 0);
+    for (int i = 0; !ready && i < 2000; ++i) {
+      api.send(sender, payload);
+      std::this_thread::sleep_for(1ms);
+    }
+    const auto start = zq::monotonic_now_ns();
+    for (size_t i = 0; ready && i < run.count; ++i) {
+      write_stamp(payload.data(), now_stamp());
+      if (!api.send(sender, payload)) {
+        break;
+      }
+    }
+    receiving.join();
+    if (last_received > start) {
+      result.seconds = static_cast<double>(last_received - start) / 1e9;
+    }
+    return result;
+  }
+
+  template <typename Api>
+  std::optional<Result> execute(const Run& run) {
+    // declared first, so the file is removed after the sockets are closed
+    IpcFile ipc_file;
+    const auto endpoint = endpoint_for(run.transport, ipc_file);
+    const std::array options{
+        zq::ContextOption{zq::CtxOptionName::IO_THREADS, run.io_threads}};
+    auto ctx = zq::mk_context(options);
+    if (!ctx) {
+      return std::nullopt;
+    }
+    auto sockets = mk_sockets(*ctx, run, endpoint);
+    if (!sockets) {
+      return std::nullopt;
+    }
+    switch (run.pattern) {
+      case Pattern::REQREP:
+        return run_reqrep<Api>(*sockets, run);
+      case Pattern::PUSHPULL:
+        return run_one_way<Api>(sockets->client, sockets->server, run);
+      case Pattern::PUBSUB:
+        Api{run.size}.subscribe(sockets->client);
+        return run_one_way<Api>(sockets->server, sockets->client, run);
+    }
+    return std::nullopt;
+  }
+
+  std::optional<Result> execute_api(const Run& run) {
+    if (run.api == "libzmq") {
+      return execute<LibzmqApi>(run);
+    }
+    if (run.api == "message") {
+      return execute<MessageApi>(run);
+    }
+    if (run.api == "typed") {
+      return execute<TypedApi>(run);
+    }
+#ifdef ZQ_PROTO
+    if (run.api == "proto") {
+      return execute<ProtoApi>(run);
+    }
+#endif
+    return std::nullopt;
+  }
+
+  std::optional<Pattern> pattern_of(std::string_view name) {
+    if (name == "reqrep") {
+      return Pattern::REQREP;
+    }
+    if (name == "pushpull") {
+      return Pattern::PUSHPULL;
+    }
+    if (name == "pubsub") {
+      return Pattern::PUBSUB;
+    }
+    return std::nullopt;
+  }
+
+  std::string result_json(const Run& run,
+                          std::string_view pattern,
+                          const Result& result) {
+    const double seconds = result.seconds > 0 ? result.seconds : 1e-9;
+    const double msgs = static_cast<double>(result.received);
+    return bench::JsonObject{}
+        .add("transport", run.transport)
+        .add("pattern", pattern)
+        .add("api", run.api)
+        .add("size", uint64_t{run.size})
+        .add("io_threads", static_cast<uint64_t>(run.io_threads))
+        .add("messages", uint64_t{run.count})
+        .add("received", uint64_t{result.received})
+        .add("seconds", result.seconds)
+        .add("msgs_per_sec", msgs / seconds)
+        .add("mb_per_sec", msgs * static_cast<double>(run.size) / seconds / 1e6)
+        .add("latency", run.pattern == Pattern::REQREP ? "round_trip"
+                                                       : "one_way")
+        .add_json("latency_ns", bench::histogram_json(result.latency))
+        .str();
+  }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Args args{argc, argv};
+  if (args.flag("--help")) {
+    std::printf(
+        "zq-bench [--transports inproc,ipc,tcp] "
+        "[--patterns reqrep,pushpull,pubsub]\n"
+        "         [--apis libzmq,message,typed,proto] [--sizes 8,64,1K,16M]\n"
+        "         [--io-threads 1,4] [--budget 256M] [--out file.json]\n");
+    return 0;
+  }
+#ifdef ZQ_PROTO
+  constexpr auto default_apis = "libzmq,message,typed,proto";
+#else
+  constexpr auto default_apis = "libzmq,message,typed";
+#endif
+  const auto transports = args.list("--transports", "inproc,ipc,tcp");
+  const auto patterns = args.list("--patterns", "reqrep,pushpull,pubsub");
+  const auto apis = args.list("--apis", default_apis);
+  const auto sizes =
+      bench::parse_sizes(args.list("--sizes", "8,64,1K,16K,256K,1M,16M"));
+  const auto threads = args.list("--io-threads", "1,4");
+  const auto budget =
+      bench::parse_size(args.value("--budget").value_or("256M")).value_or(0);
+
+  std::vector<std::string> results;
+  int failed = 0;
+  for (auto transport : transports) {
+    for (auto pattern_name : patterns) {
+      auto pattern = pattern_of(pattern_name);
+      if (!pattern) {
+        std::fprintf(stderr, "unknown pattern: %.*s\n",
+                     static_cast<int>(pattern_name.size()),
+                     pattern_name.data());
+        continue;
+      }
+      for (auto api : apis) {
+        for (auto size : sizes) {
+          for (auto thread_count : threads) {
+            Run run{transport, *pattern, api, std::max(size, stamp_size),
+                    std::atoi(std::string{thread_count}.c_str()), 0};
+            // round trips take longer, send less
+            const size_t per_run =
+                *pattern == Pattern::REQREP ? budget / 4 : budget;
+            run.count = std::clamp<size_t>(per_run / run.size, 10, 100000);
+            std::fprintf(stderr, "%.*s %.*s %.*s %zu bytes, %d io threads\n",
+                         static_cast<int>(transport.size()), transport.data(),
+                         static_cast<int>(pattern_name.size()),
+                         pattern_name.data(), static_cast<int>(api.size()),
+                         api.data(), run.size, run.io_threads);
+            auto result = execute_api(run);
+            if (!result) {
+              std::fprintf(stderr, "  failed\n");
+              ++failed;
+              continue;
+            }
+            results.push_back(result_json(run, pattern_name, *result));
+          }
+        }
+      }
+    }
+  }
+  auto report = bench::JsonObject{}
+                    .add("benchmark", "zq-bench")
+                    .add_json("results", bench::json_array(results))
+                    .str();
+  if (!bench::write_report(args, report)) {
+    return 1;
+  }
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,602 @@
+// zq-perf, a load generator and a sink that speak zq TypedMessages
+//
+// Like libzmq's remote_thr and local_thr, one process generates load and
+// another one receives it. Both sides use zq::Context and zq::Socket, so
+// what is measured is the code path of an application.
+//
+//  zq-perf load --endpoint tcp://127.0.0.1:5555 [--type push|pub|req]
+//               [--bind] [--payload string|proto] [--size 64] [--rate 0]
+//               [--duration 10] [--connections 1] [--io-threads 1]
+//               [--interval 1] [--out results.json]
+//  zq-perf sink --endpoint tcp://*:5555 [--type pull|sub|rep] [--connect]
+//               [--payload string|proto] [--duration 0] [--idle 2]
+//               [--connections 1] [--io-threads 1] [--interval 1]
+//               [--out results.json]
+//
+// The transport is the one of the endpoint, tcp://, ipc://, ...
+// load connects and sink binds, unless --bind or --connect is given.
+// Every connection is a socket with its own thread. Only the connecting
+// side can have more than one, all connect to the one bound socket.
+// --rate is messages per second over all connections, 0 is as fast as
+// possible. A rate limited sender stamps a message with the time it was
+// scheduled for, not sent, so the latency includes falling behind.
+// The sink stops after --duration seconds from the first message, or when
+// nothing came for --idle seconds, 0 disables either. Ctrl-C stops both.
+//
+// Throughput and latency are printed every interval, and at the end as
+// JSON. For req, load measures the round trip, for pull and sub, sink
+// measures the one way latency. That uses the monotonic clock, it is only
+// meaningful with both sides on one host.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <expected>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <zq/zq.hpp>
+#ifdef ZQ_PROTO
+#include "pingpong.pb.h"
+#endif
+
+#include "bench.hpp"
+
+namespace {
+
+  using namespace std::chrono_literals;
+
+  struct Config {
+    bool load;
+    zq::SocketType type;
+    std::string_view type_name;
+    std::string endpoint;
+    bool bind;
+    std::string_view payload;
+    size_t size;
+    double rate;
+    double duration;
+    double idle;
+    size_t connections;
+    int io_threads;
+    double interval;
+  };
+
+  struct TypeName {
+    std::string_view name;
+    zq::SocketType type;
+    bool load;
+  };
+
+  constexpr std::array socket_types{
+      TypeName{"push", zq::SocketType::PUSH, true},
+      TypeName{"pub", zq::SocketType::PUB, true},
+      TypeName{"req", zq::SocketType::REQ, true},
+      TypeName{"pull", zq::SocketType::PULL, false},
+      TypeName{"sub", zq::SocketType::SUB, false},
+      TypeName{"rep", zq::SocketType::REP, false},
+  };
+
+  std::atomic<bool> interrupted{false};
+
+  extern "C" void on_interrupt(int) {
+    interrupted = true;
+  }
+
+  // What the connections count, the main thread reports it
+  struct Stats {
+    std::mutex mutex;
+    uint64_t messages{0};
+    uint64_t bytes{0};
+    uint64_t errors{0};
+    uint64_t first_message_ns{0};
+    uint64_t last_message_ns{0};
+    zq::LatencyHistogram interval;
+    zq::LatencyHistogram total;
+  };
+
+  // Counted by one connection, and added to Stats now and then,
+  // so the lock is rare
+  struct Counts {
+    static constexpr uint64_t flush_every_ns = 10'000'000;
+
+    uint64_t messages{0};
+    uint64_t bytes{0};
+    uint64_t errors{0};
+    uint64_t first_message_ns{0};
+    uint64_t last_message_ns{0};
+    zq::LatencyHistogram latency;
+    uint64_t flushed_ns{0};
+
+    void count(size_t size, uint64_t now) noexcept {
+      if (first_message_ns == 0) {
+        first_message_ns = now;
+      }
+      ++messages;
+      bytes += size;
+      last_message_ns = now;
+    }
+
+    void flush(Stats& stats, uint64_t now) {
+      std::scoped_lock lock{stats.mutex};
+      stats.messages += messages;
+      stats.bytes += bytes;
+      stats.errors += errors;
+      if (first_message_ns != 0 && (stats.first_message_ns == 0 ||
+                                    first_message_ns < stats.first_message_ns)) {
+        stats.first_message_ns = first_message_ns;
+      }
+      stats.last_message_ns = std::max(stats.last_message_ns, last_message_ns);
+      if (latency.count() > 0) {
+        stats.interval.merge(latency);
+        stats.total.merge(latency);
+        latency.reset();
+      }
+      messages = 0;
+      bytes = 0;
+      errors = 0;
+      flushed_ns = now;
+    }
+
+    void flush_if_due(Stats& stats, uint64_t now) {
+      if (now - flushed_ns >= flush_every_ns) {
+        flush(stats, now);
+      }
+    }
+  };
+
+  /**
+   * The payloads below have the same interface
+   *
+   *  make(stamp)    a typed message with the stamp at the payload start
+   *  stamp_of(msg)  restore the message, and return its stamp
+   *  topic()        what a SUB socket subscribes to
+   */
+
+  struct StringPayload {
+    std::string content;
+
+    explicit StringPayload(size_t size) : content(size, 'z') {}
+
+    zq::TypedMessage make(uint64_t stamp) {
+      bench::write_stamp(content.data(), stamp);
+      return zq::typed_message(std::string_view{content});
+    }
+
+    static std::optional<uint64_t> stamp_of(const zq::TypedMessage& msg) {
+      auto value = zq::restore_as<std::string>(msg);
+      if (!value || value->size() < bench::stamp_size) {
+        return std::nullopt;
+      }
+      return bench::read_stamp(value->data());
+    }
+
+    static std::string_view topic() {
+      return zq::wire_type_name<std::string>();
+    }
+  };
+
+#ifdef ZQ_PROTO
+  struct ProtoPayload {
+    zq::proto::Ping ping;
+
+    explicit ProtoPayload(size_t size) { ping.set_msg(std::string(size, 'z')); }
+
+    zq::TypedMessage make(uint64_t stamp) {
+      bench::write_stamp(ping.mutable_msg()->data(), stamp);
+      return zq::typed_message(ping);
+    }
+
+    static std::optional<uint64_t> stamp_of(const zq::TypedMessage& msg) {
+      auto value = zq::restore_as<zq::proto::Ping>(msg);
+      if (!value || value->msg().size() < bench::stamp_size) {
+        return std::nullopt;
+      }
+      return bench::read_stamp(value->msg().data());
+    }
+
+    static std::string_view topic() {
+      return zq::wire_type_name<zq::proto::Ping>();
+    }
+  };
+#endif
+
+  // the difference of two stamps, they wrap around after 2^56 ns
+  uint64_t stamp_distance(uint64_t from, uint64_t to) noexcept {
+    return bench::to_stamp(to - from);
+  }
+
+  // zq sends the last frame with ZMQ_DONTWAIT, retry while the queue is full
+  bool send(zq::Socket& socket,
+            const zq::TypedMessage& msg,
+            const std::atomic<bool>& stop) {
+    for (;;) {
+      auto rc = socket.send(msg);
+      if (rc) {
+        return true;
+      }
+      if (rc.error().errNo != EAGAIN || stop.load(std::memory_order_relaxed)) {
+        return false;
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  // wait until the next message is due, false if stopped meanwhile
+  bool pace(uint64_t due, const std::atomic<bool>& stop) {
+    for (auto now = zq::monotonic_now_ns(); now < due;
+         now = zq::monotonic_now_ns()) {
+      if (stop.load(std::memory_order_relaxed)) {
+        return false;
+      }
+      const auto ahead = due - now;
+      if (ahead > 200'000) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds{ahead - 100'000});
+      } else {
+        std::this_thread::yield();
+      }
+    }
+    return true;
+  }
+
+  template <typename Payload>
+  void generate(zq::Socket& socket,
+                const Config& config,
+                Stats& stats,
+                const std::atomic<bool>& stop) {
+    Payload payload{config.size};
+    Counts counts;
+    const double rate = config.rate / static_cast<double>(config.connections);
+    const auto period_ns = rate > 0 ? static_cast<uint64_t>(1e9 / rate) : 0;
+    const bool round_trip = config.type == zq::SocketType::REQ;
+    auto due = zq::monotonic_now_ns();
+    while (!stop.load(std::memory_order_relaxed)) {
+      if (period_ns > 0 && !pace(due, stop)) {
+        break;
+      }
+      const auto sent = period_ns > 0 ? due : zq::monotonic_now_ns();
+      due += period_ns;
+      if (!send(socket, payload.make(bench::to_stamp(sent)), stop)) {
+        ++counts.errors;
+        break;
+      }
+      if (round_trip) {
+        std::optional<std::expected<zq::TypedMessage, zq::Error>> reply;
+        while (!reply && !stop.load(std::memory_order_relaxed)) {
+          reply = socket.await(100ms);
+        }
+        if (!reply) {
+          break;
+        }
+        auto stamp = *reply ? Payload::stamp_of(**reply) : std::nullopt;
+        if (!stamp) {
+          ++counts.errors;
+          break;
+        }
+        counts.latency.record(stamp_distance(*stamp, bench::now_stamp()));
+      }
+      const auto now = zq::monotonic_now_ns();
+      counts.count(config.size, now);
+      counts.flush_if_due(stats, now);
+    }
+    counts.flush(stats, zq::monotonic_now_ns());
+  }
+
+  template <typename Payload>
+  void receive(zq::Socket& socket,
+               const Config& config,
+               Stats& stats,
+               const std::atomic<bool>& stop) {
+    Counts counts;
+    if (config.type == zq::SocketType::SUB &&
+        !zq::subscribe(socket, {Payload::topic()})) {
+      ++counts.errors;
+    }
+    const bool echo = config.type == zq::SocketType::REP;
+    while (!stop.load(std::memory_order_relaxed)) {
+      auto msg = socket.await(100ms);
+      const auto now = zq::monotonic_now_ns();
+      counts.flush_if_due(stats, now);
+      if (!msg) {
+        continue;
+      }
+      if (!*msg) {
+        ++counts.errors;
+        continue;
+      }
+      auto stamp = Payload::stamp_of(**msg);
+      if (!stamp) {
+        ++counts.errors;
+      } else if (!echo && *stamp != 0) {
+        counts.latency.record(
+            stamp_distance(*stamp, bench::to_stamp(zq::monotonic_now_ns())));
+      }
+      if (echo && !send(socket, **msg, stop)) {
+        ++counts.errors;
+      }
+      counts.count((*msg)->payload.size(), now);
+    }
+    counts.flush(stats, zq::monotonic_now_ns());
+  }
+
+  void print_line(double elapsed,
+                  double seconds,
+                  uint64_t messages,
+                  uint64_t bytes,
+                  uint64_t errors,
+                  const zq::LatencyHistogram& latency) {
+    seconds = seconds > 0 ? seconds : 1e-9;
+    std::fprintf(stderr, "%7.1fs %12.0f msg/s %10.1f MB/s", elapsed,
+                 static_cast<double>(messages) / seconds,
+                 static_cast<double>(bytes) / seconds / 1e6);
+    if (latency.count() > 0) {
+      std::fprintf(stderr, "  p50 %9.1f us  p99 %9.1f us  p99.9 %9.1f us",
+                   static_cast<double>(latency.p50()) / 1e3,
+                   static_cast<double>(latency.p99()) / 1e3,
+                   static_cast<double>(latency.p999()) / 1e3);
+    }
+    if (errors > 0) {
+      std::fprintf(stderr, "  %llu errors",
+                   static_cast<unsigned long long>(errors));
+    }
+    std::fprintf(stderr, "\n");
+  }
+
+  std::string result_json(const Config& config,
+                          double seconds,
+                          const Stats& stats) {
+    const double s = seconds > 0 ? seconds : 1e-9;
+    const auto latency = stats.total.count() == 0 ? "none"
+                         : config.load          ? "round_trip"
+                                                : "one_way";
+    bench::JsonObject json;
+    json.add("benchmark", "zq-perf")
+        .add("mode", config.load ? "load" : "sink")
+        .add("type", config.type_name)
+        .add("endpoint", config.endpoint)
+        .add("payload", config.payload);
+    // the sink gets what the load sends
+    if (config.load) {
+      json.add("size", uint64_t{config.size}).add("rate", config.rate);
+    }
+    return json.add("connections", uint64_t{config.connections})
+        .add("io_threads", static_cast<uint64_t>(config.io_threads))
+        .add("messages", stats.messages)
+        .add("errors", stats.errors)
+        .add("seconds", seconds)
+        .add("msgs_per_sec", static_cast<double>(stats.messages) / s)
+        .add("mb_per_sec", static_cast<double>(stats.bytes) / s / 1e6)
+        .add("latency", latency)
+        .add_json("latency_ns", bench::histogram_json(stats.total))
+        .str();
+  }
+
+  template <typename Payload>
+  int run(const Config& config,
+          std::vector<zq::Socket>& sockets,
+          const bench::Args& args) {
+    Stats stats;
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> threads;
+    for (auto& socket : sockets) {
+      threads.emplace_back([&config, &socket, &stats, &stop] {
+        if (config.load) {
+          generate<Payload>(socket, config, stats, stop);
+        } else {
+          receive<Payload>(socket, config, stats, stop);
+        }
+      });
+    }
+
+    const auto to_ns = [](double seconds) {
+      return static_cast<uint64_t>(seconds * 1e9);
+    };
+    const auto start = zq::monotonic_now_ns();
+    // the sink measures from the first message on
+    uint64_t first_message_ns = config.load ? start : 0;
+    uint64_t reported_ns = start;
+    uint64_t reported_messages = 0;
+    uint64_t reported_bytes = 0;
+    uint64_t reported_errors = 0;
+    while (!interrupted) {
+      std::this_thread::sleep_for(50ms);
+      const auto now = zq::monotonic_now_ns();
+      std::scoped_lock lock{stats.mutex};
+      if (first_message_ns == 0 && stats.first_message_ns != 0) {
+        first_message_ns = stats.first_message_ns;
+        reported_ns = first_message_ns;
+      }
+      if (first_message_ns != 0 &&
+          now - reported_ns >= to_ns(config.interval)) {
+        print_line(static_cast<double>(now - first_message_ns) / 1e9,
+                   static_cast<double>(now - reported_ns) / 1e9,
+                   stats.messages - reported_messages,
+                   stats.bytes - reported_bytes,
+                   stats.errors - reported_errors, stats.interval);
+        stats.interval.reset();
+        reported_ns = now;
+        reported_messages = stats.messages;
+        reported_bytes = stats.bytes;
+        reported_errors = stats.errors;
+      }
+      if (first_message_ns == 0) {
+        continue;
+      }
+      if (config.duration > 0 &&
+          now - first_message_ns >= to_ns(config.duration)) {
+        break;
+      }
+      if (!config.load && config.idle > 0 &&
+          now - stats.last_message_ns >= to_ns(config.idle)) {
+        break;
+      }
+    }
+    stop = true;
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    const auto end = config.load ? zq::monotonic_now_ns()
+                                 : std::max(stats.last_message_ns,
+                                            first_message_ns);
+    const auto seconds =
+        first_message_ns == 0
+            ? 0.0
+            : static_cast<double>(end - first_message_ns) / 1e9;
+    std::fprintf(stderr, "total\n");
+    print_line(seconds, seconds, stats.messages, stats.bytes, stats.errors,
+               stats.total);
+    if (!bench::write_report(args, result_json(config, seconds, stats))) {
+      return 1;
+    }
+    return stats.errors == 0 ? 0 : 1;
+  }
+
+  std::optional<zq::Socket> open_socket(zq::Context& ctx,
+                                        const Config& config) {
+    auto socket = ctx.socket(config.type);
+    if (!socket) {
+      std::fprintf(stderr, "socket: %s\n", socket.error().what());
+      return std::nullopt;
+    }
+    if (config.type == zq::SocketType::PUB ||
+        config.type == zq::SocketType::SUB) {
+      // PUB drops what does not fit, measure the peer, not the drops
+      int hwm = 0;
+      zmq_setsockopt(socket->socket_ptr.get(), ZMQ_SNDHWM, &hwm, sizeof(hwm));
+      zmq_setsockopt(socket->socket_ptr.get(), ZMQ_RCVHWM, &hwm, sizeof(hwm));
+    }
+    auto rc = config.bind ? socket->bind(config.endpoint)
+                          : socket->connect(config.endpoint);
+    if (!rc) {
+      std::fprintf(stderr, "%s %s: %s\n", config.bind ? "bind" : "connect",
+                   config.endpoint.c_str(), rc.error().what());
+      return std::nullopt;
+    }
+    return std::move(*socket);
+  }
+
+  double number(const bench::Args& args,
+                std::string_view name,
+                double default_value) {
+    auto text = args.value(name);
+    if (!text) {
+      return default_value;
+    }
+    double value = 0;
+    auto [end, ec] =
+        std::from_chars(text->data(), text->data() + text->size(), value);
+    if (ec != std::errc{} || end != text->data() + text->size() || value < 0) {
+      std::fprintf(stderr, "ignoring invalid %.*s: %.*s\n",
+                   static_cast<int>(name.size()), name.data(),
+                   static_cast<int>(text->size()), text->data());
+      return default_value;
+    }
+    return value;
+  }
+
+  constexpr auto usage =
+      "zq-perf load --endpoint tcp://127.0.0.1:5555 [--type push|pub|req]\n"
+      "             [--bind] [--payload string|proto] [--size 64] "
+      "[--rate 0]\n"
+      "             [--duration 10] [--connections 1] [--io-threads 1]\n"
+      "             [--interval 1] [--out results.json]\n"
+      "zq-perf sink --endpoint tcp://*:5555 [--type pull|sub|rep] "
+      "[--connect]\n"
+      "             [--payload string|proto] [--duration 0] [--idle 2]\n"
+      "             [--connections 1] [--io-threads 1] [--interval 1]\n"
+      "             [--out results.json]\n"
+      "--connections > 1 needs the connecting side, load without --bind,\n"
+      "sink with --connect\n";
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Args args{argc, argv};
+  const std::string_view mode = argc > 1 ? argv[1] : "";
+  if (args.flag("--help") || (mode != "load" && mode != "sink")) {
+    std::printf("%s", usage);
+    return args.flag("--help") ? 0 : 1;
+  }
+  const bool load = mode == "load";
+  const auto type_name = args.value("--type").value_or(load ? "push" : "pull");
+  const auto* type = std::find_if(
+      socket_types.begin(), socket_types.end(),
+      [&](const TypeName& t) { return t.name == type_name && t.load == load; });
+  if (type == socket_types.end()) {
+    std::fprintf(stderr, "%.*s can not %s\n",
+                 static_cast<int>(type_name.size()), type_name.data(),
+                 load ? "generate load" : "be a sink");
+    return 1;
+  }
+  const auto endpoint = args.value("--endpoint");
+  if (!endpoint) {
+    std::fprintf(stderr, "--endpoint is missing\n");
+    return 1;
+  }
+
+  Config config{
+      .load = load,
+      .type = type->type,
+      .type_name = type->name,
+      .endpoint = std::string{*endpoint},
+      .bind = load ? args.flag("--bind") : !args.flag("--connect"),
+      .payload = args.value("--payload").value_or("string"),
+      .size = std::max(
+          bench::parse_size(args.value("--size").value_or("64")).value_or(64),
+          bench::stamp_size),
+      .rate = number(args, "--rate", 0),
+      .duration = number(args, "--duration", load ? 10 : 0),
+      .idle = number(args, "--idle", 2),
+      .connections = std::max<size_t>(
+          static_cast<size_t>(number(args, "--connections", 1)), 1),
+      .io_threads = static_cast<int>(number(args, "--io-threads", 1)),
+      .interval = std::max(number(args, "--interval", 1), 0.1),
+  };
+
+  if (config.bind && config.connections > 1) {
+    // more sockets can not bind the same endpoint
+    std::fprintf(stderr, "--connections %zu needs the connecting side, %s\n",
+                 config.connections,
+                 load ? "load without --bind" : "sink with --connect");
+    return 1;
+  }
+
+  const std::array options{
+      zq::ContextOption{zq::CtxOptionName::IO_THREADS, config.io_threads}};
+  auto ctx = zq::mk_context(options);
+  if (!ctx) {
+    std::fprintf(stderr, "context: %s\n", ctx.error().what());
+    return 1;
+  }
+  std::vector<zq::Socket> sockets;
+  for (size_t i = 0; i < config.connections; ++i) {
+    auto socket = open_socket(*ctx, config);
+    if (!socket) {
+      return 1;
+    }
+    sockets.push_back(std::move(*socket));
+  }
+
+  std::signal(SIGINT, on_interrupt);
+  std::signal(SIGTERM, on_interrupt);
+  if (config.payload == "string") {
+    return run<StringPayload>(config, sockets, args);
+  }
+#ifdef ZQ_PROTO
+  if (config.payload == "proto") {
+    return run<ProtoPayload>(config, sockets, args);
+  }
+#endif
+  std::fprintf(stderr, "unknown payload: %.*s\n",
+               static_cast<int>(config.payload.size()), config.payload.data());
+  return 1;
+}
@@ -0,0 +1,452 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "error.hpp"
+#include "message.hpp"
+#include "meta.hpp"
+#include "socket.hpp"
+#include "trace.hpp"
+
+namespace zq {
+
+  /**
+   * @brief Settings of a BatchingSender
+   *
+   * A batch is sent when one of the limits is reached, whichever first.
+   */
+  struct BatchOptions {
+    /// payload bytes of a batch
+    size_t max_bytes{64 * 1024};
+    /// messages in a batch
+    size_t max_count{256};
+    /// the latency bound, how long a message may wait in a batch
+    std::chrono::microseconds max_delay{200};
+    /// adapt the count limit to the rate, see BatchingSender
+    bool adaptive{true};
+  };
+
+  namespace detail {
+
+    // each message in a batch is [payload size][meta size][payload][meta],
+    // sizes are 32 bit, in the byte order of the host, like meta records
+    inline constexpr size_t batch_entry_header = 2 * sizeof(uint32_t);
+
+    struct Batch {
+      Message type;
+      std::vector<std::byte> content;
+      size_t count{0};
+      uint64_t first_ns{0};
+
+      void append(const TypedMessage& msg, uint64_t now) {
+        if (count == 0) {
+          first_ns = now;
+        }
+        const auto payload_size = static_cast<uint32_t>(msg.payload.size());
+        const auto meta_size = static_cast<uint32_t>(msg.meta.size());
+        const auto offset = content.size();
+        content.resize(offset + batch_entry_header + payload_size + meta_size);
+        auto* out = content.data() + offset;
+        std::memcpy(out, &payload_size, sizeof(payload_size));
+        std::memcpy(out + sizeof(payload_size), &meta_size, sizeof(meta_size));
+        out += batch_entry_header;
+        if (payload_size > 0) {
+          std::memcpy(out, msg.payload.data(), payload_size);
+        }
+        if (meta_size > 0) {
+          std::memcpy(out + payload_size, msg.meta.data(), meta_size);
+        }
+        ++count;
+      }
+
+      [[nodiscard]] TypedMessage take() {
+        Message payload{content.size()};
+        if (!content.empty()) {
+          std::memcpy(payload.data(), content.data(), content.size());
+        }
+        TypedMessage msg{shared_copy(type), std::move(payload),
+                         meta_message({{MetaTag::BATCH, count}})};
+        content.clear();
+        count = 0;
+        return msg;
+      }
+    };
+
+  }  // namespace detail
+
+  /**
+   * @brief true if the message is a batch of messages
+   *
+   * @param msg
+   * @return bool
+   */
+  [[nodiscard]] inline bool is_batch(const TypedMessage& msg) noexcept {
+    return msg.meta.size() != 0 && get_meta(msg, MetaTag::BATCH).has_value();
+  }
+
+  /**
+   * @brief Split a batch into its messages
+   *
+   * The messages are appended to out, a message that is no batch is moved
+   * there as it is.
+   *
+   * @param msg
+   * @param out
+   * @return std::expected<void, ZqError> an error if the batch is damaged,
+   *         out holds the messages up to the damage then
+   */
+  inline auto unbatch(TypedMessage msg, std::vector<TypedMessage>& out)
+      -> std::expected<void, ZqError> {
+    const auto count = get_meta(msg, MetaTag::BATCH);
+    if (!count) {
+      out.push_back(std::move(msg));
+      return {};
+    }
+    const auto* data = static_cast<const std::byte*>(msg.payload.data());
+    const auto* end = data + msg.payload.size();
+    for (uint64_t i = 0; i < *count; ++i) {
+      uint32_t payload_size = 0;
+      uint32_t meta_size = 0;
+      if (static_cast<size_t>(end - data) < detail::batch_entry_header) {
+        return std::unexpected(ZqError("batch is truncated"));
+      }
+      std::memcpy(&payload_size, data, sizeof(payload_size));
+      std::memcpy(&meta_size, data + sizeof(payload_size), sizeof(meta_size));
+      data += detail::batch_entry_header;
+      if (static_cast<size_t>(end - data) <
+          size_t{payload_size} + size_t{meta_size}) {
+        return std::unexpected(ZqError("batch is truncated"));
+      }
+      Message payload{payload_size};
+      if (payload_size > 0) {
+        std::memcpy(payload.data(), data, payload_size);
+      }
+      Message meta{meta_size};
+      if (meta_size > 0) {
+        std::memcpy(meta.data(), data + payload_size, meta_size);
+      }
+      data += payload_size + meta_size;
+      out.emplace_back(shared_copy(msg.type), std::move(payload),
+                       std::move(meta));
+    }
+    return {};
+  }
+
+  /**
+   * @brief Sends typed messages in batches, in the style of Nagle
+   *
+   * Many tiny messages cost one libzmq enqueue and one frame each. The
+   * sender collects messages into one batch per type, and sends a batch
+   * when it has max_bytes, max_count messages, or its oldest message
+   * waited max_delay, whichever comes first. A batch keeps the type of its
+   * messages, so subscriptions work as before, and it is marked with a
+   * MetaTag::BATCH record, BatchReceiver splits it again. Every consumer
+   * needs a BatchReceiver, restore_as rejects a batch with an error.
+   *
+   * With adaptive, the sender measures the rate of messages. If fewer than
+   * two messages are expected within max_delay, a batch would only add
+   * latency, messages are sent right away. Otherwise the count limit is
+   * what is expected within max_delay, so batches fill up before they are
+   * due.
+   *
+   * The order is kept per type only. Batches of different types fill up
+   * and are sent independently, so messages of one type can overtake
+   * messages of another one. Send types that must stay in order through
+   * different senders, or call flush before switching the type.
+   *
+   * There is no thread, the delay is checked on send, and by flush_if_due.
+   * Call that when idle, for instance with time_to_flush as poll timeout,
+   * or messages wait until the next send. The destructor sends what is
+   * still batched, if the socket takes it without blocking, call flush
+   * before to be sure nothing is lost.
+   * Like a socket, a sender must be used by one thread at a time.
+   */
+  class BatchingSender {
+    Socket socket_;
+    BatchOptions options;
+    std::vector<detail::Batch> batches;
+    uint64_t max_delay_ns;
+    // smoothed time between two messages, for adaptive
+    uint64_t interval_ns{0};
+    uint64_t last_ns{0};
+    uint64_t sent_messages{0};
+    uint64_t sent_batches{0};
+
+    [[nodiscard]] size_t count_limit() const noexcept {
+      if (!options.adaptive) {
+        return options.max_count;
+      }
+      if (interval_ns == 0) {
+        return 1;
+      }
+      return std::clamp<size_t>(max_delay_ns / interval_ns, 1,
+                                options.max_count);
+    }
+
+    void observe(uint64_t now) noexcept {
+      if (last_ns != 0) {
+        const auto interval = now - last_ns;
+        interval_ns = interval_ns == 0
+                          ? interval
+                          : interval_ns - interval_ns / 8 + interval / 8;
+      }
+      last_ns = now;
+    }
+
+    [[nodiscard]] detail::Batch& batch_for(const TypedMessage& msg) {
+      const auto type_name = as_string_view(msg.type);
+      for (auto& batch : batches) {
+        if (as_string_view(batch.type) == type_name) {
+          return batch;
+        }
+      }
+      batches.push_back(detail::Batch{shared_copy(msg.type), {}, 0, 0});
+      batches.back().content.reserve(options.max_bytes);
+      return batches.back();
+    }
+
+    [[nodiscard]] std::expected<void, ZmqError> flush(detail::Batch& batch,
+                                                      bool may_block = true) {
+      if (batch.count == 0) {
+        return {};
+      }
+      const auto count = batch.count;
+      auto msg = batch.take();
+      auto rc = may_block ? socket_.send(msg) : socket_.send_shared(msg);
+      if (!rc) {
+        return std::unexpected(rc.error());
+      }
+      sent_messages += count;
+      ++sent_batches;
+      return {};
+    }
+
+   public:
+    /**
+     * @brief Take over a bound or connected socket
+     *
+     * @param sending_socket
+     * @param batch_options
+     */
+    explicit BatchingSender(Socket sending_socket,
+                            BatchOptions batch_options = {})
+        : socket_{std::move(sending_socket)},
+          options{batch_options},
+          max_delay_ns{static_cast<uint64_t>(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  batch_options.max_delay)
+                  .count())} {
+      options.max_count = std::max<size_t>(options.max_count, 1);
+    }
+
+    BatchingSender(BatchingSender&&) noexcept = default;
+    BatchingSender& operator=(BatchingSender&&) = delete;
+    BatchingSender(const BatchingSender&) = delete;
+    BatchingSender& operator=(const BatchingSender&) = delete;
+
+    /// @brief Send what is still batched, best effort, without blocking
+    ~BatchingSender() noexcept {
+      for (auto& batch : batches) {
+        [[maybe_unused]] auto rc = flush(batch, false);
+      }
+    }
+
+    /// @brief The socket, for options and monitoring, not for sending
+    [[nodiscard]] Socket& socket() noexcept { return socket_; }
+
+    /**
+     * @brief Add a message to the batch of its type, send what is due
+     *
+     * @param msg
+     * @return std::expected<void, ZmqError> an error if sending a batch
+     *         failed, its messages are lost then
+     */
+    [[nodiscard]] std::expected<void, ZmqError> send(const TypedMessage& msg) {
+      const auto now = monotonic_now_ns();
+      observe(now);
+      const auto limit = count_limit();
+      if (limit == 1) {
+        // what waits goes first, to keep the order
+        if (auto rc = flush(); !rc) {
+          return rc;
+        }
+        if (auto rc = socket_.send(msg); !rc) {
+          return std::unexpected(rc.error());
+        }
+        ++sent_messages;
+        return {};
+      }
+      auto& batch = batch_for(msg);
+      batch.append(msg, now);
+      if (batch.count >= limit || batch.content.size() >= options.max_bytes) {
+        if (auto rc = flush(batch); !rc) {
+          return rc;
+        }
+      }
+      return flush_if_due(now);
+    }
+
+    /**
+     * @brief Create a typed message from value, and send it in a batch
+     *
+     * @param value
+     * @return std::expected<void, ZmqError>
+     */
+    template <typename T>
+    [[nodiscard]] std::expected<void, ZmqError> send(const T& value)
+      requires(!std::is_same_v<T, TypedMessage>)
+    {
+      return send(typed_message(value));
+    }
+
+    /**
+     * @brief Send the batches whose oldest message waited max_delay
+     *
+     * @param now monotonic_now_ns
+     * @return std::expected<void, ZmqError>
+     */
+    [[nodiscard]] std::expected<void, ZmqError> flush_if_due(
+        uint64_t now = monotonic_now_ns()) {
+      for (auto& batch : batches) {
+        if (batch.count > 0 && now - batch.first_ns >= max_delay_ns) {
+          if (auto rc = flush(batch); !rc) {
+            return rc;
+          }
+        }
+      }
+      return {};
+    }
+
+    /**
+     * @brief Send all batches now
+     *
+     * @return std::expected<void, ZmqError>
+     */
+    [[nodiscard]] std::expected<void, ZmqError> flush() {
+      for (auto& batch : batches) {
+        if (auto rc = flush(batch); !rc) {
+          return rc;
+        }
+      }
+      return {};
+    }
+
+    /**
+     * @brief Time until the next batch is due, to use as poll timeout
+     *
+     * @return std::optional<std::chrono::microseconds> nullopt if nothing
+     *         waits
+     */
+    [[nodiscard]] std::optional<std::chrono::microseconds> time_to_flush()
+        const noexcept {
+      std::optional<uint64_t> oldest;
+      for (const auto& batch : batches) {
+        if (batch.count > 0) {
+          oldest = std::min(oldest.value_or(batch.first_ns), batch.first_ns);
+        }
+      }
+      if (!oldest) {
+        return std::nullopt;
+      }
+      const auto waited = monotonic_now_ns() - *oldest;
+      const auto left = waited < max_delay_ns ? max_delay_ns - waited : 0;
+      return std::chrono::microseconds{left / 1000};
+    }
+
+    /// @brief Messages sent, alone or in batches
+    [[nodiscard]] uint64_t sent() const noexcept { return sent_messages; }
+
+    /// @brief Batches sent
+    [[nodiscard]] uint64_t batches_sent() const noexcept {
+      return sent_batches;
+    }
+  };
+
+  /**
+   * @brief Receives typed messages, and splits batches into their messages
+   *
+   * Messages that are no batch are passed through, so a BatchReceiver
+   * works with senders that batch and senders that do not.
+   */
+  class BatchReceiver {
+    std::vector<TypedMessage> pending;
+    size_t next{0};
+
+    [[nodiscard]] std::optional<std::expected<TypedMessage, Error>>
+    take_pending() {
+      if (next == pending.size()) {
+        return std::nullopt;
+      }
+      auto msg = std::move(pending[next++]);
+      if (next == pending.size()) {
+        pending.clear();
+        next = 0;
+      }
+      return msg;
+    }
+
+    [[nodiscard]] std::optional<std::expected<TypedMessage, Error>> split(
+        std::optional<std::expected<TypedMessage, Error>> msg) {
+      if (!msg || !*msg) {
+        return msg;
+      }
+      if (!is_batch(**msg)) {
+        return msg;
+      }
+      if (auto rc = unbatch(std::move(**msg), pending); !rc) {
+        if (pending.empty()) {
+          return std::unexpected(rc.error());
+        }
+      }
+      return take_pending();
+    }
+
+   public:
+    /**
+     * @brief The next message, from the current batch or the socket
+     *
+     * @param socket
+     * @return std::optional<std::expected<TypedMessage, Error>> nullopt if
+     *         there is none
+     */
+    [[nodiscard]] std::optional<std::expected<TypedMessage, Error>> recv(
+        Socket& socket) {
+      if (auto msg = take_pending()) {
+        return msg;
+      }
+      return split(socket.recv());
+    }
+
+    /**
+     * @brief The next message, wait up to timeout if there is none
+     *
+     * @param socket
+     * @param timeout
+     * @return std::optional<std::expected<TypedMessage, Error>>
+     */
+    [[nodiscard]] std::optional<std::expected<TypedMessage, Error>> await(
+        Socket& socket,
+        std::chrono::milliseconds timeout) {
+      if (auto msg = take_pending()) {
+        return msg;
+      }
+      return split(socket.await(timeout));
+    }
+
+    /// @brief Messages of the current batch that were not handed out yet
+    [[nodiscard]] size_t buffered() const noexcept {
+      return pending.size() - next;
+    }
+  };
+
+}  // namespace zq
@@ -0,0 +1,473 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <utility>
+
+#include "error.hpp"
+#include "message.hpp"
+#include "socket.hpp"
+
+namespace zq {
+
+  /**
+   * @brief Settings of a chunked transfer
+   *
+   * The receiver decides the window, the sender the chunk size.
+   */
+  struct ChunkOptions {
+    /// payload bytes per chunk
+    size_t chunk_size{256 * 1024};
+    /// chunks the sender may have in flight, the receiver grants these
+    uint64_t window{16};
+    /// how long to wait for the other side
+    std::chrono::milliseconds timeout{5000};
+  };
+
+  /// @brief Announces a transfer, the sender sends it first
+  struct TransferOffer {
+    uint64_t transfer_id;
+    uint64_t total_size;
+    uint64_t chunk_size;
+  };
+
+  /// @brief Lets the sender send that many more chunks
+  struct TransferCredit {
+    uint64_t transfer_id;
+    uint64_t credits;
+  };
+
+  /// @brief Ends a transfer, the receiver got everything, or refuses it
+  struct TransferDone {
+    uint64_t transfer_id;
+    uint64_t received;
+    uint64_t accepted;
+  };
+
+  /// @brief Starts the payload of each chunk, the data follows
+  struct ChunkHeader {
+    uint64_t transfer_id;
+    uint64_t sequence;
+    uint64_t offset;
+  };
+
+  /**
+   * @brief Where a receiver puts the chunks
+   *
+   * open is called once with the size of the transfer, write for each
+   * chunk, in order. Returning false ends the transfer.
+   */
+  template <typename S>
+  concept ChunkSink = requires(S sink,
+                               uint64_t value,
+                               std::span<const std::byte> data) {
+    { sink.open(value) } -> std::convertible_to<bool>;
+    { sink.write(value, data) } -> std::convertible_to<bool>;
+  };
+
+  /**
+   * @brief Reassembles a transfer into a preallocated buffer
+   *
+   * A transfer larger than the buffer is refused.
+   */
+  class BufferSink {
+    std::span<std::byte> buffer;
+    uint64_t total{0};
+
+   public:
+    explicit BufferSink(std::span<std::byte> target) noexcept
+        : buffer{target} {}
+
+    bool open(uint64_t total_size) noexcept {
+      total = total_size;
+      return total_size <= buffer.size();
+    }
+
+    bool write(uint64_t offset, std::span<const std::byte> data) noexcept {
+      if (offset + data.size() > total) {
+        return false;
+      }
+      std::memcpy(buffer.data() + offset, data.data(), data.size());
+      return true;
+    }
+
+    /// @brief Size of the last transfer
+    [[nodiscard]] uint64_t size() const noexcept { return total; }
+  };
+
+  /**
+   * @brief Writes a transfer directly into a file, chunk by chunk
+   *
+   * The file is created, or truncated. Only one chunk is in memory at a
+   * time.
+   */
+  class FileSink {
+    std::filesystem::path path;
+    std::ofstream out;
+
+   public:
+    explicit FileSink(std::filesystem::path file) : path{std::move(file)} {}
+
+    bool open(uint64_t) {
+      out.open(path, std::ios::binary | std::ios::trunc);
+      return out.good();
+    }
+
+    bool write(uint64_t, std::span<const std::byte> data) {
+      out.write(reinterpret_cast<const char*>(data.data()),
+                static_cast<std::streamsize>(data.size()));
+      return out.good();
+    }
+
+    /// @brief Flush and close the file
+    bool close() {
+      out.close();
+      return !out.fail();
+    }
+  };
+
+  namespace detail {
+
+    inline uint64_t next_transfer_id() noexcept {
+      static std::atomic<uint64_t> id{static_cast<uint64_t>(
+          std::chrono::steady_clock::now().time_since_epoch().count())};
+      return id.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    template <typename T>
+    bool is_a(const TypedMessage& msg) noexcept {
+      return as_string_view(msg.type) == wire_type_name<T>();
+    }
+
+    /// @brief Tell a sender that waits for credits, or for the end
+    inline void refuse(Socket& socket,
+                       uint64_t transfer_id,
+                       uint64_t received) {
+      [[maybe_unused]] auto credit =
+          socket.send(typed_message(TransferCredit{transfer_id, 0}));
+      [[maybe_unused]] auto done =
+          socket.send(typed_message(TransferDone{transfer_id, received, 0}));
+    }
+
+    /// @brief Wait for the next message of type T of this transfer
+    template <typename T>
+    auto await_control(Socket& socket,
+                       uint64_t transfer_id,
+                       std::chrono::milliseconds timeout)
+        -> std::expected<T, Error> {
+      const auto deadline = std::chrono::steady_clock::now() + timeout;
+      for (;;) {
+        const auto left =
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now());
+        if (left.count() <= 0) {
+          return std::unexpected(ZqError("transfer timed out"));
+        }
+        auto msg = socket.await(left);
+        if (!msg) {
+          return std::unexpected(ZqError("transfer timed out"));
+        }
+        if (!*msg) {
+          return std::unexpected(msg->error());
+        }
+        auto value = restore_as<T>(**msg);
+        if (value && value->transfer_id == transfer_id) {
+          return *value;
+        }
+      }
+    }
+
+    // The chunk is built in its message and sent without another copy.
+    // send_shared does not block, so wait until the socket takes it.
+    inline auto send_chunk(Socket& socket,
+                           const TypedMessage& chunk,
+                           std::chrono::milliseconds timeout)
+        -> std::expected<size_t, ZmqError> {
+      for (;;) {
+        auto rc = socket.send_shared(chunk);
+        if (rc || rc.error().errNo != EAGAIN) {
+          return rc;
+        }
+        zmq_pollitem_t item{socket.socket_ptr.get(), 0, ZMQ_POLLOUT, 0};
+        const auto ready =
+            zmq_poll(&item, 1, static_cast<long>(timeout.count()));
+        if (ready < 0) {
+          return std::unexpected(currentZmqError());
+        }
+        if (ready == 0) {
+          return rc;
+        }
+      }
+    }
+
+  }  // namespace detail
+
+  /**
+   * @brief Send total_size bytes in chunks, read from a source
+   *
+   * The receiver, see recv_chunked, grants credits, the sender never has
+   * more chunks in flight than the receiver allowed. Blocks until the
+   * receiver confirmed the transfer. The data is copied once, by read into
+   * the chunk, the chunk is handed to ZeroMQ as it is.
+   *
+   * The socket must be connected to one peer and able to send and receive,
+   * like PAIR, or DEALER to DEALER.
+   *
+   * @param socket
+   * @param total_size
+   * @param read called as read(offset, buffer), fills buffer with the
+   *        bytes at offset, returns false on error
+   * @param options
+   * @return std::expected<uint64_t, Error> bytes the receiver got
+   */
+  template <typename Source>
+    requires std::invocable<Source&, uint64_t, std::span<std::byte>>
+  [[nodiscard]] auto send_chunked(Socket& socket,
+                                  uint64_t total_size,
+                                  Source&& read,
+                                  ChunkOptions options = {})
+      -> std::expected<uint64_t, Error> {
+    const auto chunk_size =
+        static_cast<uint64_t>(std::max<size_t>(options.chunk_size, 1));
+    const auto id = detail::next_transfer_id();
+    if (auto rc = socket.send(typed_message(
+            TransferOffer{id, total_size, chunk_size}));
+        !rc) {
+      return std::unexpected(rc.error());
+    }
+    const auto chunk_type = typename_message<ChunkHeader>();
+    uint64_t credits = 0;
+    uint64_t sequence = 0;
+    uint64_t offset = 0;
+    while (offset < total_size) {
+      while (credits == 0) {
+        auto credit = detail::await_control<TransferCredit>(socket, id,
+                                                            options.timeout);
+        if (!credit) {
+          return std::unexpected(credit.error());
+        }
+        credits += credit->credits;
+        // a credit of 0 means the receiver refused the transfer
+        if (credit->credits == 0) {
+          return std::unexpected(ZqError("transfer refused"));
+        }
+      }
+      const auto size = std::min(chunk_size, total_size - offset);
+      Message payload{sizeof(ChunkHeader) + size};
+      const ChunkHeader header{id, sequence, offset};
+      std::memcpy(payload.data(), std::addressof(header), sizeof(header));
+      auto* data = static_cast<std::byte*>(payload.data()) + sizeof(header);
+      if (!read(offset, std::span<std::byte>{data, size})) {
+        return std::unexpected(ZqError("reading the source failed"));
+      }
+      const TypedMessage chunk{shared_copy(chunk_type), std::move(payload)};
+      if (auto rc = detail::send_chunk(socket, chunk, options.timeout); !rc) {
+        return std::unexpected(rc.error());
+      }
+      --credits;
+      ++sequence;
+      offset += size;
+    }
+    auto done = detail::await_control<TransferDone>(socket, id,
+                                                    options.timeout);
+    if (!done) {
+      return std::unexpected(done.error());
+    }
+    if (done->accepted == 0) {
+      return std::unexpected(ZqError("transfer refused"));
+    }
+    return done->received;
+  }
+
+  /**
+   * @brief Send a buffer in chunks
+   *
+   * @param socket
+   * @param data
+   * @param options
+   * @return std::expected<uint64_t, Error> bytes the receiver got
+   */
+  [[nodiscard]] inline auto send_chunked(Socket& socket,
+                                         std::span<const std::byte> data,
+                                         ChunkOptions options = {})
+      -> std::expected<uint64_t, Error> {
+    return send_chunked(
+        socket, data.size(),
+        [data](uint64_t offset, std::span<std::byte> out) noexcept {
+          std::memcpy(out.data(), data.data() + offset, out.size());
+          return true;
+        },
+        options);
+  }
+
+  /**
+   * @brief Send a file in chunks, only one chunk is in memory at a time
+   *
+   * @param socket
+   * @param file
+   * @param options
+   * @return std::expected<uint64_t, Error> bytes the receiver got
+   */
+  [[nodiscard]] inline auto send_chunked(Socket& socket,
+                                         const std::filesystem::path& file,
+                                         ChunkOptions options = {})
+      -> std::expected<uint64_t, Error> {
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(file, ec);
+    std::ifstream in{file, std::ios::binary};
+    if (ec || !in) {
+      return std::unexpected(ZqError("can not read file"));
+    }
+    return send_chunked(
+        socket, static_cast<uint64_t>(size),
+        [&in](uint64_t, std::span<std::byte> out) {
+          in.read(reinterpret_cast<char*>(out.data()),
+                  static_cast<std::streamsize>(out.size()));
+          return in.gcount() == static_cast<std::streamsize>(out.size());
+        },
+        options);
+  }
+
+  /**
+   * @brief Receive a chunked transfer into a sink
+   *
+   * Waits for the offer of a sender, see send_chunked. If the sink can not
+   * take the size, the transfer is refused. Otherwise, credits for
+   * options.window chunks are granted, and given back in batches while the
+   * chunks are written, so at most window chunks are queued.
+   *
+   * @param socket
+   * @param sink
+   * @param options
+   * @return std::expected<uint64_t, Error> bytes received
+   */
+  template <ChunkSink Sink>
+  [[nodiscard]] auto recv_chunked(Socket& socket,
+                                  Sink& sink,
+                                  ChunkOptions options = {})
+      -> std::expected<uint64_t, Error> {
+    // whatever arrives before the offer is left over from an old transfer
+    std::optional<TransferOffer> offer;
+    const auto deadline = std::chrono::steady_clock::now() + options.timeout;
+    while (!offer) {
+      const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now());
+      auto msg = socket.await(std::max(left, std::chrono::milliseconds{0}));
+      if (!msg) {
+        return std::unexpected(ZqError("transfer timed out"));
+      }
+      if (!*msg) {
+        return std::unexpected(msg->error());
+      }
+      if (auto value = restore_as<TransferOffer>(**msg)) {
+        offer = *value;
+      }
+    }
+    const auto id = offer->transfer_id;
+    if (!sink.open(offer->total_size)) {
+      detail::refuse(socket, id, 0);
+      return std::unexpected(ZqError("transfer refused by the sink"));
+    }
+    const auto window = std::max<uint64_t>(options.window, 1);
+    if (auto rc = socket.send(typed_message(TransferCredit{id, window}));
+        !rc) {
+      return std::unexpected(rc.error());
+    }
+
+    uint64_t received = 0;
+    uint64_t sequence = 0;
+    uint64_t consumed = 0;
+    while (received < offer->total_size) {
+      auto msg = socket.await(options.timeout);
+      if (!msg) {
+        return std::unexpected(ZqError("transfer timed out"));
+      }
+      if (!*msg) {
+        return std::unexpected(msg->error());
+      }
+      const auto& chunk = **msg;
+      ChunkHeader header{};
+      if (!detail::is_a<ChunkHeader>(chunk) ||
+          chunk.payload.size() < sizeof(header)) {
+        continue;
+      }
+      std::memcpy(std::addressof(header), chunk.payload.data(),
+                  sizeof(header));
+      if (header.transfer_id != id) {
+        continue;
+      }
+      const std::span<const std::byte> data{
+          static_cast<const std::byte*>(chunk.payload.data()) + sizeof(header),
+          chunk.payload.size() - sizeof(header)};
+      if (header.sequence != sequence || header.offset != received ||
+          received + data.size() > offer->total_size ||
+          !sink.write(header.offset, data)) {
+        detail::refuse(socket, id, received);
+        return std::unexpected(ZqError("transfer failed"));
+      }
+      received += data.size();
+      ++sequence;
+      // give credits back in batches, not for each chunk
+      if (++consumed >= (window + 1) / 2 && received < offer->total_size) {
+        if (auto rc = socket.send(typed_message(TransferCredit{id, consumed}));
+            !rc) {
+          return std::unexpected(rc.error());
+        }
+        consumed = 0;
+      }
+    }
+    if (auto rc = socket.send(typed_message(TransferDone{id, received, 1}));
+        !rc) {
+      return std::unexpected(rc.error());
+    }
+    return received;
+  }
+
+  /**
+   * @brief Receive a chunked transfer into a preallocated buffer
+   *
+   * @param socket
+   * @param buffer must be large enough for the transfer
+   * @param options
+   * @return std::expected<uint64_t, Error> bytes received
+   */
+  [[nodiscard]] inline auto recv_chunked(Socket& socket,
+                                         std::span<std::byte> buffer,
+                                         ChunkOptions options = {})
+      -> std::expected<uint64_t, Error> {
+    BufferSink sink{buffer};
+    return recv_chunked(socket, sink, options);
+  }
+
+  /**
+   * @brief Receive a chunked transfer directly into a file
+   *
+   * @param socket
+   * @param file created or truncated
+   * @param options
+   * @return std::expected<uint64_t, Error> bytes received
+   */
+  [[nodiscard]] inline auto recv_chunked(Socket& socket,
+                                         const std::filesystem::path& file,
+                                         ChunkOptions options = {})
+      -> std::expected<uint64_t, Error> {
+    FileSink sink{file};
+    auto received = recv_chunked(socket, sink, options);
+    if (received && !sink.close()) {
+      return std::unexpected(ZqError("writing the file failed"));
+    }
+    return received;
+  }
+
+}  // namespace zq
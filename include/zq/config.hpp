@@ -8,3 +8,9 @@ constexpr bool debug_build = false;
 #else
 constexpr bool debug_build = true;
 #endif
+
+#ifdef ZQ_SOCKET_STATS
+constexpr bool socket_stats_build = true;
+#else
+constexpr bool socket_stats_build = false;
+#endif
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <atomic>
 #include <concepts>
+#include <cstdio>
 #include <expected>
 #include <ranges>
 
@@ -27,7 +29,7 @@ namespace zq {
     requires std::same_as<ContextOption, typename T::value_type>;
   };
 
-  constexpr auto DefaultContextOptions = {
+  inline constexpr auto DefaultContextOptions = {
       ContextOption{.name = CtxOptionName::IO_THREADS, .value = 1},
       ContextOption{.name = CtxOptionName::IPV6, .value = 0},
       ContextOption{zq::CtxOptionName::BLOCKY, 0},
@@ -60,34 +62,16 @@ namespace zq {
         SocketCon con,
         SocketType type,
         std::string_view endpoint) noexcept {
-      auto z_socket = zmq_socket(z_ctx, static_cast<int>(type));
-      if (z_socket == nullptr) {
-        return std::unexpected(currentZmqError());
-      }
-      const int err_code = con == SocketCon::BIND
-                               ? zmq_bind(z_socket, endpoint.data())
-                               : zmq_connect(z_socket, endpoint.data());
-      if (err_code != 0) {
-        return std::unexpected(currentZmqError());
+      auto maybe_socket = socket(type);
+      if (!maybe_socket) {
+        return maybe_socket;
       }
-      // ZMQ_LINGER
-      {
-        // int zmq_setsockopt (void *socket, int option_name, const void
-        // *option_value, size_t option_len);
-        int opt_value = 0;
-        size_t opt_len = sizeof(opt_value);
-        auto rc =
-            zmq_setsockopt(z_socket, static_cast<int>(SocketOptionName::LINGER),
-                           std::addressof(opt_value), opt_len);
-        if (rc != 0) {
-          return std::unexpected(currentZmqError());
-        }
+      auto rc = con == SocketCon::BIND ? maybe_socket->bind(endpoint)
+                                       : maybe_socket->connect(endpoint);
+      if (!rc) {
+        return std::unexpected(rc.error());
       }
-      SocketPointer sp{z_socket};
-      /* Explicitly create the expected objects, otherwise, the return value
-       optimization will not be invoked and the Socket's move constructor and
-       destructor will be called. */
-      return std::expected<Socket, ZmqError>{std::move(sp)};
+      return maybe_socket;
     }
 
    public:
@@ -120,6 +104,69 @@ namespace zq {
       return NoError;
     }
 
+    /**
+     * @brief Create a socket that is neither bound nor connected
+     *
+     * Useful if something needs to be set up before connecting,
+     * like a monitor.
+     *
+     * @param type
+     * @return std::expected<Socket, ZmqError>
+     */
+    [[nodiscard]] std::expected<Socket, ZmqError> socket(
+        SocketType type) noexcept {
+      auto z_socket = zmq_socket(z_ctx, static_cast<int>(type));
+      if (z_socket == nullptr) {
+        return std::unexpected(currentZmqError());
+      }
+      SocketPointer sp{z_socket};
+      // ZMQ_LINGER
+      {
+        // int zmq_setsockopt (void *socket, int option_name, const void
+        // *option_value, size_t option_len);
+        int opt_value = 0;
+        size_t opt_len = sizeof(opt_value);
+        auto rc =
+            zmq_setsockopt(z_socket, static_cast<int>(SocketOptionName::LINGER),
+                           std::addressof(opt_value), opt_len);
+        if (rc != 0) {
+          return std::unexpected(currentZmqError());
+        }
+      }
+      /* Explicitly create the expected objects, otherwise, the return value
+       optimization will not be invoked and the Socket's move constructor and
+       destructor will be called. */
+      return std::expected<Socket, ZmqError>{std::move(sp)};
+    }
+
+    /**
+     * @brief Monitor the given socket
+     *
+     * Returns a PAIR socket that receives the requested events,
+     * read them with the functions from monitor.hpp.
+     *
+     * To not miss events, start monitoring before connecting, see socket().
+     *
+     * \note inproc connections do not report events
+     *
+     * @param socket
+     * @param events
+     * @return std::expected<Socket, ZmqError>
+     */
+    [[nodiscard]] std::expected<Socket, ZmqError> monitor(
+        Socket& socket,
+        MonitorEvent events = MonitorEvent::ALL) noexcept {
+      static std::atomic<unsigned> monitor_count{0};
+      char endpoint[48];
+      std::snprintf(endpoint, sizeof(endpoint), "inproc://zq-monitor-%u",
+                    monitor_count++);
+      if (zmq_socket_monitor(socket.socket_ptr.get(), endpoint,
+                             static_cast<int>(events)) != 0) {
+        return std::unexpected(currentZmqError());
+      }
+      return bind_or_connect(SocketCon::CONNECT, SocketType::PAIR, endpoint);
+    }
+
     /**
      * @brief Bind a socket to an endpoint
      *
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <optional>
+
+#include "error.hpp"
+#include "message.hpp"
+#include "meta.hpp"
+#include "socket.hpp"
+
+namespace zq {
+
+  // Deadlines are system clock time, so they work between hosts with
+  // synchronized clocks, not only on one host like SEND_TIME
+  using DeadlineClock = std::chrono::system_clock;
+
+  /**
+   * @brief Give a message a deadline, after that, receivers drop it
+   *
+   * The deadline is a record in the meta part, 9 bytes.
+   *
+   * @param msg
+   * @param deadline
+   */
+  inline void set_deadline(TypedMessage& msg,
+                           DeadlineClock::time_point deadline) {
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        deadline.time_since_epoch())
+                        .count();
+    set_meta(msg, MetaTag::DEADLINE, static_cast<uint64_t>(ns));
+  }
+
+  /**
+   * @brief Give a message a time to live, from now on
+   *
+   * @param msg
+   * @param ttl
+   */
+  inline void set_ttl(TypedMessage& msg, std::chrono::nanoseconds ttl) {
+    set_deadline(msg, DeadlineClock::now() + ttl);
+  }
+
+  /**
+   * @brief The deadline of a message
+   *
+   * @param msg
+   * @return std::optional<DeadlineClock::time_point> nullopt if it has none
+   */
+  [[nodiscard]] inline std::optional<DeadlineClock::time_point> get_deadline(
+      const TypedMessage& msg) noexcept {
+    auto ns = get_meta(msg, MetaTag::DEADLINE);
+    if (!ns) {
+      return std::nullopt;
+    }
+    return DeadlineClock::time_point{
+        std::chrono::duration_cast<DeadlineClock::duration>(
+            std::chrono::nanoseconds{static_cast<int64_t>(*ns)})};
+  }
+
+  /**
+   * @brief true if the message has a deadline, and it passed
+   *
+   * Only reads the meta part, the payload is not touched. Messages without
+   * a meta part do not even read the clock.
+   *
+   * @param msg
+   * @param now
+   * @return bool
+   */
+  [[nodiscard]] inline bool is_expired(const TypedMessage& msg,
+                                       DeadlineClock::time_point now) noexcept {
+    if (msg.meta.size() == 0) {
+      return false;
+    }
+    auto deadline = get_deadline(msg);
+    return deadline && *deadline < now;
+  }
+
+  [[nodiscard]] inline bool is_expired(const TypedMessage& msg) noexcept {
+    return msg.meta.size() != 0 && is_expired(msg, DeadlineClock::now());
+  }
+
+  /**
+   * @brief Receives typed messages, and drops the expired ones
+   *
+   * A consumer that fell behind would otherwise restore and handle
+   * messages whose results are useless by now. The shedder checks the
+   * deadline in the meta part before a message is handed out, so neither
+   * restore_as nor the handler run for it. Dropped messages are counted.
+   *
+   * Messages without a deadline are never dropped.
+   */
+  class LoadShedder {
+    uint64_t dropped_count{0};
+    uint64_t passed_count{0};
+
+   public:
+    /**
+     * @brief Check a received message, count it if it expired
+     *
+     * @param msg
+     * @return true if the message should be handled
+     */
+    [[nodiscard]] bool admit(const TypedMessage& msg) noexcept {
+      if (is_expired(msg)) {
+        ++dropped_count;
+        return false;
+      }
+      ++passed_count;
+      return true;
+    }
+
+    /**
+     * @brief Receive the next message that did not expire, if there is one
+     *
+     * Reads, and drops, expired messages until a live one is there, or
+     * the socket has no more messages.
+     *
+     * @param socket
+     * @return std::optional<std::expected<TypedMessage, Error>>
+     */
+    [[nodiscard]] std::optional<std::expected<TypedMessage, Error>> recv(
+        Socket& socket) {
+      for (;;) {
+        auto msg = socket.recv();
+        if (!msg || !*msg || admit(**msg)) {
+          return msg;
+        }
+      }
+    }
+
+    /**
+     * @brief Wait up to timeout for a message that did not expire
+     *
+     * @param socket
+     * @param timeout
+     * @return std::optional<std::expected<TypedMessage, Error>> nullopt if
+     *         no live message arrived in time
+     */
+    [[nodiscard]] std::optional<std::expected<TypedMessage, Error>> await(
+        Socket& socket,
+        std::chrono::milliseconds timeout) {
+      using namespace std::chrono;
+      const auto until = steady_clock::now() + timeout;
+      for (;;) {
+        const auto left =
+            duration_cast<milliseconds>(until - steady_clock::now());
+        auto msg = socket.await(std::max(left, milliseconds{0}));
+        if (!msg || !*msg || admit(**msg)) {
+          return msg;
+        }
+      }
+    }
+
+    /// @brief Messages dropped since creation, or the last reset
+    [[nodiscard]] uint64_t dropped() const noexcept { return dropped_count; }
+
+    /// @brief Messages handed out since creation, or the last reset
+    [[nodiscard]] uint64_t passed() const noexcept { return passed_count; }
+
+    void reset() noexcept {
+      dropped_count = 0;
+      passed_count = 0;
+    }
+  };
+
+}  // namespace zq
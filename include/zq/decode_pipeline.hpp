@@ -0,0 +1,263 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "error.hpp"
+#include "message.hpp"
+#include "ring.hpp"
+#include "socket.hpp"
+#include "wait.hpp"
+
+namespace zq {
+
+  /**
+   * @brief Settings of a DecodePipeline
+   */
+  struct DecodeOptions {
+    /// decode threads, at least 1
+    size_t workers{4};
+    /// messages queued per worker, in and out, rounded up to a power of 2
+    size_t capacity{1024};
+    /// if set, messages with the same key keep their order, others not,
+    /// if not set, all messages keep their order
+    std::function<uint64_t(const TypedMessage&)> key{};
+    WaitMode wait_mode{WaitMode::FUTEX};
+    /// with FUTEX, how often to check a queue before sleeping
+    unsigned spin_count{2000};
+  };
+
+  /**
+   * @brief Receives on one thread, decodes on many
+   *
+   * One thread calling recv and restore_as caps the ingest at what one
+   * core decodes. A DecodePipeline owns a socket and a receiving thread,
+   * that only reads raw typed messages and hands them to worker threads,
+   * each with its own input and output queue. The workers decode, next
+   * hands out the results.
+   *
+   * Without a key, message i goes to worker i modulo workers, and next
+   * reads the output queues in the same order. So the output queues are
+   * the reorder buffer, results come out in the order messages arrived,
+   * and a slow message holds up the ones after it.
+   *
+   * With a key, the key of a message picks the worker, messages with the
+   * same key are decoded by one worker, in order. next takes whatever
+   * worker has a result, so a slow message only holds up its own key.
+   * The key function runs on the receiving thread, it should only look
+   * at the type or the meta part, or hash a few bytes, see detail::fnv1a.
+   *
+   * Receive errors are handed out by next, at their place in the order.
+   * If the consumer falls behind, the queues fill up, and the receiving
+   * thread stops reading the socket, so the high water mark applies.
+   *
+   * next must be called by one thread at a time. Messages still queued on
+   * destruction are dropped.
+   *
+   * @tparam T the decoded type
+   */
+  template <typename T>
+    requires std::is_default_constructible_v<T> &&
+             std::is_nothrow_move_constructible_v<T> &&
+             std::is_nothrow_move_assignable_v<T>
+  class DecodePipeline {
+   public:
+    using Decoded = std::expected<T, Error>;
+    using Decoder = std::function<Decoded(const TypedMessage&)>;
+
+   private:
+    struct Worker {
+      SpscRing<std::expected<TypedMessage, Error>> input;
+      SpscRing<Decoded> output;
+      Waiter input_ready;
+      std::thread thread;
+
+      explicit Worker(size_t capacity) : input{capacity}, output{capacity} {}
+    };
+
+    DecodeOptions options;
+    Decoder decoder;
+    Socket socket;
+    std::vector<std::unique_ptr<Worker>> workers;
+    // workers notify after they decoded
+    Waiter decoded;
+    // notified when a queue has space again
+    Waiter space;
+    std::atomic<bool> stopping{false};
+    std::thread receiver;
+    // the consumer side, used by next
+    size_t next_worker{0};
+
+    [[nodiscard]] std::chrono::steady_clock::time_point soon() const noexcept {
+      return std::chrono::steady_clock::now() + std::chrono::milliseconds{100};
+    }
+
+    [[nodiscard]] bool stopped() const noexcept {
+      return stopping.load(std::memory_order_acquire);
+    }
+
+    template <typename Ring, typename Value>
+    bool push_waiting(Ring& ring, Value&& value) noexcept {
+      bool pushed = ring.try_push(std::move(value));
+      while (!pushed && !stopped()) {
+        space.wait(options.wait_mode, options.spin_count, soon(),
+                   [&]() noexcept {
+                     pushed = ring.try_push(std::move(value));
+                     return pushed || stopped();
+                   });
+      }
+      return pushed;
+    }
+
+    void receive() noexcept {
+      uint64_t sequence = 0;
+      while (!stopped()) {
+        auto msg = socket.await(std::chrono::milliseconds{100});
+        if (!msg) {
+          continue;
+        }
+        const auto index =
+            options.key && *msg
+                ? options.key(**msg) % workers.size()
+                : static_cast<size_t>(sequence % workers.size());
+        ++sequence;
+        auto& worker = *workers[index];
+        if (!push_waiting(worker.input, std::move(*msg))) {
+          return;
+        }
+        worker.input_ready.notify();
+      }
+    }
+
+    void work(Worker& worker) noexcept {
+      for (;;) {
+        auto msg = worker.input.try_pop();
+        if (!msg) {
+          if (stopped()) {
+            return;
+          }
+          worker.input_ready.wait(options.wait_mode, options.spin_count,
+                                  soon(), [&]() noexcept {
+                                    return !worker.input.empty() || stopped();
+                                  });
+          continue;
+        }
+        space.notify();
+        Decoded result = *msg ? decoder(**msg)
+                              : Decoded{std::unexpected(msg->error())};
+        if (!push_waiting(worker.output, std::move(result))) {
+          return;
+        }
+        decoded.notify();
+      }
+    }
+
+    // the worker next takes the result of, or workers.size() if none
+    [[nodiscard]] size_t ready_worker() const noexcept {
+      if (!options.key) {
+        return workers[next_worker]->output.empty() ? workers.size()
+                                                    : next_worker;
+      }
+      for (size_t i = 0; i < workers.size(); ++i) {
+        const auto index = (next_worker + i) % workers.size();
+        if (!workers[index]->output.empty()) {
+          return index;
+        }
+      }
+      return workers.size();
+    }
+
+   public:
+    /**
+     * @brief Take over a bound or connected socket, start the threads
+     *
+     * @param receiving_socket
+     * @param decode_options
+     * @param decode_with the decoder, restore_as<T> by default,
+     *        called by many threads at once, it must not throw
+     */
+    explicit DecodePipeline(
+        Socket receiving_socket,
+        DecodeOptions decode_options = {},
+        Decoder decode_with = [](const TypedMessage& msg) -> Decoded {
+          auto value = restore_as<T>(msg);
+          if (!value) {
+            return std::unexpected(value.error());
+          }
+          return std::move(*value);
+        })
+        : options{std::move(decode_options)},
+          decoder{std::move(decode_with)},
+          socket{std::move(receiving_socket)} {
+      const auto count = std::max<size_t>(options.workers, 1);
+      for (size_t i = 0; i < count; ++i) {
+        workers.push_back(std::make_unique<Worker>(options.capacity));
+      }
+      for (auto& worker : workers) {
+        worker->thread =
+            std::thread{[this, w = worker.get()]() noexcept { work(*w); }};
+      }
+      receiver = std::thread{[this]() noexcept { receive(); }};
+    }
+
+    DecodePipeline(const DecodePipeline&) = delete;
+    DecodePipeline& operator=(const DecodePipeline&) = delete;
+    DecodePipeline(DecodePipeline&&) = delete;
+    DecodePipeline& operator=(DecodePipeline&&) = delete;
+
+    ~DecodePipeline() noexcept {
+      stopping.store(true, std::memory_order_release);
+      space.notify();
+      if (receiver.joinable()) {
+        receiver.join();
+      }
+      for (auto& worker : workers) {
+        worker->input_ready.notify();
+        if (worker->thread.joinable()) {
+          worker->thread.join();
+        }
+      }
+    }
+
+    /// @brief Number of decode threads
+    [[nodiscard]] size_t worker_count() const noexcept {
+      return workers.size();
+    }
+
+    /**
+     * @brief The next decoded message, wait up to timeout for it
+     *
+     * @param timeout
+     * @return std::optional<Decoded> nullopt if nothing was decoded in time
+     */
+    [[nodiscard]] std::optional<Decoded> next(
+        std::chrono::milliseconds timeout) {
+      auto index = ready_worker();
+      if (index == workers.size()) {
+        decoded.wait(options.wait_mode, options.spin_count,
+                     std::chrono::steady_clock::now() + timeout,
+                     [&]() noexcept {
+                       index = ready_worker();
+                       return index != workers.size();
+                     });
+        if (index == workers.size()) {
+          return std::nullopt;
+        }
+      }
+      auto result = workers[index]->output.try_pop();
+      space.notify();
+      next_worker = (index + 1) % workers.size();
+      return result;
+    }
+  };
+
+}  // namespace zq
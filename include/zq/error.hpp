@@ -1,7 +1,9 @@
 #pragma once
 
+#include <cstring>
 #include <ostream>
 #include <string>
+#include <type_traits>
 #include <variant>
 #include "config.hpp"
 
@@ -65,7 +67,7 @@ namespace zq {
    * @brief Constant representing no error.
    *
    */
-  constexpr ZmqErrorNo NoError{0};
+  inline constexpr ZmqErrorNo NoError{0};
 
   /**
    * @brief Class encapsulating a ZeroMQ error.
@@ -74,16 +76,48 @@ namespace zq {
    * this class is used to return the ZeroMQ internal
    * error number and the error message.
    *
+   * The error is a number plus an optional static context string, it does
+   * not allocate and is trivially copyable. The text is resolved when it is
+   * asked for, from ZeroMQ's static table.
+   *
    * Note that zq does not throw exceptions, but returns expected values.
    *
    */
-  struct ZmqError : public std::runtime_error {
+  struct ZmqError {
     ZmqErrorNo errNo;
+    // static string, or nullptr for the ZeroMQ message of errNo
+    const char* context{nullptr};
+
+    constexpr explicit ZmqError(ZmqErrorNo en) noexcept : errNo(en) {}
+
+    /**
+     * @brief Error with a context instead of the ZeroMQ message
+     *
+     * @param en the error number
+     * @param static_msg must outlive the error, usually a string literal
+     */
+    constexpr ZmqError(ZmqErrorNo en, const char* static_msg) noexcept
+        : errNo(en), context(static_msg) {}
+
+    /**
+     * @brief The error text, without the number
+     *
+     * @return const char* static string
+     */
+    const char* what() const noexcept {
+      return context != nullptr ? context : zmq_strerror(errNo.value());
+    }
 
-    ZmqError(ZmqErrorNo en, std::string_view msg)
-        : std::runtime_error(std::to_string(en.value()) + std::string{": "} +
-                             msg.data()),
-          errNo(en) {}
+    /**
+     * @brief The error as "number: text"
+     *
+     * Allocates, use it for reporting, not on hot paths.
+     *
+     * @return std::string
+     */
+    std::string message() const {
+      return std::to_string(errNo.value()) + ": " + what();
+    }
   };
 
   /**
@@ -92,10 +126,43 @@ namespace zq {
    * This class is used to inform the user about unexpected behavior in zq,
    * or wrong api usage.
    *
+   * The error is a static text, plus the system errno if a system call
+   * failed. It does not allocate and is trivially copyable.
+   *
    * Note that zq does not throw exceptions, but returns expected values.
    */
-  struct ZqError : public std::logic_error {
-    using std::logic_error::logic_error;
+  struct ZqError {
+    // static string, usually a literal
+    const char* text;
+    // errno of a failed system call, or 0
+    int errNo{0};
+
+    constexpr explicit ZqError(const char* static_msg,
+                               int sys_errno = 0) noexcept
+        : text(static_msg), errNo(sys_errno) {}
+
+    /**
+     * @brief The error text, without the system error
+     *
+     * @return const char* static string
+     */
+    const char* what() const noexcept { return text; }
+
+    /**
+     * @brief The error text, with the system error if there is one
+     *
+     * Allocates, use it for reporting, not on hot paths.
+     *
+     * @return std::string
+     */
+    std::string message() const {
+      std::string msg{text};
+      if (errNo != 0) {
+        msg += ": ";
+        msg += std::strerror(errNo);
+      }
+      return msg;
+    }
   };
 
   /**
@@ -106,31 +173,40 @@ namespace zq {
    *
    *  In this case, this Error is used to hold the actual Error type.
    */
-  struct Error : public std::exception {
+  struct Error {
     std::variant<ZmqError, ZqError> error;
 
-    Error(const ZmqError& e) : error(e) {}
-    Error(const ZqError& e) : error(e) {}
+    constexpr Error(const ZmqError& e) noexcept : error(e) {}
+    constexpr Error(const ZqError& e) noexcept : error(e) {}
 
-    bool isZqError() { return std::holds_alternative<ZqError>(error); }
+    bool isZqError() const noexcept {
+      return std::holds_alternative<ZqError>(error);
+    }
 
-    bool isZmqError() { return std::holds_alternative<ZmqError>(error); }
+    bool isZmqError() const noexcept {
+      return std::holds_alternative<ZmqError>(error);
+    }
 
-    const char* what() const noexcept override {
-      if (std::holds_alternative<ZmqError>(error)) {
-        return std::get<ZmqError>(error).what();
-      } else {
-        return std::get<ZqError>(error).what();
-      }
+    const char* what() const noexcept {
+      return std::visit([](const auto& e) { return e.what(); }, error);
+    }
+
+    std::string message() const {
+      return std::visit([](const auto& e) { return e.message(); }, error);
     }
   };
 
+  // errors are returned by value on every failing call, keep them cheap
+  static_assert(std::is_trivially_copyable_v<ZmqError>);
+  static_assert(std::is_trivially_copyable_v<ZqError>);
+  static_assert(std::is_trivially_copyable_v<Error>);
+
   inline ZmqErrorNo currentError() noexcept {
     return ZmqErrorNo{zmq_errno()};
   }
 
   inline ZmqError currentZmqError() noexcept {
-    return ZmqError{currentError(), zmq_strerror(zmq_errno())};
+    return ZmqError{currentError()};
   }
 
 }  // namespace zq
@@ -2,12 +2,13 @@
 
 #include <fmt/core.h>
 #include <ostream>
+#include <stdexcept>
 #include "error.hpp"
 
 template <>
 struct fmt::formatter<zq::ZmqErrorNo> : public fmt::formatter<int> {
   template <typename FormatContext>
-  constexpr auto format(const zq::Error& e,
+  constexpr auto format(const zq::ZmqErrorNo& e,
                         FormatContext& ctx) const -> decltype(ctx.out()) {
     return fmt::formatter<int>::format(e.value(), ctx);
   }
@@ -17,8 +18,26 @@ template <>
 struct fmt::formatter<zq::ZmqError> {
   constexpr auto parse(fmt::format_parse_context& ctx) { return ctx.begin(); }
 
-  auto format(const zq::ZmqError& e, fmt::format_context& ctx) {
-    return fmt::format_to(ctx.out(), "{}, {}", e.error, e.message);
+  auto format(const zq::ZmqError& e, fmt::format_context& ctx) const {
+    return fmt::format_to(ctx.out(), "{}, {}", e.errNo.value(), e.what());
+  }
+};
+
+template <>
+struct fmt::formatter<zq::ZqError> {
+  constexpr auto parse(fmt::format_parse_context& ctx) { return ctx.begin(); }
+
+  auto format(const zq::ZqError& e, fmt::format_context& ctx) const {
+    return fmt::format_to(ctx.out(), "{}", e.message());
+  }
+};
+
+template <>
+struct fmt::formatter<zq::Error> {
+  constexpr auto parse(fmt::format_parse_context& ctx) { return ctx.begin(); }
+
+  auto format(const zq::Error& e, fmt::format_context& ctx) const {
+    return fmt::format_to(ctx.out(), "{}", e.message());
   }
 };
 
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace zq {
+
+  /**
+   * @brief A log bucketed histogram for latencies, in the style of HDR
+   *
+   * Values below 64 are exact, above that, every power of 2 range is split
+   * into 32 buckets, so a reported value is at most ~3% off.
+   * Recording is an index calculation and an increment, no allocation.
+   *
+   * Values are nanoseconds, but any unsigned 64 bit value works.
+   */
+  class LatencyHistogram {
+    static constexpr unsigned sub_bucket_bits = 5;
+    static constexpr uint64_t sub_buckets = uint64_t{1} << sub_bucket_bits;
+    // index_of of values with the top bit set goes up to
+    // (64 - sub_bucket_bits + 1) * sub_buckets - 1
+    static constexpr size_t bucket_count =
+        (64 - sub_bucket_bits + 1) * sub_buckets;
+
+    std::vector<uint64_t> buckets = std::vector<uint64_t>(bucket_count, 0);
+    uint64_t total{0};
+    uint64_t sum{0};
+    uint64_t min_value{std::numeric_limits<uint64_t>::max()};
+    uint64_t max_value{0};
+
+    static constexpr size_t index_of(uint64_t value) noexcept {
+      if (value < 2 * sub_buckets) {
+        return static_cast<size_t>(value);
+      }
+      const auto shift =
+          static_cast<unsigned>(std::bit_width(value)) - (sub_bucket_bits + 1);
+      return static_cast<size_t>(shift * sub_buckets + (value >> shift));
+    }
+
+    // the highest value that falls into the bucket
+    static constexpr uint64_t highest_of(size_t index) noexcept {
+      if (index < 2 * sub_buckets) {
+        return index;
+      }
+      const auto shift = index / sub_buckets - 1;
+      const auto mantissa = index % sub_buckets + sub_buckets;
+      return (mantissa << shift) + ((uint64_t{1} << shift) - 1);
+    }
+
+   public:
+    /// @brief Record a value
+    void record(uint64_t value) noexcept {
+      ++buckets[index_of(value)];
+      ++total;
+      sum += value;
+      min_value = std::min(min_value, value);
+      max_value = std::max(max_value, value);
+    }
+
+    /// @brief Record a duration, negative durations count as 0
+    void record(std::chrono::nanoseconds value) noexcept {
+      record(static_cast<uint64_t>(std::max(value.count(), int64_t{0})));
+    }
+
+    /// @brief Add the values of another histogram
+    void merge(const LatencyHistogram& other) noexcept {
+      for (size_t i = 0; i < bucket_count; ++i) {
+        buckets[i] += other.buckets[i];
+      }
+      total += other.total;
+      sum += other.sum;
+      min_value = std::min(min_value, other.min_value);
+      max_value = std::max(max_value, other.max_value);
+    }
+
+    /// @brief Forget all values
+    void reset() noexcept {
+      std::fill(buckets.begin(), buckets.end(), 0);
+      total = 0;
+      sum = 0;
+      min_value = std::numeric_limits<uint64_t>::max();
+      max_value = 0;
+    }
+
+    [[nodiscard]] uint64_t count() const noexcept { return total; }
+
+    [[nodiscard]] uint64_t min() const noexcept {
+      return total > 0 ? min_value : 0;
+    }
+
+    [[nodiscard]] uint64_t max() const noexcept { return max_value; }
+
+    [[nodiscard]] double mean() const noexcept {
+      return total > 0 ? static_cast<double>(sum) / static_cast<double>(total)
+                       : 0.0;
+    }
+
+    /**
+     * @brief The value below which the given percentage of values fall
+     *
+     * @param percent 0 to 100, like 99.9
+     * @return uint64_t 0 if nothing was recorded
+     */
+    [[nodiscard]] uint64_t percentile(double percent) const noexcept {
+      if (total == 0) {
+        return 0;
+      }
+      percent = std::clamp(percent, 0.0, 100.0);
+      auto wanted = static_cast<uint64_t>(
+          percent / 100.0 * static_cast<double>(total) + 0.5);
+      wanted = std::clamp(wanted, uint64_t{1}, total);
+      uint64_t seen = 0;
+      for (size_t i = 0; i < bucket_count; ++i) {
+        seen += buckets[i];
+        if (seen >= wanted) {
+          return std::clamp(highest_of(i), min_value, max_value);
+        }
+      }
+      return max_value;
+    }
+
+    [[nodiscard]] uint64_t p50() const noexcept { return percentile(50.0); }
+    [[nodiscard]] uint64_t p99() const noexcept { return percentile(99.0); }
+    [[nodiscard]] uint64_t p999() const noexcept { return percentile(99.9); }
+  };
+
+}  // namespace zq
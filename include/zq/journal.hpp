@@ -0,0 +1,690 @@
+#pragma once
+
+// Recording and replaying typed message streams, POSIX only
+
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <expected>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "error.hpp"
+#include "mapping.hpp"
+#include "message.hpp"
+#include "wait.hpp"
+
+namespace zq {
+
+  /**
+   * @brief Settings of a Journal
+   */
+  struct JournalOptions {
+    /// size of a segment file, a new one is started when it is full
+    size_t segment_bytes{size_t{64} << 20};
+    /// every n-th record goes into the sparse index
+    uint32_t index_interval{1024};
+  };
+
+  /**
+   * @brief A record of a journal, pointing into the mapped file
+   */
+  struct JournalRecord {
+    uint64_t sequence{0};
+    uint64_t timestamp_ns{0};  ///< system clock, since the epoch
+    std::string_view type{};
+    std::span<const std::byte> payload{};
+    std::span<const std::byte> meta{};
+  };
+
+  namespace detail {
+
+    /// "zq-jrnl" and the format version
+    inline constexpr uint64_t journal_magic = 0x7a712d6a726e6c01;
+
+    struct JournalSegmentHeader {
+      uint64_t magic{journal_magic};
+      uint64_t segment{0};
+      uint64_t first_sequence{0};
+      uint64_t reserved[5]{};
+    };
+
+    /**
+     * @brief Header of a record, followed by type, payload and meta
+     *
+     * size is written last, a size of 0 is the end of the segment.
+     */
+    struct JournalRecordHeader {
+      uint32_t size;  ///< of the whole record, 8 byte aligned
+      uint32_t type_size;
+      uint32_t payload_size;
+      uint32_t meta_size;
+      uint64_t sequence;
+      uint64_t timestamp_ns;
+    };
+
+    /// @brief An entry of the sparse index
+    struct JournalIndexEntry {
+      uint64_t sequence;
+      uint64_t timestamp_ns;
+      uint64_t offset;  ///< of the record in the segment
+    };
+
+    static_assert(sizeof(JournalSegmentHeader) == 64);
+    static_assert(sizeof(JournalRecordHeader) == 32);
+
+    inline std::filesystem::path segment_path(
+        const std::filesystem::path& dir,
+        uint64_t segment,
+        std::string_view extension) {
+      char name[32];
+      std::snprintf(name, sizeof(name), "%08llu",
+                    static_cast<unsigned long long>(segment));
+      return dir / (std::string{name} + std::string{extension});
+    }
+
+    /// @brief The segment numbers in dir, sorted
+    inline std::vector<uint64_t> journal_segments(
+        const std::filesystem::path& dir) {
+      std::vector<uint64_t> segments;
+      std::error_code ec;
+      for (const auto& entry : std::filesystem::directory_iterator{dir, ec}) {
+        if (entry.path().extension() != ".zqj") {
+          continue;
+        }
+        const auto stem = entry.path().stem().string();
+        uint64_t number = 0;
+        auto [end, err] =
+            std::from_chars(stem.data(), stem.data() + stem.size(), number);
+        if (err == std::errc{} && end == stem.data() + stem.size()) {
+          segments.push_back(number);
+        }
+      }
+      std::sort(segments.begin(), segments.end());
+      return segments;
+    }
+
+    /// @brief Map a segment file, read only or read write
+    inline auto map_file(const std::filesystem::path& path,
+                         size_t size,
+                         bool writable) -> std::expected<Mapping, ZqError> {
+      const int fd =
+          ::open(path.c_str(),
+                 writable ? (O_RDWR | O_CREAT | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC),
+                 0644);
+      if (fd < 0) {
+        return std::unexpected(system_error("journal open"));
+      }
+      if (writable) {
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+          ::close(fd);
+          return std::unexpected(system_error("journal truncate"));
+        }
+      } else {
+        struct stat st{};
+        if (::fstat(fd, &st) != 0) {
+          ::close(fd);
+          return std::unexpected(system_error("journal stat"));
+        }
+        size = static_cast<size_t>(st.st_size);
+      }
+      if (size == 0) {
+        ::close(fd);
+        return Mapping{};
+      }
+      auto mapping = map_shared(
+          fd, size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ,
+          "journal mmap");
+      ::close(fd);
+      return mapping;
+    }
+
+    /// @brief The record at offset, nullopt at the end of the segment
+    inline std::optional<JournalRecord> journal_record_at(
+        const Mapping& file,
+        size_t offset,
+        uint32_t& record_size) noexcept {
+      if (offset + sizeof(JournalRecordHeader) > file.size()) {
+        return std::nullopt;
+      }
+      const auto* bytes = file.data() + offset;
+      JournalRecordHeader header;
+      std::memcpy(&header, bytes, sizeof(header));
+      const size_t content = size_t{header.type_size} + header.payload_size +
+                             header.meta_size;
+      if (header.size == 0 || offset + header.size > file.size() ||
+          sizeof(header) + content > header.size) {
+        return std::nullopt;
+      }
+      record_size = header.size;
+      const auto* data = bytes + sizeof(header);
+      return JournalRecord{
+          header.sequence,
+          header.timestamp_ns,
+          {reinterpret_cast<const char*>(data), header.type_size},
+          {data + header.type_size, header.payload_size},
+          {data + header.type_size + header.payload_size, header.meta_size}};
+    }
+
+    inline uint64_t wall_clock_ns() noexcept {
+      using namespace std::chrono;
+      return static_cast<uint64_t>(
+          duration_cast<nanoseconds>(system_clock::now().time_since_epoch())
+              .count());
+    }
+
+  }  // namespace detail
+
+  class Journal;
+  class JournalReader;
+
+  [[nodiscard]] inline auto open_journal(const std::filesystem::path& dir,
+                                         JournalOptions options = {})
+      -> std::expected<Journal, ZqError>;
+
+  [[nodiscard]] inline auto open_journal_reader(
+      const std::filesystem::path& dir)
+      -> std::expected<JournalReader, ZqError>;
+
+  /**
+   * @brief Records typed messages into memory mapped segment files
+   *
+   * Each record holds the type, payload and meta frames, a sequence number
+   * and the time it was appended. Appending copies into the mapped
+   * segment, the kernel writes it to disk in the background. When a
+   * segment is full, the next one is started.
+   *
+   * Every index_interval-th record is noted in a sparse index, that is
+   * written next to the segment when the segment is complete, so a
+   * JournalReader can seek by sequence or time.
+   *
+   * Not thread safe, one thread appends.
+   */
+  class Journal {
+    std::filesystem::path dir;
+    JournalOptions options;
+    detail::Mapping file;
+    uint64_t segment{0};
+    size_t position{0};
+    uint64_t next_sequence{0};
+    std::vector<detail::JournalIndexEntry> index;
+
+    friend auto open_journal(const std::filesystem::path&, JournalOptions)
+        -> std::expected<Journal, ZqError>;
+
+    Journal(std::filesystem::path journal_dir, JournalOptions journal_options)
+        : dir{std::move(journal_dir)}, options{journal_options} {}
+
+    // write the index and cut the segment to what is used
+    auto finish_segment() -> std::expected<void, ZqError> {
+      if (file.data() == nullptr) {
+        return {};
+      }
+      file.reset();
+      const auto path = detail::segment_path(dir, segment, ".zqj");
+      if (::truncate(path.c_str(), static_cast<off_t>(position)) != 0) {
+        return std::unexpected(detail::system_error("journal truncate"));
+      }
+      std::ofstream out{detail::segment_path(dir, segment, ".zqi"),
+                        std::ios::binary | std::ios::trunc};
+      out.write(reinterpret_cast<const char*>(index.data()),
+                static_cast<std::streamsize>(index.size() *
+                                             sizeof(index.front())));
+      index.clear();
+      if (!out) {
+        return std::unexpected(ZqError("journal: index not written"));
+      }
+      return {};
+    }
+
+    auto start_segment(uint64_t number) -> std::expected<void, ZqError> {
+      auto mapped = detail::map_file(detail::segment_path(dir, number, ".zqj"),
+                                     options.segment_bytes, true);
+      if (!mapped) {
+        return std::unexpected(mapped.error());
+      }
+      file = std::move(*mapped);
+      segment = number;
+      const detail::JournalSegmentHeader header{
+          detail::journal_magic, number, next_sequence, {}};
+      std::memcpy(file.data(), &header, sizeof(header));
+      position = sizeof(header);
+      return {};
+    }
+
+    auto roll(size_t record_size) -> std::expected<void, ZqError> {
+      if (sizeof(detail::JournalSegmentHeader) + record_size >
+          options.segment_bytes) {
+        return std::unexpected(ZqError("journal: record larger than segment"));
+      }
+      if (auto rc = finish_segment(); !rc) {
+        return rc;
+      }
+      return start_segment(segment + 1);
+    }
+
+   public:
+    Journal(Journal&& rhs) noexcept
+        : dir{std::move(rhs.dir)},
+          options{rhs.options},
+          file{std::move(rhs.file)},
+          segment{rhs.segment},
+          position{rhs.position},
+          next_sequence{rhs.next_sequence},
+          index{std::move(rhs.index)} {}
+    Journal& operator=(Journal&&) = delete;
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    ~Journal() noexcept { [[maybe_unused]] auto rc = close(); }
+
+    /**
+     * @brief Append a message with the given time stamp
+     *
+     * @param msg
+     * @param timestamp_ns
+     * @return std::expected<void, ZqError> an error if a new segment could
+     * not be created, or the record is larger than a segment
+     */
+    auto append(const TypedMessage& msg, uint64_t timestamp_ns)
+        -> std::expected<void, ZqError> {
+      const auto type_size = msg.type.size();
+      const auto payload_size = msg.payload.size();
+      const auto meta_size = msg.meta.size();
+      const auto record_size =
+          (sizeof(detail::JournalRecordHeader) + type_size + payload_size +
+           meta_size + 7) &
+          ~size_t{7};
+      if (position + record_size > options.segment_bytes) [[unlikely]] {
+        if (auto rc = roll(record_size); !rc) {
+          return rc;
+        }
+      }
+      auto* out = file.data() + position;
+      if (next_sequence % options.index_interval == 0) [[unlikely]] {
+        index.push_back({next_sequence, timestamp_ns, position});
+      }
+      detail::JournalRecordHeader header{
+          0,
+          static_cast<uint32_t>(type_size),
+          static_cast<uint32_t>(payload_size),
+          static_cast<uint32_t>(meta_size),
+          next_sequence,
+          timestamp_ns};
+      std::memcpy(out, &header, sizeof(header));
+      auto* data = out + sizeof(header);
+      std::memcpy(data, msg.type.data(), type_size);
+      if (payload_size > 0) {
+        std::memcpy(data + type_size, msg.payload.data(), payload_size);
+      }
+      if (meta_size > 0) {
+        std::memcpy(data + type_size + payload_size, msg.meta.data(),
+                    meta_size);
+      }
+      // the size last, so a partly written record looks like the end
+      std::atomic_ref<uint32_t>{*reinterpret_cast<uint32_t*>(out)}.store(
+          static_cast<uint32_t>(record_size), std::memory_order_release);
+      position += record_size;
+      ++next_sequence;
+      return {};
+    }
+
+    /**
+     * @brief Append a message, time stamped with the system clock
+     *
+     * @param msg
+     * @return std::expected<void, ZqError>
+     */
+    auto append(const TypedMessage& msg) -> std::expected<void, ZqError> {
+      return append(msg, detail::wall_clock_ns());
+    }
+
+    /// @brief The sequence number the next record gets
+    [[nodiscard]] uint64_t sequence() const noexcept { return next_sequence; }
+
+    /// @brief Ask the kernel to write the current segment to disk, now
+    void flush() noexcept {
+      if (file.data() != nullptr) {
+        ::msync(file.data(), position, MS_ASYNC);
+      }
+    }
+
+    /**
+     * @brief Finish the current segment, called by the destructor
+     *
+     * @return std::expected<void, ZqError>
+     */
+    auto close() -> std::expected<void, ZqError> { return finish_segment(); }
+  };
+
+  /**
+   * @brief Reads the records of a journal directory, zero copy
+   *
+   * All segments are mapped when the reader is opened, records point into
+   * the mapped files and stay valid as long as the reader exists.
+   */
+  class JournalReader {
+    struct Segment {
+      detail::Mapping file;
+      uint64_t first_sequence{0};
+      std::vector<detail::JournalIndexEntry> index;
+    };
+
+    std::vector<Segment> segments;
+    size_t current{0};
+    size_t position{sizeof(detail::JournalSegmentHeader)};
+
+    friend auto open_journal_reader(const std::filesystem::path&)
+        -> std::expected<JournalReader, ZqError>;
+
+    JournalReader() = default;
+
+    // move to the indexed record at or before key in the segment
+    template <typename Key>
+    void seek_in(size_t segment_index, uint64_t key) {
+      current = segment_index;
+      position = sizeof(detail::JournalSegmentHeader);
+      const auto& index = segments[segment_index].index;
+      auto it = std::upper_bound(
+          index.begin(), index.end(), key,
+          [](uint64_t k, const auto& entry) { return k < Key{}(entry); });
+      if (it != index.begin()) {
+        position = std::prev(it)->offset;
+      }
+    }
+
+    struct BySequence {
+      uint64_t operator()(const detail::JournalIndexEntry& e) const noexcept {
+        return e.sequence;
+      }
+    };
+    struct ByTime {
+      uint64_t operator()(const detail::JournalIndexEntry& e) const noexcept {
+        return e.timestamp_ns;
+      }
+    };
+
+   public:
+    JournalReader(JournalReader&&) noexcept = default;
+    JournalReader& operator=(JournalReader&&) noexcept = default;
+    JournalReader(const JournalReader&) = delete;
+    JournalReader& operator=(const JournalReader&) = delete;
+    ~JournalReader() noexcept = default;
+
+    /**
+     * @brief The next record, nullopt at the end of the journal
+     *
+     * @return std::optional<JournalRecord>
+     */
+    [[nodiscard]] std::optional<JournalRecord> next() noexcept {
+      while (current < segments.size()) {
+        uint32_t size = 0;
+        if (auto record = detail::journal_record_at(segments[current].file,
+                                                    position, size)) {
+          position += size;
+          return record;
+        }
+        ++current;
+        position = sizeof(detail::JournalSegmentHeader);
+      }
+      return std::nullopt;
+    }
+
+    /// @brief Start from the beginning again
+    void rewind() noexcept {
+      current = 0;
+      position = sizeof(detail::JournalSegmentHeader);
+    }
+
+    /**
+     * @brief Continue with the first record with at least this sequence
+     *
+     * Uses the sparse index, and reads forward from there.
+     */
+    void seek(uint64_t sequence) noexcept {
+      auto it = std::upper_bound(
+          segments.begin(), segments.end(), sequence,
+          [](uint64_t s, const Segment& seg) { return s < seg.first_sequence; });
+      seek_in<BySequence>(
+          it == segments.begin()
+              ? 0
+              : static_cast<size_t>(std::prev(it) - segments.begin()),
+          sequence);
+      skip_while([sequence](const JournalRecord& r) {
+        return r.sequence < sequence;
+      });
+    }
+
+    /**
+     * @brief Continue with the first record appended at or after this time
+     *
+     * @param timestamp_ns system clock, since the epoch
+     */
+    void seek_time(uint64_t timestamp_ns) noexcept {
+      size_t segment_index = 0;
+      for (size_t i = 0; i < segments.size(); ++i) {
+        const auto& index = segments[i].index;
+        if (!index.empty() && index.front().timestamp_ns <= timestamp_ns) {
+          segment_index = i;
+        }
+      }
+      seek_in<ByTime>(segment_index, timestamp_ns);
+      skip_while([timestamp_ns](const JournalRecord& r) {
+        return r.timestamp_ns < timestamp_ns;
+      });
+    }
+
+    /// @brief Skip records as long as predicate returns true
+    template <typename Predicate>
+    void skip_while(Predicate&& predicate) noexcept {
+      for (;;) {
+        const auto saved_segment = current;
+        const auto saved_position = position;
+        auto record = next();
+        if (!record || !predicate(*record)) {
+          current = saved_segment;
+          position = saved_position;
+          return;
+        }
+      }
+    }
+  };
+
+  /**
+   * @brief Open a journal directory for appending
+   *
+   * Creates the directory if needed. If it has segments already, new
+   * records go into a new segment, and the sequence continues.
+   *
+   * @param dir
+   * @param options
+   * @return std::expected<Journal, ZqError>
+   */
+  inline auto open_journal(const std::filesystem::path& dir,
+                           JournalOptions options)
+      -> std::expected<Journal, ZqError> {
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+      return std::unexpected(
+          ZqError("journal: can not create directory", ec.value()));
+    }
+    options.index_interval = std::max<uint32_t>(options.index_interval, 1);
+    Journal journal{dir, options};
+    const auto segments = detail::journal_segments(dir);
+    uint64_t first = 0;
+    if (!segments.empty()) {
+      first = segments.back() + 1;
+      auto last = detail::map_file(
+          detail::segment_path(dir, segments.back(), ".zqj"), 0, false);
+      if (!last) {
+        return std::unexpected(last.error());
+      }
+      // a segment without records still knows where the sequence was
+      detail::JournalSegmentHeader header{};
+      if (last->size() >= sizeof(header)) {
+        std::memcpy(&header, last->data(), sizeof(header));
+        if (header.magic != detail::journal_magic) {
+          return std::unexpected(ZqError("journal: not a journal segment"));
+        }
+        journal.next_sequence = header.first_sequence;
+      }
+      uint32_t size = 0;
+      size_t offset = sizeof(detail::JournalSegmentHeader);
+      while (auto record = detail::journal_record_at(*last, offset, size)) {
+        journal.next_sequence = record->sequence + 1;
+        offset += size;
+      }
+    }
+    if (auto rc = journal.start_segment(first); !rc) {
+      return std::unexpected(rc.error());
+    }
+    return journal;
+  }
+
+  /**
+   * @brief Open a journal directory for reading
+   *
+   * @param dir
+   * @return std::expected<JournalReader, ZqError>
+   */
+  inline auto open_journal_reader(const std::filesystem::path& dir)
+      -> std::expected<JournalReader, ZqError> {
+    JournalReader reader;
+    for (auto number : detail::journal_segments(dir)) {
+      auto file = detail::map_file(detail::segment_path(dir, number, ".zqj"),
+                                   0, false);
+      if (!file) {
+        return std::unexpected(file.error());
+      }
+      detail::JournalSegmentHeader header{};
+      if (file->size() < sizeof(header)) {
+        continue;
+      }
+      std::memcpy(&header, file->data(), sizeof(header));
+      if (header.magic != detail::journal_magic) {
+        return std::unexpected(ZqError("journal: not a journal segment"));
+      }
+      JournalReader::Segment seg{std::move(*file), header.first_sequence, {}};
+      std::ifstream in{detail::segment_path(dir, number, ".zqi"),
+                       std::ios::binary};
+      detail::JournalIndexEntry entry{};
+      while (in.read(reinterpret_cast<char*>(&entry), sizeof(entry))) {
+        seg.index.push_back(entry);
+      }
+      reader.segments.push_back(std::move(seg));
+    }
+    if (reader.segments.empty()) {
+      return std::unexpected(ZqError("journal: no segments found"));
+    }
+    return reader;
+  }
+
+  /**
+   * @brief A typed message with the content of a record
+   *
+   * Without copying, the message points into the journal, the reader has
+   * to outlive the message.
+   *
+   * @param record
+   * @return TypedMessage
+   */
+  [[nodiscard]] inline TypedMessage to_typed_message(
+      const JournalRecord& record) noexcept {
+    auto view = [](const void* data, size_t size) {
+      Message m;
+      if (size > 0) {
+        zmq_msg_close(std::addressof(m.msg));
+        zmq_msg_init_data(std::addressof(m.msg), const_cast<void*>(data), size,
+                          nullptr, nullptr);
+      }
+      return m;
+    };
+    return TypedMessage{view(record.type.data(), record.type.size()),
+                        view(record.payload.data(), record.payload.size()),
+                        view(record.meta.data(), record.meta.size())};
+  }
+
+  /**
+   * @brief How fast to replay a journal
+   */
+  struct ReplayOptions {
+    /// 1 is the original speed, 2 twice as fast, 0 as fast as possible
+    double speed{1.0};
+  };
+
+  /**
+   * @brief Send the remaining records of a journal
+   *
+   * Works with anything that has send(const TypedMessage&), like Socket
+   * or ShmChannel. Sends that would block are retried.
+   *
+   * @param reader
+   * @param sender
+   * @param options
+   * @return std::expected<size_t, ZmqError> number of messages sent
+   */
+  template <typename Sender>
+  [[nodiscard]] auto replay(JournalReader& reader,
+                            Sender& sender,
+                            ReplayOptions options = {})
+      -> std::expected<size_t, ZmqError> {
+    using namespace std::chrono;
+    size_t sent = 0;
+    std::optional<uint64_t> first_timestamp;
+    // wall clock time stamps can step backwards, pace from the latest seen
+    uint64_t latest_timestamp = 0;
+    const auto start = steady_clock::now();
+    while (auto record = reader.next()) {
+      if (options.speed > 0) {
+        if (!first_timestamp) {
+          first_timestamp = record->timestamp_ns;
+          latest_timestamp = record->timestamp_ns;
+        }
+        latest_timestamp = std::max(latest_timestamp, record->timestamp_ns);
+        const auto offset = static_cast<double>(latest_timestamp -
+                                                *first_timestamp) /
+                            options.speed;
+        const auto due =
+            start + duration_cast<steady_clock::duration>(
+                        duration<double, std::nano>{offset});
+        std::this_thread::sleep_until(due);
+      }
+      const auto msg = to_typed_message(*record);
+      for (;;) {
+        auto rc = sender.send(msg);
+        if (rc) {
+          break;
+        }
+        if (rc.error().errNo != EAGAIN) {
+          return std::unexpected(rc.error());
+        }
+        cpu_relax();
+      }
+      ++sent;
+    }
+    return sent;
+  }
+
+}  // namespace zq
+
+#endif
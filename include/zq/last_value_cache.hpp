@@ -0,0 +1,237 @@
+#pragma once
+
+#include <chrono>
+#include <expected>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+
+#include "error.hpp"
+#include "message.hpp"
+#include "socket.hpp"
+#include "zflags.hpp"
+
+namespace zq {
+
+  /**
+   * @brief Extracts an optional cache key from a typed message
+   *
+   * The last value cache remembers one message per type and key.
+   * Returning an empty string, or not having a key function at all,
+   * means one message per type.
+   */
+  using CacheKeyFunction = std::function<std::string(const TypedMessage&)>;
+
+  /**
+   * @brief A last value cache between an XSUB and an XPUB socket
+   *
+   * Publishers connect to the XSUB (frontend) socket, subscribers to the
+   * XPUB (backend) socket.
+   * All messages are forwarded unchanged from the frontend to the backend,
+   * and the most recent TypedMessage per type (and optional key) is
+   * remembered. Messages that are not typed messages, with other than 2 or
+   * 3 parts, are forwarded but not cached.
+   *
+   * When the backend reports a new subscription, the cached values matching
+   * the subscription prefix are sent immediately, so a late joining
+   * subscriber gets a snapshot instead of waiting for the next update.
+   *
+   * \note XPUB can not address a single subscriber, existing subscribers
+   * of the same prefix receive the cached values again.
+   *
+   * The cache subscribes the frontend to all topics, it needs to see all
+   * values anyway.
+   */
+  class LastValueCache {
+    friend std::expected<LastValueCache, Error> mk_last_value_cache(
+        Socket frontend,
+        Socket backend,
+        CacheKeyFunction key_function) noexcept;
+
+    Socket frontend;
+    Socket backend;
+    CacheKeyFunction cache_key;
+    // type name -> key -> last message
+    std::map<std::string, std::map<std::string, TypedMessage>, std::less<>>
+        cache;
+
+    LastValueCache(Socket f, Socket b, CacheKeyFunction key_function) noexcept
+        : frontend{std::move(f)},
+          backend{std::move(b)},
+          cache_key{std::move(key_function)} {}
+
+    [[nodiscard]] std::expected<size_t, Error> on_frontend() {
+      auto maybe_msgs = frontend.recv_all();
+      if (!maybe_msgs) {
+        return 0;
+      }
+      if (!*maybe_msgs) {
+        return std::unexpected(maybe_msgs->error());
+      }
+      auto& msgs = **maybe_msgs;
+      // only typed messages are cached, type, payload and optional meta
+      if (msgs.size() == 2 || msgs.size() == 3) {
+        TypedMessage msg{shared_copy(msgs[0]), shared_copy(msgs[1]),
+                         msgs.size() == 3 ? shared_copy(msgs[2]) : Message{}};
+        std::string key = cache_key ? cache_key(msg) : std::string{};
+        auto& per_type = cache[as_string(msg.type)];
+        per_type.insert_or_assign(std::move(key), std::move(msg));
+      }
+      // a proxy forwards every message as it is
+      if (auto rc = backend.send(msgs); !rc) {
+        return std::unexpected(rc.error());
+      }
+      return 1;
+    }
+
+    [[nodiscard]] std::expected<size_t, Error> on_backend() {
+      auto maybe_msgs = backend.recv_all();
+      if (!maybe_msgs) {
+        return 0;
+      }
+      if (!*maybe_msgs) {
+        return std::unexpected(maybe_msgs->error());
+      }
+      auto& msgs = **maybe_msgs;
+      // subscription messages are one frame, 1 for subscribe, 0 for
+      // unsubscribe, followed by the topic
+      if (msgs.size() != 1 || msgs[0].size() == 0) {
+        return 0;
+      }
+      const auto frame = as_string_view(msgs[0]);
+      if (frame[0] != 1) {
+        return 0;
+      }
+      return send_snapshot(frame.substr(1));
+    }
+
+   public:
+    LastValueCache(LastValueCache&&) noexcept = default;
+    LastValueCache& operator=(LastValueCache&&) = delete;
+    LastValueCache(const LastValueCache&) = delete;
+    LastValueCache& operator=(const LastValueCache&) = delete;
+    ~LastValueCache() noexcept = default;
+
+    /**
+     * @brief Number of cached messages
+     *
+     * @return size_t
+     */
+    [[nodiscard]] size_t size() const noexcept {
+      size_t count = 0;
+      for (const auto& [_, per_type] : cache) {
+        count += per_type.size();
+      }
+      return count;
+    }
+
+    /**
+     * @brief Send all cached messages whose type matches the topic prefix
+     *
+     * This is what happens on a new subscription, but it can also be
+     * triggered manually.
+     *
+     * @param topic_prefix
+     * @return std::expected<size_t, Error> Number of messages sent
+     */
+    [[nodiscard]] std::expected<size_t, Error> send_snapshot(
+        std::string_view topic_prefix) {
+      size_t sent = 0;
+      for (const auto& [type_name, per_type] : cache) {
+        if (!type_name.starts_with(topic_prefix)) {
+          continue;
+        }
+        for (const auto& [_, msg] : per_type) {
+          if (auto rc = backend.send(msg); !rc) {
+            return std::unexpected(rc.error());
+          }
+          ++sent;
+        }
+      }
+      return sent;
+    }
+
+    /**
+     * @brief Process what is available on the sockets
+     *
+     * Waits at most timeout for activity, forwards published messages and
+     * answers new subscriptions with the cached values.
+     * Call this in a loop.
+     *
+     * @param timeout
+     * @return std::expected<size_t, Error> Number of messages sent
+     */
+    [[nodiscard]] std::expected<size_t, Error> step(
+        std::chrono::milliseconds timeout) {
+      zmq_pollitem_t poll_items[] = {
+          {frontend.socket_ptr.get(), 0, ZMQ_POLLIN, 0},
+          {backend.socket_ptr.get(), 0, ZMQ_POLLIN, 0},
+      };
+      long tm = static_cast<long>(timeout.count());
+      if (zmq_poll(poll_items, 2, tm) == -1) {
+        return std::unexpected(currentZmqError());
+      }
+      size_t handled = 0;
+      if (poll_items[0].revents & ZMQ_POLLIN) {
+        auto rc = on_frontend();
+        if (!rc) {
+          return rc;
+        }
+        handled += *rc;
+      }
+      if (poll_items[1].revents & ZMQ_POLLIN) {
+        auto rc = on_backend();
+        if (!rc) {
+          return rc;
+        }
+        handled += *rc;
+      }
+      return handled;
+    }
+  };
+
+  /**
+   * @brief Factory function for a last value cache
+   *
+   * The frontend must be an XSUB socket, the backend an XPUB socket,
+   * otherwise a ZqError is returned.
+   *
+   * @param frontend XSUB socket publishers connect to
+   * @param backend XPUB socket subscribers connect to
+   * @param key_function optional key, to cache more than one value per type
+   * @return std::expected<LastValueCache, Error>
+   */
+  [[nodiscard]] inline auto mk_last_value_cache(
+      Socket frontend,
+      Socket backend,
+      CacheKeyFunction key_function = {}) noexcept
+      -> std::expected<LastValueCache, Error> {
+    auto frontend_type = frontend.type();
+    if (!frontend_type) {
+      return std::unexpected(frontend_type.error());
+    }
+    auto backend_type = backend.type();
+    if (!backend_type) {
+      return std::unexpected(backend_type.error());
+    }
+    if (*frontend_type != SocketType::XSUB ||
+        *backend_type != SocketType::XPUB) {
+      return std::unexpected(ZqError("frontend must be XSUB, backend XPUB"));
+    }
+    // get every subscription, not only the first one per topic
+    int verbose = 1;
+    if (zmq_setsockopt(backend.socket_ptr.get(),
+                       static_cast<int>(SocketOptionName::XPUB_VERBOSE),
+                       std::addressof(verbose), sizeof(verbose)) != 0) {
+      return std::unexpected(currentZmqError());
+    }
+    // subscribe to everything upstream
+    if (auto rc = frontend.send(str_message("\x01")); !rc) {
+      return std::unexpected(rc.error());
+    }
+    return LastValueCache{std::move(frontend), std::move(backend),
+                          std::move(key_function)};
+  }
+
+}  // namespace zq
@@ -0,0 +1,362 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "error.hpp"
+#include "message.hpp"
+#include "ring.hpp"
+#include "wait.hpp"
+
+namespace zq {
+
+  /// @brief Whether a LocalBus has one or many publishers
+  enum class Producers {
+    SINGLE,  ///< one publisher, subscribers use a SPSC ring
+    MANY,    ///< any number of publishers, subscribers use a MPSC ring
+  };
+
+  /**
+   * @brief Settings of a LocalBus
+   */
+  struct LocalBusOptions {
+    /// messages a subscriber can queue, rounded up to a power of 2
+    size_t capacity{1024};
+    Producers producers{Producers::MANY};
+    WaitMode wait_mode{WaitMode::FUTEX};
+    /// with FUTEX, how often to check for data before sleeping
+    unsigned spin_count{2000};
+  };
+
+  namespace detail {
+
+    /**
+     * @brief The queue and the topics of one subscriber
+     */
+    struct LocalSubscription {
+      std::vector<std::string> prefixes;
+      std::optional<SpscRing<TypedMessage>> spsc;
+      std::optional<MpscRing<TypedMessage>> mpsc;
+      Waiter waiter;
+      std::atomic<uint64_t> dropped{0};
+
+      LocalSubscription(std::vector<std::string> topics,
+                        const LocalBusOptions& options)
+          : prefixes{std::move(topics)} {
+        if (options.producers == Producers::SINGLE) {
+          spsc.emplace(options.capacity);
+        } else {
+          mpsc.emplace(options.capacity);
+        }
+      }
+
+      [[nodiscard]] bool matches(std::string_view type) const noexcept {
+        if (prefixes.empty()) {
+          return true;
+        }
+        for (const auto& prefix : prefixes) {
+          if (type.starts_with(prefix)) {
+            return true;
+          }
+        }
+        return false;
+      }
+
+      bool push(TypedMessage&& msg) noexcept {
+        const bool pushed = spsc ? spsc->try_push(std::move(msg))
+                                 : mpsc->try_push(std::move(msg));
+        if (pushed) {
+          waiter.notify();
+        } else {
+          dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        return pushed;
+      }
+
+      std::optional<TypedMessage> pop() noexcept {
+        return spsc ? spsc->try_pop() : mpsc->try_pop();
+      }
+
+      [[nodiscard]] bool empty() const noexcept {
+        return spsc ? spsc->empty() : mpsc->empty();
+      }
+    };
+
+    using LocalSubscriptions =
+        std::vector<std::shared_ptr<LocalSubscription>>;
+
+  }  // namespace detail
+
+  class LocalBus;
+
+  /**
+   * @brief Receives the messages a LocalBus delivers for its topics
+   *
+   * Like a SUB socket, used by one thread.
+   * Unsubscribes when destroyed, the bus must outlive it.
+   */
+  class LocalSubscriber {
+    friend class LocalBus;
+
+    LocalBus* bus;
+    std::shared_ptr<detail::LocalSubscription> subscription;
+    WaitMode wait_mode;
+    unsigned spin_count;
+
+    LocalSubscriber(LocalBus* b,
+                    std::shared_ptr<detail::LocalSubscription> s,
+                    WaitMode mode,
+                    unsigned spins) noexcept
+        : bus{b},
+          subscription{std::move(s)},
+          wait_mode{mode},
+          spin_count{spins} {}
+
+   public:
+    LocalSubscriber(LocalSubscriber&& rhs) noexcept
+        : bus{std::exchange(rhs.bus, nullptr)},
+          subscription{std::move(rhs.subscription)},
+          wait_mode{rhs.wait_mode},
+          spin_count{rhs.spin_count} {}
+
+    LocalSubscriber(const LocalSubscriber&) = delete;
+    LocalSubscriber& operator=(const LocalSubscriber&) = delete;
+    LocalSubscriber& operator=(LocalSubscriber&&) = delete;
+    inline ~LocalSubscriber() noexcept;
+
+    /**
+     * @brief Take a message if one is available
+     *
+     * @return std::optional<TypedMessage> nullopt if there is none
+     */
+    [[nodiscard]] std::optional<TypedMessage> recv() noexcept {
+      return subscription->pop();
+    }
+
+    /**
+     * @brief Wait at most timeout for a message
+     *
+     * Busy spins, or spins and sleeps, depending on the bus options.
+     *
+     * @param timeout
+     * @return std::optional<TypedMessage> nullopt on timeout
+     */
+    [[nodiscard]] std::optional<TypedMessage> await(
+        std::chrono::milliseconds timeout) noexcept {
+      std::optional<TypedMessage> msg;
+      subscription->waiter.wait(
+          wait_mode, spin_count, std::chrono::steady_clock::now() + timeout,
+          [&]() noexcept {
+            msg = subscription->pop();
+            return msg.has_value();
+          });
+      return msg;
+    }
+
+    /// @brief Messages dropped because the queue was full
+    [[nodiscard]] uint64_t dropped() const noexcept {
+      return subscription->dropped.load(std::memory_order_relaxed);
+    }
+  };
+
+  /**
+   * @brief Publishes typed messages to the subscribers of a LocalBus
+   *
+   * Like a PUB socket, used by one thread.
+   * A message that does not fit into the queue of a subscriber is dropped
+   * for that subscriber, like at the high water mark of a PUB socket.
+   */
+  class LocalPublisher {
+    friend class LocalBus;
+
+    LocalBus* bus;
+    uint64_t seen_version{~uint64_t{0}};
+    detail::LocalSubscriptions subscriptions;
+
+    explicit LocalPublisher(LocalBus* b) noexcept : bus{b} {}
+
+    inline void refresh();
+
+   public:
+    LocalPublisher(LocalPublisher&& rhs) noexcept
+        : bus{std::exchange(rhs.bus, nullptr)},
+          seen_version{rhs.seen_version},
+          subscriptions{std::move(rhs.subscriptions)} {}
+
+    LocalPublisher(const LocalPublisher&) = delete;
+    LocalPublisher& operator=(const LocalPublisher&) = delete;
+    LocalPublisher& operator=(LocalPublisher&&) = delete;
+    inline ~LocalPublisher() noexcept;
+
+    /**
+     * @brief Deliver a message to all subscribers of its type
+     *
+     * With more than one subscriber, they share the message content,
+     * see shared_copy.
+     *
+     * @param msg
+     * @return size_t number of subscribers that got the message
+     */
+    inline size_t publish(TypedMessage msg);
+
+    /**
+     * @brief Create a typed message from value and publish it
+     *
+     * @param value
+     * @return size_t number of subscribers that got the message
+     */
+    template <typename T>
+    size_t publish(const T& value)
+      requires(!std::is_same_v<T, TypedMessage>)
+    {
+      return publish(typed_message(value));
+    }
+  };
+
+  /**
+   * @brief Typed publish subscribe between threads of one process
+   *
+   * The same typed messages and subscribe by type prefix as with PUB/SUB
+   * sockets, but messages are moved through lock-free rings, no libzmq
+   * pipes, no mailbox signalling.
+   * Each subscriber has its own ring, SPSC if the bus has a single
+   * publisher, MPSC otherwise.
+   *
+   * Publishers keep a copy of the subscriber list, and only take a lock to
+   * refresh it after subscribers came or went.
+   *
+   * The bus must outlive its publishers and subscribers.
+   */
+  class LocalBus {
+    friend class LocalSubscriber;
+    friend class LocalPublisher;
+
+    LocalBusOptions options;
+    std::mutex mutex;
+    detail::LocalSubscriptions subscriptions;
+    std::atomic<uint64_t> version{0};
+    std::atomic<unsigned> publishers{0};
+
+    void remove(const detail::LocalSubscription* subscription) {
+      std::lock_guard lock{mutex};
+      std::erase_if(subscriptions, [&](const auto& s) {
+        return s.get() == subscription;
+      });
+      version.fetch_add(1, std::memory_order_release);
+    }
+
+    detail::LocalSubscriptions snapshot(uint64_t& seen) {
+      std::lock_guard lock{mutex};
+      seen = version.load(std::memory_order_acquire);
+      return subscriptions;
+    }
+
+   public:
+    explicit LocalBus(LocalBusOptions bus_options = {}) noexcept
+        : options{bus_options} {}
+
+    LocalBus(const LocalBus&) = delete;
+    LocalBus& operator=(const LocalBus&) = delete;
+    LocalBus(LocalBus&&) = delete;
+    LocalBus& operator=(LocalBus&&) = delete;
+    ~LocalBus() noexcept = default;
+
+    /**
+     * @brief Subscribe to type name prefixes, none means everything
+     *
+     * @param topic_filters
+     * @return LocalSubscriber
+     */
+    [[nodiscard]] LocalSubscriber subscribe(
+        std::initializer_list<std::string_view> topic_filters) {
+      std::vector<std::string> prefixes{topic_filters.begin(),
+                                        topic_filters.end()};
+      auto subscription = std::make_shared<detail::LocalSubscription>(
+          std::move(prefixes), options);
+      {
+        std::lock_guard lock{mutex};
+        subscriptions.push_back(subscription);
+        version.fetch_add(1, std::memory_order_release);
+      }
+      return LocalSubscriber{this, std::move(subscription), options.wait_mode,
+                             options.spin_count};
+    }
+
+    /**
+     * @brief Subscribe to messages of type T
+     *
+     * @return LocalSubscriber
+     */
+    template <typename T>
+    [[nodiscard]] LocalSubscriber subscribe() {
+      return subscribe({wire_type_name<T>()});
+    }
+
+    /**
+     * @brief Create a publisher
+     *
+     * A bus with Producers::SINGLE allows only one publisher at a time,
+     * otherwise a ZqError is returned.
+     *
+     * @return std::expected<LocalPublisher, ZqError>
+     */
+    [[nodiscard]] auto publisher() -> std::expected<LocalPublisher, ZqError> {
+      const auto before = publishers.fetch_add(1);
+      if (options.producers == Producers::SINGLE && before > 0) {
+        publishers.fetch_sub(1);
+        return std::unexpected(ZqError("bus has already a publisher"));
+      }
+      return LocalPublisher{this};
+    }
+  };
+
+  LocalSubscriber::~LocalSubscriber() noexcept {
+    if (bus != nullptr) {
+      bus->remove(subscription.get());
+    }
+  }
+
+  LocalPublisher::~LocalPublisher() noexcept {
+    if (bus != nullptr) {
+      bus->publishers.fetch_sub(1);
+    }
+  }
+
+  void LocalPublisher::refresh() {
+    if (bus->version.load(std::memory_order_acquire) != seen_version) {
+      subscriptions = bus->snapshot(seen_version);
+    }
+  }
+
+  size_t LocalPublisher::publish(TypedMessage msg) {
+    refresh();
+    const auto type = as_string_view(msg.type);
+    detail::LocalSubscription* last = nullptr;
+    size_t delivered = 0;
+    for (const auto& subscription : subscriptions) {
+      if (!subscription->matches(type)) {
+        continue;
+      }
+      // the last match gets the original, the others a shared copy
+      if (last != nullptr && last->push(shared_copy(msg))) {
+        ++delivered;
+      }
+      last = subscription.get();
+    }
+    if (last != nullptr && last->push(std::move(msg))) {
+      ++delivered;
+    }
+    return delivered;
+  }
+
+}  // namespace zq
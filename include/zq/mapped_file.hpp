@@ -0,0 +1,166 @@
+#pragma once
+
+// Sending file contents without copying them, POSIX only
+
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "error.hpp"
+#include "mapping.hpp"
+#include "message.hpp"
+
+namespace zq {
+
+  /// @brief To the end of the file
+  inline constexpr uint64_t whole_file = std::numeric_limits<uint64_t>::max();
+
+  namespace detail {
+
+    // the free function of a file message, it owns the mapping
+    inline void unmap(void*, void* hint) noexcept {
+      delete static_cast<Mapping*>(hint);
+    }
+
+  }  // namespace detail
+
+  /**
+   * @brief A message with the content of a file, or a range of it
+   *
+   * The file is mapped into memory, not read. The message owns the
+   * mapping, it is unmapped when ZeroMQ releases the message, also if it
+   * is shared, see shared_copy.
+   * Send it with Socket::send_shared, Socket::send copies the content.
+   *
+   * The file should not be changed or truncated while the message exists.
+   *
+   * @param path
+   * @param offset where the content starts
+   * @param length bytes, at most to the end of the file
+   * @return std::expected<Message, ZqError>
+   */
+  [[nodiscard]] inline auto file_message(const std::filesystem::path& path,
+                                         uint64_t offset = 0,
+                                         uint64_t length = whole_file)
+      -> std::expected<Message, ZqError> {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return std::unexpected(detail::system_error("file message open"));
+    }
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      return std::unexpected(detail::system_error("file message stat"));
+    }
+    const auto file_size = static_cast<uint64_t>(st.st_size);
+    if (offset > file_size) {
+      ::close(fd);
+      return std::unexpected(ZqError("offset is behind the end of the file"));
+    }
+    const auto size = std::min(length, file_size - offset);
+    if (size == 0) {
+      ::close(fd);
+      return Message{};
+    }
+    // mmap wants an offset at a page boundary
+    const auto page = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+    const auto aligned = offset / page * page;
+    const auto map_length = static_cast<size_t>(size + (offset - aligned));
+    auto mapped = detail::map_shared(fd, map_length, PROT_READ,
+                                     "file message mmap",
+                                     static_cast<off_t>(aligned));
+    ::close(fd);
+    if (!mapped) {
+      return std::unexpected(mapped.error());
+    }
+    ::madvise(mapped->data(), map_length, MADV_SEQUENTIAL);
+    auto* mapping = new detail::Mapping{std::move(*mapped)};
+    Message m;
+    zmq_msg_close(std::addressof(m.msg));
+    if (zmq_msg_init_data(std::addressof(m.msg),
+                          mapping->data() + (offset - aligned),
+                          static_cast<size_t>(size), detail::unmap,
+                          mapping) != 0) {
+      detail::unmap(nullptr, mapping);
+      zmq_msg_init(std::addressof(m.msg));
+      return std::unexpected(ZqError("can not create message"));
+    }
+    return m;
+  }
+
+  /**
+   * @brief A typed message with the content of a file as payload
+   *
+   * @param type_name what to send as type, the topic for subscribers
+   * @param path
+   * @param offset
+   * @param length
+   * @return std::expected<TypedMessage, ZqError>
+   */
+  [[nodiscard]] inline auto typed_file_message(
+      std::string_view type_name,
+      const std::filesystem::path& path,
+      uint64_t offset = 0,
+      uint64_t length = whole_file) -> std::expected<TypedMessage, ZqError> {
+    auto payload = file_message(path, offset, length);
+    if (!payload) {
+      return std::unexpected(payload.error());
+    }
+    return TypedMessage{str_message(type_name), std::move(*payload)};
+  }
+
+  /**
+   * @brief Write the content of a message into a file
+   *
+   * The content goes from the message to the file with write, there is no
+   * buffer in between. The file is created, or truncated.
+   *
+   * @param m
+   * @param path
+   * @return std::expected<size_t, ZqError> bytes written
+   */
+  [[nodiscard]] inline auto write_to_file(const Message& m,
+                                          const std::filesystem::path& path)
+      -> std::expected<size_t, ZqError> {
+    const int fd =
+        ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      return std::unexpected(detail::system_error("write to file open"));
+    }
+    const auto* data = static_cast<const std::byte*>(m.data());
+    size_t written = 0;
+    while (written < m.size()) {
+      const auto rc = ::write(fd, data + written, m.size() - written);
+      if (rc < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        auto error = detail::system_error("write to file write");
+        ::close(fd);
+        return std::unexpected(error);
+      }
+      written += static_cast<size_t>(rc);
+    }
+    if (::close(fd) != 0) {
+      return std::unexpected(detail::system_error("write to file close"));
+    }
+    return written;
+  }
+
+}  // namespace zq
+
+#endif
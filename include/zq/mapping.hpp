@@ -0,0 +1,98 @@
+#pragma once
+
+// Memory mappings and system call errors, shared by the POSIX only headers
+
+#ifndef _WIN32
+
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <expected>
+#include <utility>
+
+#include "error.hpp"
+
+namespace zq {
+
+  namespace detail {
+
+    /**
+     * @brief The error of a failed system call, what it was and errno
+     *
+     * @param what a static string, like "journal open"
+     * @return ZqError
+     */
+    inline ZqError system_error(const char* what) noexcept {
+      return ZqError(what, errno);
+    }
+
+    /// @brief Owns a memory mapping, unmaps it on destruction
+    class Mapping {
+      void* base{nullptr};
+      size_t length{0};
+
+     public:
+      Mapping() noexcept = default;
+      Mapping(void* b, size_t l) noexcept : base{b}, length{l} {}
+      Mapping(Mapping&& rhs) noexcept
+          : base{std::exchange(rhs.base, nullptr)},
+            length{std::exchange(rhs.length, 0)} {}
+      Mapping& operator=(Mapping&& rhs) noexcept {
+        if (this != &rhs) {
+          reset();
+          base = std::exchange(rhs.base, nullptr);
+          length = std::exchange(rhs.length, 0);
+        }
+        return *this;
+      }
+      Mapping(const Mapping&) = delete;
+      Mapping& operator=(const Mapping&) = delete;
+      ~Mapping() noexcept { reset(); }
+
+      void reset() noexcept {
+        if (base != nullptr) {
+          ::munmap(base, length);
+          base = nullptr;
+          length = 0;
+        }
+      }
+
+      [[nodiscard]] std::byte* data() const noexcept {
+        return static_cast<std::byte*>(base);
+      }
+      [[nodiscard]] size_t size() const noexcept { return length; }
+      [[nodiscard]] explicit operator bool() const noexcept {
+        return base != nullptr;
+      }
+    };
+
+    /**
+     * @brief Map length bytes of fd, shared with other mappings of it
+     *
+     * @param fd
+     * @param length
+     * @param protection PROT_READ, or PROT_READ | PROT_WRITE
+     * @param what the context of the error, a static string
+     * @param offset a multiple of the page size
+     * @return std::expected<Mapping, ZqError>
+     */
+    [[nodiscard]] inline auto map_shared(int fd,
+                                         size_t length,
+                                         int protection,
+                                         const char* what,
+                                         off_t offset = 0)
+        -> std::expected<Mapping, ZqError> {
+      void* base = ::mmap(nullptr, length, protection, MAP_SHARED, fd, offset);
+      if (base == MAP_FAILED) {
+        return std::unexpected(system_error(what));
+      }
+      return Mapping{base, length};
+    }
+
+  }  // namespace detail
+
+}  // namespace zq
+
+#endif
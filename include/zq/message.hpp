@@ -1,8 +1,12 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <limits>
+#include <utility>
+#include <variant>
 #include "a4z/typename.hpp"
 #include "config.hpp"
 #include "error.hpp"
@@ -13,7 +17,7 @@ namespace zq {
   // might be std::string, or class std::basic_string<char,struct
   // std::char_traits<char>,class std::allocator<char> >> depending on the
   // platform, therefore a typename that fits into SSO is choosen
-  static inline const auto str_type_name = "zq::str";
+  inline constexpr auto str_type_name = "zq::str";
 
   /**
    * @brief Wrapper for a zmq_msg_t message
@@ -84,16 +88,24 @@ namespace zq {
    * By sending this to the other side, the other side can restore the
    * payload to the original type
    *
+   * Optional, there is a third part, meta, for things like timestamps,
+   * see meta.hpp. It is only sent if it is not empty, and it comes last,
+   * so the type stays the topic for subscriptions.
+   *
    */
   struct TypedMessage {
     Message type;
     Message payload;
+    Message meta;
 
     TypedMessage() noexcept = default;
 
     TypedMessage(Message t, Message p) noexcept
         : type(std::move(t)), payload(std::move(p)) {}
 
+    TypedMessage(Message t, Message p, Message m) noexcept
+        : type(std::move(t)), payload(std::move(p)), meta(std::move(m)) {}
+
     TypedMessage(TypedMessage&&) noexcept = default;
     TypedMessage& operator=(TypedMessage&&) noexcept = default;
 
@@ -102,6 +114,33 @@ namespace zq {
     ~TypedMessage() noexcept = default;
   };
 
+  /**
+   * @brief Create a message that shares the content of the given one
+   *
+   * Uses zmq_msg_copy, so the payload is not copied, ZeroMQ reference counts
+   * it (very small messages are stored inline and therefore copied).
+   *
+   * @param m
+   * @return Message
+   */
+  inline Message shared_copy(const Message& m) noexcept {
+    Message copy;
+    zmq_msg_copy(std::addressof(copy.msg),
+                 const_cast<zmq_msg_t*>(std::addressof(m.msg)));
+    return copy;
+  }
+
+  /**
+   * @brief Create a typed message that shares the content of the given one
+   *
+   * @param tm
+   * @return TypedMessage
+   */
+  inline TypedMessage shared_copy(const TypedMessage& tm) noexcept {
+    return TypedMessage{shared_copy(tm.type), shared_copy(tm.payload),
+                        shared_copy(tm.meta)};
+  }
+
   // create / restore typed messages
 
   // char array shall convert to a string view
@@ -131,6 +170,26 @@ namespace zq {
     return m;
   }
 
+  namespace detail {
+    template <typename T>
+    inline constexpr auto type_name_of = a4z::type_name<T>();
+  }  // namespace detail
+
+  /**
+   * @brief The type name that is sent in the type part for T
+   *
+   * @return std::string_view
+   */
+  template <typename T>
+  constexpr std::string_view wire_type_name() noexcept {
+    if constexpr (std::is_same_v<T, std::string>) {
+      return str_type_name;
+    } else {
+      return std::string_view(detail::type_name_of<T>.c_str(),
+                              detail::type_name_of<T>.size());
+    }
+  }
+
   inline Message str_message(std::string_view val) {
     Message m(val.size());
     memcpy(m.data(), val.data(), val.size());
@@ -164,6 +223,20 @@ namespace zq {
     return std::string_view{data, m.size()};
   }
 
+  /**
+   * @brief The type name in a type part
+   *
+   * A type part is the type name, for partitioned topics followed by a
+   * '\0' and the partition, see partition.hpp. Only the name is the type.
+   *
+   * @param type the type part of a message
+   * @return std::string_view
+   */
+  inline std::string_view type_name_part(const Message& type) {
+    const auto name = as_string_view(type);
+    return name.substr(0, name.find('\0'));
+  }
+
   // restore typed messages
 
   template <typename T>
@@ -177,15 +250,71 @@ namespace zq {
     static_assert(!std::is_same_v<T, T>, "Unsupported type");
   }
 
+  namespace detail {
+    // MetaTag::BATCH and the size of a meta record, see meta.hpp
+    inline constexpr unsigned char batch_meta_tag = 5;
+    inline constexpr size_t meta_record_bytes = 1 + sizeof(uint64_t);
+
+    /// @brief true if the meta part marks a batch, see batching.hpp
+    inline bool is_batch_meta(const Message& meta) noexcept {
+      const auto* data = static_cast<const unsigned char*>(meta.data());
+      const size_t records = meta.size() / meta_record_bytes;
+      for (size_t i = 0; i < records; ++i, data += meta_record_bytes) {
+        if (data[0] == batch_meta_tag) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // a batch has the type of its messages, but restored as one value,
+    // it would be the batch encoding, only a BatchReceiver can split it
+    inline ZqError batch_error() noexcept {
+      return ZqError("Message is a batch, receive it with a BatchReceiver");
+    }
+  }  // namespace detail
+
+  // Restores the payload as T, without looking at the type part, for
+  // callers that checked the type name already, like restore_any.
+  // The built in types skip the check, for other types this is restore_as.
+  template <typename T>
+  auto restore_payload_as(const TypedMessage& msg) noexcept
+      -> restore_result<T> {
+    return restore_as<T>(msg);
+  }
+
+  template <>
+  inline auto restore_payload_as<std::string>(const TypedMessage& msg) noexcept
+      -> restore_result<std::string> {
+    if (detail::is_batch_meta(msg.meta)) {
+      return std::unexpected(detail::batch_error());
+    }
+    return as_string(msg.payload);
+  }
+
+  template <typename T>
+    requires mem_copyable_message<T>
+  inline auto restore_payload_as(const TypedMessage& msg) noexcept
+      -> restore_result<T> {
+    if (detail::is_batch_meta(msg.meta)) {
+      return std::unexpected(detail::batch_error());
+    }
+    if (msg.payload.size() != sizeof(T)) {
+      return std::unexpected(ZqError("Data size does not match"));
+    }
+    T value;
+    memcpy(std::addressof(value), msg.payload.data(), sizeof(T));
+    return value;
+  }
+
   // This is a template specialization for restore_as function for std::string.
   template <>
   inline auto restore_as<std::string>(const TypedMessage& msg) noexcept
       -> restore_result<std::string> {
-    const auto having_name = as_string_view(msg.type);
-    if (having_name != str_type_name) {
+    if (type_name_part(msg.type) != wire_type_name<std::string>()) {
       return std::unexpected(ZqError("Message type does not match"));
     }
-    return as_string(msg.payload);
+    return restore_payload_as<std::string>(msg);
   }
 
   // This is a template specialization for restore_as function for types that
@@ -194,29 +323,73 @@ namespace zq {
     requires mem_copyable_message<T>
   inline auto restore_as(const TypedMessage& msg) noexcept
       -> restore_result<T> {
-    auto check_type_name = [&]() {
-      constexpr auto tn = a4z::type_name<T>();
-      if (msg.type.size() != tn.size()) {
-        return false;
-      }
-      const auto expected_name = std::string_view(tn.c_str(), tn.size());
-      const auto having_name = as_string_view(msg.type);
-      return expected_name == having_name;
-    };
+    if (type_name_part(msg.type) != wire_type_name<T>()) {
+      return std::unexpected(ZqError("Message type does not match"));
+    }
+    return restore_payload_as<T>(msg);
+  }
 
-    auto unexpected = [](std::string_view err_msg) {
-      return std::unexpected(ZqError(err_msg.data()));
-    };
+  namespace detail {
 
-    if (!check_type_name()) {
-      return unexpected("Message type does not match");
+    /// @brief 64 bit FNV-1a, usable at compile time
+    constexpr uint64_t fnv1a(std::string_view data) noexcept {
+      uint64_t hash = 0xcbf29ce484222325u;
+      for (const char c : data) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3u;
+      }
+      return hash;
     }
-    if (msg.payload.size() != sizeof(T)) {
-      return unexpected("Data size does not match");
+
+    // restore_any matched the type name, only the payload is left
+    template <size_t I, typename... Ts>
+    auto restore_alternative(const TypedMessage& msg) noexcept
+        -> std::expected<std::variant<Ts...>, ZqError> {
+      using T = std::variant_alternative_t<I, std::variant<Ts...>>;
+      auto value = restore_payload_as<T>(msg);
+      if (!value) {
+        return std::unexpected(std::move(value.error()));
+      }
+      return std::variant<Ts...>{std::in_place_index<I>, std::move(*value)};
     }
-    T value;
-    memcpy(std::addressof(value), msg.payload.data(), sizeof(T));
-    return value;
+
+  }  // namespace detail
+
+  /**
+   * @brief Restore a message that is one of a closed set of types
+   *
+   * The type part is looked up once, in a table of name hashes built at
+   * compile time, and only the matching type is restored.
+   * Use std::visit on the result to handle each type.
+   *
+   * @tparam Ts the types the message can be
+   * @param msg
+   * @return std::expected<std::variant<Ts...>, ZqError> an error if the type
+   *         is none of Ts, or restoring it failed
+   */
+  template <typename... Ts>
+    requires(sizeof...(Ts) > 0)
+  auto restore_any(const TypedMessage& msg) noexcept
+      -> std::expected<std::variant<Ts...>, ZqError> {
+    using Restore = std::expected<std::variant<Ts...>, ZqError> (*)(
+        const TypedMessage&) noexcept;
+    static constexpr std::array<uint64_t, sizeof...(Ts)> hashes{
+        detail::fnv1a(wire_type_name<Ts>())...};
+    static constexpr std::array<std::string_view, sizeof...(Ts)> names{
+        wire_type_name<Ts>()...};
+    static constexpr auto restore = []<size_t... I>(std::index_sequence<I...>) {
+      return std::array<Restore, sizeof...(Ts)>{
+          &detail::restore_alternative<I, Ts...>...};
+    }(std::index_sequence_for<Ts...>{});
+
+    const auto name = type_name_part(msg.type);
+    const auto hash = detail::fnv1a(name);
+    for (size_t i = 0; i < hashes.size(); ++i) {
+      if (hashes[i] == hash && names[i] == name) {
+        return restore[i](msg);
+      }
+    }
+    return std::unexpected(ZqError("Message type does not match"));
   }
 
 }  // namespace zq
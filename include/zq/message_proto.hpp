@@ -18,34 +18,29 @@ namespace zq {
     return TypedMessage(typename_message<T>(), std::move(payload));
   }
 
-  // This is a template specialization for restore_as function for types derived
-  // from google::protobuf::Message.
   template <protobuf_message T>
-  inline auto restore_as(const TypedMessage& msg) noexcept
+  inline auto restore_payload_as(const TypedMessage& msg) noexcept
       -> restore_result<T> {
-    auto check_type_name = [&]() {
-      constexpr auto tn = a4z::type_name<T>();
-      if (msg.type.size() != tn.size()) {
-        return false;
-      }
-      const auto expected_name = std::string_view(tn.c_str(), tn.size());
-      const auto having_name = as_string_view(msg.type);
-      return expected_name == having_name;
-    };
-
-    auto unexpected = [](std::string_view err_msg) {
-      return std::unexpected(ZqError{err_msg.data()});
-    };
-
-    if (!check_type_name()) {
-      return unexpected("Message type does not match");
+    if (detail::is_batch_meta(msg.meta)) {
+      return std::unexpected(detail::batch_error());
     }
     T value;
     auto proto_size = static_cast<int>(msg.payload.size());
     if (!value.ParseFromArray(msg.payload.data(), proto_size)) {
-      return unexpected("Failed to parse protobuf");
+      return std::unexpected(ZqError{"Failed to parse protobuf"});
     }
     return value;
   }
 
+  // This is a template specialization for restore_as function for types derived
+  // from google::protobuf::Message.
+  template <protobuf_message T>
+  inline auto restore_as(const TypedMessage& msg) noexcept
+      -> restore_result<T> {
+    if (type_name_part(msg.type) != wire_type_name<T>()) {
+      return std::unexpected(ZqError{"Message type does not match"});
+    }
+    return restore_payload_as<T>(msg);
+  }
+
 }  // namespace zq
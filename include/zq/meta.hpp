@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <optional>
+#include <utility>
+
+#include "message.hpp"
+
+namespace zq {
+
+  /**
+   * @brief Known fields of the meta part of a TypedMessage
+   *
+   * The meta part is a sequence of records, each is a one byte tag followed
+   * by a 64 bit value. Readers skip tags they do not know.
+   */
+  enum class MetaTag : uint8_t {
+    SEND_TIME = 1,  ///< steady clock nanoseconds at send time
+    SEQUENCE = 2,   ///< sequence number of the sender
+    TRACE_ID = 3,   ///< trace id, if the message is sampled
+    DEADLINE = 4,   ///< system clock nanoseconds, useless after that
+    BATCH = 5,      ///< the payload holds this many messages, batching.hpp
+  };
+
+  /// A record is the tag plus the value
+  inline constexpr size_t meta_record_size = 1 + sizeof(uint64_t);
+
+  // restore_as rejects batches, message.hpp knows the tag for that
+  static_assert(static_cast<unsigned char>(MetaTag::BATCH) ==
+                detail::batch_meta_tag);
+  static_assert(meta_record_size == detail::meta_record_bytes);
+
+  /// A tag, value pair
+  using MetaField = std::pair<MetaTag, uint64_t>;
+
+  /**
+   * @brief Create a meta message from the given fields
+   *
+   * @param fields
+   * @return Message
+   */
+  inline Message meta_message(std::initializer_list<MetaField> fields) {
+    Message m{fields.size() * meta_record_size};
+    auto* data = static_cast<unsigned char*>(m.data());
+    for (const auto& [tag, value] : fields) {
+      data[0] = static_cast<unsigned char>(tag);
+      std::memcpy(data + 1, std::addressof(value), sizeof(value));
+      data += meta_record_size;
+    }
+    return m;
+  }
+
+  /**
+   * @brief Read a field from a meta message
+   *
+   * @param meta
+   * @param tag
+   * @return std::optional<uint64_t> the value, nullopt if not there
+   */
+  inline std::optional<uint64_t> get_meta(const Message& meta,
+                                          MetaTag tag) noexcept {
+    const auto* data = static_cast<const unsigned char*>(meta.data());
+    const size_t records = meta.size() / meta_record_size;
+    for (size_t i = 0; i < records; ++i, data += meta_record_size) {
+      if (data[0] == static_cast<unsigned char>(tag)) {
+        uint64_t value = 0;
+        std::memcpy(std::addressof(value), data + 1, sizeof(value));
+        return value;
+      }
+    }
+    return std::nullopt;
+  }
+
+  /**
+   * @brief Read a field from the meta part of a typed message
+   *
+   * @param msg
+   * @param tag
+   * @return std::optional<uint64_t> the value, nullopt if not there
+   */
+  inline std::optional<uint64_t> get_meta(const TypedMessage& msg,
+                                          MetaTag tag) noexcept {
+    return get_meta(msg.meta, tag);
+  }
+
+  /**
+   * @brief Set a field in the meta part of a typed message
+   *
+   * Replaces the value if the field exists, otherwise adds the field.
+   * The meta part is rebuilt, not changed in place, since it might be
+   * shared with a copy.
+   *
+   * @param msg
+   * @param tag
+   * @param value
+   */
+  inline void set_meta(TypedMessage& msg, MetaTag tag, uint64_t value) {
+    const auto* old_data = static_cast<const unsigned char*>(msg.meta.data());
+    const size_t old_size = msg.meta.size() / meta_record_size *
+                            meta_record_size;
+    size_t offset = 0;
+    while (offset < old_size &&
+           old_data[offset] != static_cast<unsigned char>(tag)) {
+      offset += meta_record_size;
+    }
+    const size_t new_size =
+        offset < old_size ? old_size : old_size + meta_record_size;
+    Message m{new_size};
+    auto* data = static_cast<unsigned char*>(m.data());
+    if (old_size > 0) {
+      std::memcpy(data, old_data, old_size);
+    }
+    data[offset] = static_cast<unsigned char>(tag);
+    std::memcpy(data + offset + 1, std::addressof(value), sizeof(value));
+    msg.meta = std::move(m);
+  }
+
+}  // namespace zq
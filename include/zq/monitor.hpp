@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <optional>
+#include <string>
+
+#include "error.hpp"
+#include "message.hpp"
+#include "socket.hpp"
+#include "zflags.hpp"
+
+namespace zq {
+
+  /**
+   * @brief A decoded event from a socket monitor
+   *
+   * The meaning of value depends on the event,
+   * it is the file descriptor for connect, accept, close and disconnect,
+   * the errno for failures, and the reconnect interval for CONNECT_RETRIED.
+   */
+  struct SocketEvent {
+    MonitorEvent event{};
+    uint32_t value{0};
+    std::string endpoint{};
+
+    /// @brief true if the event is one of the given events
+    [[nodiscard]] bool is(MonitorEvent events) const noexcept {
+      return static_cast<int>(event & events) != 0;
+    }
+  };
+
+  /**
+   * @brief Decode the two frames a monitor sends per event
+   *
+   * The first frame holds a 16 bit event and a 32 bit value,
+   * the second one the endpoint.
+   *
+   * @param msg
+   * @return std::expected<SocketEvent, ZqError>
+   */
+  [[nodiscard]] inline auto decode_event(const TypedMessage& msg) noexcept
+      -> std::expected<SocketEvent, ZqError> {
+    if (msg.type.size() != sizeof(uint16_t) + sizeof(uint32_t)) {
+      return std::unexpected(ZqError("not a monitor event"));
+    }
+    const auto* data = static_cast<const char*>(msg.type.data());
+    uint16_t event = 0;
+    uint32_t value = 0;
+    std::memcpy(std::addressof(event), data, sizeof(event));
+    std::memcpy(std::addressof(value), data + sizeof(event), sizeof(value));
+    return SocketEvent{static_cast<MonitorEvent>(event), value,
+                       as_string(msg.payload)};
+  }
+
+  /**
+   * @brief Receive an event from a monitor socket, if one is available
+   *
+   * @param monitor the socket returned by Context::monitor
+   * @return std::optional<std::expected<SocketEvent, Error>>
+   */
+  [[nodiscard]] inline auto recv_event(Socket& monitor)
+      -> std::optional<std::expected<SocketEvent, Error>> {
+    auto maybe_msg = monitor.recv();
+    if (!maybe_msg) {
+      return std::nullopt;
+    }
+    if (!*maybe_msg) {
+      return std::unexpected(maybe_msg->error());
+    }
+    auto event = decode_event(**maybe_msg);
+    if (!event) {
+      return std::unexpected(event.error());
+    }
+    return std::move(*event);
+  }
+
+  /**
+   * @brief Wait until one of the given events arrives
+   *
+   * Other events are read and dropped.
+   * Returns nullopt if none of the events arrived within the timeout.
+   *
+   * @param monitor the socket returned by Context::monitor
+   * @param events the events to wait for
+   * @param timeout
+   * @return std::optional<std::expected<SocketEvent, Error>>
+   */
+  [[nodiscard]] inline auto await_event(Socket& monitor,
+                                        MonitorEvent events,
+                                        std::chrono::milliseconds timeout)
+      -> std::optional<std::expected<SocketEvent, Error>> {
+    using clock = std::chrono::steady_clock;
+    const auto deadline = clock::now() + timeout;
+    for (;;) {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - clock::now());
+      auto ready = monitor.poll(std::max(remaining, {}));
+      if (!ready) {
+        return std::unexpected(ready.error());
+      }
+      if (*ready) {
+        auto event = recv_event(monitor);
+        if (event && (!*event || (*event)->is(events))) {
+          return event;
+        }
+      }
+      // also when other events keep coming, they must not extend the wait
+      if (remaining.count() <= 0) {
+        return std::nullopt;
+      }
+    }
+  }
+
+  /**
+   * @brief Wait until the monitored socket finished the ZMTP handshake
+   *
+   * After this, messages sent will not queue up waiting for the connection.
+   * Returns the HANDSHAKE_SUCCEEDED event, or a HANDSHAKE_FAILED_* event if
+   * the handshake failed.
+   * Returns nullopt if nothing happened within the timeout.
+   *
+   * @param monitor the socket returned by Context::monitor
+   * @param timeout
+   * @return std::optional<std::expected<SocketEvent, Error>>
+   */
+  [[nodiscard]] inline auto await_handshake(Socket& monitor,
+                                            std::chrono::milliseconds timeout)
+      -> std::optional<std::expected<SocketEvent, Error>> {
+    constexpr auto handshake_events =
+        MonitorEvent::HANDSHAKE_SUCCEEDED | MonitorEvent::HANDSHAKE_FAILED;
+    return await_event(monitor, handshake_events, timeout);
+  }
+
+}  // namespace zq
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "error.hpp"
+#include "message.hpp"
+#include "socket.hpp"
+
+namespace zq {
+
+  // A partitioned type part is: the type name, '\0', the partition as
+  // 16 bit big endian. The name comes first, so a subscription to the
+  // name still gets all partitions, and big endian keeps the partitions
+  // of a type in order, byte by byte.
+
+  /// @brief Separates type name and partition in the type part
+  inline constexpr char partition_separator = '\0';
+
+  /// @brief Bytes a partition adds to the type part
+  inline constexpr size_t partition_suffix_size = 1 + sizeof(uint16_t);
+
+  /// @brief Partitions first to last, both included
+  struct PartitionRange {
+    uint16_t first{0};
+    uint16_t last{0};
+  };
+
+  /**
+   * @brief The partition of a key, FNV-1a of the key modulo partitions
+   *
+   * Publishers and subscribers must agree on the number of partitions.
+   *
+   * @param key
+   * @param partitions at least 1
+   * @return uint16_t
+   */
+  [[nodiscard]] inline uint16_t partition_for(std::string_view key,
+                                              uint16_t partitions) noexcept {
+    return static_cast<uint16_t>(detail::fnv1a(key) %
+                                 std::max<uint16_t>(partitions, 1));
+  }
+
+  /// @brief The partition of a numeric key, like an account id
+  [[nodiscard]] inline uint16_t partition_for(uint64_t key,
+                                              uint16_t partitions) noexcept {
+    char bytes[sizeof(key)];
+    std::memcpy(bytes, &key, sizeof(key));
+    return partition_for(std::string_view{bytes, sizeof(bytes)}, partitions);
+  }
+
+  /**
+   * @brief The topic of a partition of a type, what the type part holds
+   *
+   * @param type_name see wire_type_name
+   * @param partition
+   * @return std::string
+   */
+  [[nodiscard]] inline std::string partition_topic(std::string_view type_name,
+                                                   uint16_t partition) {
+    std::string topic;
+    topic.reserve(type_name.size() + partition_suffix_size);
+    topic.append(type_name);
+    topic.push_back(partition_separator);
+    topic.push_back(static_cast<char>(partition >> 8));
+    topic.push_back(static_cast<char>(partition & 0xff));
+    return topic;
+  }
+
+  /**
+   * @brief Put a message into a partition of its type
+   *
+   * Replaces a partition the message already has.
+   *
+   * @param msg
+   * @param partition
+   */
+  inline void set_partition(TypedMessage& msg, uint16_t partition) {
+    msg.type = str_message(
+        partition_topic(type_name_part(msg.type), partition));
+  }
+
+  /**
+   * @brief The partition of a message
+   *
+   * @param msg
+   * @return std::optional<uint16_t> nullopt if the message has none
+   */
+  [[nodiscard]] inline std::optional<uint16_t> get_partition(
+      const TypedMessage& msg) {
+    const auto type = as_string_view(msg.type);
+    const auto separator = type.find(partition_separator);
+    if (separator == std::string_view::npos ||
+        type.size() - separator != partition_suffix_size) {
+      return std::nullopt;
+    }
+    const auto high = static_cast<unsigned char>(type[separator + 1]);
+    const auto low = static_cast<unsigned char>(type[separator + 2]);
+    return static_cast<uint16_t>((high << 8) | low);
+  }
+
+  /**
+   * @brief Create a typed message in the partition of key
+   *
+   * @param value
+   * @param key
+   * @param partitions
+   * @return TypedMessage
+   */
+  template <typename T, typename Key>
+  [[nodiscard]] TypedMessage partitioned_message(const T& value,
+                                                 const Key& key,
+                                                 uint16_t partitions) {
+    auto msg = typed_message(value);
+    set_partition(msg, partition_for(key, partitions));
+    return msg;
+  }
+
+  /**
+   * @brief The partitions consumer of consumers owns
+   *
+   * Splits the partitions in consecutive ranges, as even as possible, so
+   * consumers can be added until there is one per partition.
+   *
+   * @param consumer 0 to consumers - 1
+   * @param consumers
+   * @param partitions at least consumers
+   * @return PartitionRange
+   */
+  [[nodiscard]] inline PartitionRange partition_range(
+      uint16_t consumer,
+      uint16_t consumers,
+      uint16_t partitions) noexcept {
+    consumers = std::max<uint16_t>(consumers, 1);
+    const auto begin = uint32_t{partitions} * consumer / consumers;
+    const auto end = uint32_t{partitions} * (consumer + 1u) / consumers;
+    return {static_cast<uint16_t>(begin),
+            static_cast<uint16_t>(std::max(end, begin + 1) - 1)};
+  }
+
+  /**
+   * @brief Subscribe to some partitions of a type
+   *
+   * One subscription per partition, the publisher filters them, so
+   * messages of other partitions are not even sent.
+   *
+   * @param subscriber
+   * @param type_name see wire_type_name
+   * @param partitions
+   * @return std::expected<size_t, Error> number of subscriptions
+   */
+  [[nodiscard]] inline std::expected<size_t, Error> subscribe_partitions(
+      Socket& subscriber,
+      std::string_view type_name,
+      PartitionRange partitions) {
+    if (partitions.first > partitions.last) {
+      return std::unexpected(ZqError("empty partition range"));
+    }
+    size_t count = 0;
+    for (uint32_t p = partitions.first; p <= partitions.last; ++p) {
+      const auto topic =
+          partition_topic(type_name, static_cast<uint16_t>(p));
+      if (auto rc = subscribe(subscriber, {topic}); !rc) {
+        return rc;
+      }
+      ++count;
+    }
+    return count;
+  }
+
+  /**
+   * @brief Subscribe to some partitions of type T
+   *
+   * @tparam T
+   * @param subscriber
+   * @param partitions
+   * @return std::expected<size_t, Error>
+   */
+  template <typename T>
+  [[nodiscard]] std::expected<size_t, Error> subscribe_partitions(
+      Socket& subscriber,
+      PartitionRange partitions) {
+    return subscribe_partitions(subscriber, wire_type_name<T>(), partitions);
+  }
+
+}  // namespace zq
@@ -0,0 +1,365 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "context.hpp"
+#include "error.hpp"
+#include "message.hpp"
+#include "socket.hpp"
+
+namespace zq {
+
+  /// @brief In which order a PriorityChannel reads its lanes
+  enum class PollOrder {
+    STRICT,    ///< the highest priority lane that has a message
+    WEIGHTED,  ///< lanes that have messages share the reads by weight
+  };
+
+  /**
+   * @brief Settings of a PriorityChannel
+   */
+  struct PriorityOptions {
+    PollOrder order{PollOrder::STRICT};
+    /// with WEIGHTED, the share of each lane, priority 0 first,
+    /// lanes without a weight get 1
+    std::vector<unsigned> weights{};
+  };
+
+  /**
+   * @brief The endpoints of the lanes of a priority channel
+   *
+   * Lane i of tcp://host:port uses the port + i, other transports get a
+   * suffix, ipc://name.p0, ipc://name.p1 and so on.
+   * A tcp wildcard port can not be used, the peer must know the ports.
+   *
+   * @param endpoint
+   * @param lanes
+   * @return std::expected<std::vector<std::string>, ZqError>
+   */
+  [[nodiscard]] inline auto lane_endpoints(std::string_view endpoint,
+                                           size_t lanes)
+      -> std::expected<std::vector<std::string>, ZqError> {
+    std::vector<std::string> endpoints;
+    endpoints.reserve(lanes);
+    if (!endpoint.starts_with("tcp://")) {
+      for (size_t i = 0; i < lanes; ++i) {
+        endpoints.push_back(std::string{endpoint} + ".p" + std::to_string(i));
+      }
+      return endpoints;
+    }
+    const auto colon = endpoint.rfind(':');
+    const auto port_text = endpoint.substr(colon + 1);
+    unsigned port = 0;
+    auto [end, ec] = std::from_chars(
+        port_text.data(), port_text.data() + port_text.size(), port);
+    if (ec != std::errc{} || end != port_text.data() + port_text.size() ||
+        port == 0 || port + lanes > 65536) {
+      return std::unexpected(ZqError("priority lanes need a tcp port"));
+    }
+    const auto host = endpoint.substr(0, colon + 1);
+    for (size_t i = 0; i < lanes; ++i) {
+      endpoints.push_back(std::string{host} + std::to_string(port + i));
+    }
+    return endpoints;
+  }
+
+  /**
+   * @brief Typed messages between two endpoints, one socket per priority
+   *
+   * Small control messages that share a socket with bulk data queue
+   * behind it. A PriorityChannel has a socket, a lane, per priority class,
+   * so each class has its own queues, and the receiver decides which lane
+   * to read next. Priority 0 is the highest.
+   *
+   * On send, the lane is the one routed for the type of the message, or
+   * the default priority, the lowest, if there is no route. It can also
+   * be given explicitly. Both sides must have the same number of lanes,
+   * routes are only needed on the sending side.
+   *
+   * Like a socket, a channel must be used by one thread at a time.
+   */
+  class PriorityChannel {
+    std::vector<Socket> lanes;
+    std::vector<zmq_pollitem_t> poll_items;
+    PollOrder order;
+    std::vector<int64_t> weights;
+    std::vector<int64_t> credits;
+    std::vector<std::pair<std::string, size_t>> routes;
+    size_t default_lane;
+
+    [[nodiscard]] size_t lane_index(size_t priority) const noexcept {
+      return std::min(priority, lanes.size() - 1);
+    }
+
+    // smooth weighted round robin over the lanes that have messages
+    [[nodiscard]] size_t weighted_pick() noexcept {
+      int64_t total = 0;
+      size_t pick = lanes.size();
+      for (size_t i = 0; i < lanes.size(); ++i) {
+        if ((poll_items[i].revents & ZMQ_POLLIN) == 0) {
+          continue;
+        }
+        credits[i] += weights[i];
+        total += weights[i];
+        if (pick == lanes.size() || credits[i] > credits[pick]) {
+          pick = i;
+        }
+      }
+      credits[pick] -= total;
+      return pick;
+    }
+
+   public:
+    /**
+     * @brief Create a channel from sockets, one per lane
+     *
+     * The sockets must be bound or connected, lane_sockets[0] has the
+     * highest priority.
+     *
+     * @param lane_sockets at least one
+     * @param options
+     */
+    explicit PriorityChannel(std::vector<Socket> lane_sockets,
+                             PriorityOptions options = {})
+        : lanes{std::move(lane_sockets)},
+          order{options.order},
+          weights(lanes.size(), 1),
+          credits(lanes.size(), 0),
+          default_lane{lanes.empty() ? 0 : lanes.size() - 1} {
+      for (size_t i = 0; i < lanes.size() && i < options.weights.size(); ++i) {
+        weights[i] = std::max<int64_t>(options.weights[i], 1);
+      }
+      for (auto& lane : lanes) {
+        poll_items.push_back({lane.socket_ptr.get(), 0, ZMQ_POLLIN, 0});
+      }
+    }
+
+    PriorityChannel(PriorityChannel&& other) noexcept = default;
+    PriorityChannel& operator=(PriorityChannel&& other) noexcept = default;
+
+    /// @brief Number of lanes, priorities are 0 to lane_count() - 1
+    [[nodiscard]] size_t lane_count() const noexcept { return lanes.size(); }
+
+    /// @brief The socket of a lane, to set options or monitor it
+    [[nodiscard]] Socket& lane(size_t priority) noexcept {
+      return lanes[lane_index(priority)];
+    }
+
+    /**
+     * @brief Send messages with this type name with the given priority
+     *
+     * @param type_name the type frame, see wire_type_name
+     * @param priority clamped to the lowest priority
+     */
+    void route(std::string_view type_name, size_t priority) {
+      for (auto& [name, lane_of_name] : routes) {
+        if (name == type_name) {
+          lane_of_name = lane_index(priority);
+          return;
+        }
+      }
+      routes.emplace_back(std::string{type_name}, lane_index(priority));
+    }
+
+    /**
+     * @brief Send messages of type T with the given priority
+     *
+     * @tparam T
+     * @param priority
+     */
+    template <typename T>
+    void route(size_t priority) {
+      route(wire_type_name<T>(), priority);
+    }
+
+    /// @brief The priority of messages without a route, the lowest if unset
+    void default_priority(size_t priority) noexcept {
+      default_lane = lane_index(priority);
+    }
+
+    /**
+     * @brief The priority a message would be sent with
+     *
+     * @param msg
+     * @return size_t
+     */
+    [[nodiscard]] size_t priority_of(const TypedMessage& msg) const noexcept {
+      const auto type_name = type_name_part(msg.type);
+      for (const auto& [name, lane_of_name] : routes) {
+        if (name == type_name) {
+          return lane_of_name;
+        }
+      }
+      return default_lane;
+    }
+
+    /**
+     * @brief Send a message on the lane routed for its type
+     *
+     * @param msg
+     * @return std::expected<size_t, ZmqError> bytes sent
+     */
+    [[nodiscard]] std::expected<size_t, ZmqError> send(
+        const TypedMessage& msg) {
+      return lanes[priority_of(msg)].send(msg);
+    }
+
+    /**
+     * @brief Send a message with an explicit priority
+     *
+     * @param msg
+     * @param priority clamped to the lowest priority
+     * @return std::expected<size_t, ZmqError> bytes sent
+     */
+    [[nodiscard]] std::expected<size_t, ZmqError> send(const TypedMessage& msg,
+                                                       size_t priority) {
+      return lanes[lane_index(priority)].send(msg);
+    }
+
+    /**
+     * @brief Create a typed message from value, and send it on its lane
+     *
+     * @param value
+     * @return std::expected<size_t, ZmqError>
+     */
+    template <typename T>
+    [[nodiscard]] std::expected<size_t, ZmqError> send(const T& value)
+      requires(!std::is_same_v<T, TypedMessage>)
+    {
+      return send(typed_message(value));
+    }
+
+    /**
+     * @brief Wait for a message on any lane, read it in priority order
+     *
+     * If messages wait on more than one lane, STRICT reads the highest
+     * priority one, WEIGHTED shares the reads by the weights of the lanes.
+     *
+     * @param timeout
+     * @return std::optional<std::expected<TypedMessage, Error>> nullopt if
+     *         nothing arrived in time
+     */
+    [[nodiscard]] std::optional<std::expected<TypedMessage, Error>> await(
+        std::chrono::milliseconds timeout) {
+      if (lanes.empty()) {
+        return std::nullopt;
+      }
+      const auto rc = zmq_poll(poll_items.data(),
+                               static_cast<int>(poll_items.size()),
+                               static_cast<long>(timeout.count()));
+      if (rc == -1) {
+        return std::unexpected(currentZmqError());
+      }
+      if (rc == 0) {
+        return std::nullopt;
+      }
+      if (order == PollOrder::WEIGHTED) {
+        return lanes[weighted_pick()].recv();
+      }
+      for (size_t i = 0; i < lanes.size(); ++i) {
+        if ((poll_items[i].revents & ZMQ_POLLIN) != 0) {
+          return lanes[i].recv();
+        }
+      }
+      return std::nullopt;
+    }
+
+    /**
+     * @brief Read a message if one is there, in priority order
+     *
+     * @return std::optional<std::expected<TypedMessage, Error>>
+     */
+    [[nodiscard]] std::optional<std::expected<TypedMessage, Error>> recv() {
+      return await(std::chrono::milliseconds{0});
+    }
+  };
+
+  namespace detail {
+
+    template <typename Attach>
+    auto mk_priority_channel(Context& context,
+                             SocketType type,
+                             std::string_view endpoint,
+                             size_t lanes,
+                             PriorityOptions options,
+                             Attach&& attach)
+        -> std::expected<PriorityChannel, Error> {
+      if (lanes == 0) {
+        return std::unexpected(ZqError("a priority channel needs a lane"));
+      }
+      auto endpoints = lane_endpoints(endpoint, lanes);
+      if (!endpoints) {
+        return std::unexpected(endpoints.error());
+      }
+      std::vector<Socket> sockets;
+      sockets.reserve(lanes);
+      for (const auto& lane_endpoint : *endpoints) {
+        auto socket = context.socket(type);
+        if (!socket) {
+          return std::unexpected(socket.error());
+        }
+        if (auto rc = attach(*socket, lane_endpoint); !rc) {
+          return std::unexpected(rc.error());
+        }
+        sockets.push_back(std::move(*socket));
+      }
+      return PriorityChannel{std::move(sockets), std::move(options)};
+    }
+
+  }  // namespace detail
+
+  /**
+   * @brief Bind a priority channel, the lanes get endpoints by
+   * lane_endpoints
+   *
+   * @param context
+   * @param type of all lane sockets
+   * @param endpoint
+   * @param lanes number of priorities
+   * @param options
+   * @return std::expected<PriorityChannel, Error>
+   */
+  [[nodiscard]] inline auto bind_priority_channel(Context& context,
+                                                  SocketType type,
+                                                  std::string_view endpoint,
+                                                  size_t lanes,
+                                                  PriorityOptions options = {})
+      -> std::expected<PriorityChannel, Error> {
+    return detail::mk_priority_channel(
+        context, type, endpoint, lanes, std::move(options),
+        [](Socket& s, const std::string& e) { return s.bind(e); });
+  }
+
+  /**
+   * @brief Connect a priority channel to one created by
+   * bind_priority_channel
+   *
+   * @param context
+   * @param type of all lane sockets
+   * @param endpoint
+   * @param lanes must be the same as the bound side has
+   * @param options
+   * @return std::expected<PriorityChannel, Error>
+   */
+  [[nodiscard]] inline auto connect_priority_channel(
+      Context& context,
+      SocketType type,
+      std::string_view endpoint,
+      size_t lanes,
+      PriorityOptions options = {}) -> std::expected<PriorityChannel, Error> {
+    return detail::mk_priority_channel(
+        context, type, endpoint, lanes, std::move(options),
+        [](Socket& s, const std::string& e) { return s.connect(e); });
+  }
+
+}  // namespace zq
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <type_traits>
+
+namespace zq {
+
+  /// Separates data written by different threads, avoids false sharing
+  inline constexpr size_t cache_line_size = 64;
+
+  /**
+   * @brief Bounded lock-free single producer, single consumer ring
+   *
+   * The capacity is rounded up to a power of 2.
+   * Values are moved in and out, a slot is reused, so T has to be default
+   * constructible and move assignable.
+   */
+  template <typename T>
+    requires std::is_default_constructible_v<T> &&
+             std::is_nothrow_move_assignable_v<T>
+  class SpscRing {
+    const size_t mask;
+    std::unique_ptr<T[]> slots;
+
+    // written by the consumer
+    alignas(cache_line_size) std::atomic<size_t> head{0};
+    size_t cached_tail{0};
+    // written by the producer
+    alignas(cache_line_size) std::atomic<size_t> tail{0};
+    size_t cached_head{0};
+
+   public:
+    explicit SpscRing(size_t capacity)
+        : mask{std::bit_ceil(std::max<size_t>(capacity, 2)) - 1},
+          slots{std::make_unique<T[]>(mask + 1)} {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    [[nodiscard]] size_t capacity() const noexcept { return mask + 1; }
+
+    /**
+     * @brief Add a value, producer only
+     *
+     * @param value moved from only if there was space
+     * @return false if the ring is full
+     */
+    bool try_push(T&& value) noexcept {
+      const auto t = tail.load(std::memory_order_relaxed);
+      if (t - cached_head > mask) {
+        cached_head = head.load(std::memory_order_acquire);
+        if (t - cached_head > mask) {
+          return false;
+        }
+      }
+      slots[t & mask] = std::move(value);
+      tail.store(t + 1, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     * @brief Take a value, consumer only
+     *
+     * @return std::optional<T> nullopt if the ring is empty
+     */
+    std::optional<T> try_pop() noexcept {
+      const auto h = head.load(std::memory_order_relaxed);
+      if (h == cached_tail) {
+        cached_tail = tail.load(std::memory_order_acquire);
+        if (h == cached_tail) {
+          return std::nullopt;
+        }
+      }
+      std::optional<T> value{std::move(slots[h & mask])};
+      head.store(h + 1, std::memory_order_release);
+      return value;
+    }
+
+    /// @brief true if there is nothing to pop, consumer only
+    [[nodiscard]] bool empty() const noexcept {
+      return head.load(std::memory_order_relaxed) ==
+             tail.load(std::memory_order_acquire);
+    }
+  };
+
+  /**
+   * @brief Bounded lock-free multi producer, single consumer ring
+   *
+   * Each slot has a sequence number telling whether it is free or filled,
+   * producers claim a slot with a compare and swap.
+   * Same requirements for T as SpscRing.
+   */
+  template <typename T>
+    requires std::is_default_constructible_v<T> &&
+             std::is_nothrow_move_assignable_v<T>
+  class MpscRing {
+    struct Slot {
+      std::atomic<size_t> sequence{0};
+      T value{};
+    };
+
+    const size_t mask;
+    std::unique_ptr<Slot[]> slots;
+
+    alignas(cache_line_size) std::atomic<size_t> tail{0};
+    alignas(cache_line_size) size_t head{0};
+
+   public:
+    explicit MpscRing(size_t capacity)
+        : mask{std::bit_ceil(std::max<size_t>(capacity, 2)) - 1},
+          slots{std::make_unique<Slot[]>(mask + 1)} {
+      for (size_t i = 0; i <= mask; ++i) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+      }
+    }
+
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    [[nodiscard]] size_t capacity() const noexcept { return mask + 1; }
+
+    /**
+     * @brief Add a value, from any thread
+     *
+     * @param value moved from only if there was space
+     * @return false if the ring is full
+     */
+    bool try_push(T&& value) noexcept {
+      auto pos = tail.load(std::memory_order_relaxed);
+      for (;;) {
+        auto& slot = slots[pos & mask];
+        const auto seq = slot.sequence.load(std::memory_order_acquire);
+        const auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+        if (diff == 0) {
+          if (tail.compare_exchange_weak(pos, pos + 1,
+                                         std::memory_order_relaxed)) {
+            slot.value = std::move(value);
+            slot.sequence.store(pos + 1, std::memory_order_release);
+            return true;
+          }
+        } else if (diff < 0) {
+          return false;
+        } else {
+          pos = tail.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    /**
+     * @brief Take a value, consumer only
+     *
+     * @return std::optional<T> nullopt if the ring is empty
+     */
+    std::optional<T> try_pop() noexcept {
+      auto& slot = slots[head & mask];
+      if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+        return std::nullopt;
+      }
+      std::optional<T> value{std::move(slot.value)};
+      slot.sequence.store(head + mask + 1, std::memory_order_release);
+      ++head;
+      return value;
+    }
+
+    /// @brief true if there is nothing to pop, consumer only
+    [[nodiscard]] bool empty() const noexcept {
+      return slots[head & mask].sequence.load(std::memory_order_acquire) !=
+             head + 1;
+    }
+  };
+
+}  // namespace zq
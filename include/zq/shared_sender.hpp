@@ -0,0 +1,253 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "error.hpp"
+#include "message.hpp"
+#include "ring.hpp"
+#include "socket.hpp"
+#include "wait.hpp"
+
+namespace zq {
+
+  /// @brief What SharedSender::send does if the queue is full
+  enum class WhenFull {
+    BLOCK,  ///< wait until the owner thread made space
+    FAIL,   ///< return an error, the message is not queued
+  };
+
+  /**
+   * @brief Settings of a SharedSender
+   */
+  struct SharedSenderOptions {
+    /// messages that can be queued, rounded up to a power of 2
+    size_t capacity{4096};
+    /// messages the owner thread sends before it signals free space
+    size_t batch_size{64};
+    WhenFull when_full{WhenFull::BLOCK};
+    WaitMode wait_mode{WaitMode::FUTEX};
+    /// with FUTEX, how often to check the queue before sleeping
+    unsigned spin_count{2000};
+    /// on close, how long to retry messages the socket does not take
+    std::chrono::milliseconds linger{1000};
+  };
+
+  /**
+   * @brief Lets many threads send typed messages through one socket
+   *
+   * ZMQ sockets must not be used by more than one thread at a time.
+   * A SharedSender owns a socket and a thread, the owner, that is the only
+   * one using the socket. Other threads put messages into a lock-free MPSC
+   * queue, the owner takes them out in batches and sends them.
+   *
+   * Errors of the socket are not reported to the thread that queued the
+   * message, they are counted, see failed().
+   * If the socket would block, the owner waits until it can send again,
+   * the queue fills up then, and senders block or fail, see WhenFull.
+   *
+   * close, and the destructor, must not run concurrently with send.
+   */
+  class SharedSender {
+    SharedSenderOptions options;
+    Socket socket;
+    MpscRing<TypedMessage> queue;
+    Waiter not_empty;
+    Waiter not_full;
+    std::atomic<bool> closed{false};
+    std::atomic<bool> stopping{false};
+    alignas(cache_line_size) std::atomic<uint64_t> sent_count{0};
+    std::atomic<uint64_t> failed_count{0};
+    std::thread owner;
+
+    // the first frame of a message is sent blocking, so only send when
+    // the socket can take a message
+    [[nodiscard]] bool writable() const noexcept {
+      int events = 0;
+      size_t size = sizeof(events);
+      return zmq_getsockopt(socket.socket_ptr.get(), ZMQ_EVENTS, &events,
+                            &size) == 0 &&
+             (events & ZMQ_POLLOUT) != 0;
+    }
+
+    void wait_writable(std::chrono::milliseconds timeout) noexcept {
+      zmq_pollitem_t item{socket.socket_ptr.get(), 0, ZMQ_POLLOUT, 0};
+      zmq_poll(&item, 1, static_cast<long>(timeout.count()));
+    }
+
+    void send_one(const TypedMessage& msg) noexcept {
+      std::chrono::steady_clock::time_point give_up{};
+      for (;;) {
+        if (writable()) {
+          auto rc = socket.send(msg);
+          if (rc) {
+            sent_count.fetch_add(1, std::memory_order_relaxed);
+            return;
+          }
+          if (rc.error().errNo != EAGAIN) {
+            break;
+          }
+        }
+        if (stopping.load(std::memory_order_acquire)) {
+          const auto now = std::chrono::steady_clock::now();
+          if (give_up == std::chrono::steady_clock::time_point{}) {
+            give_up = now + options.linger;
+          } else if (now >= give_up) {
+            break;
+          }
+        }
+        wait_writable(std::chrono::milliseconds{10});
+      }
+      failed_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void run() noexcept {
+      for (;;) {
+        size_t batch = 0;
+        while (batch < options.batch_size) {
+          auto msg = queue.try_pop();
+          if (!msg) {
+            break;
+          }
+          send_one(*msg);
+          ++batch;
+        }
+        if (batch > 0) {
+          not_full.notify();
+          continue;
+        }
+        if (stopping.load(std::memory_order_acquire)) {
+          // stopping is set after the last send, the queue is empty
+          if (queue.empty()) {
+            return;
+          }
+          continue;
+        }
+        not_empty.wait(options.wait_mode, options.spin_count,
+                       std::chrono::steady_clock::now() +
+                           std::chrono::milliseconds{100},
+                       [this]() noexcept {
+                         return !queue.empty() ||
+                                stopping.load(std::memory_order_acquire);
+                       });
+      }
+    }
+
+    bool enqueue(TypedMessage& msg) noexcept {
+      if (queue.try_push(std::move(msg))) {
+        not_empty.notify();
+        return true;
+      }
+      return false;
+    }
+
+   public:
+    /**
+     * @brief Take over socket, and start the owner thread
+     *
+     * @param sending_socket
+     * @param sender_options
+     */
+    explicit SharedSender(Socket sending_socket,
+                          SharedSenderOptions sender_options = {})
+        : options{sender_options},
+          socket{std::move(sending_socket)},
+          queue{sender_options.capacity} {
+      if (options.batch_size == 0) {
+        options.batch_size = 1;
+      }
+      owner = std::thread{[this]() noexcept { run(); }};
+    }
+
+    SharedSender(const SharedSender&) = delete;
+    SharedSender& operator=(const SharedSender&) = delete;
+    SharedSender(SharedSender&&) = delete;
+    SharedSender& operator=(SharedSender&&) = delete;
+
+    ~SharedSender() noexcept { close(); }
+
+    /**
+     * @brief Queue a message, from any thread
+     *
+     * If the queue is full, blocks or fails, depending on the options.
+     *
+     * @param msg
+     * @return std::expected<void, ZqError> an error if the queue is full
+     *         with WhenFull::FAIL, or the sender is closed
+     */
+    [[nodiscard]] std::expected<void, ZqError> send(TypedMessage msg) {
+      if (closed.load(std::memory_order_relaxed)) {
+        return std::unexpected(ZqError("sender is closed"));
+      }
+      if (enqueue(msg)) {
+        return {};
+      }
+      if (options.when_full == WhenFull::FAIL) {
+        return std::unexpected(ZqError("send queue is full"));
+      }
+      bool queued = false;
+      while (!queued) {
+        not_full.wait(options.wait_mode, options.spin_count,
+                      std::chrono::steady_clock::now() +
+                          std::chrono::milliseconds{100},
+                      [&]() noexcept {
+                        queued = enqueue(msg);
+                        return queued ||
+                               closed.load(std::memory_order_relaxed);
+                      });
+        if (!queued && closed.load(std::memory_order_relaxed)) {
+          return std::unexpected(ZqError("sender is closed"));
+        }
+      }
+      return {};
+    }
+
+    /**
+     * @brief Create a typed message from value and queue it
+     *
+     * @param value
+     * @return std::expected<void, ZqError>
+     */
+    template <typename T>
+    [[nodiscard]] std::expected<void, ZqError> send(const T& value)
+      requires(!std::is_same_v<T, TypedMessage>)
+    {
+      return send(typed_message(value));
+    }
+
+    /**
+     * @brief Send what is queued, and stop the owner thread
+     *
+     * Messages the socket does not take within the linger time are
+     * counted as failed. Later sends return an error.
+     */
+    void close() noexcept {
+      if (closed.exchange(true)) {
+        return;
+      }
+      stopping.store(true, std::memory_order_release);
+      not_empty.notify();
+      not_full.notify();
+      if (owner.joinable()) {
+        owner.join();
+      }
+    }
+
+    /// @brief Messages the socket took
+    [[nodiscard]] uint64_t sent() const noexcept {
+      return sent_count.load(std::memory_order_relaxed);
+    }
+
+    /// @brief Messages the socket refused, or did not take in time on close
+    [[nodiscard]] uint64_t failed() const noexcept {
+      return failed_count.load(std::memory_order_relaxed);
+    }
+  };
+
+}  // namespace zq
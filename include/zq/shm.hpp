@@ -0,0 +1,611 @@
+#pragma once
+
+// Shared memory transport between processes on the same host, Linux only
+
+#ifdef __linux__
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <filesystem>
+#include <new>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "error.hpp"
+#include "mapping.hpp"
+#include "message.hpp"
+#include "ring.hpp"
+#include "wait.hpp"
+
+namespace zq {
+
+  /**
+   * @brief Settings of a shared memory channel
+   */
+  struct ShmOptions {
+    /// bytes per direction, rounded up to a power of 2, messages can use
+    /// up to half of it
+    size_t ring_bytes{size_t{4} << 20};
+    /// FUTEX spins first and then sleeps on an eventfd
+    WaitMode wait_mode{WaitMode::FUTEX};
+    /// with FUTEX, how often to check for data before sleeping
+    unsigned spin_count{2000};
+  };
+
+  namespace detail {
+
+    /// "zq-shm" and the layout version
+    inline constexpr uint64_t shm_magic = 0x7a712d73686d0001;
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                      std::atomic<uint32_t>::is_always_lock_free,
+                  "atomics in shared memory must be lock free");
+
+    /// @brief Owns a file descriptor
+    class Fd {
+      int fd{-1};
+
+     public:
+      Fd() noexcept = default;
+      explicit Fd(int f) noexcept : fd{f} {}
+      Fd(Fd&& rhs) noexcept : fd{std::exchange(rhs.fd, -1)} {}
+      Fd& operator=(Fd&& rhs) noexcept {
+        reset(std::exchange(rhs.fd, -1));
+        return *this;
+      }
+      Fd(const Fd&) = delete;
+      Fd& operator=(const Fd&) = delete;
+      ~Fd() noexcept { reset(); }
+
+      void reset(int f = -1) noexcept {
+        if (fd >= 0) {
+          ::close(fd);
+        }
+        fd = f;
+      }
+
+      [[nodiscard]] int get() const noexcept { return fd; }
+      [[nodiscard]] explicit operator bool() const noexcept { return fd >= 0; }
+    };
+
+    /// @brief One direction, written by one side and read by the other
+    struct ShmRingHeader {
+      alignas(cache_line_size) std::atomic<uint64_t> head{0};
+      alignas(cache_line_size) std::atomic<uint64_t> tail{0};
+      alignas(cache_line_size) std::atomic<uint32_t> reader_sleeping{0};
+      std::atomic<uint32_t> writer_closed{0};
+    };
+
+    /// @brief The start of the segment, followed by the data of both rings
+    struct ShmSegmentHeader {
+      uint64_t magic{shm_magic};
+      uint64_t ring_bytes{0};
+      /// 0 is written by the listening side, 1 by the connecting side
+      std::array<ShmRingHeader, 2> rings{};
+    };
+
+    /**
+     * @brief Header of a message in the ring
+     *
+     * Followed by the type, payload and meta bytes.
+     * Records start at a multiple of 16 and do not wrap, at the end of the
+     * ring there is a wrap record if the next one does not fit.
+     */
+    struct ShmRecord {
+      uint32_t size;  ///< of the whole record, with padding
+      uint32_t type_size;
+      uint32_t payload_size;
+      uint32_t meta_size;
+    };
+
+    inline constexpr uint32_t shm_wrap = ~uint32_t{0};
+    inline constexpr size_t shm_record_align = 16;
+    static_assert(sizeof(ShmRecord) == shm_record_align);
+
+    inline void notify_eventfd(int fd) noexcept {
+      const uint64_t one = 1;
+      [[maybe_unused]] auto rc = ::write(fd, &one, sizeof(one));
+    }
+
+    inline void drain_eventfd(int fd) noexcept {
+      uint64_t value = 0;
+      [[maybe_unused]] auto rc = ::read(fd, &value, sizeof(value));
+    }
+
+    /// @brief Wait for fd to become readable, false on timeout or error
+    inline bool poll_readable(int fd,
+                              std::chrono::milliseconds timeout) noexcept {
+      pollfd pfd{fd, POLLIN, 0};
+      int rc = 0;
+      do {
+        rc = ::poll(&pfd, 1, static_cast<int>(timeout.count()));
+      } while (rc < 0 && errno == EINTR);
+      return rc > 0;
+    }
+
+    inline sockaddr_un unix_address(const std::filesystem::path& path) {
+      sockaddr_un addr{};
+      addr.sun_family = AF_UNIX;
+      const auto& native = path.native();
+      std::memcpy(addr.sun_path, native.data(),
+                  std::min(native.size(), sizeof(addr.sun_path) - 1));
+      return addr;
+    }
+
+  }  // namespace detail
+
+  class ShmChannel;
+  class ShmListener;
+
+  [[nodiscard]] inline auto shm_listen(const std::filesystem::path& path)
+      -> std::expected<ShmListener, ZqError>;
+
+  [[nodiscard]] inline auto shm_connect(const std::filesystem::path& path,
+                                        std::chrono::milliseconds timeout,
+                                        ShmOptions options = {})
+      -> std::expected<ShmChannel, ZqError>;
+
+  /**
+   * @brief A pair of processes exchanging typed messages in shared memory
+   *
+   * Each direction is a single producer, single consumer byte ring in a
+   * memfd segment, so messages are copied once into the ring and once out
+   * of it, with no system call on the hot path.
+   * A side that waits for data sleeps on an eventfd, the sender only writes
+   * to it if the receiver sleeps.
+   *
+   * send and recv work like those of a PAIR Socket, send does not block
+   * and returns EAGAIN if the ring is full.
+   * A channel is used by one thread, like a socket.
+   *
+   * Create one with ShmListener::accept and shm_connect.
+   */
+  class ShmChannel {
+    detail::Mapping segment;
+    detail::ShmRingHeader* tx{nullptr};
+    detail::ShmRingHeader* rx{nullptr};
+    std::byte* tx_data{nullptr};
+    std::byte* rx_data{nullptr};
+    uint64_t mask{0};
+    uint64_t cached_head{0};
+    uint64_t cached_tail{0};
+    detail::Fd tx_event;
+    detail::Fd rx_event;
+    ShmOptions options;
+
+    friend class ShmListener;
+    friend auto shm_connect(const std::filesystem::path&,
+                            std::chrono::milliseconds,
+                            ShmOptions) -> std::expected<ShmChannel, ZqError>;
+
+    ShmChannel(detail::Mapping seg,
+               int side,
+               detail::Fd events_0,
+               detail::Fd events_1,
+               ShmOptions channel_options) noexcept
+        : segment{std::move(seg)}, options{channel_options} {
+      auto* header = std::launder(
+          reinterpret_cast<detail::ShmSegmentHeader*>(segment.data()));
+      const auto ring_bytes = header->ring_bytes;
+      auto* data = segment.data() + sizeof(detail::ShmSegmentHeader);
+      const auto other = 1 - side;
+      tx = &header->rings[static_cast<size_t>(side)];
+      rx = &header->rings[static_cast<size_t>(other)];
+      tx_data = data + static_cast<size_t>(side) * ring_bytes;
+      rx_data = data + static_cast<size_t>(other) * ring_bytes;
+      mask = ring_bytes - 1;
+      tx_event = side == 0 ? std::move(events_0) : std::move(events_1);
+      rx_event = side == 0 ? std::move(events_1) : std::move(events_0);
+    }
+
+    void notify() noexcept {
+      // order the new tail before reading whether the reader sleeps
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (tx->reader_sleeping.load(std::memory_order_relaxed) != 0) {
+        detail::notify_eventfd(tx_event.get());
+      }
+    }
+
+    [[nodiscard]] bool rx_empty() noexcept {
+      const auto h = rx->head.load(std::memory_order_relaxed);
+      if (h != cached_tail) {
+        return false;
+      }
+      cached_tail = rx->tail.load(std::memory_order_acquire);
+      return h == cached_tail;
+    }
+
+    void close() noexcept {
+      if (!segment) {
+        return;
+      }
+      tx->writer_closed.store(1, std::memory_order_release);
+      detail::notify_eventfd(tx_event.get());
+      segment.reset();
+    }
+
+   public:
+    ShmChannel(ShmChannel&& rhs) noexcept
+        : segment{std::move(rhs.segment)},
+          tx{rhs.tx},
+          rx{rhs.rx},
+          tx_data{rhs.tx_data},
+          rx_data{rhs.rx_data},
+          mask{rhs.mask},
+          cached_head{rhs.cached_head},
+          cached_tail{rhs.cached_tail},
+          tx_event{std::move(rhs.tx_event)},
+          rx_event{std::move(rhs.rx_event)},
+          options{rhs.options} {}
+
+    ShmChannel& operator=(ShmChannel&& rhs) noexcept {
+      if (this != &rhs) {
+        close();
+        segment = std::move(rhs.segment);
+        tx = rhs.tx;
+        rx = rhs.rx;
+        tx_data = rhs.tx_data;
+        rx_data = rhs.rx_data;
+        mask = rhs.mask;
+        cached_head = rhs.cached_head;
+        cached_tail = rhs.cached_tail;
+        tx_event = std::move(rhs.tx_event);
+        rx_event = std::move(rhs.rx_event);
+        options = rhs.options;
+      }
+      return *this;
+    }
+
+    ShmChannel(const ShmChannel&) = delete;
+    ShmChannel& operator=(const ShmChannel&) = delete;
+
+    /// @brief Tells the peer, its recv returns an error once all is read
+    ~ShmChannel() noexcept { close(); }
+
+    /// @brief Bytes a message can have at most, type, payload and meta
+    [[nodiscard]] size_t max_message_size() const noexcept {
+      return static_cast<size_t>((mask + 1) / 2) - sizeof(detail::ShmRecord);
+    }
+
+    /**
+     * @brief Send a typed message, does not block
+     *
+     * @param msg
+     * @return std::expected<size_t, ZmqError> bytes sent, EAGAIN if the
+     * ring is full, EMSGSIZE if the message can never fit
+     */
+    [[nodiscard]] std::expected<size_t, ZmqError> send(
+        const TypedMessage& msg) {
+      const auto bytes = msg.type.size() + msg.payload.size() + msg.meta.size();
+      if (bytes > max_message_size()) {
+        return std::unexpected(
+            ZmqError(ZmqErrorNo{EMSGSIZE}, "message too large for the ring"));
+      }
+      const auto need = (sizeof(detail::ShmRecord) + bytes +
+                         detail::shm_record_align - 1) &
+                        ~(detail::shm_record_align - 1);
+      auto t = tx->tail.load(std::memory_order_relaxed);
+      const auto to_end = mask + 1 - (t & mask);
+      const auto total = need + (to_end < need ? to_end : 0);
+      if (t + total - cached_head > mask + 1) {
+        cached_head = tx->head.load(std::memory_order_acquire);
+        if (t + total - cached_head > mask + 1) {
+          return std::unexpected(
+              ZmqError(ZmqErrorNo{EAGAIN}, "shared memory ring is full"));
+        }
+      }
+      if (to_end < need) {
+        const detail::ShmRecord wrap{static_cast<uint32_t>(to_end),
+                                     detail::shm_wrap, 0, 0};
+        std::memcpy(tx_data + (t & mask), &wrap, sizeof(wrap));
+        t += to_end;
+      }
+      auto* out = tx_data + (t & mask);
+      const detail::ShmRecord record{
+          static_cast<uint32_t>(need), static_cast<uint32_t>(msg.type.size()),
+          static_cast<uint32_t>(msg.payload.size()),
+          static_cast<uint32_t>(msg.meta.size())};
+      std::memcpy(out, &record, sizeof(record));
+      out += sizeof(record);
+      for (const Message* part : {&msg.type, &msg.payload, &msg.meta}) {
+        if (part->size() > 0) {
+          std::memcpy(out, part->data(), part->size());
+          out += part->size();
+        }
+      }
+      tx->tail.store(t + need, std::memory_order_release);
+      notify();
+      return bytes;
+    }
+
+    /**
+     * @brief Receive a typed message, if there is one
+     *
+     * @return std::optional<std::expected<TypedMessage, Error>> nullopt if
+     * there is nothing, a ZqError if the peer is gone and all is read
+     */
+    [[nodiscard]] std::optional<std::expected<TypedMessage, Error>> recv() {
+      if (rx_empty()) {
+        if (rx->writer_closed.load(std::memory_order_acquire) != 0 &&
+            rx_empty()) {
+          return std::unexpected(ZqError("shared memory peer closed"));
+        }
+        return std::nullopt;
+      }
+      auto h = rx->head.load(std::memory_order_relaxed);
+      detail::ShmRecord record{};
+      std::memcpy(&record, rx_data + (h & mask), sizeof(record));
+      if (record.type_size == detail::shm_wrap) {
+        h += record.size;
+        std::memcpy(&record, rx_data + (h & mask), sizeof(record));
+      }
+      const auto* in = rx_data + (h & mask) + sizeof(record);
+      TypedMessage typed_message{Message{record.type_size},
+                                 Message{record.payload_size}};
+      if (record.meta_size > 0) {
+        typed_message.meta = Message{record.meta_size};
+      }
+      for (Message* part : {&typed_message.type, &typed_message.payload,
+                            &typed_message.meta}) {
+        if (part->size() > 0) {
+          std::memcpy(part->data(), in, part->size());
+          in += part->size();
+        }
+      }
+      rx->head.store(h + record.size, std::memory_order_release);
+      return typed_message;
+    }
+
+    /**
+     * @brief Wait at most timeout for a message
+     *
+     * Spins first, and with WaitMode::FUTEX sleeps on the eventfd.
+     *
+     * @param timeout
+     * @return std::optional<std::expected<TypedMessage, Error>> nullopt on
+     * timeout
+     */
+    [[nodiscard]] std::optional<std::expected<TypedMessage, Error>> await(
+        std::chrono::milliseconds timeout) {
+      using namespace std::chrono;
+      const auto deadline = steady_clock::now() + timeout;
+      for (unsigned spins = 0;; ++spins) {
+        if (auto msg = recv()) {
+          return msg;
+        }
+        if (options.wait_mode == WaitMode::BUSY_SPIN ||
+            spins < options.spin_count) {
+          if ((spins & 0x3ff) == 0 && steady_clock::now() >= deadline) {
+            return std::nullopt;
+          }
+          cpu_relax();
+          continue;
+        }
+        const auto now = steady_clock::now();
+        if (now >= deadline) {
+          return std::nullopt;
+        }
+        rx->reader_sleeping.store(1, std::memory_order_seq_cst);
+        if (rx_empty() &&
+            rx->writer_closed.load(std::memory_order_acquire) == 0) {
+          detail::poll_readable(
+              rx_event.get(),
+              ceil<milliseconds>(deadline - now));
+          detail::drain_eventfd(rx_event.get());
+        }
+        rx->reader_sleeping.store(0, std::memory_order_relaxed);
+      }
+    }
+  };
+
+  /**
+   * @brief Accepts shared memory channels on a Unix domain socket path
+   *
+   * The handshake: the listener creates the segment and the eventfds and
+   * passes their file descriptors to the connecting process, which checks
+   * the segment and confirms. After that the Unix socket is not used.
+   * The path is removed when the listener is destroyed.
+   */
+  class ShmListener {
+    detail::Fd socket_fd;
+    std::filesystem::path path;
+
+    friend auto shm_listen(const std::filesystem::path&)
+        -> std::expected<ShmListener, ZqError>;
+
+    ShmListener(detail::Fd fd, std::filesystem::path socket_path) noexcept
+        : socket_fd{std::move(fd)}, path{std::move(socket_path)} {}
+
+   public:
+    ShmListener(ShmListener&&) noexcept = default;
+    ShmListener& operator=(ShmListener&&) noexcept = default;
+    ShmListener(const ShmListener&) = delete;
+    ShmListener& operator=(const ShmListener&) = delete;
+
+    ~ShmListener() noexcept {
+      if (socket_fd) {
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+      }
+    }
+
+    /**
+     * @brief Wait at most timeout for a peer and set up a channel with it
+     *
+     * @param timeout
+     * @param options the ring size is used by both sides
+     * @return std::expected<ShmChannel, ZqError>
+     */
+    [[nodiscard]] auto accept(std::chrono::milliseconds timeout,
+                              ShmOptions options = {})
+        -> std::expected<ShmChannel, ZqError> {
+      if (!detail::poll_readable(socket_fd.get(), timeout)) {
+        return std::unexpected(ZqError("shm accept: timeout"));
+      }
+      detail::Fd peer{::accept4(socket_fd.get(), nullptr, nullptr,
+                                SOCK_CLOEXEC)};
+      if (!peer) {
+        return std::unexpected(detail::system_error("shm accept"));
+      }
+      const auto ring_bytes =
+          std::bit_ceil(std::max<size_t>(options.ring_bytes, 4096));
+      const auto segment_size =
+          sizeof(detail::ShmSegmentHeader) + 2 * ring_bytes;
+      detail::Fd memory{::memfd_create("zq-shm", MFD_CLOEXEC)};
+      if (!memory ||
+          ::ftruncate(memory.get(), static_cast<off_t>(segment_size)) != 0) {
+        return std::unexpected(detail::system_error("shm segment"));
+      }
+      auto segment = detail::map_shared(memory.get(), segment_size,
+                                        PROT_READ | PROT_WRITE, "shm mmap");
+      if (!segment) {
+        return std::unexpected(segment.error());
+      }
+      auto* header = new (segment->data()) detail::ShmSegmentHeader{};
+      header->ring_bytes = ring_bytes;
+      detail::Fd events_0{::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)};
+      detail::Fd events_1{::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)};
+      ShmChannel channel{std::move(*segment), 0, std::move(events_0),
+                         std::move(events_1), options};
+      if (!channel.tx_event || !channel.rx_event) {
+        return std::unexpected(detail::system_error("shm eventfd"));
+      }
+
+      // the segment and the two eventfds go to the peer
+      const std::array<int, 3> fds{memory.get(), channel.tx_event.get(),
+                                   channel.rx_event.get()};
+      uint64_t magic = detail::shm_magic;
+      iovec iov{&magic, sizeof(magic)};
+      alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(fds))> control{};
+      msghdr msg{};
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control.data();
+      msg.msg_controllen = control.size();
+      auto* cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+      std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(fds));
+      if (::sendmsg(peer.get(), &msg, MSG_NOSIGNAL) !=
+          static_cast<ssize_t>(sizeof(magic))) {
+        return std::unexpected(detail::system_error("shm handshake"));
+      }
+      char ack = 0;
+      if (!detail::poll_readable(peer.get(), timeout) ||
+          ::recv(peer.get(), &ack, 1, 0) != 1 || ack != 'k') {
+        return std::unexpected(ZqError("shm handshake: no confirmation"));
+      }
+      return channel;
+    }
+  };
+
+  /**
+   * @brief Listen for shared memory channels on a Unix domain socket path
+   *
+   * @param path file system path, must not exist
+   * @return std::expected<ShmListener, ZqError>
+   */
+  inline auto shm_listen(const std::filesystem::path& path)
+      -> std::expected<ShmListener, ZqError> {
+    detail::Fd fd{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    if (!fd) {
+      return std::unexpected(detail::system_error("shm listen"));
+    }
+    const auto addr = detail::unix_address(path);
+    if (::bind(fd.get(), reinterpret_cast<const sockaddr*>(&addr),
+               sizeof(addr)) != 0 ||
+        ::listen(fd.get(), 8) != 0) {
+      return std::unexpected(detail::system_error("shm listen"));
+    }
+    return ShmListener{std::move(fd), path};
+  }
+
+  /**
+   * @brief Connect to a ShmListener and set up a channel
+   *
+   * @param path the path the listener listens on
+   * @param timeout for the handshake
+   * @param options ring_bytes is taken from the listener
+   * @return std::expected<ShmChannel, ZqError>
+   */
+  inline auto shm_connect(const std::filesystem::path& path,
+                          std::chrono::milliseconds timeout,
+                          ShmOptions options)
+      -> std::expected<ShmChannel, ZqError> {
+    detail::Fd fd{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    const auto addr = detail::unix_address(path);
+    if (!fd || ::connect(fd.get(), reinterpret_cast<const sockaddr*>(&addr),
+                         sizeof(addr)) != 0) {
+      return std::unexpected(detail::system_error("shm connect"));
+    }
+    if (!detail::poll_readable(fd.get(), timeout)) {
+      return std::unexpected(ZqError("shm handshake: timeout"));
+    }
+    uint64_t magic = 0;
+    iovec iov{&magic, sizeof(magic)};
+    std::array<int, 3> fds{-1, -1, -1};
+    alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(fds))> control{};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    if (::recvmsg(fd.get(), &msg, MSG_CMSG_CLOEXEC) !=
+        static_cast<ssize_t>(sizeof(magic))) {
+      return std::unexpected(detail::system_error("shm handshake"));
+    }
+    auto* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+      return std::unexpected(ZqError("shm handshake: no segment received"));
+    }
+    std::memcpy(fds.data(), CMSG_DATA(cmsg), sizeof(fds));
+    detail::Fd memory{fds[0]};
+    detail::Fd events_0{fds[1]};
+    detail::Fd events_1{fds[2]};
+    struct stat st{};
+    if (magic != detail::shm_magic || ::fstat(memory.get(), &st) != 0 ||
+        static_cast<size_t>(st.st_size) < sizeof(detail::ShmSegmentHeader)) {
+      return std::unexpected(ZqError("shm handshake: invalid segment"));
+    }
+    const auto segment_size = static_cast<size_t>(st.st_size);
+    auto segment = detail::map_shared(memory.get(), segment_size,
+                                      PROT_READ | PROT_WRITE, "shm mmap");
+    if (!segment) {
+      return std::unexpected(segment.error());
+    }
+    const auto* header = std::launder(
+        reinterpret_cast<const detail::ShmSegmentHeader*>(segment->data()));
+    if (header->magic != detail::shm_magic ||
+        sizeof(detail::ShmSegmentHeader) + 2 * header->ring_bytes !=
+            segment_size) {
+      return std::unexpected(ZqError("shm handshake: invalid segment"));
+    }
+    ShmChannel channel{std::move(*segment), 1, std::move(events_0),
+                       std::move(events_1), options};
+    const char ack = 'k';
+    if (::send(fd.get(), &ack, 1, MSG_NOSIGNAL) != 1) {
+      return std::unexpected(detail::system_error("shm handshake"));
+    }
+    return channel;
+  }
+
+}  // namespace zq
+
+#endif
@@ -0,0 +1,500 @@
+#pragma once
+
+// One writer, many readers, in shared memory, Linux only
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <initializer_list>
+#include <new>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "error.hpp"
+#include "mapping.hpp"
+#include "message.hpp"
+#include "ring.hpp"
+#include "shm.hpp"
+#include "wait.hpp"
+
+namespace zq {
+
+  /**
+   * @brief Settings of a shared memory broadcast ring
+   */
+  struct ShmBroadcastOptions {
+    /// messages kept, rounded up to a power of 2, a reader that falls
+    /// further behind loses messages
+    size_t slots{4096};
+    /// bytes a message can have at most, type, payload and meta
+    size_t slot_size{1024};
+    /// for readers, FUTEX spins first and then sleeps
+    WaitMode wait_mode{WaitMode::FUTEX};
+    /// with FUTEX, how often to check for data before sleeping
+    unsigned spin_count{2000};
+  };
+
+  /**
+   * @brief A message in the broadcast ring, read in place
+   */
+  struct ShmFrames {
+    uint64_t sequence{0};
+    std::string_view type{};
+    std::span<const std::byte> payload{};
+    std::span<const std::byte> meta{};
+  };
+
+  namespace detail {
+
+    /// "zq-bcst" and the layout version
+    inline constexpr uint64_t shm_broadcast_magic = 0x7a712d6263737401;
+
+    /**
+     * @brief The start of the segment, followed by the slots
+     */
+    struct ShmBroadcastHeader {
+      uint64_t magic{shm_broadcast_magic};
+      uint64_t slot_count{0};
+      uint64_t slot_size{0};
+      uint64_t stride{0};
+      /// number of messages written so far
+      alignas(cache_line_size) std::atomic<uint64_t> published{0};
+      std::atomic<uint32_t> closed{0};
+      alignas(cache_line_size) Waiter waiter{true};
+    };
+
+    /**
+     * @brief Header of a slot, followed by type, payload and meta bytes
+     *
+     * sequence works like a seqlock, it is odd while the writer fills the
+     * slot, and 2 * (message number + 1) when the message is complete.
+     */
+    struct ShmBroadcastSlot {
+      std::atomic<uint64_t> sequence{0};
+      uint32_t type_size{0};
+      uint32_t payload_size{0};
+      uint32_t meta_size{0};
+    };
+
+    inline size_t broadcast_header_size() noexcept {
+      return (sizeof(ShmBroadcastHeader) + cache_line_size - 1) &
+             ~(cache_line_size - 1);
+    }
+
+    inline std::string shm_name(std::string_view name) {
+      return name.starts_with('/') ? std::string{name}
+                                   : "/" + std::string{name};
+    }
+
+    /// @brief A mapped broadcast segment, header and slots
+    class BroadcastMapping {
+      Mapping segment;
+
+     public:
+      BroadcastMapping() noexcept = default;
+      explicit BroadcastMapping(Mapping seg) noexcept
+          : segment{std::move(seg)} {}
+
+      [[nodiscard]] explicit operator bool() const noexcept {
+        return static_cast<bool>(segment);
+      }
+
+      [[nodiscard]] ShmBroadcastHeader* header() const noexcept {
+        return std::launder(
+            reinterpret_cast<ShmBroadcastHeader*>(segment.data()));
+      }
+
+      [[nodiscard]] ShmBroadcastSlot* slot(uint64_t sequence) const noexcept {
+        const auto* h = header();
+        auto* base = segment.data() + broadcast_header_size();
+        return std::launder(reinterpret_cast<ShmBroadcastSlot*>(
+            base + (sequence & (h->slot_count - 1)) * h->stride));
+      }
+    };
+
+  }  // namespace detail
+
+  /**
+   * @brief Writes messages into a shared memory broadcast ring
+   *
+   * Like a Disruptor: the writer never waits for readers, each reader has
+   * its own cursor. Publishing is a copy into the next slot and a wake up
+   * if a reader sleeps, the same cost for any number of readers.
+   * A reader that is more than a ring behind detects that it was overrun.
+   *
+   * The segment is a POSIX shared memory object with the given name,
+   * readers open it by name. An existing segment with that name is
+   * replaced, it is removed when the writer is destroyed.
+   */
+  class ShmBroadcaster {
+    detail::BroadcastMapping mapping;
+    std::string name;
+    uint64_t next{0};
+
+   public:
+    ShmBroadcaster(detail::BroadcastMapping m, std::string segment_name)
+        : mapping{std::move(m)}, name{std::move(segment_name)} {}
+
+    ShmBroadcaster(ShmBroadcaster&& rhs) noexcept
+        : mapping{std::move(rhs.mapping)},
+          name{std::move(rhs.name)},
+          next{rhs.next} {}
+    ShmBroadcaster& operator=(ShmBroadcaster&&) = delete;
+    ShmBroadcaster(const ShmBroadcaster&) = delete;
+    ShmBroadcaster& operator=(const ShmBroadcaster&) = delete;
+
+    /// @brief Tells the readers, and removes the segment name
+    ~ShmBroadcaster() noexcept {
+      if (mapping) {
+        auto* header = mapping.header();
+        header->closed.store(1, std::memory_order_release);
+        header->waiter.notify();
+        ::shm_unlink(name.c_str());
+      }
+    }
+
+    /// @brief Bytes a message can have at most, type, payload and meta
+    [[nodiscard]] size_t max_message_size() const noexcept {
+      return mapping.header()->slot_size;
+    }
+
+    /// @brief Messages published so far
+    [[nodiscard]] uint64_t published() const noexcept { return next; }
+
+    /**
+     * @brief Publish a typed message to all readers, does not block
+     *
+     * @param msg
+     * @return std::expected<size_t, ZmqError> bytes written, EMSGSIZE if
+     * the message does not fit into a slot
+     */
+    [[nodiscard]] std::expected<size_t, ZmqError> send(
+        const TypedMessage& msg) {
+      const auto bytes = msg.type.size() + msg.payload.size() + msg.meta.size();
+      if (bytes > max_message_size()) {
+        return std::unexpected(
+            ZmqError(ZmqErrorNo{EMSGSIZE}, "message too large for a slot"));
+      }
+      auto* header = mapping.header();
+      auto* slot = mapping.slot(next);
+      slot->sequence.store(2 * next + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      slot->type_size = static_cast<uint32_t>(msg.type.size());
+      slot->payload_size = static_cast<uint32_t>(msg.payload.size());
+      slot->meta_size = static_cast<uint32_t>(msg.meta.size());
+      auto* out = reinterpret_cast<std::byte*>(slot + 1);
+      for (const Message* part : {&msg.type, &msg.payload, &msg.meta}) {
+        if (part->size() > 0) {
+          std::memcpy(out, part->data(), part->size());
+          out += part->size();
+        }
+      }
+      slot->sequence.store(2 * next + 2, std::memory_order_release);
+      ++next;
+      header->published.store(next, std::memory_order_release);
+      header->waiter.notify();
+      return bytes;
+    }
+  };
+
+  /**
+   * @brief Reads the messages of a ShmBroadcaster, from another process
+   *
+   * A reader starts with the next published message, like a subscriber.
+   * Messages are checked against the type filters in place, only matching
+   * ones are handed out.
+   *
+   * If the writer overwrote messages before they were read, the read
+   * returns a ZqError, lost() tells how many, and the reader continues with
+   * the oldest message still available.
+   */
+  class ShmBroadcastReader {
+    detail::BroadcastMapping mapping;
+    std::vector<std::string> prefixes;
+    uint64_t cursor{0};
+    uint64_t lost_count{0};
+    WaitMode wait_mode;
+    unsigned spin_count;
+
+    [[nodiscard]] bool matches(std::string_view type) const noexcept {
+      if (prefixes.empty()) {
+        return true;
+      }
+      for (const auto& prefix : prefixes) {
+        if (type.starts_with(prefix)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // continue with the oldest message the writer will not overwrite next
+    ZqError overrun() {
+      const auto* header = mapping.header();
+      const auto published = header->published.load(std::memory_order_acquire);
+      const auto oldest = published + 1 > header->slot_count
+                              ? published + 1 - header->slot_count
+                              : 0;
+      const auto next = std::max(cursor + 1, oldest);
+      lost_count += next - cursor;
+      cursor = next;
+      return ZqError("broadcast reader overrun");
+    }
+
+   public:
+    ShmBroadcastReader(detail::BroadcastMapping m,
+                       std::vector<std::string> topics,
+                       const ShmBroadcastOptions& options)
+        : mapping{std::move(m)},
+          prefixes{std::move(topics)},
+          cursor{mapping.header()->published.load(std::memory_order_acquire)},
+          wait_mode{options.wait_mode},
+          spin_count{options.spin_count} {}
+
+    ShmBroadcastReader(ShmBroadcastReader&&) noexcept = default;
+    ShmBroadcastReader& operator=(ShmBroadcastReader&&) noexcept = default;
+    ShmBroadcastReader(const ShmBroadcastReader&) = delete;
+    ShmBroadcastReader& operator=(const ShmBroadcastReader&) = delete;
+    ~ShmBroadcastReader() noexcept = default;
+
+    /// @brief Messages lost by overruns
+    [[nodiscard]] uint64_t lost() const noexcept { return lost_count; }
+
+    /// @brief Messages not read yet, including the ones not matching
+    [[nodiscard]] uint64_t backlog() const noexcept {
+      return mapping.header()->published.load(std::memory_order_acquire) -
+             cursor;
+    }
+
+    /**
+     * @brief Hand the next matching message to handler, in place
+     *
+     * The frames point into shared memory, the writer may overwrite them
+     * while handler runs. That is detected after handler returns, then
+     * the result is an overrun error and whatever handler did with the
+     * frames must be discarded.
+     *
+     * @param handler called with ShmFrames
+     * @return std::expected<bool, ZqError> false if there was nothing to
+     * read, a ZqError on overrun, or if the writer is gone
+     */
+    template <typename Handler>
+    [[nodiscard]] auto read(Handler&& handler)
+        -> std::expected<bool, ZqError> {
+      auto* header = mapping.header();
+      for (;;) {
+        const auto published =
+            header->published.load(std::memory_order_acquire);
+        if (cursor == published) {
+          if (header->closed.load(std::memory_order_acquire) != 0 &&
+              cursor == header->published.load(std::memory_order_acquire)) {
+            return std::unexpected(ZqError("broadcast writer closed"));
+          }
+          return false;
+        }
+        if (published - cursor >= header->slot_count) {
+          return std::unexpected(overrun());
+        }
+        const auto* slot = mapping.slot(cursor);
+        const auto expected = 2 * cursor + 2;
+        if (slot->sequence.load(std::memory_order_acquire) != expected) {
+          return std::unexpected(overrun());
+        }
+        const auto* data = reinterpret_cast<const std::byte*>(slot + 1);
+        const size_t type_size = slot->type_size;
+        const size_t payload_size = slot->payload_size;
+        const size_t meta_size = slot->meta_size;
+        const bool fits =
+            type_size + payload_size + meta_size <= header->slot_size;
+        bool handled = false;
+        if (fits) {
+          const ShmFrames frames{
+              cursor,
+              {reinterpret_cast<const char*>(data), type_size},
+              {data + type_size, payload_size},
+              {data + type_size + payload_size, meta_size}};
+          if (matches(frames.type)) {
+            handler(frames);
+            handled = true;
+          }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (!fits ||
+            slot->sequence.load(std::memory_order_relaxed) != expected) {
+          return std::unexpected(overrun());
+        }
+        ++cursor;
+        if (handled) {
+          return true;
+        }
+      }
+    }
+
+    /**
+     * @brief Receive the next matching message as TypedMessage
+     *
+     * Copies the frames out of the ring, so the message stays valid.
+     *
+     * @return std::optional<std::expected<TypedMessage, Error>> nullopt if
+     * there is nothing to read, a ZqError on overrun or if the writer is gone
+     */
+    [[nodiscard]] std::optional<std::expected<TypedMessage, Error>> recv() {
+      TypedMessage typed_message;
+      auto rc = read([&typed_message](const ShmFrames& frames) {
+        auto copy = [](const void* data, size_t size) {
+          Message m{size};
+          if (size > 0) {
+            std::memcpy(m.data(), data, size);
+          }
+          return m;
+        };
+        typed_message.type = copy(frames.type.data(), frames.type.size());
+        typed_message.payload =
+            copy(frames.payload.data(), frames.payload.size());
+        if (!frames.meta.empty()) {
+          typed_message.meta = copy(frames.meta.data(), frames.meta.size());
+        }
+      });
+      if (!rc) {
+        return std::unexpected(rc.error());
+      }
+      if (!*rc) {
+        return std::nullopt;
+      }
+      return typed_message;
+    }
+
+    /**
+     * @brief Wait at most timeout for the next matching message
+     *
+     * @param timeout
+     * @return std::optional<std::expected<TypedMessage, Error>> nullopt on
+     * timeout
+     */
+    [[nodiscard]] std::optional<std::expected<TypedMessage, Error>> await(
+        std::chrono::milliseconds timeout) {
+      const auto deadline = std::chrono::steady_clock::now() + timeout;
+      auto* header = mapping.header();
+      for (;;) {
+        if (auto msg = recv()) {
+          return msg;
+        }
+        const bool ready =
+            header->waiter.wait(wait_mode, spin_count, deadline, [&]() {
+              return header->published.load(std::memory_order_acquire) !=
+                         cursor ||
+                     header->closed.load(std::memory_order_acquire) != 0;
+            });
+        if (!ready) {
+          return std::nullopt;
+        }
+      }
+    }
+  };
+
+  /**
+   * @brief Create a broadcast ring with the given name
+   *
+   * @param name of the POSIX shared memory object, like zq_prices
+   * @param options
+   * @return std::expected<ShmBroadcaster, ZqError>
+   */
+  [[nodiscard]] inline auto shm_broadcaster(std::string_view name,
+                                            ShmBroadcastOptions options = {})
+      -> std::expected<ShmBroadcaster, ZqError> {
+    auto segment_name = detail::shm_name(name);
+    const auto slot_count =
+        std::bit_ceil(std::max<size_t>(options.slots, 2));
+    const auto stride = (sizeof(detail::ShmBroadcastSlot) + options.slot_size +
+                         cache_line_size - 1) &
+                        ~(cache_line_size - 1);
+    const auto segment_size =
+        detail::broadcast_header_size() + slot_count * stride;
+
+    ::shm_unlink(segment_name.c_str());
+    detail::Fd fd{::shm_open(segment_name.c_str(),
+                             O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600)};
+    if (!fd) {
+      return std::unexpected(detail::system_error("shm broadcast create"));
+    }
+    if (::ftruncate(fd.get(), static_cast<off_t>(segment_size)) != 0) {
+      ::shm_unlink(segment_name.c_str());
+      return std::unexpected(detail::system_error("shm broadcast create"));
+    }
+    auto segment = detail::map_shared(fd.get(), segment_size,
+                                      PROT_READ | PROT_WRITE,
+                                      "shm broadcast mmap");
+    if (!segment) {
+      ::shm_unlink(segment_name.c_str());
+      return std::unexpected(segment.error());
+    }
+    auto* header = new (segment->data()) detail::ShmBroadcastHeader{};
+    detail::BroadcastMapping mapping{std::move(*segment)};
+    header->slot_count = slot_count;
+    header->slot_size = options.slot_size;
+    header->stride = stride;
+    for (uint64_t i = 0; i < slot_count; ++i) {
+      new (mapping.slot(i)) detail::ShmBroadcastSlot{};
+    }
+    return ShmBroadcaster{std::move(mapping), std::move(segment_name)};
+  }
+
+  /**
+   * @brief Open the broadcast ring with the given name for reading
+   *
+   * @param name as given to shm_broadcaster
+   * @param topic_filters type name prefixes, none means everything
+   * @param options wait_mode and spin_count are used
+   * @return std::expected<ShmBroadcastReader, ZqError>
+   */
+  [[nodiscard]] inline auto shm_broadcast_reader(
+      std::string_view name,
+      std::initializer_list<std::string_view> topic_filters = {},
+      ShmBroadcastOptions options = {})
+      -> std::expected<ShmBroadcastReader, ZqError> {
+    const auto segment_name = detail::shm_name(name);
+    detail::Fd fd{::shm_open(segment_name.c_str(), O_RDWR | O_CLOEXEC, 0)};
+    struct stat st{};
+    if (!fd || ::fstat(fd.get(), &st) != 0) {
+      return std::unexpected(detail::system_error("shm broadcast open"));
+    }
+    const auto segment_size = static_cast<size_t>(st.st_size);
+    if (segment_size < detail::broadcast_header_size()) {
+      return std::unexpected(ZqError("shm broadcast open: invalid segment"));
+    }
+    auto segment = detail::map_shared(fd.get(), segment_size,
+                                      PROT_READ | PROT_WRITE,
+                                      "shm broadcast mmap");
+    if (!segment) {
+      return std::unexpected(segment.error());
+    }
+    detail::BroadcastMapping mapping{std::move(*segment)};
+    const auto* header = mapping.header();
+    if (header->magic != detail::shm_broadcast_magic ||
+        detail::broadcast_header_size() +
+                header->slot_count * header->stride !=
+            segment_size) {
+      return std::unexpected(ZqError("shm broadcast open: invalid segment"));
+    }
+    return ShmBroadcastReader{
+        std::move(mapping),
+        std::vector<std::string>{topic_filters.begin(), topic_filters.end()},
+        options};
+  }
+
+}  // namespace zq
+
+#endif
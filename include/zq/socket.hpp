@@ -3,11 +3,13 @@
 #include "a4z/typename.hpp"
 #include "config.hpp"
 #include "message.hpp"
+#include "socket_stats.hpp"
 #include "zflags.hpp"
 
 #include <array>
 #include <chrono>
 #include <memory>
+#include <span>
 #include <string_view>
 #include <vector>
 
@@ -77,14 +79,19 @@ namespace zq {
    *  and receiving messages. In especially, TypeMessage, but also other forms
    *  of multipart messages.
    *  And a single message can also be sent, of course
+   *
+   *  If zq is built with ZQ_SOCKET_STATS, the socket counts what it does,
+   *  see stats(). Otherwise the counters are empty, and cost nothing.
    */
-  struct Socket {
+  struct Socket : private SocketCounters {
     SocketPointer socket_ptr{nullptr};
 
     /// @brief Construct a socket from a pointer
     Socket(SocketPointer socket) noexcept : socket_ptr{std::move(socket)} {};
     /// @brief Move constructor
-    Socket(Socket&& rhs) noexcept : socket_ptr{std::move(rhs.socket_ptr)} {}
+    Socket(Socket&& rhs) noexcept
+        : SocketCounters{std::move(rhs)},
+          socket_ptr{std::move(rhs.socket_ptr)} {}
 
     Socket(Socket const&) = delete;
     Socket& operator=(Socket const&) = delete;
@@ -109,6 +116,61 @@ namespace zq {
       return NoError;
     }
 
+    /**
+     * @brief A snapshot of the socket counters
+     *
+     * All 0 if zq is not built with ZQ_SOCKET_STATS
+     *
+     * @return SocketStats
+     */
+    [[nodiscard]] SocketStats stats() const noexcept {
+      return SocketCounters::snapshot();
+    }
+
+    /**
+     * @brief Bind the socket to an endpoint
+     *
+     * @param endpoint
+     * @return std::expected<void, ZmqError>
+     */
+    [[nodiscard]] std::expected<void, ZmqError> bind(
+        std::string_view endpoint) noexcept {
+      if (zmq_bind(socket_ptr.get(), endpoint.data()) != 0) {
+        return std::unexpected(currentZmqError());
+      }
+      return {};
+    }
+
+    /**
+     * @brief Connect the socket to an endpoint
+     *
+     * @param endpoint
+     * @return std::expected<void, ZmqError>
+     */
+    [[nodiscard]] std::expected<void, ZmqError> connect(
+        std::string_view endpoint) noexcept {
+      if (zmq_connect(socket_ptr.get(), endpoint.data()) != 0) {
+        return std::unexpected(currentZmqError());
+      }
+      return {};
+    }
+
+    /**
+     * @brief Query the type of the socket
+     *
+     * @return std::expected<SocketType, ZmqError>
+     */
+    [[nodiscard]] std::expected<SocketType, ZmqError> type() const noexcept {
+      int val = 0;
+      size_t size = sizeof(val);
+      int rc = zmq_getsockopt(socket_ptr.get(), ZMQ_TYPE, std::addressof(val),
+                              std::addressof(size));
+      if (rc != 0) {
+        return std::unexpected(currentZmqError());
+      }
+      return static_cast<SocketType>(val);
+    }
+
     /**
      * @brief Send one or more messages
      *
@@ -121,41 +183,67 @@ namespace zq {
     [[nodiscard]] std::expected<size_t, ZmqError> send(
         const Message& first,
         const Messages&... messages) {
-      size_t bytes_sent = 0;
-
-      if constexpr (sizeof...(messages) == 0) {
-        auto rc = zmq_send(socket_ptr.get(), first.data(), first.size(),
-                           ZMQ_DONTWAIT);
-        if (rc < 0) {
-          return std::unexpected(currentZmqError());
-        }
-        bytes_sent += static_cast<size_t>(rc);
-      } else {
-        auto rc =
-            zmq_send(socket_ptr.get(), first.data(), first.size(), ZMQ_SNDMORE);
-        if (rc < 0) {
-          return std::unexpected(currentZmqError());
-        }
-        auto maybe_rc = send(messages...);
-        if (!maybe_rc) {
-          return maybe_rc;
-        }
-        bytes_sent += static_cast<size_t>(rc) + maybe_rc.value();
+      auto rc = send_frames(first, messages...);
+      if (rc) {
+        record_send(*rc);
       }
-      return bytes_sent;
+      return rc;
     }
 
     /**
      * @brief Send a typed message
      *
+     * The meta part is only sent if it is not empty
+     *
      * @param msg
      * @return std::expected<size_t, ZmqError>
      */
     [[nodiscard]] std::expected<size_t, ZmqError> send(
         const TypedMessage& msg) {
+      if (msg.meta.size() > 0) {
+        return send(msg.type, msg.payload, msg.meta);
+      }
       return send(msg.type, msg.payload);
     }
 
+    /**
+     * @brief Send a typed message without copying its content
+     *
+     * Each part is sent as a shared copy, see shared_copy, ZeroMQ only
+     * increments the reference count of the content. msg stays valid and can
+     * be sent again, to this or to other sockets.
+     *
+     * Unlike send, this never blocks. If the socket can not take the
+     * message, it returns EAGAIN.
+     *
+     * @param msg
+     * @return std::expected<size_t, ZmqError>
+     */
+    [[nodiscard]] std::expected<size_t, ZmqError> send_shared(
+        const TypedMessage& msg) {
+      const bool with_meta = msg.meta.size() > 0;
+      // once the first part is taken, ZeroMQ takes the whole message
+      auto type = send_shared_frame(msg.type, ZMQ_SNDMORE | ZMQ_DONTWAIT);
+      if (!type) {
+        return type;
+      }
+      auto payload = send_shared_frame(
+          msg.payload, with_meta ? ZMQ_SNDMORE : ZMQ_DONTWAIT);
+      if (!payload) {
+        return payload;
+      }
+      size_t bytes_sent = *type + *payload;
+      if (with_meta) {
+        auto meta = send_shared_frame(msg.meta, ZMQ_DONTWAIT);
+        if (!meta) {
+          return meta;
+        }
+        bytes_sent += *meta;
+      }
+      record_send(bytes_sent);
+      return bytes_sent;
+    }
+
     /**
      * @brief Send a vector or array of Message elements
      *
@@ -173,10 +261,11 @@ namespace zq {
         auto& m = msg[i];
         auto rc = zmq_send(socket_ptr.get(), m.data(), m.size(), flags);
         if (rc < 0) {
-          return std::unexpected(currentZmqError());
+          return send_failed();
         }
         bytes_sent += static_cast<size_t>(rc);
       }
+      record_send(bytes_sent);
       return bytes_sent;
     }
 
@@ -187,6 +276,8 @@ namespace zq {
      *  Returns an Error with a ZqError if there was no multipart message
      *  but only a single one.
      *
+     *  A third part is received as meta, any further parts are dropped.
+     *
      * \note re rec_n or rec_all message are more resilient in
      * case of messages that have more then two parts. In case it's not 100%
      * sure TypeMessage is communicated, better use one of them.
@@ -201,26 +292,50 @@ namespace zq {
 
       if (rc == -1) {
         if (zmq_errno() == EAGAIN) {
+          record_recv_error(EAGAIN);
           return std::nullopt;
         } else {
-          return std::unexpected(currentZmqError());
+          return recv_failed();
         }
       }
+      size_t bytes = static_cast<size_t>(rc);
       int more = 0;
       size_t more_size = sizeof(more);
       rc = zmq_getsockopt(socket_ptr.get(), ZMQ_RCVMORE, &more, &more_size);
       if (rc == -1) {
-        return std::unexpected(currentZmqError());
+        return recv_failed();
       }
       if (more) {
         rc = zmq_msg_recv(std::addressof(typed_message.payload.msg),
                           socket_ptr.get(), 0);
         if (rc == -1) {
-          return std::unexpected(currentZmqError());
+          return recv_failed();
         }
+        bytes += static_cast<size_t>(rc);
       } else {
+        record_recv(1, bytes);
         return std::unexpected(ZqError("no more message"));
       }
+      size_t frames = 2;
+      // an optional meta part, anything after that is dropped
+      while (more) {
+        rc = zmq_getsockopt(socket_ptr.get(), ZMQ_RCVMORE, &more, &more_size);
+        if (rc == -1) {
+          return recv_failed();
+        }
+        if (!more) {
+          break;
+        }
+        Message dropped;
+        Message& target = frames == 2 ? typed_message.meta : dropped;
+        rc = zmq_msg_recv(std::addressof(target.msg), socket_ptr.get(), 0);
+        if (rc == -1) {
+          return recv_failed();
+        }
+        bytes += static_cast<size_t>(rc);
+        ++frames;
+      }
+      record_recv(frames, bytes);
 
       return typed_message;
     }
@@ -233,6 +348,7 @@ namespace zq {
     [[nodiscard]] std::optional<std::expected<std::vector<Message>, ZmqError>>
     recv_all() {
       std::vector<Message> messages;
+      size_t bytes = 0;
       int more = 1;
       size_t more_size = sizeof(more);
       while (more) {
@@ -242,16 +358,19 @@ namespace zq {
         messages.emplace_back(std::move(message));
         if (rc == -1) {
           if (zmq_errno() == EAGAIN) {
+            record_recv_error(EAGAIN);
             return std::nullopt;
           } else {
-            return std::unexpected(currentZmqError());
+            return recv_failed();
           }
         }
+        bytes += static_cast<size_t>(rc);
         rc = zmq_getsockopt(socket_ptr.get(), ZMQ_RCVMORE, &more, &more_size);
         if (rc == -1) {
-          return std::unexpected(currentZmqError());
+          return recv_failed();
         }
       }
+      record_recv(messages.size(), bytes);
       return messages;
     }
 
@@ -272,7 +391,7 @@ namespace zq {
       long tm = static_cast<long>(timeout.count());
       auto rc = zmq_poll(poll_item, 1, tm);
       if (rc == -1) {
-        return std::unexpected(currentZmqError());
+        return recv_failed();
       }
 
       return recv();
@@ -314,12 +433,14 @@ namespace zq {
 
       if (rc == -1) {
         if (zmq_errno() == EAGAIN) {
+          record_recv_error(EAGAIN);
           return std::nullopt;
         } else {
-          return std::unexpected(currentZmqError());
+          return recv_failed();
         }
       }
       data.msg_count++;
+      size_t bytes = static_cast<size_t>(rc);
 
       int more = 0;
       size_t more_size = sizeof(more);
@@ -327,22 +448,25 @@ namespace zq {
       for (size_t i = 1; i < N; ++i) {
         rc = zmq_getsockopt(socket_ptr.get(), ZMQ_RCVMORE, &more, &more_size);
         if (rc == -1) {
-          return std::unexpected(currentZmqError());
+          return recv_failed();
         }
         if (!more) {
+          record_recv(data.msg_count, bytes);
           return data;
         }
         rc = zmq_msg_recv(std::addressof(data.messages[i].msg),
                           socket_ptr.get(), 0);
         if (rc == -1) {
-          return std::unexpected(currentZmqError());
+          return recv_failed();
         }
         data.msg_count++;
+        bytes += static_cast<size_t>(rc);
       }
+      record_recv(data.msg_count, bytes);
       // one more 'more' check for the overflow case is required
       rc = zmq_getsockopt(socket_ptr.get(), ZMQ_RCVMORE, &more, &more_size);
       if (rc == -1) {
-        return std::unexpected(currentZmqError());
+        return recv_failed();
       }
       if (more) {
         data.msg_count++;
@@ -351,6 +475,58 @@ namespace zq {
 
       return data;
     }
+
+   private:
+    template <pack_of_messages... Messages>
+    [[nodiscard]] std::expected<size_t, ZmqError> send_frames(
+        const Message& first,
+        const Messages&... messages) {
+      size_t bytes_sent = 0;
+
+      if constexpr (sizeof...(messages) == 0) {
+        auto rc = zmq_send(socket_ptr.get(), first.data(), first.size(),
+                           ZMQ_DONTWAIT);
+        if (rc < 0) {
+          return send_failed();
+        }
+        bytes_sent += static_cast<size_t>(rc);
+      } else {
+        auto rc =
+            zmq_send(socket_ptr.get(), first.data(), first.size(), ZMQ_SNDMORE);
+        if (rc < 0) {
+          return send_failed();
+        }
+        auto maybe_rc = send_frames(messages...);
+        if (!maybe_rc) {
+          return maybe_rc;
+        }
+        bytes_sent += static_cast<size_t>(rc) + maybe_rc.value();
+      }
+      return bytes_sent;
+    }
+
+    [[nodiscard]] std::expected<size_t, ZmqError> send_shared_frame(
+        const Message& m,
+        int flags) {
+      auto copy = shared_copy(m);
+      auto rc =
+          zmq_msg_send(std::addressof(copy.msg), socket_ptr.get(), flags);
+      if (rc < 0) {
+        return send_failed();
+      }
+      return static_cast<size_t>(rc);
+    }
+
+    // count the current error, and return it
+    [[nodiscard]] std::unexpected<ZmqError> send_failed() noexcept {
+      record_send_error(zmq_errno());
+      return std::unexpected(currentZmqError());
+    }
+
+    [[nodiscard]] std::unexpected<ZmqError> recv_failed() noexcept {
+      record_recv_error(zmq_errno());
+      return std::unexpected(currentZmqError());
+    }
   };
 
   /**
@@ -369,14 +545,11 @@ namespace zq {
     // subscribe to all topics, todo, maybe overload this function with 1 or 2
     // arguments
     {
-      int val = 0;
-      size_t size = sizeof(val);
-      int rc = zmq_getsockopt(subscriber.socket_ptr.get(), ZMQ_TYPE,
-                              std::addressof(val), std::addressof(size));
-      if (rc != 0) {
-        return std::unexpected(currentZmqError());
+      auto type = subscriber.type();
+      if (!type) {
+        return std::unexpected(type.error());
       }
-      if (val != ZMQ_SUB) {
+      if (*type != SocketType::SUB) {
         return std::unexpected(ZqError("socket is not a subscriber"));
       }
     }
@@ -402,4 +575,27 @@ namespace zq {
     return topicCount;
   }
 
+  /**
+   * @brief Send one typed message to several sockets
+   *
+   * The content is not copied, every socket gets a shared copy, see
+   * Socket::send_shared. A socket that can not take the message right now
+   * reports EAGAIN, the others still get it.
+   *
+   * @param sockets
+   * @param msg
+   * @return std::vector<std::expected<size_t, ZmqError>> one result per
+   *         socket, in the order of sockets
+   */
+  [[nodiscard]] inline std::vector<std::expected<size_t, ZmqError>> broadcast(
+      std::span<Socket* const> sockets,
+      const TypedMessage& msg) {
+    std::vector<std::expected<size_t, ZmqError>> results;
+    results.reserve(sockets.size());
+    for (auto* socket : sockets) {
+      results.push_back(socket->send_shared(msg));
+    }
+    return results;
+  }
+
 }  // namespace zq
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <zmq.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <type_traits>
+
+#include "config.hpp"
+
+namespace zq {
+
+  /// The errno values that are counted individually, others count as other
+  inline constexpr std::array<int, 7> tracked_errnos{
+      ETERM, EINTR, EFSM, EHOSTUNREACH, ENOTSOCK, EMSGSIZE, EFAULT};
+
+  /// Multipart messages with this many frames, or more, share one bucket
+  inline constexpr size_t max_tracked_frames = 8;
+
+  /**
+   * @brief A snapshot of the counters of a socket
+   *
+   * All counters stay 0 unless zq is built with ZQ_SOCKET_STATS
+   */
+  struct SocketStats {
+    uint64_t messages_sent{0};
+    uint64_t bytes_sent{0};
+    uint64_t messages_received{0};
+    uint64_t bytes_received{0};
+    uint64_t frames_received{0};
+    uint64_t send_would_block{0};
+    uint64_t recv_would_block{0};
+    /// per tracked_errnos entry, the last one counts all other errors
+    std::array<uint64_t, tracked_errnos.size() + 1> errors{};
+    /// index 0 counts single frame messages, index 1 two frame messages, ...
+    std::array<uint64_t, max_tracked_frames> frames_per_message{};
+
+    /// @brief Number of errors for the given errno
+    [[nodiscard]] uint64_t errors_for(int err) const noexcept {
+      for (size_t i = 0; i < tracked_errnos.size(); ++i) {
+        if (tracked_errnos[i] == err) {
+          return errors[i];
+        }
+      }
+      return errors.back();
+    }
+
+    /// @brief Number of all errors, would block is not an error
+    [[nodiscard]] uint64_t total_errors() const noexcept {
+      uint64_t total = 0;
+      for (auto e : errors) {
+        total += e;
+      }
+      return total;
+    }
+  };
+
+  namespace detail {
+
+    /**
+     * @brief Counters for a socket
+     *
+     * A socket is used by one thread only, so the counters have a single
+     * writer. Load and store with relaxed order is enough for that, and
+     * avoids locked instructions, another thread can still take consistent
+     * snapshots of each single counter.
+     */
+    class SocketCounters {
+      using counter = std::atomic<uint64_t>;
+
+      counter sent_messages{0};
+      counter sent_bytes{0};
+      counter received_messages{0};
+      counter received_bytes{0};
+      counter received_frames{0};
+      counter send_blocks{0};
+      counter recv_blocks{0};
+      std::array<counter, tracked_errnos.size() + 1> error_counts{};
+      std::array<counter, max_tracked_frames> frame_counts{};
+
+      static void add(counter& c, uint64_t n) noexcept {
+        c.store(c.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+      }
+
+      static uint64_t get(const counter& c) noexcept {
+        return c.load(std::memory_order_relaxed);
+      }
+
+      static void take(counter& c, counter& from) noexcept {
+        c.store(from.exchange(0, std::memory_order_relaxed),
+                std::memory_order_relaxed);
+      }
+
+     public:
+      SocketCounters() noexcept = default;
+
+      SocketCounters(SocketCounters&& rhs) noexcept {
+        take(sent_messages, rhs.sent_messages);
+        take(sent_bytes, rhs.sent_bytes);
+        take(received_messages, rhs.received_messages);
+        take(received_bytes, rhs.received_bytes);
+        take(received_frames, rhs.received_frames);
+        take(send_blocks, rhs.send_blocks);
+        take(recv_blocks, rhs.recv_blocks);
+        for (size_t i = 0; i < error_counts.size(); ++i) {
+          take(error_counts[i], rhs.error_counts[i]);
+        }
+        for (size_t i = 0; i < frame_counts.size(); ++i) {
+          take(frame_counts[i], rhs.frame_counts[i]);
+        }
+      }
+
+      SocketCounters(const SocketCounters&) = delete;
+      SocketCounters& operator=(const SocketCounters&) = delete;
+      SocketCounters& operator=(SocketCounters&&) = delete;
+      ~SocketCounters() noexcept = default;
+
+      void record_send(size_t bytes) noexcept {
+        add(sent_messages, 1);
+        add(sent_bytes, bytes);
+      }
+
+      void record_recv(size_t frames, size_t bytes) noexcept {
+        add(received_messages, 1);
+        add(received_frames, frames);
+        add(received_bytes, bytes);
+        if (frames > 0) {
+          auto bucket = std::min(frames, max_tracked_frames) - 1;
+          add(frame_counts[bucket], 1);
+        }
+      }
+
+      void record_send_error(int err) noexcept {
+        if (err == EAGAIN) {
+          add(send_blocks, 1);
+        } else {
+          record_error(err);
+        }
+      }
+
+      void record_recv_error(int err) noexcept {
+        if (err == EAGAIN) {
+          add(recv_blocks, 1);
+        } else {
+          record_error(err);
+        }
+      }
+
+      void record_error(int err) noexcept {
+        size_t i = 0;
+        while (i < tracked_errnos.size() && tracked_errnos[i] != err) {
+          ++i;
+        }
+        add(error_counts[i], 1);
+      }
+
+      [[nodiscard]] SocketStats snapshot() const noexcept {
+        SocketStats s;
+        s.messages_sent = get(sent_messages);
+        s.bytes_sent = get(sent_bytes);
+        s.messages_received = get(received_messages);
+        s.bytes_received = get(received_bytes);
+        s.frames_received = get(received_frames);
+        s.send_would_block = get(send_blocks);
+        s.recv_would_block = get(recv_blocks);
+        for (size_t i = 0; i < error_counts.size(); ++i) {
+          s.errors[i] = get(error_counts[i]);
+        }
+        for (size_t i = 0; i < frame_counts.size(); ++i) {
+          s.frames_per_message[i] = get(frame_counts[i]);
+        }
+        return s;
+      }
+    };
+
+    /**
+     * @brief The counters if stats are disabled
+     *
+     * Empty, and every function does nothing, so the compiler removes all
+     * of it.
+     */
+    struct NoSocketCounters {
+      constexpr void record_send(size_t) noexcept {}
+      constexpr void record_recv(size_t, size_t) noexcept {}
+      constexpr void record_send_error(int) noexcept {}
+      constexpr void record_recv_error(int) noexcept {}
+      constexpr void record_error(int) noexcept {}
+      [[nodiscard]] constexpr SocketStats snapshot() const noexcept {
+        return {};
+      }
+    };
+
+  }  // namespace detail
+
+  /// The counters a Socket uses, depends on ZQ_SOCKET_STATS
+  using SocketCounters = std::conditional_t<socket_stats_build,
+                                            detail::SocketCounters,
+                                            detail::NoSocketCounters>;
+
+}  // namespace zq
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <optional>
+
+#include "error.hpp"
+#include "message.hpp"
+#include "socket.hpp"
+#include "topology.hpp"
+#include "wait.hpp"
+
+namespace zq {
+
+  /**
+   * @brief Settings of a SpinReceiver
+   */
+  struct SpinOptions {
+    /// how long to retry receiving before sleeping in zmq_poll,
+    /// 0 is the same as Socket::await
+    std::chrono::nanoseconds spin_budget{std::chrono::microseconds{50}};
+    /// pin the thread that receives to this cpu, on its first receive
+    std::optional<int> pin_cpu{};
+  };
+
+  /**
+   * @brief Receives typed messages, spins a while before it sleeps
+   *
+   * Socket::await sleeps in zmq_poll, the wakeup of the thread costs some
+   * microseconds, more than a short request path. A SpinReceiver retries
+   * a non-blocking receive, with a cpu pause in between, for the spin
+   * budget, and only then falls back to zmq_poll. That burns the cpu for
+   * the spin budget, it pays off if messages usually arrive within it.
+   * Whether they do is counted, see spin_hits and spin_misses.
+   *
+   * With pin_cpu, the first receive pins the calling thread, a spinning
+   * thread that migrates loses its caches.
+   *
+   * Each spin is a Socket::recv, with ZQ_SOCKET_STATS the unsuccessful
+   * ones count as recv_would_block.
+   *
+   * Like a socket, a receiver must be used by one thread at a time.
+   */
+  class SpinReceiver {
+    SpinOptions options;
+    bool pinned{false};
+    uint64_t hits{0};
+    uint64_t misses{0};
+
+   public:
+    explicit SpinReceiver(SpinOptions spin_options = {}) noexcept
+        : options{spin_options} {}
+
+    /**
+     * @brief Wait up to timeout for a message, spin first
+     *
+     * @param socket
+     * @param timeout
+     * @return std::optional<std::expected<TypedMessage, Error>> nullopt if
+     *         nothing arrived in time, an error also if pinning failed
+     */
+    [[nodiscard]] std::optional<std::expected<TypedMessage, Error>> await(
+        Socket& socket,
+        std::chrono::milliseconds timeout) {
+      using namespace std::chrono;
+      if (options.pin_cpu && !pinned) {
+        if (auto rc = pin_current_thread(*options.pin_cpu); !rc) {
+          return std::unexpected(rc.error());
+        }
+        pinned = true;
+      }
+      const auto start = steady_clock::now();
+      const auto spin_until =
+          start + std::min<nanoseconds>(options.spin_budget, timeout);
+      for (;;) {
+        if (auto msg = socket.recv()) {
+          ++hits;
+          return msg;
+        }
+        if (steady_clock::now() >= spin_until) {
+          break;
+        }
+        cpu_relax();
+      }
+      ++misses;
+      // round up, a rest below 1 ms must not become a poll without wait
+      const auto left =
+          ceil<milliseconds>(start + timeout - steady_clock::now());
+      return socket.await(std::max(left, milliseconds{0}));
+    }
+
+    /// @brief Receives that got a message while spinning
+    [[nodiscard]] uint64_t spin_hits() const noexcept { return hits; }
+
+    /// @brief Receives that spun the whole budget, and slept then
+    [[nodiscard]] uint64_t spin_misses() const noexcept { return misses; }
+
+    /// @brief spin_hits of all receives, 0 if there were none
+    [[nodiscard]] double hit_ratio() const noexcept {
+      const auto total = hits + misses;
+      return total == 0 ? 0.0
+                        : static_cast<double>(hits) /
+                              static_cast<double>(total);
+    }
+
+    void reset() noexcept {
+      hits = 0;
+      misses = 0;
+    }
+  };
+
+}  // namespace zq
@@ -0,0 +1,413 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <expected>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "context.hpp"
+#include "error.hpp"
+#include "zflags.hpp"
+
+namespace zq {
+
+  /**
+   * @brief Parse a Linux cpu list, like 0-3,8,10-11
+   *
+   * @param list
+   * @return std::optional<std::vector<int>> sorted cpus, nullopt if invalid
+   */
+  [[nodiscard]] inline std::optional<std::vector<int>> parse_cpu_list(
+      std::string_view list) {
+    std::vector<int> cpus;
+    while (!list.empty() && (list.back() == '\n' || list.back() == ' ')) {
+      list.remove_suffix(1);
+    }
+    while (!list.empty()) {
+      auto item = list.substr(0, list.find(','));
+      list.remove_prefix(std::min(item.size() + 1, list.size()));
+      const auto dash = item.find('-');
+      int first = 0;
+      int last = 0;
+      auto first_part = item.substr(0, dash);
+      auto rc = std::from_chars(first_part.data(),
+                                first_part.data() + first_part.size(), first);
+      if (rc.ec != std::errc{} || first < 0) {
+        return std::nullopt;
+      }
+      last = first;
+      if (dash != std::string_view::npos) {
+        auto last_part = item.substr(dash + 1);
+        rc = std::from_chars(last_part.data(),
+                             last_part.data() + last_part.size(), last);
+        if (rc.ec != std::errc{} || last < first) {
+          return std::nullopt;
+        }
+      }
+      for (int cpu = first; cpu <= last; ++cpu) {
+        cpus.push_back(cpu);
+      }
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+  }
+
+  /**
+   * @brief Format cpus as Linux cpu list, the reverse of parse_cpu_list
+   *
+   * @param cpus sorted
+   * @return std::string
+   */
+  [[nodiscard]] inline std::string format_cpu_list(
+      const std::vector<int>& cpus) {
+    std::string out;
+    for (size_t i = 0; i < cpus.size();) {
+      size_t j = i;
+      while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+        ++j;
+      }
+      if (!out.empty()) {
+        out += ',';
+      }
+      out += std::to_string(cpus[i]);
+      if (j > i) {
+        out += '-' + std::to_string(cpus[j]);
+      }
+      i = j + 1;
+    }
+    return out;
+  }
+
+  /// @brief A NUMA node and its cpus
+  struct NumaNode {
+    int id{0};
+    std::vector<int> cpus{};
+  };
+
+  /**
+   * @brief The cpus of the host, grouped per NUMA node
+   *
+   * isolated are the cpus taken out of the scheduler (isolcpus), usually
+   * the ones the latency critical application threads are pinned to.
+   */
+  struct CpuTopology {
+    std::vector<NumaNode> nodes{};
+    std::vector<int> isolated{};
+  };
+
+  namespace detail {
+
+    inline std::optional<std::vector<int>> read_cpu_list(
+        const std::filesystem::path& file) {
+      std::ifstream in{file};
+      if (!in) {
+        return std::nullopt;
+      }
+      std::string line;
+      std::getline(in, line);
+      return parse_cpu_list(line);
+    }
+
+    inline void keep_only(std::vector<int>& cpus,
+                          const std::vector<int>& allowed) {
+      std::erase_if(cpus, [&](int cpu) {
+        return !std::binary_search(allowed.begin(), allowed.end(), cpu);
+      });
+    }
+
+  }  // namespace detail
+
+  /**
+   * @brief Read the cpu topology from a sysfs tree
+   *
+   * Reads node/node<N>/cpulist and cpu/isolated below the given root,
+   * if there are no NUMA nodes, cpu/online is one node.
+   *
+   * @param sysfs_root usually /sys/devices/system
+   * @return std::expected<CpuTopology, ZqError>
+   */
+  [[nodiscard]] inline auto read_topology(
+      const std::filesystem::path& sysfs_root)
+      -> std::expected<CpuTopology, ZqError> {
+    namespace fs = std::filesystem;
+    CpuTopology topology;
+    std::error_code ec;
+    const auto node_dir = sysfs_root / "node";
+    if (fs::is_directory(node_dir, ec)) {
+      for (const auto& entry : fs::directory_iterator{node_dir, ec}) {
+        const auto name = entry.path().filename().string();
+        int id = 0;
+        if (!name.starts_with("node") ||
+            std::from_chars(name.data() + 4, name.data() + name.size(), id)
+                    .ec != std::errc{}) {
+          continue;
+        }
+        auto cpus = detail::read_cpu_list(entry.path() / "cpulist");
+        // memory only nodes have no cpus
+        if (cpus && !cpus->empty()) {
+          topology.nodes.push_back(NumaNode{id, std::move(*cpus)});
+        }
+      }
+    }
+    if (topology.nodes.empty()) {
+      auto cpus = detail::read_cpu_list(sysfs_root / "cpu" / "online");
+      if (!cpus || cpus->empty()) {
+        return std::unexpected(ZqError("no cpu topology found"));
+      }
+      topology.nodes.push_back(NumaNode{0, std::move(*cpus)});
+    }
+    std::sort(topology.nodes.begin(), topology.nodes.end(),
+              [](const auto& a, const auto& b) { return a.id < b.id; });
+    topology.isolated = detail::read_cpu_list(sysfs_root / "cpu" / "isolated")
+                            .value_or(std::vector<int>{});
+    return topology;
+  }
+
+  /**
+   * @brief Read the topology of this host
+   *
+   * Only cpus this process may run on are included, so a cpuset of a
+   * container or taskset is respected.
+   * Returns a ZqError on systems without sysfs.
+   *
+   * @return std::expected<CpuTopology, ZqError>
+   */
+  [[nodiscard]] inline auto read_topology()
+      -> std::expected<CpuTopology, ZqError> {
+    auto topology = read_topology("/sys/devices/system");
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (topology && sched_getaffinity(0, sizeof(set), &set) == 0) {
+      std::vector<int> allowed;
+      for (size_t cpu = 0; cpu < static_cast<size_t>(CPU_SETSIZE); ++cpu) {
+        if (CPU_ISSET(cpu, &set)) {
+          allowed.push_back(static_cast<int>(cpu));
+        }
+      }
+      for (auto& node : topology->nodes) {
+        detail::keep_only(node.cpus, allowed);
+      }
+      std::erase_if(topology->nodes,
+                    [](const auto& node) { return node.cpus.empty(); });
+    }
+#endif
+    return topology;
+  }
+
+  /**
+   * @brief Pin the calling thread to one cpu
+   *
+   * Keeps a latency critical thread, like one that spins on a socket, on
+   * its cpu, and its caches warm. Best with a cpu that is reserved, see
+   * ContextBuilder::reserve_cpus.
+   * Returns a ZqError on systems without sched_setaffinity.
+   *
+   * @param cpu
+   * @return std::expected<void, ZqError>
+   */
+  [[nodiscard]] inline auto pin_current_thread(int cpu)
+      -> std::expected<void, ZqError> {
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+      return std::unexpected(ZqError("no such cpu", EINVAL));
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(static_cast<size_t>(cpu), &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+      return std::unexpected(ZqError("can not pin the thread", errno));
+    }
+    return {};
+#else
+    (void)cpu;
+    return std::unexpected(ZqError("thread pinning is not supported"));
+#endif
+  }
+
+  /**
+   * @brief Where the I/O threads of a context go
+   */
+  struct NodePlacement {
+    int node{0};
+    int io_threads{0};
+    std::vector<int> cpus{};      ///< the I/O threads may run on these
+    std::vector<int> reserved{};  ///< kept free for the application
+
+    /// @brief Human readable, like: node 0: 2 io threads on cpus 2-7, ...
+    [[nodiscard]] std::string describe() const {
+      std::string out = "node " + std::to_string(node) + ": " +
+                        std::to_string(io_threads) + " io threads on cpus " +
+                        (cpus.empty() ? "any" : format_cpu_list(cpus));
+      if (!reserved.empty()) {
+        out += ", reserved " + format_cpu_list(reserved);
+      }
+      return out;
+    }
+  };
+
+  /// @brief A context for one NUMA node
+  struct NodeContext {
+    NodePlacement placement;
+    Context context;
+  };
+
+  /**
+   * @brief Creates contexts with I/O threads placed by the cpu topology
+   *
+   * Per NUMA node, the I/O threads get the cpus of the node that are
+   * neither reserved nor isolated. Without an explicit count, there is
+   * one I/O thread per 8 of those cpus, at least 1 and at most 4.
+   *
+   * Either build() one context with threads on all nodes, or
+   * build_per_node() one context per node, so sockets of threads running on
+   * a node can use I/O threads on the same node.
+   *
+   * \note libzmq applies the affinity to all I/O threads of a context,
+   * a thread is not pinned to a single cpu.
+   */
+  class ContextBuilder {
+    CpuTopology topology;
+    std::vector<int> reserved;
+    int threads_per_node{0};
+    std::vector<ContextOption> extra_options;
+
+    [[nodiscard]] NodePlacement place(const NumaNode& node) const {
+      NodePlacement placement{node.id, 0, {}, {}};
+      for (int cpu : node.cpus) {
+        if (std::binary_search(reserved.begin(), reserved.end(), cpu)) {
+          placement.reserved.push_back(cpu);
+        } else {
+          placement.cpus.push_back(cpu);
+        }
+      }
+      if (placement.cpus.empty()) {
+        return placement;
+      }
+      const auto free_cpus = static_cast<int>(placement.cpus.size());
+      placement.io_threads =
+          threads_per_node > 0
+              ? std::min(threads_per_node, free_cpus)
+              : std::clamp(free_cpus / 8, 1, 4);
+      return placement;
+    }
+
+    [[nodiscard]] auto mk_placed_context(
+        int io_threads,
+        const std::vector<int>& cpus) const
+        -> std::expected<Context, ZmqError> {
+      std::vector<ContextOption> options{
+          {CtxOptionName::IO_THREADS, io_threads},
+          {CtxOptionName::IPV6, 0},
+          {CtxOptionName::BLOCKY, 0},
+      };
+      for (int cpu : cpus) {
+        options.push_back({CtxOptionName::THREAD_AFFINITY_CPU_ADD, cpu});
+      }
+      options.insert(options.end(), extra_options.begin(),
+                     extra_options.end());
+      return mk_context(options);
+    }
+
+   public:
+    /**
+     * @brief Start with a topology, isolated cpus are reserved
+     *
+     * @param cpu_topology see read_topology
+     */
+    explicit ContextBuilder(CpuTopology cpu_topology)
+        : topology{std::move(cpu_topology)}, reserved{topology.isolated} {}
+
+    /**
+     * @brief Keep I/O threads off these cpus
+     *
+     * For the latency critical application threads.
+     * Adds to the isolated cpus, which are reserved anyway.
+     */
+    ContextBuilder& reserve_cpus(const std::vector<int>& cpus) {
+      reserved.insert(reserved.end(), cpus.begin(), cpus.end());
+      std::sort(reserved.begin(), reserved.end());
+      reserved.erase(std::unique(reserved.begin(), reserved.end()),
+                     reserved.end());
+      return *this;
+    }
+
+    /// @brief Use this many I/O threads per node, instead of the default
+    ContextBuilder& io_threads_per_node(int count) {
+      threads_per_node = count;
+      return *this;
+    }
+
+    /// @brief Any other context option, like THREAD_PRIORITY
+    ContextBuilder& option(CtxOptionName name, CtxOptionValue value) {
+      extra_options.push_back({name, value});
+      return *this;
+    }
+
+    /**
+     * @brief The placement per node, this is what build uses
+     *
+     * Nodes where all cpus are reserved get 0 I/O threads.
+     *
+     * @return std::vector<NodePlacement>
+     */
+    [[nodiscard]] std::vector<NodePlacement> plan() const {
+      std::vector<NodePlacement> placements;
+      for (const auto& node : topology.nodes) {
+        placements.push_back(place(node));
+      }
+      return placements;
+    }
+
+    /**
+     * @brief One context, the I/O threads of all nodes added up
+     *
+     * If every cpu is reserved, there is one I/O thread without affinity.
+     *
+     * @return std::expected<Context, ZmqError>
+     */
+    [[nodiscard]] auto build() const -> std::expected<Context, ZmqError> {
+      int io_threads = 0;
+      std::vector<int> cpus;
+      for (const auto& placement : plan()) {
+        io_threads += placement.io_threads;
+        cpus.insert(cpus.end(), placement.cpus.begin(), placement.cpus.end());
+      }
+      return mk_placed_context(std::max(io_threads, 1), cpus);
+    }
+
+    /**
+     * @brief One context per node that has I/O threads
+     *
+     * @return std::expected<std::vector<NodeContext>, ZmqError>
+     */
+    [[nodiscard]] auto build_per_node() const
+        -> std::expected<std::vector<NodeContext>, ZmqError> {
+      std::vector<NodeContext> contexts;
+      for (auto& placement : plan()) {
+        if (placement.io_threads == 0) {
+          continue;
+        }
+        auto ctx = mk_placed_context(placement.io_threads, placement.cpus);
+        if (!ctx) {
+          return std::unexpected(ctx.error());
+        }
+        contexts.push_back(
+            NodeContext{std::move(placement), std::move(*ctx)});
+      }
+      return contexts;
+    }
+  };
+
+}  // namespace zq
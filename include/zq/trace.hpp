@@ -0,0 +1,155 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+
+#include "histogram.hpp"
+#include "message.hpp"
+#include "meta.hpp"
+
+namespace zq {
+
+  /**
+   * @brief Nanoseconds of the steady clock, what SEND_TIME contains
+   *
+   * The steady clock is not synchronized between hosts, latencies are only
+   * meaningful if sender and receiver share the clock, like for inproc and
+   * ipc, or on a host with a common monotonic clock.
+   *
+   * @return uint64_t
+   */
+  inline uint64_t monotonic_now_ns() noexcept {
+    using namespace std::chrono;
+    return static_cast<uint64_t>(
+        duration_cast<nanoseconds>(steady_clock::now().time_since_epoch())
+            .count());
+  }
+
+  /**
+   * @brief The tracing fields from the meta part of a typed message
+   */
+  struct Envelope {
+    uint64_t send_time_ns{0};
+    uint64_t sequence{0};
+    std::optional<uint64_t> trace_id{};
+  };
+
+  /**
+   * @brief Read the envelope of a message
+   *
+   * @param msg
+   * @return std::optional<Envelope> nullopt if the message has no send time
+   */
+  [[nodiscard]] inline std::optional<Envelope> read_envelope(
+      const TypedMessage& msg) noexcept {
+    auto send_time = get_meta(msg, MetaTag::SEND_TIME);
+    if (!send_time) {
+      return std::nullopt;
+    }
+    return Envelope{*send_time,
+                    get_meta(msg, MetaTag::SEQUENCE).value_or(0),
+                    get_meta(msg, MetaTag::TRACE_ID)};
+  }
+
+  /**
+   * @brief Stamps outgoing messages with send time and sequence number
+   *
+   * One tracer per sender, it is not thread safe, like a socket.
+   * Every sample_every message gets a random trace id in addition,
+   * 0 means no trace ids at all.
+   */
+  class Tracer {
+    uint64_t next_sequence{0};
+    uint64_t sample_every{0};
+    std::mt19937_64 random{std::random_device{}()};
+
+   public:
+    explicit Tracer(uint64_t sample_every_n = 0) noexcept
+        : sample_every{sample_every_n} {}
+
+    /**
+     * @brief Add the envelope to the message, right before it is sent
+     *
+     * Other meta fields, like a deadline, are kept.
+     *
+     * @param msg
+     */
+    void stamp(TypedMessage& msg) {
+      const auto sequence = next_sequence++;
+      set_meta(msg, MetaTag::SEND_TIME, monotonic_now_ns());
+      set_meta(msg, MetaTag::SEQUENCE, sequence);
+      if (sample_every > 0 && sequence % sample_every == 0) {
+        set_meta(msg, MetaTag::TRACE_ID, random());
+      }
+    }
+
+    /// @brief The sequence number the next stamped message gets
+    [[nodiscard]] uint64_t sequence() const noexcept { return next_sequence; }
+  };
+
+  /**
+   * @brief Collects the latency of received messages, per message type
+   *
+   * Messages without an envelope are ignored.
+   */
+  class LatencyRecorder {
+    std::map<std::string, LatencyHistogram, std::less<>> per_type;
+
+   public:
+    /**
+     * @brief Record the latency of a received message
+     *
+     * @param msg
+     * @param now_ns receive time, by default now
+     * @return std::optional<std::chrono::nanoseconds> the latency,
+     * nullopt if the message has no send time
+     */
+    std::optional<std::chrono::nanoseconds> record(
+        const TypedMessage& msg,
+        uint64_t now_ns = monotonic_now_ns()) {
+      auto send_time = get_meta(msg, MetaTag::SEND_TIME);
+      if (!send_time) {
+        return std::nullopt;
+      }
+      const auto latency = now_ns > *send_time ? now_ns - *send_time : 0;
+      const auto type = type_name_part(msg.type);
+      auto it = per_type.find(type);
+      if (it == per_type.end()) {
+        it = per_type.emplace(std::string{type}, LatencyHistogram{}).first;
+      }
+      it->second.record(latency);
+      return std::chrono::nanoseconds{static_cast<int64_t>(latency)};
+    }
+
+    /**
+     * @brief The histogram of a message type
+     *
+     * @param type_name as in the type part of the message, all
+     *        partitions of a type are recorded together
+     * @return const LatencyHistogram* nullptr if nothing was recorded
+     */
+    [[nodiscard]] const LatencyHistogram* find(
+        std::string_view type_name) const noexcept {
+      auto it = per_type.find(type_name);
+      return it == per_type.end() ? nullptr : std::addressof(it->second);
+    }
+
+    /// @brief The histogram of type T, nullptr if nothing was recorded
+    template <typename T>
+    [[nodiscard]] const LatencyHistogram* find() const noexcept {
+      return find(wire_type_name<T>());
+    }
+
+    /// @brief All histograms, by type name
+    [[nodiscard]] const auto& histograms() const noexcept { return per_type; }
+
+    /// @brief Forget everything recorded
+    void reset() noexcept { per_type.clear(); }
+  };
+
+}  // namespace zq
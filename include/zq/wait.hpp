@@ -0,0 +1,172 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <climits>
+#include <ctime>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace zq {
+
+  /**
+   * @brief How a thread waits for data from another thread
+   */
+  enum class WaitMode {
+    BUSY_SPIN,  ///< never sleep, lowest latency, burns a core
+    FUTEX,      ///< spin a while, then sleep until woken up
+  };
+
+  /**
+   * @brief Tell the cpu we are in a spin loop
+   *
+   * Saves power and frees resources for the other hyper thread.
+   */
+  inline void cpu_relax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_pause();
+#else
+    std::this_thread::yield();
+#endif
+  }
+
+  namespace detail {
+
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t));
+
+    /**
+     * @brief Sleep while word has the expected value, at most timeout
+     *
+     * Can return early, callers need to check their condition again.
+     * Without futex, this sleeps a short while.
+     * If word is in memory shared between processes, process_shared must
+     * be true.
+     */
+    inline void futex_wait(std::atomic<uint32_t>& word,
+                           uint32_t expected,
+                           std::chrono::nanoseconds timeout,
+                           bool process_shared = false) noexcept {
+#ifdef __linux__
+      using namespace std::chrono;
+      const auto secs = duration_cast<seconds>(timeout);
+      timespec ts{};
+      ts.tv_sec = static_cast<time_t>(secs.count());
+      ts.tv_nsec = static_cast<long>((timeout - secs).count());
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(std::addressof(word)),
+              process_shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, expected,
+              std::addressof(ts), nullptr, 0);
+#else
+      (void)process_shared;
+      if (word.load(std::memory_order_acquire) == expected) {
+        std::this_thread::sleep_for(
+            std::min<std::chrono::nanoseconds>(timeout,
+                                               std::chrono::microseconds{50}));
+      }
+#endif
+    }
+
+    /// @brief Wake all threads sleeping in futex_wait on word
+    inline void futex_wake(std::atomic<uint32_t>& word,
+                           bool process_shared = false) noexcept {
+#ifdef __linux__
+      syscall(SYS_futex, reinterpret_cast<uint32_t*>(std::addressof(word)),
+              process_shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, INT_MAX,
+              nullptr, nullptr, 0);
+#else
+      (void)word;
+      (void)process_shared;
+#endif
+    }
+
+  }  // namespace detail
+
+  /**
+   * @brief Lets a consumer sleep until a producer signals new data
+   *
+   * The producer calls notify after it published the data, that costs an
+   * atomic load if nobody sleeps.
+   * The consumer calls wait with a check for the data, wait returns when
+   * the check succeeds or the timeout passed.
+   *
+   * A Waiter placed in shared memory works between processes, it has to be
+   * created as process shared then.
+   */
+  class Waiter {
+    std::atomic<uint32_t> signal{0};
+    std::atomic<uint32_t> sleepers{0};
+    const bool process_shared{false};
+
+   public:
+    Waiter() noexcept = default;
+
+    /// @brief A Waiter for memory shared between processes, or not
+    explicit Waiter(bool shared_between_processes) noexcept
+        : process_shared{shared_between_processes} {}
+
+    /// @brief Wake the consumers, if they sleep
+    void notify() noexcept {
+      // order the published data before reading sleepers
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (sleepers.load(std::memory_order_relaxed) > 0) {
+        signal.fetch_add(1, std::memory_order_release);
+        detail::futex_wake(signal, process_shared);
+      }
+    }
+
+    /**
+     * @brief Wait until ready() returns true, or the deadline passed
+     *
+     * @param mode busy spin, or spin spin_count times and then sleep
+     * @param spin_count
+     * @param deadline
+     * @param ready the check, called repeatedly
+     * @return true if ready() returned true
+     */
+    template <typename Ready>
+    bool wait(WaitMode mode,
+              unsigned spin_count,
+              std::chrono::steady_clock::time_point deadline,
+              Ready&& ready) noexcept(noexcept(ready())) {
+      for (unsigned spins = 0;; ++spins) {
+        if (ready()) {
+          return true;
+        }
+        if (mode == WaitMode::BUSY_SPIN || spins < spin_count) {
+          if ((spins & 0x3ff) == 0 &&
+              std::chrono::steady_clock::now() >= deadline) {
+            return false;
+          }
+          cpu_relax();
+          continue;
+        }
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+          return false;
+        }
+        const auto seen = signal.load(std::memory_order_acquire);
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        if (ready()) {
+          sleepers.fetch_sub(1, std::memory_order_relaxed);
+          return true;
+        }
+        detail::futex_wait(signal, seen, deadline - now, process_shared);
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+      }
+    }
+  };
+
+}  // namespace zq
@@ -82,4 +82,36 @@ namespace zq {
   };
 
   enum class SendFlags : int { NONE = 0, SNDMORE = ZMQ_SNDMORE };
+
+  enum class MonitorEvent : int {
+    CONNECTED = ZMQ_EVENT_CONNECTED,
+    CONNECT_DELAYED = ZMQ_EVENT_CONNECT_DELAYED,
+    CONNECT_RETRIED = ZMQ_EVENT_CONNECT_RETRIED,
+    LISTENING = ZMQ_EVENT_LISTENING,
+    BIND_FAILED = ZMQ_EVENT_BIND_FAILED,
+    ACCEPTED = ZMQ_EVENT_ACCEPTED,
+    ACCEPT_FAILED = ZMQ_EVENT_ACCEPT_FAILED,
+    CLOSED = ZMQ_EVENT_CLOSED,
+    CLOSE_FAILED = ZMQ_EVENT_CLOSE_FAILED,
+    DISCONNECTED = ZMQ_EVENT_DISCONNECTED,
+    MONITOR_STOPPED = ZMQ_EVENT_MONITOR_STOPPED,
+    HANDSHAKE_FAILED_NO_DETAIL = ZMQ_EVENT_HANDSHAKE_FAILED_NO_DETAIL,
+    HANDSHAKE_SUCCEEDED = ZMQ_EVENT_HANDSHAKE_SUCCEEDED,
+    HANDSHAKE_FAILED_PROTOCOL = ZMQ_EVENT_HANDSHAKE_FAILED_PROTOCOL,
+    HANDSHAKE_FAILED_AUTH = ZMQ_EVENT_HANDSHAKE_FAILED_AUTH,
+    HANDSHAKE_FAILED = ZMQ_EVENT_HANDSHAKE_FAILED_NO_DETAIL |
+                       ZMQ_EVENT_HANDSHAKE_FAILED_PROTOCOL |
+                       ZMQ_EVENT_HANDSHAKE_FAILED_AUTH,
+    ALL = ZMQ_EVENT_ALL
+  };
+
+  constexpr MonitorEvent operator|(MonitorEvent lhs, MonitorEvent rhs) {
+    return static_cast<MonitorEvent>(static_cast<int>(lhs) |
+                                     static_cast<int>(rhs));
+  }
+
+  constexpr MonitorEvent operator&(MonitorEvent lhs, MonitorEvent rhs) {
+    return static_cast<MonitorEvent>(static_cast<int>(lhs) &
+                                     static_cast<int>(rhs));
+  }
 }  // namespace zq
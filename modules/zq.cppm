@@ -0,0 +1,83 @@
+// The zq named module
+//
+//  import zq;
+//
+// has the same API as #include <zq/zq.hpp>, built once with the options of
+// the zq_module target, ZQ_PROTO and ZQ_SOCKET_STATS included.
+// The ZeroMQ macros, like ZMQ_PUSH, are not exported, use the zflags enums.
+// Opt-in headers, like journal.hpp or chunked.hpp, are not part of the
+// module, include them after the import.
+
+module;
+
+#include <zq/zq.hpp>
+
+export module zq;
+
+export namespace zq {
+
+  // error.hpp
+  using zq::currentError;
+  using zq::currentZmqError;
+  using zq::Error;
+  using zq::NoError;
+  using zq::ZmqError;
+  using zq::ZmqErrorNo;
+  using zq::ZqError;
+
+  // zflags.hpp
+  using zq::CtxOptionName;
+  using zq::MonitorEvent;
+  using zq::SendFlags;
+  using zq::SocketOptionName;
+  using zq::SocketType;
+  using zq::operator|;
+  using zq::operator&;
+
+  // context.hpp
+  using zq::Context;
+  using zq::ContextOption;
+  using zq::ContextOptions;
+  using zq::CtxOptionValue;
+  using zq::DefaultContextOptions;
+  using zq::mk_context;
+
+  // message.hpp, and message_proto.hpp with ZQ_PROTO
+  using zq::as_string;
+  using zq::as_string_view;
+  using zq::is_char_array;
+  using zq::is_message;
+  using zq::mem_copyable;
+  using zq::mem_copyable_message;
+  using zq::Message;
+  using zq::pack_of_messages;
+  using zq::restore_any;
+  using zq::restore_as;
+  using zq::restore_result;
+  using zq::shared_copy;
+  using zq::str_message;
+  using zq::str_type_name;
+  using zq::typed_message;
+  using zq::TypedMessage;
+  using zq::type_name_part;
+  using zq::typename_message;
+  using zq::wire_type_name;
+#ifdef ZQ_PROTO
+  using zq::protobuf_message;
+#endif
+
+  // socket.hpp
+  using zq::broadcast;
+  using zq::MessageContainer;
+  using zq::RecvData;
+  using zq::RecvResult;
+  using zq::Socket;
+  using zq::SocketPointer;
+  using zq::StdArrayOfMessage;
+  using zq::subscribe;
+  using zq::ZmqSocketClose;
+
+  // socket_stats.hpp
+  using zq::SocketStats;
+
+}  // namespace zq
@@ -1,6 +1,10 @@
 #include <doctest/doctest.h>
 #include <zq/zq.hpp>
 
+#include <cerrno>
+#include <cstring>
+#include <string>
+
 SCENARIO("Testing the Error type") {
   GIVEN("an Error instances with value 0") {
     zq::ZmqErrorNo e0{0};
@@ -32,3 +36,21 @@ SCENARIO("Testing the Error type") {
     }
   }
 }
+
+SCENARIO("Testing the error representation") {
+  GIVEN("a ZeroMQ error without context") {
+    zq::ZmqError err{zq::ZmqErrorNo{EAGAIN}};
+    THEN("the text is the ZeroMQ message of the number") {
+      CHECK_EQ(std::string{err.what()}, std::string{zmq_strerror(EAGAIN)});
+      CHECK_EQ(err.message(), std::to_string(EAGAIN) + ": " + err.what());
+    }
+  }
+  GIVEN("a zq error with a system error") {
+    zq::Error err{zq::ZqError{"open", ENOENT}};
+    THEN("the text is static, the message has the system error") {
+      CHECK(err.isZqError());
+      CHECK_EQ(std::string{err.what()}, "open");
+      CHECK_EQ(err.message(), std::string{"open: "} + std::strerror(ENOENT));
+    }
+  }
+}
@@ -0,0 +1,201 @@
+#include <doctest/doctest.h>
+#include "../zq_testing.hpp"
+
+#include <zq/last_value_cache.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+  using namespace std::chrono_literals;
+  auto await_time = 1000ms;
+
+  // publish until the cache has seen the message,
+  // the publisher needs the upstream subscription first
+  void publish(zq::Socket& publisher,
+               zq::LastValueCache& lvc,
+               const zq::TypedMessage& msg) {
+    for (int i = 0; i < 100; ++i) {
+      REQUIRE(publisher.send(msg));
+      auto handled = lvc.step(10ms);
+      REQUIRE(handled);
+      if (*handled > 0) {
+        return;
+      }
+    }
+    FAIL("message did not arrive at the cache");
+  }
+}  // namespace
+
+SCENARIO("A late joining subscriber gets the last values") {
+  auto context = zq::mk_context();
+  REQUIRE(context);
+  auto frontend_address = next_inproc_address();
+  auto backend_address = next_inproc_address();
+
+  GIVEN("a last value cache and a publisher") {
+    auto frontend = context->bind(zq::SocketType::XSUB, frontend_address);
+    auto backend = context->bind(zq::SocketType::XPUB, backend_address);
+    REQUIRE(frontend);
+    REQUIRE(backend);
+    auto lvc =
+        zq::mk_last_value_cache(std::move(*frontend), std::move(*backend));
+    REQUIRE(lvc);
+    auto publisher = context->connect(zq::SocketType::PUB, frontend_address);
+    REQUIRE(publisher);
+
+    WHEN("publishing an int and a string before anyone subscribed") {
+      publish(*publisher, *lvc, zq::typed_message(int{1}));
+      publish(*publisher, *lvc, zq::typed_message(int{42}));
+      publish(*publisher, *lvc, zq::typed_message("hello"));
+      REQUIRE_EQ(lvc->size(), 2);
+
+      THEN("a new int subscriber receives only the last int") {
+        auto subscriber =
+            context->connect(zq::SocketType::SUB, backend_address);
+        REQUIRE(subscriber);
+        REQUIRE(zq::subscribe(*subscriber, {"int"}));
+        auto handled = lvc->step(await_time);
+        REQUIRE(handled);
+        REQUIRE_EQ(*handled, 1);
+
+        auto reply = subscriber->await(await_time);
+        REQUIRE(reply);
+        REQUIRE(reply.value());
+        REQUIRE_EQ(zq::restore_as<int>(*reply.value()), 42);
+        REQUIRE_FALSE(subscriber->await(10ms));
+      }
+    }
+  }
+}
+
+SCENARIO("The last value cache can keep more than one value per type") {
+  auto context = zq::mk_context();
+  REQUIRE(context);
+  auto frontend_address = next_inproc_address();
+  auto backend_address = next_inproc_address();
+
+  GIVEN("a last value cache keyed on the first letter of a string") {
+    auto frontend = context->bind(zq::SocketType::XSUB, frontend_address);
+    auto backend = context->bind(zq::SocketType::XPUB, backend_address);
+    REQUIRE(frontend);
+    REQUIRE(backend);
+    auto first_letter = [](const zq::TypedMessage& msg) {
+      return zq::as_string(msg.payload).substr(0, 1);
+    };
+    auto lvc = zq::mk_last_value_cache(std::move(*frontend),
+                                       std::move(*backend), first_letter);
+    REQUIRE(lvc);
+    auto publisher = context->connect(zq::SocketType::PUB, frontend_address);
+    REQUIRE(publisher);
+
+    WHEN("publishing strings with different keys") {
+      publish(*publisher, *lvc, zq::typed_message("a1"));
+      publish(*publisher, *lvc, zq::typed_message("b1"));
+      publish(*publisher, *lvc, zq::typed_message("a2"));
+      REQUIRE_EQ(lvc->size(), 2);
+
+      THEN("a subscriber gets the last value of each key") {
+        auto subscriber =
+            context->connect(zq::SocketType::SUB, backend_address);
+        REQUIRE(subscriber);
+        REQUIRE(zq::subscribe(*subscriber, {zq::str_type_name}));
+        auto handled = lvc->step(await_time);
+        REQUIRE(handled);
+        REQUIRE_EQ(*handled, 2);
+
+        std::vector<std::string> received;
+        for (int i = 0; i < 2; ++i) {
+          auto reply = subscriber->await(await_time);
+          REQUIRE(reply);
+          REQUIRE(reply.value());
+          auto restored = zq::restore_as<std::string>(*reply.value());
+          REQUIRE(restored);
+          received.push_back(*restored);
+        }
+        std::sort(received.begin(), received.end());
+        const std::vector<std::string> expected{"a2", "b1"};
+        REQUIRE_EQ(received, expected);
+      }
+    }
+  }
+}
+
+SCENARIO("The last value cache forwards messages it can not cache") {
+  auto context = zq::mk_context();
+  REQUIRE(context);
+  auto frontend_address = next_inproc_address();
+  auto backend_address = next_inproc_address();
+
+  GIVEN("a last value cache, a publisher and a subscriber to everything") {
+    auto frontend = context->bind(zq::SocketType::XSUB, frontend_address);
+    auto backend = context->bind(zq::SocketType::XPUB, backend_address);
+    REQUIRE(frontend);
+    REQUIRE(backend);
+    auto lvc =
+        zq::mk_last_value_cache(std::move(*frontend), std::move(*backend));
+    REQUIRE(lvc);
+    auto publisher = context->connect(zq::SocketType::PUB, frontend_address);
+    REQUIRE(publisher);
+    auto subscriber = context->connect(zq::SocketType::SUB, backend_address);
+    REQUIRE(subscriber);
+    REQUIRE(zq::subscribe(*subscriber, {""}));
+
+    // publish until the subscriber has it, both subscriptions take a while
+    auto forward = [&](const std::vector<zq::Message>& frames) {
+      for (int i = 0; i < 100; ++i) {
+        REQUIRE(publisher->send(frames));
+        REQUIRE(lvc->step(10ms));
+        // skip copies of a message published before
+        while (subscriber->poll(0ms).value_or(false)) {
+          auto received = subscriber->recv_all();
+          REQUIRE(received);
+          REQUIRE(*received);
+          if ((*received)->size() == frames.size()) {
+            return std::move(**received);
+          }
+        }
+      }
+      FAIL("message did not arrive at the subscriber");
+      return std::vector<zq::Message>{};
+    };
+
+    WHEN("publishing a message of one and one of four parts") {
+      std::vector<zq::Message> one;
+      one.push_back(zq::str_message("plain"));
+      std::vector<zq::Message> four;
+      for (const auto* part : {"a", "b", "c", "d"}) {
+        four.push_back(zq::str_message(part));
+      }
+      auto received_one = forward(one);
+      auto received_four = forward(four);
+
+      THEN("they arrive unchanged, and are not cached") {
+        REQUIRE_EQ(received_one.size(), 1);
+        REQUIRE_EQ(zq::as_string(received_one[0]), "plain");
+        REQUIRE_EQ(received_four.size(), 4);
+        REQUIRE_EQ(zq::as_string(received_four[3]), "d");
+        REQUIRE_EQ(lvc->size(), 0);
+      }
+    }
+  }
+}
+
+SCENARIO("A last value cache needs XSUB and XPUB sockets") {
+  auto context = zq::mk_context();
+  REQUIRE(context);
+
+  GIVEN("a request and a reply socket") {
+    auto [client, server] = pp_cs_sockets(*context, next_inproc_address());
+
+    WHEN("creating a last value cache from them") {
+      auto lvc = zq::mk_last_value_cache(std::move(client), std::move(server));
+
+      THEN("a zq error is returned") {
+        REQUIRE_FALSE(lvc);
+        REQUIRE(lvc.error().isZqError());
+      }
+    }
+  }
+}
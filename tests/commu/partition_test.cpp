@@ -0,0 +1,119 @@
+#include <doctest/doctest.h>
+#include <zq/partition.hpp>
+#include <zq/zq.hpp>
+#include "../zq_testing.hpp"
+
+#include <thread>
+
+namespace {
+
+  using namespace std::chrono_literals;
+
+  struct Trade {
+    uint64_t account;
+    int quantity;
+  };
+
+  constexpr uint16_t partitions = 8;
+
+  // read until nothing more arrives, check every trade is in range
+  size_t receive_all(zq::Socket& subscriber, zq::PartitionRange range) {
+    size_t count = 0;
+    while (auto msg = subscriber.await(200ms)) {
+      REQUIRE(*msg);
+      auto partition = zq::get_partition(**msg);
+      auto trade = zq::restore_as<Trade>(**msg);
+      REQUIRE(trade);
+      if (partition) {
+        REQUIRE_EQ(*partition, zq::partition_for(trade->account, partitions));
+        REQUIRE_GE(*partition, range.first);
+        REQUIRE_LE(*partition, range.last);
+      }
+      ++count;
+    }
+    return count;
+  }
+
+}  // namespace
+
+SCENARIO("Partitioned messages") {
+  GIVEN("a message in a partition") {
+    auto msg = zq::partitioned_message(Trade{42, 100}, uint64_t{42},
+                                       partitions);
+    THEN("the type part has the partition after the type name") {
+      auto partition = zq::get_partition(msg);
+      REQUIRE(partition);
+      REQUIRE_EQ(*partition, zq::partition_for(uint64_t{42}, partitions));
+      REQUIRE_EQ(zq::type_name_part(msg.type), zq::wire_type_name<Trade>());
+      REQUIRE_EQ(zq::as_string_view(msg.type),
+                 zq::partition_topic(zq::wire_type_name<Trade>(), *partition));
+    }
+    AND_THEN("it restores as its type") {
+      auto trade = zq::restore_as<Trade>(msg);
+      REQUIRE(trade);
+      REQUIRE_EQ(trade->quantity, 100);
+    }
+  }
+  GIVEN("a message without a partition") {
+    auto msg = zq::typed_message(Trade{1, 1});
+    THEN("it has none") { REQUIRE_FALSE(zq::get_partition(msg)); }
+  }
+  GIVEN("8 partitions and 3 consumers") {
+    THEN("each consumer owns a consecutive range") {
+      auto first = zq::partition_range(0, 3, partitions);
+      auto second = zq::partition_range(1, 3, partitions);
+      auto third = zq::partition_range(2, 3, partitions);
+      REQUIRE_EQ(first.first, 0);
+      REQUIRE_EQ(first.last, 1);
+      REQUIRE_EQ(second.first, 2);
+      REQUIRE_EQ(second.last, 4);
+      REQUIRE_EQ(third.first, 5);
+      REQUIRE_EQ(third.last, 7);
+    }
+  }
+}
+
+SCENARIO("Subscribing to partitions") {
+  auto context = zq::mk_context();
+  REQUIRE(context);
+  auto endpoint = next_ipc_address();
+
+  GIVEN("a publisher, two partition consumers, and one for the whole type") {
+    auto publisher = context->bind(zq::SocketType::PUB, endpoint);
+    auto lower = context->connect(zq::SocketType::SUB, endpoint);
+    auto upper = context->connect(zq::SocketType::SUB, endpoint);
+    auto all = context->connect(zq::SocketType::SUB, endpoint);
+    REQUIRE(publisher);
+    REQUIRE(lower);
+    REQUIRE(upper);
+    REQUIRE(all);
+
+    const auto lower_range = zq::partition_range(0, 2, partitions);
+    const auto upper_range = zq::partition_range(1, 2, partitions);
+    auto subscribed = zq::subscribe_partitions<Trade>(*lower, lower_range);
+    REQUIRE(subscribed);
+    REQUIRE_EQ(*subscribed, 4);
+    REQUIRE(zq::subscribe_partitions<Trade>(*upper, upper_range));
+    REQUIRE(zq::subscribe(*all, {zq::wire_type_name<Trade>()}));
+    std::this_thread::sleep_for(50ms);
+
+    WHEN("trades of many accounts are published") {
+      constexpr size_t count = 100;
+      for (uint64_t account = 0; account < count; ++account) {
+        REQUIRE(publisher->send(zq::partitioned_message(
+            Trade{account, 1}, account, partitions)));
+      }
+
+      THEN("each consumer gets its partitions, together all of them") {
+        const auto from_lower = receive_all(*lower, lower_range);
+        const auto from_upper = receive_all(*upper, upper_range);
+        REQUIRE_GT(from_lower, 0);
+        REQUIRE_GT(from_upper, 0);
+        REQUIRE_EQ(from_lower + from_upper, count);
+      }
+      AND_THEN("a subscription to the type gets every partition") {
+        REQUIRE_EQ(receive_all(*all, {0, partitions - 1}), count);
+      }
+    }
+  }
+}
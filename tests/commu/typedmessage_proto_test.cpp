@@ -21,6 +21,11 @@ SCENARIO("Testing a protobuf based typed message") {
         auto restored = zq::restore_as<zq::proto::Pong>(tm);
         REQUIRE_FALSE(restored);
       }
+      AND_THEN("it can be restored as one of a set of types") {
+        auto restored = zq::restore_any<zq::proto::Pong, zq::proto::Ping>(tm);
+        REQUIRE(restored);
+        REQUIRE_EQ(std::get<zq::proto::Ping>(*restored).id(), ping.id());
+      }
     }
   }
 }
@@ -3,6 +3,9 @@
 #include <zq/message.hpp>
 #include <zq/zq.hpp>
 
+#include <string>
+#include <variant>
+
 SCENARIO("Testing an empty typed message") {
   GIVEN("an empty message") {
     zq::TypedMessage m;
@@ -82,3 +85,59 @@ SCENARIO("Testing double based typed message") {
     }
   }
 }
+
+SCENARIO("Restoring one of a set of types") {
+  using Any = std::variant<int, double, std::string>;
+  static_assert(zq::wire_type_name<std::string>() == zq::str_type_name);
+
+  GIVEN("messages of different types") {
+    auto i = zq::typed_message(42);
+    auto d = zq::typed_message(4.2);
+    auto s = zq::typed_message("hello");
+
+    WHEN("restoring them as any of int, double or string") {
+      auto ri = zq::restore_any<int, double, std::string>(i);
+      auto rd = zq::restore_any<int, double, std::string>(d);
+      auto rs = zq::restore_any<int, double, std::string>(s);
+
+      THEN("each becomes the matching alternative") {
+        REQUIRE(ri);
+        REQUIRE(rd);
+        REQUIRE(rs);
+        REQUIRE_EQ(std::get<int>(*ri), 42);
+        REQUIRE_EQ(std::get<double>(*rd), 4.2);
+        REQUIRE_EQ(std::get<std::string>(*rs), "hello");
+      }
+      AND_THEN("they can be handled with std::visit") {
+        std::string seen;
+        for (const Any& any : {*ri, *rd, *rs}) {
+          std::visit(
+              [&](const auto& value) {
+                using T = std::decay_t<decltype(value)>;
+                seen += std::is_same_v<T, int>      ? "i"
+                        : std::is_same_v<T, double> ? "d"
+                                                    : "s";
+              },
+              any);
+        }
+        REQUIRE_EQ(seen, "ids");
+      }
+    }
+    AND_WHEN("the type is not in the set") {
+      auto r = zq::restore_any<int, std::string>(d);
+      THEN("restoring fails") {
+        REQUIRE_FALSE(r);
+        REQUIRE_EQ(std::string(r.error().what()),
+                   "Message type does not match");
+      }
+    }
+    AND_WHEN("the type matches, but the payload does not") {
+      i.payload = zq::str_message("42");
+      auto r = zq::restore_any<int, std::string>(i);
+      THEN("restoring fails") {
+        REQUIRE_FALSE(r);
+        REQUIRE_EQ(std::string(r.error().what()), "Data size does not match");
+      }
+    }
+  }
+}
@@ -0,0 +1,224 @@
+#include <doctest/doctest.h>
+#include <zq/local_bus.hpp>
+#include <zq/zq.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../zq_testing.hpp"
+
+using namespace std::chrono_literals;
+
+SCENARIO("Publishing typed messages on a local bus") {
+  zq::LocalBus bus;
+  TimeOutInsurance toi{2000ms};
+
+  GIVEN("a subscriber for int, one for strings and one for all") {
+    auto ints = bus.subscribe<int>();
+    auto strings = bus.subscribe<std::string>();
+    auto all = bus.subscribe({});
+    auto publisher = bus.publisher();
+    REQUIRE(publisher);
+
+    WHEN("publishing an int and a string") {
+      REQUIRE_EQ(publisher->publish(42), 2);
+      REQUIRE_EQ(publisher->publish(zq::typed_message("Hello world")), 2);
+
+      THEN("each subscriber gets the types it subscribed to") {
+        auto i = ints.recv();
+        REQUIRE(i);
+        REQUIRE_EQ(zq::restore_as<int>(*i), 42);
+        REQUIRE_FALSE(ints.recv());
+
+        auto s = strings.await(100ms);
+        REQUIRE(s);
+        REQUIRE_EQ(zq::restore_as<std::string>(*s), "Hello world");
+
+        auto first = all.recv();
+        auto second = all.recv();
+        REQUIRE(first);
+        REQUIRE(second);
+        REQUIRE_EQ(zq::restore_as<int>(*first), 42);
+        REQUIRE_EQ(zq::restore_as<std::string>(*second), "Hello world");
+      }
+    }
+    AND_WHEN("a subscriber goes away") {
+      { auto temporary = bus.subscribe<int>(); }
+      THEN("it does not get messages anymore") {
+        REQUIRE_EQ(publisher->publish(1), 2);
+      }
+    }
+  }
+
+  GIVEN("nothing subscribed") {
+    auto publisher = bus.publisher();
+    REQUIRE(publisher);
+    THEN("publishing delivers nothing") {
+      REQUIRE_EQ(publisher->publish(1), 0);
+    }
+  }
+}
+
+SCENARIO("Local bus limits") {
+  TimeOutInsurance toi{2000ms};
+
+  GIVEN("a single producer bus with a small queue") {
+    zq::LocalBus bus{zq::LocalBusOptions{.capacity = 4,
+                                         .producers = zq::Producers::SINGLE}};
+    auto sub = bus.subscribe<int>();
+    auto publisher = bus.publisher();
+    REQUIRE(publisher);
+
+    THEN("a second publisher is refused") {
+      REQUIRE_FALSE(bus.publisher());
+    }
+    AND_WHEN("publishing more than fits") {
+      for (int i = 0; i < 6; ++i) {
+        publisher->publish(i);
+      }
+      THEN("the rest is dropped, like at the high water mark") {
+        REQUIRE_EQ(sub.dropped(), 2);
+        for (int i = 0; i < 4; ++i) {
+          auto msg = sub.recv();
+          REQUIRE(msg);
+          REQUIRE_EQ(zq::restore_as<int>(*msg), i);
+        }
+        REQUIRE_FALSE(sub.recv());
+      }
+    }
+    AND_WHEN("nothing is published") {
+      THEN("await times out") {
+        REQUIRE_FALSE(sub.await(10ms));
+      }
+    }
+  }
+}
+
+namespace {
+
+  // publishers on several threads, returns the number of messages received
+  // in order per publisher
+  int publish_from_threads(zq::WaitMode mode) {
+    constexpr int publisher_count = 4;
+    constexpr int per_publisher = 5000;
+    zq::LocalBus bus{zq::LocalBusOptions{.capacity = 256, .wait_mode = mode}};
+    auto sub = bus.subscribe<int>();
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < publisher_count; ++p) {
+      threads.emplace_back([&bus, p] {
+        auto publisher = bus.publisher();
+        for (int i = 0; i < per_publisher; ++i) {
+          // retry when the queue is full
+          while (publisher->publish(p * per_publisher + i) == 0) {
+            std::this_thread::yield();
+          }
+        }
+      });
+    }
+    std::vector<int> last(publisher_count, -1);
+    int in_order = 0;
+    for (int n = 0; n < publisher_count * per_publisher; ++n) {
+      auto msg = sub.await(1000ms);
+      if (!msg) {
+        break;
+      }
+      auto value = zq::restore_as<int>(*msg);
+      if (!value) {
+        break;
+      }
+      const auto p = static_cast<size_t>(*value / per_publisher);
+      if (*value % per_publisher > last[p]) {
+        ++in_order;
+      }
+      last[p] = *value % per_publisher;
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    return in_order;
+  }
+
+}  // namespace
+
+SCENARIO("Many publishers on a local bus") {
+  TimeOutInsurance toi{5000ms};
+
+  GIVEN("a bus with many producers, and a sleeping subscriber") {
+    THEN("the subscriber gets every message, in order per publisher") {
+      REQUIRE_EQ(publish_from_threads(zq::WaitMode::FUTEX), 20000);
+    }
+  }
+  GIVEN("a bus with many producers, and a spinning subscriber") {
+    THEN("the subscriber gets every message, in order per publisher") {
+      REQUIRE_EQ(publish_from_threads(zq::WaitMode::BUSY_SPIN), 20000);
+    }
+  }
+}
+
+SCENARIO("The local bus and inproc sockets deliver the same messages") {
+  // zq-local-bus-bench compares their throughput
+  TimeOutInsurance toi{10000ms};
+  constexpr int message_count = 20000;
+
+  GIVEN("the same messages sent thread to thread") {
+    WHEN("using a PUSH/PULL inproc pair") {
+      auto context = zq::mk_context();
+      REQUIRE(context);
+      auto address = next_inproc_address();
+      auto pull = context->bind(zq::SocketType::PULL, address);
+      auto push = context->connect(zq::SocketType::PUSH, address);
+      REQUIRE(pull);
+      REQUIRE(push);
+
+      std::thread pusher([&] {
+        for (int i = 0; i < message_count; ++i) {
+          auto tm = zq::typed_message(i);
+          while (!push->send(tm)) {
+            std::this_thread::yield();
+          }
+        }
+      });
+      int received = 0;
+      while (received < message_count) {
+        auto msg = pull->await(1000ms);
+        REQUIRE(msg);
+        REQUIRE(*msg);
+        REQUIRE_EQ(zq::restore_as<int>(**msg), received);
+        ++received;
+      }
+      pusher.join();
+      THEN("all messages arrive, in order") {
+        REQUIRE_EQ(received, message_count);
+      }
+    }
+    AND_WHEN("using a local bus") {
+      zq::LocalBus bus{zq::LocalBusOptions{
+          .capacity = 1024, .producers = zq::Producers::SINGLE}};
+      auto sub = bus.subscribe<int>();
+      auto publisher = bus.publisher();
+      REQUIRE(publisher);
+
+      std::thread pusher([&] {
+        for (int i = 0; i < message_count; ++i) {
+          auto tm = zq::typed_message(i);
+          while (publisher->publish(zq::shared_copy(tm)) == 0) {
+            std::this_thread::yield();
+          }
+        }
+      });
+      int received = 0;
+      while (received < message_count) {
+        auto msg = sub.await(1000ms);
+        REQUIRE(msg);
+        REQUIRE_EQ(zq::restore_as<int>(*msg), received);
+        ++received;
+      }
+      pusher.join();
+      THEN("all messages arrive, in order") {
+        REQUIRE_EQ(received, message_count);
+      }
+    }
+  }
+}
@@ -0,0 +1,193 @@
+#include <doctest/doctest.h>
+#include <zq/batching.hpp>
+#include <zq/zq.hpp>
+
+#include <string>
+#include <thread>
+#include <vector>
+#include "../zq_testing.hpp"
+
+using namespace std::chrono_literals;
+
+SCENARIO("Splitting batches") {
+  GIVEN("a message that is no batch") {
+    auto msg = zq::typed_message(std::string{"single"});
+    THEN("unbatch passes it through") {
+      REQUIRE_FALSE(zq::is_batch(msg));
+      std::vector<zq::TypedMessage> out;
+      REQUIRE(zq::unbatch(std::move(msg), out));
+      REQUIRE_EQ(out.size(), 1);
+      REQUIRE_EQ(zq::restore_as<std::string>(out[0]), "single");
+    }
+  }
+  GIVEN("a batch that claims more messages than it holds") {
+    auto msg = zq::typed_message(0);
+    msg.payload = zq::Message{};
+    msg.meta = zq::meta_message({{zq::MetaTag::BATCH, 2}});
+    THEN("unbatch reports the damage") {
+      std::vector<zq::TypedMessage> out;
+      REQUIRE_FALSE(zq::unbatch(std::move(msg), out));
+      REQUIRE(out.empty());
+    }
+  }
+}
+
+SCENARIO("Sending in batches") {
+  TimeOutInsurance toi{5000ms};
+  auto context = zq::mk_context();
+  REQUIRE(context);
+  auto address = next_inproc_address();
+  auto pull = context->bind(zq::SocketType::PULL, address);
+  auto push = context->connect(zq::SocketType::PUSH, address);
+  REQUIRE(pull);
+  REQUIRE(push);
+
+  GIVEN("a sender with a count limit of 4") {
+    zq::BatchingSender sender{
+        std::move(*push),
+        {.max_count = 4, .max_delay = 10s, .adaptive = false}};
+
+    WHEN("4 messages are sent, one with meta data") {
+      REQUIRE(sender.send(1));
+      REQUIRE(sender.send(2));
+      auto traced = zq::typed_message(3);
+      zq::set_meta(traced, zq::MetaTag::SEQUENCE, 77);
+      REQUIRE(sender.send(traced));
+      REQUIRE_FALSE(sender.time_to_flush() == std::nullopt);
+      REQUIRE(sender.send(4));
+
+      THEN("they arrive as one batch") {
+        REQUIRE_EQ(sender.batches_sent(), 1);
+        REQUIRE_EQ(sender.sent(), 4);
+        auto batch = pull->await(1000ms);
+        REQUIRE(batch);
+        REQUIRE(*batch);
+        REQUIRE(zq::is_batch(**batch));
+        REQUIRE_EQ(zq::get_meta(**batch, zq::MetaTag::BATCH), 4);
+      }
+      AND_THEN("a receiver splits it, in order and with the meta data") {
+        zq::BatchReceiver receiver;
+        for (int i = 1; i <= 4; ++i) {
+          auto msg = receiver.await(*pull, 1000ms);
+          REQUIRE(msg);
+          REQUIRE(*msg);
+          REQUIRE_FALSE(zq::is_batch(**msg));
+          REQUIRE_EQ(zq::restore_as<int>(**msg), i);
+          if (i == 3) {
+            REQUIRE_EQ(zq::get_meta(**msg, zq::MetaTag::SEQUENCE), 77);
+          }
+        }
+        REQUIRE_EQ(receiver.buffered(), 0);
+        REQUIRE_FALSE(receiver.recv(*pull));
+      }
+    }
+
+    WHEN("ints and strings are sent in turns") {
+      REQUIRE(sender.send(1));
+      REQUIRE(sender.send(std::string{"a"}));
+      REQUIRE(sender.send(2));
+      REQUIRE(sender.send(std::string{"b"}));
+      REQUIRE(sender.flush());
+
+      THEN("each type arrives in its own batch, in order") {
+        REQUIRE_EQ(sender.batches_sent(), 2);
+        zq::BatchReceiver receiver;
+        std::vector<int> ints;
+        std::vector<std::string> strings;
+        for (int i = 0; i < 4; ++i) {
+          auto msg = receiver.await(*pull, 1000ms);
+          REQUIRE(msg);
+          REQUIRE(*msg);
+          if (auto value = zq::restore_as<int>(**msg)) {
+            ints.push_back(*value);
+          } else {
+            auto text = zq::restore_as<std::string>(**msg);
+            REQUIRE(text);
+            strings.push_back(*text);
+          }
+        }
+        const std::vector<int> expected_ints{1, 2};
+        const std::vector<std::string> expected_strings{"a", "b"};
+        REQUIRE_EQ(ints, expected_ints);
+        REQUIRE_EQ(strings, expected_strings);
+      }
+    }
+
+    WHEN("a batch of strings is received without a BatchReceiver") {
+      REQUIRE(sender.send(std::string{"a"}));
+      REQUIRE(sender.send(std::string{"b"}));
+      REQUIRE(sender.flush());
+      auto batch = pull->await(1000ms);
+      REQUIRE(batch);
+      REQUIRE(*batch);
+
+      THEN("restoring it as a single string fails") {
+        auto value = zq::restore_as<std::string>(**batch);
+        REQUIRE_FALSE(value);
+        REQUIRE_EQ(std::string(value.error().what()),
+                   "Message is a batch, receive it with a BatchReceiver");
+        REQUIRE_FALSE(zq::restore_any<int, std::string>(**batch));
+      }
+    }
+
+    WHEN("a batch is not full, but its delay passed") {
+      zq::BatchingSender short_delay{
+          std::move(sender.socket()),
+          {.max_count = 4, .max_delay = 1ms, .adaptive = false}};
+      REQUIRE(short_delay.send(std::string{"late"}));
+      REQUIRE_FALSE(pull->poll(10ms).value_or(true));
+      std::this_thread::sleep_for(2ms);
+      REQUIRE(short_delay.flush_if_due());
+
+      THEN("flush_if_due sends it") {
+        REQUIRE_EQ(short_delay.time_to_flush(), std::nullopt);
+        zq::BatchReceiver receiver;
+        auto msg = receiver.await(*pull, 1000ms);
+        REQUIRE(msg);
+        REQUIRE(*msg);
+        REQUIRE_EQ(zq::restore_as<std::string>(**msg), "late");
+      }
+    }
+  }
+
+  GIVEN("a sender that goes out of scope with a pending batch") {
+    {
+      zq::BatchingSender sender{
+          std::move(*push),
+          {.max_count = 4, .max_delay = 10s, .adaptive = false}};
+      REQUIRE(sender.send(1));
+      REQUIRE(sender.send(2));
+      REQUIRE_EQ(sender.batches_sent(), 0);
+    }
+
+    THEN("the destructor sends the batch") {
+      zq::BatchReceiver receiver;
+      for (int i = 1; i <= 2; ++i) {
+        auto msg = receiver.await(*pull, 1000ms);
+        REQUIRE(msg);
+        REQUIRE(*msg);
+        REQUIRE_EQ(zq::restore_as<int>(**msg), i);
+      }
+    }
+  }
+
+  GIVEN("an adaptive sender and a low rate") {
+    zq::BatchingSender sender{std::move(*push), {.max_delay = 100us}};
+
+    WHEN("messages are sent a millisecond apart") {
+      for (int i = 0; i < 3; ++i) {
+        REQUIRE(sender.send(i));
+        std::this_thread::sleep_for(1ms);
+      }
+
+      THEN("they are sent right away, not batched") {
+        REQUIRE_EQ(sender.batches_sent(), 0);
+        REQUIRE_EQ(sender.sent(), 3);
+        auto msg = pull->await(1000ms);
+        REQUIRE(msg);
+        REQUIRE(*msg);
+        REQUIRE_FALSE(zq::is_batch(**msg));
+      }
+    }
+  }
+}
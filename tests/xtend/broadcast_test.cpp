@@ -0,0 +1,109 @@
+#include <doctest/doctest.h>
+#include <zq/meta.hpp>
+#include <zq/zq.hpp>
+
+#include <array>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../zq_testing.hpp"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+  std::atomic<int> payload_frees{0};
+
+  void count_free(void*, void*) {
+    ++payload_frees;
+  }
+
+  // a typed message whose payload lives in buffer, ZeroMQ does not own it
+  zq::TypedMessage borrowed_message(std::string& buffer) {
+    auto tm = zq::typed_message(std::string{});
+    zmq_msg_close(std::addressof(tm.payload.msg));
+    zmq_msg_init_data(std::addressof(tm.payload.msg), buffer.data(),
+                      buffer.size(), count_free, nullptr);
+    return tm;
+  }
+
+}  // namespace
+
+SCENARIO("Broadcasting one typed message to several sockets") {
+  TimeOutInsurance toi{2000ms};
+  auto context = zq::mk_context();
+  REQUIRE(context);
+
+  GIVEN("three connected push sockets") {
+    std::vector<zq::Socket> pulls;
+    std::vector<zq::Socket> pushes;
+    for (int i = 0; i < 3; ++i) {
+      auto address = next_inproc_address();
+      auto pull = context->bind(zq::SocketType::PULL, address);
+      auto push = context->connect(zq::SocketType::PUSH, address);
+      REQUIRE(pull);
+      REQUIRE(push);
+      pulls.push_back(std::move(*pull));
+      pushes.push_back(std::move(*push));
+    }
+    std::array<zq::Socket*, 3> sockets{&pushes[0], &pushes[1], &pushes[2]};
+
+    WHEN("broadcasting a message with a large payload") {
+      payload_frees = 0;
+      std::string buffer(4096, 'x');
+      {
+        auto tm = borrowed_message(buffer);
+        auto results = zq::broadcast(sockets, tm);
+        REQUIRE_EQ(results.size(), 3);
+        for (const auto& rc : results) {
+          REQUIRE(rc);
+        }
+      }
+
+      THEN("every socket delivers the same payload, it was never copied") {
+        for (auto& pull : pulls) {
+          auto msg = pull.await(100ms);
+          REQUIRE(msg);
+          REQUIRE(*msg);
+          REQUIRE_EQ((**msg).payload.data(), buffer.data());
+          REQUIRE_EQ((**msg).payload.size(), buffer.size());
+        }
+      }
+      AND_THEN("the payload is released once, after the last receiver") {
+        REQUIRE_EQ(payload_frees, 0);
+        for (auto& pull : pulls) {
+          REQUIRE(pull.await(100ms));
+        }
+        REQUIRE_EQ(payload_frees, 1);
+      }
+    }
+  }
+
+  GIVEN("a socket that can not send, and one that can") {
+    auto address = next_inproc_address();
+    auto pull = context->bind(zq::SocketType::PULL, address);
+    auto push = context->connect(zq::SocketType::PUSH, address);
+    auto unconnected = context->socket(zq::SocketType::PUSH);
+    REQUIRE(pull);
+    REQUIRE(push);
+    REQUIRE(unconnected);
+    std::array<zq::Socket*, 2> sockets{&*unconnected, &*push};
+
+    WHEN("broadcasting a message with meta") {
+      auto tm = zq::typed_message(42);
+      zq::set_meta(tm, zq::MetaTag::SEQUENCE, 7);
+      auto results = zq::broadcast(sockets, tm);
+
+      THEN("the first reports would block, the second sends") {
+        REQUIRE_FALSE(results[0]);
+        REQUIRE_EQ(results[0].error().errNo, EAGAIN);
+        REQUIRE(results[1]);
+        auto msg = pull->await(100ms);
+        REQUIRE(msg);
+        REQUIRE(*msg);
+        REQUIRE_EQ(zq::restore_as<int>(**msg), 42);
+        REQUIRE_EQ(zq::get_meta(**msg, zq::MetaTag::SEQUENCE), 7);
+      }
+    }
+  }
+}
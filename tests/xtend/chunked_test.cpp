@@ -0,0 +1,104 @@
+#include <doctest/doctest.h>
+#include <zq/chunked.hpp>
+#include <zq/zq.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <vector>
+#include "../zq_testing.hpp"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+  std::vector<std::byte> pattern(size_t size) {
+    std::vector<std::byte> data(size);
+    for (size_t i = 0; i < size; ++i) {
+      data[i] = static_cast<std::byte>(i * 7 % 251);
+    }
+    return data;
+  }
+
+}  // namespace
+
+SCENARIO("Transferring a large payload in chunks") {
+  TimeOutInsurance toi{5000ms};
+  auto context = zq::mk_context();
+  REQUIRE(context);
+  auto address = next_inproc_address();
+  auto receiver = context->bind(zq::SocketType::PAIR, address);
+  auto sender = context->connect(zq::SocketType::PAIR, address);
+  REQUIRE(receiver);
+  REQUIRE(sender);
+  const zq::ChunkOptions options{.chunk_size = 1000, .window = 4};
+  const auto data = pattern(100 * 1000 + 17);
+
+  GIVEN("a receiver with a large enough buffer") {
+    std::vector<std::byte> buffer(data.size());
+    auto received = std::async(std::launch::async, [&]() {
+      return zq::recv_chunked(*receiver, std::span{buffer}, options);
+    });
+
+    WHEN("sending the payload") {
+      auto sent = zq::send_chunked(*sender, std::span{data}, options);
+
+      THEN("the buffer holds the payload") {
+        REQUIRE(sent);
+        REQUIRE_EQ(*sent, data.size());
+        auto got = received.get();
+        REQUIRE(got);
+        REQUIRE_EQ(*got, data.size());
+        REQUIRE(buffer == data);
+      }
+    }
+  }
+
+  GIVEN("a receiver with a too small buffer") {
+    std::vector<std::byte> buffer(data.size() / 2);
+    auto received = std::async(std::launch::async, [&]() {
+      return zq::recv_chunked(*receiver, std::span{buffer}, options);
+    });
+
+    WHEN("sending the payload") {
+      auto sent = zq::send_chunked(*sender, std::span{data}, options);
+
+      THEN("the transfer is refused on both sides") {
+        REQUIRE_FALSE(sent);
+        REQUIRE_FALSE(received.get());
+      }
+    }
+  }
+
+  GIVEN("a file, and a receiver that writes into a file") {
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto source = dir / ("zq_chunked_in_" + address.substr(10));
+    const auto target = dir / ("zq_chunked_out_" + address.substr(10));
+    {
+      std::ofstream out{source, std::ios::binary};
+      out.write(reinterpret_cast<const char*>(data.data()),
+                static_cast<std::streamsize>(data.size()));
+    }
+    auto received = std::async(std::launch::async, [&]() {
+      return zq::recv_chunked(*receiver, target, options);
+    });
+
+    WHEN("sending the file") {
+      auto sent = zq::send_chunked(*sender, source, options);
+      auto got = received.get();
+
+      THEN("the copy has the same content") {
+        REQUIRE(sent);
+        REQUIRE(got);
+        REQUIRE_EQ(std::filesystem::file_size(target), data.size());
+        std::vector<std::byte> copy(data.size());
+        std::ifstream in{target, std::ios::binary};
+        in.read(reinterpret_cast<char*>(copy.data()),
+                static_cast<std::streamsize>(copy.size()));
+        REQUIRE(copy == data);
+      }
+    }
+    std::filesystem::remove(source);
+    std::filesystem::remove(target);
+  }
+}
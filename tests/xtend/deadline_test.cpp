@@ -0,0 +1,64 @@
+#include <doctest/doctest.h>
+#include <zq/deadline.hpp>
+#include <zq/zq.hpp>
+
+#include <string>
+#include "../zq_testing.hpp"
+
+using namespace std::chrono_literals;
+
+SCENARIO("Messages with a deadline") {
+  GIVEN("a message without a deadline") {
+    auto msg = zq::typed_message(std::string{"no hurry"});
+    THEN("it never expires") {
+      REQUIRE_FALSE(zq::get_deadline(msg));
+      REQUIRE_FALSE(zq::is_expired(msg));
+    }
+  }
+  GIVEN("a message with a time to live") {
+    auto msg = zq::typed_message(std::string{"hurry"});
+    zq::set_ttl(msg, 1s);
+    THEN("it expires after that time") {
+      REQUIRE(zq::get_deadline(msg));
+      REQUIRE_FALSE(zq::is_expired(msg));
+      REQUIRE(zq::is_expired(msg, zq::DeadlineClock::now() + 2s));
+      REQUIRE_EQ(msg.meta.size(), zq::meta_record_size);
+    }
+  }
+}
+
+SCENARIO("Shedding expired messages") {
+  TimeOutInsurance toi{5000ms};
+  auto context = zq::mk_context();
+  REQUIRE(context);
+  auto address = next_inproc_address();
+  auto pull = context->bind(zq::SocketType::PULL, address);
+  auto push = context->connect(zq::SocketType::PUSH, address);
+  REQUIRE(pull);
+  REQUIRE(push);
+
+  GIVEN("expired messages queued before a live one") {
+    for (int i = 0; i < 3; ++i) {
+      auto msg = zq::typed_message(i);
+      zq::set_deadline(msg, zq::DeadlineClock::now() - 1s);
+      REQUIRE(push->send(msg));
+    }
+    auto live = zq::typed_message(42);
+    zq::set_ttl(live, 10s);
+    REQUIRE(push->send(live));
+
+    WHEN("receiving through a load shedder") {
+      zq::LoadShedder shedder;
+      auto msg = shedder.await(*pull, 1000ms);
+
+      THEN("only the live message is handed out") {
+        REQUIRE(msg);
+        REQUIRE(*msg);
+        REQUIRE_EQ(zq::restore_as<int>(**msg), 42);
+        REQUIRE_EQ(shedder.dropped(), 3);
+        REQUIRE_EQ(shedder.passed(), 1);
+        REQUIRE_FALSE(shedder.recv(*pull));
+      }
+    }
+  }
+}
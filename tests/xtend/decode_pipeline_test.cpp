@@ -0,0 +1,117 @@
+#include <doctest/doctest.h>
+#include <zq/decode_pipeline.hpp>
+#include <zq/zq.hpp>
+
+#include <map>
+#include <string>
+#include <thread>
+#include "../zq_testing.hpp"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+  struct Order {
+    int account;
+    int sequence;
+  };
+
+  // slow for some messages, so workers finish out of order
+  auto slow_decoder(int every) {
+    return [every](const zq::TypedMessage& msg)
+               -> zq::DecodePipeline<Order>::Decoded {
+      auto order = zq::restore_as<Order>(msg);
+      if (!order) {
+        return std::unexpected(order.error());
+      }
+      if (order->sequence % every == 0) {
+        std::this_thread::sleep_for(200us);
+      }
+      return *order;
+    };
+  }
+
+}  // namespace
+
+SCENARIO("Decoding on many threads") {
+  TimeOutInsurance toi{10000ms};
+  auto context = zq::mk_context();
+  REQUIRE(context);
+  auto address = next_inproc_address();
+  auto pull = context->bind(zq::SocketType::PULL, address);
+  auto push = context->connect(zq::SocketType::PUSH, address);
+  REQUIRE(pull);
+  REQUIRE(push);
+  constexpr int count = 200;
+
+  GIVEN("a pipeline without a key") {
+    zq::DecodePipeline<Order> pipeline{
+        std::move(*pull), {.workers = 4, .capacity = 16}, slow_decoder(7)};
+    REQUIRE_EQ(pipeline.worker_count(), 4);
+
+    WHEN("messages are sent") {
+      for (int i = 0; i < count; ++i) {
+        REQUIRE(push->send(zq::typed_message(Order{i % 3, i})));
+      }
+
+      THEN("they come out in the order they were sent") {
+        for (int i = 0; i < count; ++i) {
+          auto order = pipeline.next(1000ms);
+          REQUIRE(order);
+          REQUIRE(*order);
+          REQUIRE_EQ((*order)->sequence, i);
+        }
+        REQUIRE_FALSE(pipeline.next(10ms));
+      }
+    }
+
+    WHEN("a message can not be decoded") {
+      REQUIRE(push->send(zq::typed_message(std::string{"no order"})));
+      REQUIRE(push->send(zq::typed_message(Order{0, 1})));
+
+      THEN("the error comes out at its place") {
+        auto first = pipeline.next(1000ms);
+        REQUIRE(first);
+        REQUIRE_FALSE(*first);
+        auto second = pipeline.next(1000ms);
+        REQUIRE(second);
+        REQUIRE(*second);
+        REQUIRE_EQ((*second)->sequence, 1);
+      }
+    }
+  }
+
+  GIVEN("a pipeline with the account as key") {
+    zq::DecodePipeline<Order> pipeline{
+        std::move(*pull),
+        {.workers = 3,
+         .capacity = 16,
+         .key = [](const zq::TypedMessage& msg) -> uint64_t {
+           auto order = zq::restore_as<Order>(msg);
+           return order ? static_cast<uint64_t>(order->account) : 0;
+         }},
+        slow_decoder(5)};
+
+    WHEN("messages of several accounts are sent") {
+      for (int i = 0; i < count; ++i) {
+        REQUIRE(push->send(zq::typed_message(Order{i % 5, i})));
+      }
+
+      THEN("each account keeps its order") {
+        std::map<int, int> last;
+        for (int i = 0; i < count; ++i) {
+          auto order = pipeline.next(1000ms);
+          REQUIRE(order);
+          REQUIRE(*order);
+          auto [it, first] =
+              last.try_emplace((*order)->account, (*order)->sequence);
+          if (!first) {
+            REQUIRE_LT(it->second, (*order)->sequence);
+            it->second = (*order)->sequence;
+          }
+        }
+        REQUIRE_EQ(last.size(), 5);
+      }
+    }
+  }
+}
@@ -0,0 +1,254 @@
+#include <doctest/doctest.h>
+
+#ifndef _WIN32
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <zq/journal.hpp>
+#include <zq/meta.hpp>
+#include "../zq_testing.hpp"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+  struct TempDir {
+    std::filesystem::path path;
+
+    TempDir()
+        : path{std::filesystem::temp_directory_path() /
+               ("zq_journal_" + std::to_string(atomic_counter++))} {
+      std::filesystem::remove_all(path);
+    }
+    ~TempDir() {
+      std::error_code ec;
+      std::filesystem::remove_all(path, ec);
+    }
+  };
+
+  // records 0..count-1 with time stamps 1000 ns apart
+  void record_ints(const std::filesystem::path& dir,
+                   int count,
+                   zq::JournalOptions options = {}) {
+    auto journal = zq::open_journal(dir, options);
+    REQUIRE(journal);
+    for (int i = 0; i < count; ++i) {
+      REQUIRE(journal->append(zq::typed_message(i),
+                              static_cast<uint64_t>(i) * 1000));
+    }
+  }
+
+}  // namespace
+
+SCENARIO("Recording typed messages into a journal") {
+  TempDir dir;
+
+  GIVEN("a journal with a few messages") {
+    {
+      auto journal = zq::open_journal(dir.path);
+      REQUIRE(journal);
+      auto tm = zq::typed_message(42);
+      zq::set_meta(tm, zq::MetaTag::SEQUENCE, 7);
+      REQUIRE(journal->append(tm));
+      REQUIRE(journal->append(zq::typed_message("Hello world")));
+      REQUIRE_EQ(journal->sequence(), 2);
+    }
+
+    THEN("a reader gets them back, in order") {
+      auto reader = zq::open_journal_reader(dir.path);
+      REQUIRE(reader);
+      auto first = reader->next();
+      REQUIRE(first);
+      REQUIRE_EQ(first->sequence, 0);
+      REQUIRE_GT(first->timestamp_ns, 0);
+      REQUIRE_EQ(first->type, zq::wire_type_name<int>());
+      auto tm = zq::to_typed_message(*first);
+      REQUIRE_EQ(zq::restore_as<int>(tm), 42);
+      REQUIRE_EQ(zq::get_meta(tm, zq::MetaTag::SEQUENCE), 7);
+
+      auto second = reader->next();
+      REQUIRE(second);
+      REQUIRE_EQ(zq::restore_as<std::string>(zq::to_typed_message(*second)),
+                 "Hello world");
+      REQUIRE_FALSE(reader->next());
+    }
+    AND_WHEN("the journal is opened again") {
+      {
+        auto journal = zq::open_journal(dir.path);
+        REQUIRE(journal);
+        REQUIRE_EQ(journal->sequence(), 2);
+        REQUIRE(journal->append(zq::typed_message(3)));
+      }
+      THEN("new records continue the sequence") {
+        auto reader = zq::open_journal_reader(dir.path);
+        REQUIRE(reader);
+        uint64_t last = 0;
+        int count = 0;
+        while (auto record = reader->next()) {
+          last = record->sequence;
+          ++count;
+        }
+        REQUIRE_EQ(count, 3);
+        REQUIRE_EQ(last, 2);
+      }
+    }
+    AND_WHEN("it is reopened twice without appending, then appended to") {
+      for (int i = 0; i < 2; ++i) {
+        auto journal = zq::open_journal(dir.path);
+        REQUIRE(journal);
+        REQUIRE_EQ(journal->sequence(), 2);
+      }
+      {
+        auto journal = zq::open_journal(dir.path);
+        REQUIRE(journal);
+        REQUIRE_EQ(journal->sequence(), 2);
+        REQUIRE(journal->append(zq::typed_message(3)));
+      }
+      THEN("the sequence continues, and seek finds the new record") {
+        auto reader = zq::open_journal_reader(dir.path);
+        REQUIRE(reader);
+        uint64_t expected = 0;
+        while (auto record = reader->next()) {
+          REQUIRE_EQ(record->sequence, expected);
+          ++expected;
+        }
+        REQUIRE_EQ(expected, 3);
+        reader->seek(2);
+        auto record = reader->next();
+        REQUIRE(record);
+        REQUIRE_EQ(record->sequence, 2);
+        REQUIRE_EQ(zq::restore_as<int>(zq::to_typed_message(*record)), 3);
+      }
+    }
+  }
+
+  GIVEN("small segments and a dense index") {
+    record_ints(dir.path, 1000,
+                zq::JournalOptions{.segment_bytes = 4096, .index_interval = 10});
+
+    THEN("the records are spread over many segment files") {
+      size_t segments = 0;
+      for (const auto& entry : std::filesystem::directory_iterator{dir.path}) {
+        if (entry.path().extension() == ".zqj") {
+          ++segments;
+        }
+      }
+      REQUIRE_GT(segments, 5);
+
+      auto reader = zq::open_journal_reader(dir.path);
+      REQUIRE(reader);
+      int expected = 0;
+      while (auto record = reader->next()) {
+        REQUIRE_EQ(zq::restore_as<int>(zq::to_typed_message(*record)),
+                   expected);
+        ++expected;
+      }
+      REQUIRE_EQ(expected, 1000);
+    }
+    AND_THEN("a reader can seek by sequence and by time") {
+      auto reader = zq::open_journal_reader(dir.path);
+      REQUIRE(reader);
+      reader->seek(777);
+      auto record = reader->next();
+      REQUIRE(record);
+      REQUIRE_EQ(record->sequence, 777);
+
+      reader->seek_time(123500);
+      record = reader->next();
+      REQUIRE(record);
+      REQUIRE_EQ(record->sequence, 124);
+
+      reader->seek(5000);
+      REQUIRE_FALSE(reader->next());
+    }
+  }
+
+  GIVEN("no journal") {
+    THEN("opening a reader fails") {
+      REQUIRE_FALSE(zq::open_journal_reader(dir.path));
+    }
+  }
+}
+
+SCENARIO("Replaying a journal to a socket") {
+  TimeOutInsurance toi{5000ms};
+  TempDir dir;
+  auto context = zq::mk_context();
+  REQUIRE(context);
+  auto address = next_inproc_address();
+  auto pull = context->bind(zq::SocketType::PULL, address);
+  auto push = context->connect(zq::SocketType::PUSH, address);
+  REQUIRE(pull);
+  REQUIRE(push);
+
+  GIVEN("a journal of 100 messages over 99 ms") {
+    {
+      auto journal = zq::open_journal(dir.path);
+      REQUIRE(journal);
+      for (int i = 0; i < 100; ++i) {
+        REQUIRE(journal->append(zq::typed_message(i),
+                                static_cast<uint64_t>(i) * 1000000));
+      }
+    }
+    auto reader = zq::open_journal_reader(dir.path);
+    REQUIRE(reader);
+
+    WHEN("replaying as fast as possible") {
+      auto sent = zq::replay(*reader, *push, {.speed = 0});
+      THEN("all messages arrive in order") {
+        REQUIRE(sent);
+        REQUIRE_EQ(*sent, 100);
+        for (int i = 0; i < 100; ++i) {
+          auto msg = pull->await(100ms);
+          REQUIRE(msg);
+          REQUIRE(*msg);
+          REQUIRE_EQ(zq::restore_as<int>(**msg), i);
+        }
+      }
+    }
+    AND_WHEN("replaying at twice the original speed") {
+      const auto start = std::chrono::steady_clock::now();
+      auto sent = zq::replay(*reader, *push, {.speed = 2.0});
+      const auto elapsed = std::chrono::steady_clock::now() - start;
+      THEN("it takes about half the recorded time") {
+        REQUIRE(sent);
+        REQUIRE_EQ(*sent, 100);
+        REQUIRE_GE(elapsed, 49ms);
+        REQUIRE_LT(elapsed, 500ms);
+      }
+    }
+  }
+  GIVEN("a journal with a time stamp that steps backwards") {
+    {
+      auto journal = zq::open_journal(dir.path);
+      REQUIRE(journal);
+      REQUIRE(journal->append(zq::typed_message(0), 5000000));
+      REQUIRE(journal->append(zq::typed_message(1), 1000000));
+      REQUIRE(journal->append(zq::typed_message(2), 10000000));
+    }
+    auto reader = zq::open_journal_reader(dir.path);
+    REQUIRE(reader);
+
+    WHEN("replaying at the original speed") {
+      const auto start = std::chrono::steady_clock::now();
+      auto sent = zq::replay(*reader, *push);
+      const auto elapsed = std::chrono::steady_clock::now() - start;
+      THEN("the earlier message is sent right away, the rest on time") {
+        REQUIRE(sent);
+        REQUIRE_EQ(*sent, 3);
+        REQUIRE_GE(elapsed, 5ms);
+        REQUIRE_LT(elapsed, 500ms);
+        for (int i = 0; i < 3; ++i) {
+          auto msg = pull->await(100ms);
+          REQUIRE(msg);
+          REQUIRE(*msg);
+          REQUIRE_EQ(zq::restore_as<int>(**msg), i);
+        }
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include <doctest/doctest.h>
+
+#ifndef _WIN32
+
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include <zq/mapped_file.hpp>
+#include "../zq_testing.hpp"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+  struct TempFile {
+    std::filesystem::path path;
+
+    explicit TempFile(const std::string& content)
+        : path{std::filesystem::temp_directory_path() /
+               ("zq_mapped_" + std::to_string(atomic_counter++))} {
+      std::ofstream out{path, std::ios::binary};
+      out << content;
+    }
+    ~TempFile() {
+      std::error_code ec;
+      std::filesystem::remove(path, ec);
+    }
+  };
+
+  std::string content_of(const zq::Message& m) {
+    return zq::as_string(m);
+  }
+
+}  // namespace
+
+SCENARIO("Sending the content of a file without copying it") {
+  TimeOutInsurance toi{2000ms};
+  // more than a page, so a range can start behind a page boundary
+  std::string content;
+  for (int i = 0; content.size() < 10000; ++i) {
+    content += std::to_string(i) + ",";
+  }
+  TempFile file{content};
+
+  GIVEN("a message of a whole file, and one of a range") {
+    auto whole = zq::file_message(file.path);
+    auto range = zq::file_message(file.path, 5000, 100);
+    REQUIRE(whole);
+    REQUIRE(range);
+
+    THEN("they have the content of the file") {
+      REQUIRE_EQ(content_of(*whole), content);
+      REQUIRE_EQ(content_of(*range), content.substr(5000, 100));
+    }
+  }
+
+  GIVEN("a typed file message sent over inproc") {
+    auto context = zq::mk_context();
+    REQUIRE(context);
+    auto address = next_inproc_address();
+    auto pull = context->bind(zq::SocketType::PULL, address);
+    auto push = context->connect(zq::SocketType::PUSH, address);
+    REQUIRE(pull);
+    REQUIRE(push);
+    auto tm = zq::typed_file_message("snapshot", file.path);
+    REQUIRE(tm);
+    const void* mapped = tm->payload.data();
+    REQUIRE(push->send_shared(*tm));
+
+    WHEN("receiving it") {
+      auto msg = pull->await(100ms);
+      REQUIRE(msg);
+      REQUIRE(*msg);
+
+      THEN("the receiver sees the mapping itself") {
+        REQUIRE_EQ(zq::as_string(msg->value().type), "snapshot");
+        REQUIRE_EQ((**msg).payload.data(), mapped);
+      }
+      AND_THEN("it can be written into a file") {
+        TempFile copy{""};
+        auto written = zq::write_to_file((**msg).payload, copy.path);
+        REQUIRE(written);
+        REQUIRE_EQ(*written, content.size());
+        auto back = zq::file_message(copy.path);
+        REQUIRE(back);
+        REQUIRE_EQ(content_of(*back), content);
+      }
+    }
+  }
+
+  GIVEN("bad arguments") {
+    THEN("a missing file or an offset behind the end fail") {
+      auto missing = zq::file_message(file.path.string() + ".missing");
+      REQUIRE_FALSE(missing);
+      REQUIRE_EQ(std::string{missing.error().what()}, "file message open");
+      REQUIRE_EQ(missing.error().errNo, ENOENT);
+      REQUIRE_FALSE(zq::file_message(file.path, content.size() + 1));
+    }
+    AND_THEN("an empty range gives an empty message") {
+      auto empty = zq::file_message(file.path, content.size());
+      REQUIRE(empty);
+      REQUIRE_EQ(empty->size(), 0);
+    }
+  }
+}
+
+#endif
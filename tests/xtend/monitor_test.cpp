@@ -0,0 +1,71 @@
+#include <doctest/doctest.h>
+#include <chrono>
+
+#include <zq/monitor.hpp>
+#include "../zq_testing.hpp"
+
+SCENARIO("Monitoring a socket") {
+  auto context = zq::mk_context();
+  REQUIRE(context);
+  using namespace std::chrono_literals;
+
+  GIVEN("a reply socket and a monitored, not yet connected, request socket") {
+    auto address = next_ipc_address();
+    auto server = context->bind(zq::SocketType::REP, address);
+    REQUIRE(server);
+    auto client = context->socket(zq::SocketType::REQ);
+    REQUIRE(client);
+    auto monitor = context->monitor(*client);
+    REQUIRE(monitor);
+
+    WHEN("connecting the request socket") {
+      REQUIRE(client->connect(address));
+
+      THEN("the connection is reported") {
+        auto event = zq::await_event(*monitor, zq::MonitorEvent::CONNECTED,
+                                     1000ms);
+        REQUIRE(event);
+        REQUIRE(*event);
+        REQUIRE_EQ((*event)->event, zq::MonitorEvent::CONNECTED);
+        REQUIRE_EQ((*event)->endpoint, address);
+      }
+      AND_THEN("the handshake can be awaited before the first send") {
+        auto event = zq::await_handshake(*monitor, 1000ms);
+        REQUIRE(event);
+        REQUIRE(*event);
+        REQUIRE((*event)->is(zq::MonitorEvent::HANDSHAKE_SUCCEEDED));
+
+        REQUIRE(client->send(zq::typed_message("Hello")));
+        auto request = server->await(1000ms);
+        REQUIRE(request);
+        REQUIRE(request.value());
+        REQUIRE_EQ(zq::restore_as<std::string>(*request.value()), "Hello");
+      }
+      AND_THEN("closing the socket is reported") {
+        REQUIRE(zq::await_handshake(*monitor, 1000ms));
+        REQUIRE_EQ(client->close(), zq::NoError);
+        auto event = zq::await_event(
+            *monitor, zq::MonitorEvent::MONITOR_STOPPED, 1000ms);
+        REQUIRE(event);
+        REQUIRE(*event);
+      }
+    }
+    AND_WHEN("not connecting") {
+      THEN("awaiting the handshake times out") {
+        REQUIRE_FALSE(zq::await_handshake(*monitor, 10ms));
+      }
+    }
+  }
+}
+
+SCENARIO("Decoding something that is not a monitor event") {
+  GIVEN("a string typed message") {
+    auto tm = zq::typed_message("Hello");
+    WHEN("decoding it as event") {
+      auto event = zq::decode_event(tm);
+      THEN("an error is returned") {
+        REQUIRE_FALSE(event);
+      }
+    }
+  }
+}
@@ -0,0 +1,129 @@
+#include <doctest/doctest.h>
+#include <zq/priority_channel.hpp>
+#include <zq/zq.hpp>
+
+#include <string>
+#include "../zq_testing.hpp"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+  struct Cancel {
+    int order_id;
+  };
+
+  // wait until every lane has something to read
+  bool all_lanes_ready(zq::PriorityChannel& channel) {
+    for (size_t i = 0; i < channel.lane_count(); ++i) {
+      auto ready = channel.lane(i).poll(1000ms);
+      if (!ready || !*ready) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+}  // namespace
+
+SCENARIO("Endpoints of priority lanes") {
+  GIVEN("a tcp endpoint") {
+    THEN("the lanes use the following ports") {
+      auto endpoints = zq::lane_endpoints("tcp://127.0.0.1:5555", 2);
+      REQUIRE(endpoints);
+      REQUIRE_EQ(endpoints->at(0), "tcp://127.0.0.1:5555");
+      REQUIRE_EQ(endpoints->at(1), "tcp://127.0.0.1:5556");
+    }
+    AND_THEN("a wildcard port can not be used") {
+      REQUIRE_FALSE(zq::lane_endpoints("tcp://127.0.0.1:*", 2));
+    }
+  }
+  GIVEN("an ipc endpoint") {
+    THEN("the lanes get a suffix") {
+      auto endpoints = zq::lane_endpoints("ipc://lanes", 2);
+      REQUIRE(endpoints);
+      REQUIRE_EQ(endpoints->at(0), "ipc://lanes.p0");
+      REQUIRE_EQ(endpoints->at(1), "ipc://lanes.p1");
+    }
+  }
+}
+
+SCENARIO("Reading priority lanes") {
+  TimeOutInsurance toi{5000ms};
+  auto context = zq::mk_context();
+  REQUIRE(context);
+  const auto address = next_inproc_address();
+
+  GIVEN("a strict channel, with cancels routed to the control lane") {
+    auto receiver = zq::bind_priority_channel(*context, zq::SocketType::PULL,
+                                              address, 2);
+    auto sender = zq::connect_priority_channel(*context, zq::SocketType::PUSH,
+                                               address, 2);
+    REQUIRE(receiver);
+    REQUIRE(sender);
+    sender->route<Cancel>(0);
+
+    WHEN("bulk data is sent before a cancel") {
+      REQUIRE(sender->send(std::string{"bulk 1"}));
+      REQUIRE(sender->send(std::string{"bulk 2"}));
+      REQUIRE(sender->send(Cancel{23}));
+      REQUIRE(all_lanes_ready(*receiver));
+
+      THEN("the cancel is read first") {
+        auto first = receiver->recv();
+        REQUIRE(first);
+        REQUIRE(*first);
+        auto cancel = zq::restore_as<Cancel>(**first);
+        REQUIRE(cancel);
+        REQUIRE_EQ(cancel->order_id, 23);
+        auto second = receiver->await(100ms);
+        REQUIRE(second);
+        REQUIRE(*second);
+        REQUIRE_EQ(zq::restore_as<std::string>(**second), "bulk 1");
+      }
+    }
+
+    WHEN("a message is sent with an explicit priority") {
+      REQUIRE(sender->send(zq::typed_message("urgent"), 0));
+      REQUIRE(receiver->lane(0).poll(1000ms).value_or(false));
+
+      THEN("it arrives on that lane") {
+        auto msg = receiver->lane(0).recv();
+        REQUIRE(msg);
+        REQUIRE(*msg);
+        REQUIRE_EQ(zq::restore_as<std::string>(**msg), "urgent");
+      }
+    }
+  }
+
+  GIVEN("a weighted channel, where lane 0 has twice the share of lane 1") {
+    auto receiver = zq::bind_priority_channel(
+        *context, zq::SocketType::PULL, address, 2,
+        {.order = zq::PollOrder::WEIGHTED, .weights = {2, 1}});
+    auto sender = zq::connect_priority_channel(*context, zq::SocketType::PUSH,
+                                               address, 2);
+    REQUIRE(receiver);
+    REQUIRE(sender);
+
+    WHEN("both lanes have many messages") {
+      for (int i = 0; i < 6; ++i) {
+        REQUIRE(sender->send(zq::typed_message(i), 0));
+        REQUIRE(sender->send(zq::typed_message(100 + i), 1));
+      }
+      REQUIRE(all_lanes_ready(*receiver));
+
+      THEN("the reads are shared 2 to 1") {
+        int from_lane_0 = 0;
+        for (int i = 0; i < 6; ++i) {
+          auto msg = receiver->await(100ms);
+          REQUIRE(msg);
+          REQUIRE(*msg);
+          auto value = zq::restore_as<int>(**msg);
+          REQUIRE(value);
+          from_lane_0 += *value < 100 ? 1 : 0;
+        }
+        REQUIRE_EQ(from_lane_0, 4);
+      }
+    }
+  }
+}
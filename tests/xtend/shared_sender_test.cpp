@@ -0,0 +1,91 @@
+#include <doctest/doctest.h>
+#include <zq/shared_sender.hpp>
+#include <zq/zq.hpp>
+
+#include <set>
+#include <thread>
+#include <vector>
+#include "../zq_testing.hpp"
+
+using namespace std::chrono_literals;
+
+SCENARIO("Sending from many threads through one socket") {
+  TimeOutInsurance toi{5000ms};
+  auto context = zq::mk_context();
+  REQUIRE(context);
+  auto address = next_inproc_address();
+  auto pull = context->bind(zq::SocketType::PULL, address);
+  auto push = context->connect(zq::SocketType::PUSH, address);
+  REQUIRE(pull);
+  REQUIRE(push);
+
+  GIVEN("a shared sender and 4 producer threads") {
+    constexpr int producers = 4;
+    constexpr int per_producer = 1000;
+    zq::SharedSender sender{std::move(*push), {.capacity = 64}};
+
+    WHEN("each thread sends its numbers") {
+      std::vector<std::thread> threads;
+      for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&sender, p]() {
+          for (int i = 0; i < per_producer; ++i) {
+            REQUIRE(sender.send(p * per_producer + i));
+          }
+        });
+      }
+      std::set<int> received;
+      std::vector<int> last(producers, -1);
+      bool in_order = true;
+      for (int n = 0; n < producers * per_producer; ++n) {
+        auto msg = pull->await(1000ms);
+        REQUIRE(msg);
+        REQUIRE(*msg);
+        const auto value = zq::restore_as<int>(**msg);
+        REQUIRE(value);
+        const auto producer = static_cast<size_t>(*value / per_producer);
+        in_order = in_order && *value > last[producer];
+        last[producer] = *value;
+        received.insert(*value);
+      }
+      for (auto& t : threads) {
+        t.join();
+      }
+      sender.close();
+
+      THEN("all messages arrive, in order per thread") {
+        REQUIRE_EQ(received.size(), producers * per_producer);
+        REQUIRE(in_order);
+        REQUIRE_EQ(sender.sent(), producers * per_producer);
+        REQUIRE_EQ(sender.failed(), 0);
+      }
+      AND_THEN("sending after close fails") {
+        REQUIRE_FALSE(sender.send(1));
+      }
+    }
+  }
+
+  GIVEN("a sender that fails when full, and a socket that can not send") {
+    auto socket = context->socket(zq::SocketType::PUSH);
+    REQUIRE(socket);
+    zq::SharedSender sender{
+        std::move(*socket),
+        {.capacity = 4, .when_full = zq::WhenFull::FAIL, .linger = 10ms}};
+
+    WHEN("sending more than fits") {
+      int refused = 0;
+      for (int i = 0; i < 16; ++i) {
+        if (!sender.send(i)) {
+          ++refused;
+        }
+      }
+      THEN("some messages are refused") {
+        REQUIRE_GT(refused, 0);
+      }
+      AND_THEN("on close, what could not be sent is counted") {
+        sender.close();
+        REQUIRE_EQ(sender.sent(), 0);
+        REQUIRE_EQ(sender.failed(), static_cast<uint64_t>(16 - refused));
+      }
+    }
+  }
+}
@@ -0,0 +1,148 @@
+#include <doctest/doctest.h>
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <string>
+#include <thread>
+
+#include <zq/shm_broadcast.hpp>
+#include "../zq_testing.hpp"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+  std::string next_broadcast_name() {
+    return "zq_bcast_" + std::to_string(::getpid()) + "_" +
+           std::to_string(atomic_counter++);
+  }
+
+}  // namespace
+
+SCENARIO("Broadcasting typed messages in shared memory") {
+  TimeOutInsurance toi{5000ms};
+
+  GIVEN("a writer, a reader for int and a reader for all") {
+    const auto name = next_broadcast_name();
+    auto writer = zq::shm_broadcaster(name, {.slots = 16, .slot_size = 256});
+    REQUIRE(writer);
+    auto ints = zq::shm_broadcast_reader(name, {zq::wire_type_name<int>()});
+    auto all = zq::shm_broadcast_reader(name);
+    REQUIRE(ints);
+    REQUIRE(all);
+
+    WHEN("publishing an int and a string") {
+      REQUIRE(writer->send(zq::typed_message(42)));
+      REQUIRE(writer->send(zq::typed_message("Hello world")));
+
+      THEN("each reader gets the types it asked for") {
+        auto i = ints->recv();
+        REQUIRE(i);
+        REQUIRE(*i);
+        REQUIRE_EQ(zq::restore_as<int>(**i), 42);
+        REQUIRE_FALSE(ints->recv());
+
+        auto first = all->recv();
+        auto second = all->await(100ms);
+        REQUIRE(first);
+        REQUIRE(second);
+        REQUIRE_EQ(zq::restore_as<int>(**first), 42);
+        REQUIRE_EQ(zq::restore_as<std::string>(**second), "Hello world");
+      }
+      AND_THEN("a reader can look at the frames in place") {
+        std::string type;
+        size_t payload_size = 0;
+        auto rc = all->read([&](const zq::ShmFrames& frames) {
+          type = frames.type;
+          payload_size = frames.payload.size();
+        });
+        REQUIRE(rc);
+        REQUIRE(*rc);
+        REQUIRE_EQ(type, zq::wire_type_name<int>());
+        REQUIRE_EQ(payload_size, sizeof(int));
+      }
+    }
+    AND_WHEN("a message does not fit into a slot") {
+      auto rc = writer->send(zq::typed_message(std::string(300, 'x')));
+      THEN("it is refused") {
+        REQUIRE_FALSE(rc);
+        REQUIRE_EQ(rc.error().errNo, EMSGSIZE);
+      }
+    }
+    AND_WHEN("a reader falls more than a ring behind") {
+      for (int i = 0; i < 40; ++i) {
+        REQUIRE(writer->send(zq::typed_message(i)));
+      }
+      THEN("it detects the overrun and continues with the oldest message") {
+        auto overrun = ints->recv();
+        REQUIRE(overrun);
+        REQUIRE_FALSE(*overrun);
+        REQUIRE_EQ(ints->lost(), 25);
+        auto next = ints->recv();
+        REQUIRE(next);
+        REQUIRE(*next);
+        REQUIRE_EQ(zq::restore_as<int>(**next), 25);
+      }
+    }
+  }
+}
+
+SCENARIO("Waiting for broadcast messages") {
+  TimeOutInsurance toi{5000ms};
+
+  GIVEN("a reader, and a writer on another thread") {
+    const auto name = next_broadcast_name();
+    auto writer = zq::shm_broadcaster(name);
+    REQUIRE(writer);
+    auto reader = zq::shm_broadcast_reader(name);
+    REQUIRE(reader);
+
+    THEN("await times out if nothing is published") {
+      REQUIRE_FALSE(reader->await(10ms));
+    }
+    AND_WHEN("the writer publishes and goes away") {
+      constexpr int message_count = 1000;
+      std::thread publisher([w = std::move(*writer)]() mutable {
+        for (int i = 0; i < message_count; ++i) {
+          [[maybe_unused]] auto rc = w.send(zq::typed_message(i));
+          if (i % 100 == 0) {
+            std::this_thread::sleep_for(1ms);
+          }
+        }
+      });
+      int received = 0;
+      for (;;) {
+        const auto lost = reader->lost();
+        auto msg = reader->await(1000ms);
+        if (!msg) {
+          break;
+        }
+        if (!*msg) {
+          // an overrun, or the writer is gone
+          if (reader->lost() > lost) {
+            continue;
+          }
+          break;
+        }
+        ++received;
+      }
+      publisher.join();
+      THEN("the reader gets what it did not lose, and then an error") {
+        REQUIRE_EQ(received + static_cast<int>(reader->lost()),
+                   message_count);
+        auto closed = reader->recv();
+        REQUIRE(closed);
+        REQUIRE_FALSE(*closed);
+      }
+    }
+  }
+
+  GIVEN("no writer") {
+    THEN("opening a reader fails") {
+      REQUIRE_FALSE(zq::shm_broadcast_reader(next_broadcast_name()));
+    }
+  }
+}
+
+#endif
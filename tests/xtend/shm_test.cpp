@@ -0,0 +1,158 @@
+#include <doctest/doctest.h>
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <filesystem>
+#include <future>
+#include <string>
+#include <thread>
+
+#include <zq/meta.hpp>
+#include <zq/shm.hpp>
+#include "../zq_testing.hpp"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+  std::filesystem::path next_shm_path() {
+    return std::filesystem::temp_directory_path() /
+           ("zq_shm_" + std::to_string(::getpid()) + "_" +
+            std::to_string(atomic_counter++));
+  }
+
+  // both ends of a channel, connected from a second thread
+  std::pair<zq::ShmChannel, zq::ShmChannel> shm_pair(
+      zq::ShmOptions options = {}) {
+    const auto path = next_shm_path();
+    auto listener = zq::shm_listen(path);
+    REQUIRE(listener);
+    auto connecting = std::async(std::launch::async, [&path, options] {
+      return zq::shm_connect(path, 1000ms, options);
+    });
+    auto accepted = listener->accept(1000ms, options);
+    auto connected = connecting.get();
+    REQUIRE(accepted);
+    REQUIRE(connected);
+    return {std::move(*accepted), std::move(*connected)};
+  }
+
+}  // namespace
+
+SCENARIO("Typed messages over shared memory") {
+  TimeOutInsurance toi{5000ms};
+
+  GIVEN("two ends of a shared memory channel") {
+    auto [server, client] = shm_pair();
+
+    WHEN("sending in both directions") {
+      auto tm = zq::typed_message(42);
+      zq::set_meta(tm, zq::MetaTag::SEQUENCE, 7);
+      REQUIRE(client.send(tm));
+      REQUIRE(server.send(zq::typed_message("Hello world")));
+
+      THEN("each side receives what the other sent") {
+        auto at_server = server.await(100ms);
+        REQUIRE(at_server);
+        REQUIRE(*at_server);
+        REQUIRE_EQ(zq::restore_as<int>(**at_server), 42);
+        REQUIRE_EQ(zq::get_meta(**at_server, zq::MetaTag::SEQUENCE), 7);
+
+        auto at_client = client.await(100ms);
+        REQUIRE(at_client);
+        REQUIRE(*at_client);
+        REQUIRE_EQ(zq::restore_as<std::string>(**at_client), "Hello world");
+        REQUIRE_EQ((**at_client).meta.size(), 0);
+      }
+    }
+    AND_WHEN("nothing is sent") {
+      THEN("recv returns nothing and await times out") {
+        REQUIRE_FALSE(server.recv());
+        REQUIRE_FALSE(server.await(10ms));
+      }
+    }
+    AND_WHEN("one side goes away") {
+      REQUIRE(client.send(zq::typed_message(1)));
+      { auto gone = std::move(client); }
+      THEN("the other side reads what is left, then gets an error") {
+        auto last = server.recv();
+        REQUIRE(last);
+        REQUIRE(*last);
+        auto closed = server.await(100ms);
+        REQUIRE(closed);
+        REQUIRE_FALSE(*closed);
+      }
+    }
+  }
+}
+
+SCENARIO("Shared memory ring limits") {
+  TimeOutInsurance toi{10000ms};
+
+  GIVEN("a channel with a small ring") {
+    auto [server, client] = shm_pair(zq::ShmOptions{.ring_bytes = 4096});
+
+    THEN("a message larger than half the ring is refused") {
+      const std::string big(client.max_message_size(), 'x');
+      auto rc = client.send(zq::typed_message(big));
+      REQUIRE_FALSE(rc);
+      REQUIRE_EQ(rc.error().errNo, EMSGSIZE);
+    }
+    AND_WHEN("sending until the ring is full") {
+      int sent = 0;
+      std::expected<size_t, zq::ZmqError> rc;
+      while ((rc = client.send(zq::typed_message(sent)))) {
+        ++sent;
+      }
+      THEN("send says try again, like a socket at the high water mark") {
+        REQUIRE_EQ(rc.error().errNo, EAGAIN);
+        for (int i = 0; i < sent; ++i) {
+          auto msg = server.recv();
+          REQUIRE(msg);
+          REQUIRE(*msg);
+          REQUIRE_EQ(zq::restore_as<int>(**msg), i);
+        }
+        REQUIRE(client.send(zq::typed_message(sent)));
+      }
+    }
+    AND_WHEN("streaming messages of changing size from another thread") {
+      constexpr int message_count = 5000;
+      std::thread sender([&client] {
+        for (int i = 0; i < message_count; ++i) {
+          const std::string text(static_cast<size_t>(i % 700), 'a');
+          auto tm = zq::typed_message(text);
+          while (!client.send(tm)) {
+            std::this_thread::yield();
+          }
+        }
+      });
+      int received = 0;
+      int wrong = 0;
+      while (received < message_count) {
+        auto msg = server.await(1000ms);
+        if (!msg || !*msg) {
+          break;
+        }
+        auto text = zq::restore_as<std::string>(**msg);
+        if (!text || text->size() != static_cast<size_t>(received % 700)) {
+          ++wrong;
+        }
+        ++received;
+      }
+      sender.join();
+      THEN("all arrive intact, across the end of the ring") {
+        REQUIRE_EQ(received, message_count);
+        REQUIRE_EQ(wrong, 0);
+      }
+    }
+  }
+
+  GIVEN("no listener") {
+    THEN("connect fails") {
+      REQUIRE_FALSE(zq::shm_connect(next_shm_path(), 10ms));
+    }
+  }
+}
+
+#endif
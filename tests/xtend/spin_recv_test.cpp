@@ -0,0 +1,96 @@
+#include <doctest/doctest.h>
+#include <zq/spin_recv.hpp>
+#include <zq/zq.hpp>
+
+#include <thread>
+#include "../zq_testing.hpp"
+
+using namespace std::chrono_literals;
+
+SCENARIO("Spinning before sleeping") {
+  TimeOutInsurance toi{5000ms};
+  auto context = zq::mk_context();
+  REQUIRE(context);
+  auto address = next_inproc_address();
+  auto pull = context->bind(zq::SocketType::PULL, address);
+  auto push = context->connect(zq::SocketType::PUSH, address);
+  REQUIRE(pull);
+  REQUIRE(push);
+
+  GIVEN("a receiver with a spin budget") {
+    zq::SpinReceiver receiver{{.spin_budget = 1ms}};
+
+    WHEN("a message is there") {
+      REQUIRE(push->send(zq::typed_message(1)));
+      REQUIRE(pull->poll(1000ms).value_or(false));
+      auto msg = receiver.await(*pull, 1000ms);
+
+      THEN("it is received while spinning") {
+        REQUIRE(msg);
+        REQUIRE(*msg);
+        REQUIRE_EQ(zq::restore_as<int>(**msg), 1);
+        REQUIRE_EQ(receiver.spin_hits(), 1);
+        REQUIRE_EQ(receiver.spin_misses(), 0);
+        REQUIRE_EQ(receiver.hit_ratio(), 1.0);
+      }
+    }
+
+    WHEN("nothing arrives") {
+      auto msg = receiver.await(*pull, 5ms);
+
+      THEN("the spin misses, and await times out") {
+        REQUIRE_FALSE(msg);
+        REQUIRE_EQ(receiver.spin_hits(), 0);
+        REQUIRE_EQ(receiver.spin_misses(), 1);
+      }
+    }
+
+    WHEN("a message arrives after the spin budget, inside the timeout") {
+      std::thread sending{[&] {
+        std::this_thread::sleep_for(10ms);
+        CHECK(push->send(zq::typed_message(3)));
+      }};
+      auto msg = receiver.await(*pull, 1000ms);
+      sending.join();
+
+      THEN("the spin misses, and it is received after sleeping") {
+        REQUIRE(msg);
+        REQUIRE(*msg);
+        REQUIRE_EQ(zq::restore_as<int>(**msg), 3);
+        REQUIRE_EQ(receiver.spin_hits(), 0);
+        REQUIRE_EQ(receiver.spin_misses(), 1);
+      }
+    }
+  }
+
+  GIVEN("a receiver without a spin budget") {
+    zq::SpinReceiver receiver{{.spin_budget = 0ns}};
+
+    WHEN("a message arrives later") {
+      std::thread sending{[&] {
+        std::this_thread::sleep_for(10ms);
+        CHECK(push->send(zq::typed_message(2)));
+      }};
+      auto msg = receiver.await(*pull, 2000ms);
+      sending.join();
+
+      THEN("it is received after sleeping in zmq_poll") {
+        REQUIRE(msg);
+        REQUIRE(*msg);
+        REQUIRE_EQ(zq::restore_as<int>(**msg), 2);
+        REQUIRE_EQ(receiver.spin_misses(), 1);
+      }
+    }
+  }
+
+  GIVEN("a receiver that pins to a cpu that does not exist") {
+    zq::SpinReceiver receiver{{.pin_cpu = -1}};
+
+    THEN("receiving reports the error") {
+      auto msg = receiver.await(*pull, 0ms);
+      REQUIRE(msg);
+      REQUIRE_FALSE(*msg);
+      REQUIRE(msg->error().isZqError());
+    }
+  }
+}
@@ -0,0 +1,154 @@
+#include <doctest/doctest.h>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include <zq/topology.hpp>
+#include "../zq_testing.hpp"
+
+namespace {
+
+  // a fake sysfs tree with two nodes, cpus 0-3 and 4-7, 2 and 3 isolated
+  struct FakeSysfs {
+    std::filesystem::path root;
+
+    FakeSysfs()
+        : root{std::filesystem::temp_directory_path() /
+               ("zq_sysfs_" + std::to_string(atomic_counter++))} {
+      write("node/node0/cpulist", "0-3\n");
+      write("node/node1/cpulist", "4-7\n");
+      write("node/node2/cpulist", "\n");  // memory only
+      write("cpu/online", "0-7\n");
+      write("cpu/isolated", "2-3\n");
+    }
+
+    ~FakeSysfs() {
+      std::error_code ec;
+      std::filesystem::remove_all(root, ec);
+    }
+
+    void write(const std::string& file, const std::string& content) {
+      auto path = root / file;
+      std::filesystem::create_directories(path.parent_path());
+      std::ofstream{path} << content;
+    }
+  };
+
+}  // namespace
+
+SCENARIO("Parsing cpu lists") {
+  GIVEN("a list with ranges and single cpus") {
+    auto cpus = zq::parse_cpu_list("8,0-2,4\n");
+    THEN("all cpus are there, sorted") {
+      REQUIRE(cpus);
+      const std::vector<int> expected{0, 1, 2, 4, 8};
+      REQUIRE_EQ(*cpus, expected);
+      REQUIRE_EQ(zq::format_cpu_list(*cpus), "0-2,4,8");
+    }
+  }
+  GIVEN("invalid lists") {
+    THEN("they are rejected") {
+      REQUIRE_FALSE(zq::parse_cpu_list("3-1"));
+      REQUIRE_FALSE(zq::parse_cpu_list("a"));
+    }
+  }
+}
+
+SCENARIO("Placing I/O threads by topology") {
+  GIVEN("a two node topology") {
+    FakeSysfs sysfs;
+    auto topology = zq::read_topology(sysfs.root);
+    REQUIRE(topology);
+    REQUIRE_EQ(topology->nodes.size(), 2);
+    const std::vector<int> node1_cpus{4, 5, 6, 7};
+    const std::vector<int> isolated{2, 3};
+    REQUIRE_EQ(topology->nodes[1].cpus, node1_cpus);
+    REQUIRE_EQ(topology->isolated, isolated);
+
+    WHEN("reserving application cpus") {
+      zq::ContextBuilder builder{*topology};
+      builder.reserve_cpus({0, 4, 5, 6, 7});
+      auto plan = builder.plan();
+
+      THEN("I/O threads avoid isolated and reserved cpus") {
+        REQUIRE_EQ(plan.size(), 2);
+        REQUIRE_EQ(plan[0].cpus, std::vector<int>{1});
+        REQUIRE_EQ(plan[0].io_threads, 1);
+        REQUIRE_EQ(plan[0].describe(),
+                   "node 0: 1 io threads on cpus 1, reserved 0,2-3");
+      }
+      AND_THEN("a node without free cpus gets no I/O threads") {
+        REQUIRE_EQ(plan[1].io_threads, 0);
+        REQUIRE(plan[1].cpus.empty());
+      }
+    }
+    AND_WHEN("asking for more threads than free cpus") {
+      zq::ContextBuilder builder{*topology};
+      builder.io_threads_per_node(8);
+      auto plan = builder.plan();
+      THEN("there is one thread per free cpu") {
+        REQUIRE_EQ(plan[0].io_threads, 2);
+        REQUIRE_EQ(plan[1].io_threads, 4);
+      }
+    }
+  }
+}
+
+SCENARIO("Creating contexts for this host") {
+  auto topology = zq::read_topology();
+  if (!topology) {
+    MESSAGE("no sysfs topology, skipping");
+    return;
+  }
+  GIVEN("a builder for the host topology") {
+    zq::ContextBuilder builder{*topology};
+    WHEN("building one context per node") {
+      auto contexts = builder.build_per_node();
+      REQUIRE(contexts);
+      THEN("sockets of each context work") {
+        for (auto& [placement, context] : *contexts) {
+          REQUIRE_GT(placement.io_threads, 0);
+          auto address = next_inproc_address();
+          auto pull = context.bind(zq::SocketType::PULL, address);
+          auto push = context.connect(zq::SocketType::PUSH, address);
+          REQUIRE(pull);
+          REQUIRE(push);
+          REQUIRE(push->send(zq::typed_message(placement.node)));
+          auto msg = pull->await(std::chrono::milliseconds{1000});
+          REQUIRE(msg);
+          REQUIRE(*msg);
+          REQUIRE_EQ(zq::restore_as<int>(**msg), placement.node);
+        }
+      }
+    }
+    AND_WHEN("building a single context") {
+      auto context = builder.build();
+      THEN("it can be used over tcp, which starts the I/O threads") {
+        REQUIRE(context);
+        auto pull = context->bind(zq::SocketType::PULL, "tcp://127.0.0.1:*");
+        REQUIRE(pull);
+      }
+    }
+  }
+}
+
+SCENARIO("Pinning a thread") {
+  auto topology = zq::read_topology();
+  if (!topology) {
+    MESSAGE("no sysfs topology, skipping");
+    return;
+  }
+  GIVEN("a cpu this process may run on") {
+    const int cpu = topology->nodes.front().cpus.front();
+    THEN("a thread can be pinned to it") {
+      // not the test thread, it keeps its affinity
+      std::expected<void, zq::ZqError> rc;
+      std::thread pinned{[&] { rc = zq::pin_current_thread(cpu); }};
+      pinned.join();
+      REQUIRE(rc);
+    }
+    AND_THEN("a cpu that does not exist is an error") {
+      REQUIRE_FALSE(zq::pin_current_thread(-1));
+    }
+  }
+}
@@ -0,0 +1,191 @@
+#include <doctest/doctest.h>
+#include <chrono>
+#include <cstdint>
+
+#include <zq/deadline.hpp>
+#include <zq/trace.hpp>
+#include "../zq_testing.hpp"
+
+SCENARIO("Recording values in a latency histogram") {
+  GIVEN("an empty histogram") {
+    zq::LatencyHistogram histogram;
+    THEN("all values are 0") {
+      REQUIRE_EQ(histogram.count(), 0);
+      REQUIRE_EQ(histogram.p99(), 0);
+      REQUIRE_EQ(histogram.min(), 0);
+    }
+    WHEN("recording the values 1 to 1000") {
+      for (uint64_t i = 1; i <= 1000; ++i) {
+        histogram.record(i);
+      }
+      THEN("count, min, max and mean are exact") {
+        REQUIRE_EQ(histogram.count(), 1000);
+        REQUIRE_EQ(histogram.min(), 1);
+        REQUIRE_EQ(histogram.max(), 1000);
+        REQUIRE_EQ(histogram.mean(), 500.5);
+      }
+      AND_THEN("percentiles are within the bucket precision") {
+        REQUIRE_GE(histogram.p50(), 500);
+        REQUIRE_LE(histogram.p50(), 500 * 103 / 100);
+        REQUIRE_GE(histogram.p99(), 990);
+        REQUIRE_LE(histogram.p99(), 1000);
+        REQUIRE_EQ(histogram.percentile(100.0), 1000);
+      }
+    }
+    AND_WHEN("recording large values") {
+      const uint64_t second = 1'000'000'000;
+      histogram.record(second);
+      histogram.record(std::chrono::nanoseconds{-5});
+      THEN("they keep their precision, negative durations count as 0") {
+        REQUIRE_EQ(histogram.min(), 0);
+        REQUIRE_EQ(histogram.percentile(100.0), second);
+        REQUIRE_LE(histogram.percentile(50.0), 1);
+      }
+    }
+    AND_WHEN("recording the largest value") {
+      const uint64_t largest = UINT64_MAX;
+      histogram.record(largest);
+      THEN("it lands in the last bucket") {
+        REQUIRE_EQ(histogram.count(), 1);
+        REQUIRE_EQ(histogram.max(), largest);
+        REQUIRE_EQ(histogram.p999(), largest);
+      }
+    }
+  }
+}
+
+SCENARIO("Stamping messages with an envelope") {
+  GIVEN("a tracer that samples every second message") {
+    zq::Tracer tracer{2};
+    WHEN("stamping two messages") {
+      auto first = zq::typed_message(1);
+      auto second = zq::typed_message(2);
+      tracer.stamp(first);
+      tracer.stamp(second);
+      THEN("both have send time and sequence, the first one a trace id") {
+        auto e1 = zq::read_envelope(first);
+        auto e2 = zq::read_envelope(second);
+        REQUIRE(e1);
+        REQUIRE(e2);
+        REQUIRE_EQ(e1->sequence, 0);
+        REQUIRE_EQ(e2->sequence, 1);
+        REQUIRE_LE(e1->send_time_ns, e2->send_time_ns);
+        REQUIRE(e1->trace_id);
+        REQUIRE_FALSE(e2->trace_id);
+      }
+      AND_THEN("the payload is unchanged") {
+        REQUIRE_EQ(zq::restore_as<int>(second), 2);
+      }
+    }
+    AND_WHEN("stamping a message with a deadline") {
+      auto msg = zq::typed_message(1);
+      const auto deadline =
+          zq::DeadlineClock::now() + std::chrono::seconds{10};
+      zq::set_deadline(msg, deadline);
+      tracer.stamp(msg);
+      THEN("the message keeps the deadline") {
+        REQUIRE(zq::read_envelope(msg));
+        auto kept = zq::get_deadline(msg);
+        REQUIRE(kept);
+        REQUIRE_EQ(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       kept->time_since_epoch()),
+                   std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       deadline.time_since_epoch()));
+      }
+    }
+    AND_WHEN("setting a meta field twice") {
+      auto msg = zq::typed_message(1);
+      zq::set_meta(msg, zq::MetaTag::SEQUENCE, 1);
+      zq::set_meta(msg, zq::MetaTag::SEQUENCE, 2);
+      THEN("the value is replaced") {
+        REQUIRE_EQ(msg.meta.size(), zq::meta_record_size);
+        REQUIRE_EQ(zq::get_meta(msg, zq::MetaTag::SEQUENCE), 2);
+        REQUIRE_FALSE(zq::read_envelope(msg));
+      }
+    }
+  }
+}
+
+SCENARIO("Measuring latency between sockets") {
+  auto context = zq::mk_context();
+  REQUIRE(context);
+  using namespace std::chrono_literals;
+  TimeOutInsurance insurance{5000ms};
+
+  GIVEN("a push and a pull socket") {
+    auto address = next_inproc_address();
+    auto pull = context->bind(zq::SocketType::PULL, address);
+    auto push = context->connect(zq::SocketType::PUSH, address);
+    REQUIRE(pull);
+    REQUIRE(push);
+    zq::Tracer tracer;
+    zq::LatencyRecorder recorder;
+
+    WHEN("sending stamped and plain messages") {
+      for (int i = 0; i < 10; ++i) {
+        auto msg = zq::typed_message(i);
+        tracer.stamp(msg);
+        REQUIRE(push->send(msg));
+      }
+      REQUIRE(push->send(zq::typed_message("plain")));
+
+      THEN("the stamped ones are recorded per type") {
+        for (int i = 0; i < 10; ++i) {
+          auto msg = pull->await(1000ms);
+          REQUIRE(msg);
+          REQUIRE(*msg);
+          auto envelope = zq::read_envelope(**msg);
+          REQUIRE(envelope);
+          REQUIRE_EQ(envelope->sequence, static_cast<uint64_t>(i));
+          REQUIRE(recorder.record(**msg));
+          REQUIRE_EQ(zq::restore_as<int>(**msg), i);
+        }
+        auto plain = pull->await(1000ms);
+        REQUIRE(plain);
+        REQUIRE(*plain);
+        REQUIRE_FALSE(recorder.record(**plain));
+        REQUIRE_EQ(zq::restore_as<std::string>(**plain), "plain");
+
+        auto histogram = recorder.find<int>();
+        REQUIRE(histogram);
+        REQUIRE_EQ(histogram->count(), 10);
+        REQUIRE_FALSE(recorder.find<std::string>());
+      }
+    }
+  }
+}
+
+SCENARIO("Subscribing to stamped messages") {
+  auto context = zq::mk_context();
+  REQUIRE(context);
+  using namespace std::chrono_literals;
+  TimeOutInsurance insurance{5000ms};
+
+  GIVEN("a subscriber for int") {
+    auto address = next_inproc_address();
+    auto pub = context->bind(zq::SocketType::PUB, address);
+    auto sub = context->connect(zq::SocketType::SUB, address);
+    REQUIRE(pub);
+    REQUIRE(sub);
+    REQUIRE(zq::subscribe(*sub, {zq::wire_type_name<int>()}));
+    std::this_thread::sleep_for(100ms);
+
+    WHEN("publishing stamped messages of different types") {
+      zq::Tracer tracer;
+      auto d = zq::typed_message(1.0);
+      auto i = zq::typed_message(1);
+      tracer.stamp(d);
+      tracer.stamp(i);
+      REQUIRE(pub->send(d));
+      REQUIRE(pub->send(i));
+
+      THEN("the type is still the topic") {
+        auto msg = sub->await(1000ms);
+        REQUIRE(msg);
+        REQUIRE(*msg);
+        REQUIRE_EQ(zq::restore_as<int>(**msg), 1);
+        REQUIRE(zq::read_envelope(**msg));
+      }
+    }
+  }
+}
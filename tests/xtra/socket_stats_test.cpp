@@ -0,0 +1,100 @@
+#include <doctest/doctest.h>
+#include <chrono>
+
+#include "../zq_testing.hpp"
+
+// this file is compiled with and without ZQ_SOCKET_STATS
+
+SCENARIO("Socket stats cost nothing if disabled") {
+  GIVEN("a build without socket stats") {
+    if constexpr (!socket_stats_build) {
+      THEN("a socket is not bigger than the pointer it wraps") {
+        CHECK_EQ(sizeof(zq::Socket), sizeof(zq::SocketPointer));
+      }
+      AND_THEN("the snapshot is empty") {
+        auto context = zq::mk_context();
+        REQUIRE(context);
+        auto [client, server] = pp_cs_sockets(*context, next_inproc_address());
+        REQUIRE(client.send(zq::typed_message(int{1})));
+        CHECK_EQ(client.stats().messages_sent, 0);
+      }
+    }
+  }
+}
+
+SCENARIO("Socket stats count what a socket does") {
+  if constexpr (socket_stats_build) {
+    auto context = zq::mk_context();
+    REQUIRE(context);
+    using namespace std::chrono_literals;
+
+    GIVEN("a request, a reply socket") {
+      auto [client, server] = pp_cs_sockets(*context, next_inproc_address());
+
+      WHEN("receiving while nothing has been sent") {
+        REQUIRE_FALSE(server.recv());
+
+        THEN("a would block is counted, but no error") {
+          auto stats = server.stats();
+          CHECK_EQ(stats.recv_would_block, 1);
+          CHECK_EQ(stats.total_errors(), 0);
+          CHECK_EQ(stats.messages_received, 0);
+        }
+      }
+      AND_WHEN("sending a typed message") {
+        auto tm = zq::typed_message(int{42});
+        auto sent = client.send(tm);
+        REQUIRE(sent);
+        auto request = server.await(1000ms);
+        REQUIRE(request);
+        REQUIRE(*request);
+
+        THEN("messages, frames and bytes are counted on both sides") {
+          auto client_stats = client.stats();
+          CHECK_EQ(client_stats.messages_sent, 1);
+          CHECK_EQ(client_stats.bytes_sent, *sent);
+
+          auto server_stats = server.stats();
+          CHECK_EQ(server_stats.messages_received, 1);
+          CHECK_EQ(server_stats.frames_received, 2);
+          CHECK_EQ(server_stats.frames_per_message[1], 1);
+          CHECK_EQ(server_stats.bytes_received, *sent);
+        }
+      }
+      AND_WHEN("sending in the wrong state") {
+        REQUIRE(client.send(zq::typed_message(int{1})));
+        REQUIRE_FALSE(client.send(zq::typed_message(int{2})));
+
+        THEN("the error is counted") {
+          auto stats = client.stats();
+          CHECK_EQ(stats.messages_sent, 1);
+          CHECK_EQ(stats.errors_for(EFSM), 1);
+          CHECK_EQ(stats.total_errors(), 1);
+        }
+      }
+      AND_WHEN("receiving a multipart message with recv_all") {
+        REQUIRE(client.send(zq::str_message("a"), zq::str_message("b"),
+                            zq::str_message("c")));
+        REQUIRE(server.poll(1000ms));
+        auto messages = server.recv_all();
+        REQUIRE(messages);
+        REQUIRE(*messages);
+
+        THEN("the frames per message are counted") {
+          auto stats = server.stats();
+          CHECK_EQ(stats.frames_received, 3);
+          CHECK_EQ(stats.frames_per_message[2], 1);
+          CHECK_EQ(stats.bytes_received, 3);
+        }
+      }
+      AND_WHEN("moving the socket") {
+        REQUIRE(client.send(zq::typed_message(int{1})));
+        zq::Socket moved{std::move(client)};
+
+        THEN("the counters move with it") {
+          CHECK_EQ(moved.stats().messages_sent, 1);
+        }
+      }
+    }
+  }
+}